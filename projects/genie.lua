@@ -223,6 +223,15 @@ project "unit_tests"
 	useLua()
 	defaultConfigurations()
 
+project "packer"
+	kind "ConsoleApp"
+
+	files { "../src/packer/**.h", "../src/packer/**.cpp" }
+	includedirs { "../src" }
+	links { "engine" }
+
+	defaultConfigurations()
+
 project "render_test"
 	kind "WindowedApp"
 
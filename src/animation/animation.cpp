@@ -93,6 +93,12 @@ void Animation::getPose(float time, Pose& pose, Model& model) const
 
 
 bool Animation::load(FS::IFile& file)
+{
+	return loadAsync(file);
+}
+
+
+bool Animation::loadAsync(FS::IFile& file)
 {
 	IAllocator& allocator = getAllocator();
 	allocator.deallocate(m_positions);
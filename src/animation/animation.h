@@ -64,6 +64,8 @@ class LUMIX_ANIMATION_API Animation : public Resource
 
 		void unload() override;
 		bool load(FS::IFile& file) override;
+		bool isAsyncLoadSupported() const override { return true; }
+		bool loadAsync(FS::IFile& file) override;
 
 	private:
 		int	m_frame_count;
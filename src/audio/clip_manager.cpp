@@ -19,6 +19,12 @@ void Clip::unload()
 
 
 bool Clip::load(FS::IFile& file)
+{
+	return loadAsync(file);
+}
+
+
+bool Clip::loadAsync(FS::IFile& file)
 {
 	short* output = nullptr;
 	auto res = stb_vorbis_decode_memory(
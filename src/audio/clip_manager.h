@@ -21,6 +21,8 @@ public:
 
 	void unload(void) override;
 	bool load(FS::IFile& file) override;
+	bool isAsyncLoadSupported() const override { return true; }
+	bool loadAsync(FS::IFile& file) override;
 	int getChannels() const { return m_channels; }
 	int getSampleRate() const { return m_sample_rate; }
 	int getSize() const { return m_data.size() * sizeof(m_data[0]); }
@@ -321,7 +321,7 @@ void Gizmo::renderTranslateGizmo(Pipeline& pipeline)
 		0,
 		6,
 		BGFX_STATE_PT_LINES | BGFX_STATE_DEPTH_TEST_LEQUAL,
-		m_shader->getInstance(0).m_program_handles[pipeline.getPassIdx()]);
+		m_shader->getInstance(0).getProgramHandle(pipeline.getPassIdx()));
 
 	if (dotProduct(gizmo_mtx.getXVector(), m_camera_dir) < 0) mtx.setXVector(-mtx.getXVector());
 	if (dotProduct(gizmo_mtx.getYVector(), m_camera_dir) < 0) mtx.setYVector(-mtx.getYVector());
@@ -358,7 +358,7 @@ void Gizmo::renderTranslateGizmo(Pipeline& pipeline)
 	indices[8] = 8;
 
 	Lumix::TransientGeometry geom2(vertices, 9, renderer.getBasicVertexDecl(), indices, 9);
-	auto program_handle = m_shader->getInstance(0).m_program_handles[pipeline.getPassIdx()];
+	auto program_handle = m_shader->getInstance(0).getProgramHandle(pipeline.getPassIdx());
 	pipeline.render(geom2, mtx, 0, 9, BGFX_STATE_DEPTH_TEST_LEQUAL, program_handle);
 }
 
@@ -419,7 +419,7 @@ void Gizmo::renderQuarterRing(Pipeline& pipeline, const Matrix& mtx, const Vec3&
 		0,
 		offset,
 		BGFX_STATE_DEPTH_TEST_LEQUAL,
-		m_shader->getInstance(0).m_program_handles[pipeline.getPassIdx()]);
+		m_shader->getInstance(0).getProgramHandle(pipeline.getPassIdx()));
 
 	const int GRID_SIZE = 5;
 	offset = -1;
@@ -455,7 +455,7 @@ void Gizmo::renderQuarterRing(Pipeline& pipeline, const Matrix& mtx, const Vec3&
 		0,
 		offset,
 		BGFX_STATE_DEPTH_TEST_LEQUAL | BGFX_STATE_PT_LINES,
-		m_shader->getInstance(0).m_program_handles[pipeline.getPassIdx()]);
+		m_shader->getInstance(0).getProgramHandle(pipeline.getPassIdx()));
 };
 
 
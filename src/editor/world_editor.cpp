@@ -3232,12 +3232,24 @@ public:
 	}
 
 
+	void waitForLoads()
+	{
+		FS::FileSystem& fs = m_engine->getFileSystem();
+		ResourceManager& resource_manager = m_engine->getResourceManager();
+		while (fs.hasWork() || resource_manager.hasWork())
+		{
+			fs.updateAsyncTransactions();
+			resource_manager.update();
+		}
+	}
+
+
 	bool runTest(const Path& undo_stack_path, const Path& result_universe_path) override
 	{
-		while (m_engine->getFileSystem().hasWork()) m_engine->getFileSystem().updateAsyncTransactions();
+		waitForLoads();
 		newUniverse();
 		executeUndoStack(undo_stack_path);
-		while (m_engine->getFileSystem().hasWork()) m_engine->getFileSystem().updateAsyncTransactions();
+		waitForLoads();
 
 		FS::IFile* file =
 			m_engine->getFileSystem().open(m_engine->getFileSystem().getMemoryDevice(),
@@ -4,7 +4,9 @@
 #include "core/fs/ifile.h"
 #include "core/fs/ifile_system_defines.h"
 #include "core/fs/os_file.h"
+#include "core/math_utils.h"
 #include "core/path.h"
+#include "core/string.h"
 
 
 namespace Lumix
@@ -14,7 +16,13 @@ namespace Lumix
 		class DiskFile : public IFile
 		{
 		public:
-			DiskFile(DiskFileDevice& device, IAllocator& allocator) : m_device(device), m_allocator(allocator) {}
+			DiskFile(DiskFileDevice& device, IAllocator& allocator)
+				: m_device(device)
+				, m_allocator(allocator)
+				, m_is_mapped(false)
+				, m_pos(0)
+			{
+			}
 
 			IFileDevice& getDevice() override
 			{ 
@@ -23,42 +31,68 @@ namespace Lumix
 
 			bool open(const Path& path, Mode mode) override
 			{
-				return m_file.open(path.c_str(), mode, m_allocator);
+				// read-only files are mapped, getBuffer() then points into the mapping
+				m_mapping.close();
+				m_pos = 0;
+				m_is_mapped = mode == Mode::OPEN_AND_READ && m_mapping.open(path.c_str());
+				return m_is_mapped || m_file.open(path.c_str(), mode, m_allocator);
 			}
 
 			void close() override
 			{
-				m_file.close();
+				// the mapping lives until the file is released
+				if (!m_is_mapped) m_file.close();
 			}
 
 			bool read(void* buffer, size_t size) override
 			{
-				return m_file.read(buffer, size);
+				if (!m_is_mapped) return m_file.read(buffer, size);
+
+				size_t amount = m_pos + size < m_mapping.size() ? size : m_mapping.size() - m_pos;
+				copyMemory(buffer, (const uint8*)m_mapping.getData() + m_pos, (int)amount);
+				m_pos += amount;
+				return amount == size;
 			}
 
 			bool write(const void* buffer, size_t size) override
 			{
-				return m_file.write(buffer, size);
+				return !m_is_mapped && m_file.write(buffer, size);
 			}
 
 			const void* getBuffer() const override
 			{
-				return nullptr;
+				return m_mapping.getData();
+			}
+
+			void* detachBuffer(IAllocator** allocator) override
+			{
+				m_pos = 0;
+				return m_mapping.detach(allocator);
 			}
 
 			size_t size() override
 			{
-				return m_file.size();
+				return m_is_mapped ? m_mapping.size() : m_file.size();
 			}
 
 			size_t seek(SeekMode base, size_t pos) override
 			{
-				return m_file.seek(base, pos);
+				if (!m_is_mapped) return m_file.seek(base, pos);
+
+				switch (base)
+				{
+					case SeekMode::BEGIN: m_pos = pos; break;
+					case SeekMode::CURRENT: m_pos += pos; break;
+					case SeekMode::END: m_pos = m_mapping.size() - pos; break;
+					default: ASSERT(false); break;
+				}
+				m_pos = Math::minValue(m_pos, m_mapping.size());
+				return m_pos;
 			}
 
 			size_t pos() override
 			{
-				return m_file.pos();
+				return m_is_mapped ? m_pos : m_file.pos();
 			}
 
 		private:
@@ -67,6 +101,9 @@ namespace Lumix
 			DiskFileDevice& m_device;
 			IAllocator& m_allocator;
 			OsFile m_file;
+			OsFileMapping m_mapping;
+			bool m_is_mapped;
+			size_t m_pos;
 		};
 
 		void DiskFileDevice::destroyFile(IFile* file)
@@ -79,6 +79,12 @@ namespace Lumix
 			}
 
 
+			void* detachBuffer(IAllocator** allocator) override
+			{
+				return m_file.detachBuffer(allocator);
+			}
+
+
 			size_t size() override
 			{
 				invokeEvent(EventType::SIZE_BEGIN, "", -1, -1);
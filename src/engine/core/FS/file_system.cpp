@@ -4,12 +4,13 @@
 #include "core/base_proxy_allocator.h"
 #include "core/fs/disk_file_device.h"
 #include "core/fs/ifile.h"
-#include "core/mt/lock_free_fixed_queue.h"
+#include "core/fs/os_file.h"
+#include "core/math_utils.h"
 #include "core/mt/task.h"
-#include "core/mt/transaction.h"
+#include "core/mt/sync.h"
 #include "core/path.h"
+#include "core/pod_hash_map.h"
 #include "core/profiler.h"
-#include "core/queue.h"
 #include "core/stack_allocator.h"
 #include "core/string.h"
 
@@ -37,23 +38,29 @@ struct AsyncItem
 	Mode m_mode;
 	char m_path[MAX_PATH_LENGTH];
 	uint8 m_flags;
+	AsyncHandle m_handle;
+	int m_priority;
+	bool m_is_cancelled;
 };
 
-static const int32 C_MAX_TRANS = 16;
+static const int MAX_IO_THREADS = 16;
+static const int MAX_BATCH_SIZE = 16;
+// closing releases the file, so it goes before any open
+static const int CLOSE_PRIORITY = 0x7fffFFFF;
 
-typedef MT::Transaction<AsyncItem> AsynTrans;
-typedef MT::LockFreeFixedQueue<AsynTrans, C_MAX_TRANS> TransQueue;
-typedef Queue<AsynTrans*, C_MAX_TRANS> InProgressQueue;
-typedef Array<AsyncItem> ItemsTable;
+typedef Array<AsyncItem*> ItemsTable;
 typedef Array<IFileDevice*> DevicesTable;
 
 
+class FileSystemImpl;
+
+
 class FSTask : public MT::Task
 {
 public:
-	FSTask(TransQueue* queue, IAllocator& allocator)
+	FSTask(FileSystemImpl& fs, IAllocator& allocator)
 		: MT::Task(allocator)
-		, m_trans_queue(queue)
+		, m_fs(fs)
 	{
 	}
 
@@ -61,71 +68,88 @@ public:
 	~FSTask() {}
 
 
-	int task()
-	{
-		while (!m_trans_queue->isAborted())
-		{
-			PROFILE_BLOCK("transaction");
-			AsynTrans* tr = m_trans_queue->pop(true);
-			if (!tr) break;
-
-			if ((tr->data.m_flags & E_IS_OPEN) == E_IS_OPEN)
-			{
-				tr->data.m_flags |=
-					tr->data.m_file->open(Path(tr->data.m_path), tr->data.m_mode) ? E_SUCCESS : E_FAIL;
-			}
-			else if ((tr->data.m_flags & E_CLOSE) == E_CLOSE)
-			{
-				tr->data.m_file->close();
-				tr->data.m_file->release();
-				tr->data.m_file = nullptr;
-			}
-			tr->setCompleted();
-		}
-		return 0;
-	}
-
-	void stop() { m_trans_queue->abort(); }
+	int task();
 
 private:
-	TransQueue* m_trans_queue;
+	FileSystemImpl& m_fs;
 };
 
+
 class FileSystemImpl : public FileSystem
 {
 public:
-	FileSystemImpl(IAllocator& allocator)
+	FileSystemImpl(IAllocator& allocator, int io_thread_count)
 		: m_allocator(allocator)
-		, m_in_progress(m_allocator)
-		, m_pending(m_allocator)
 		, m_devices(m_allocator)
+		, m_tasks(m_allocator)
+		, m_pending(m_allocator)
+		, m_work_queue(m_allocator)
+		, m_completed(m_allocator)
+		, m_finished(m_allocator)
+		, m_mutex(false)
+		, m_work_signal(0, 0x7fffFFFF)
+		, m_is_aborted(false)
+		, m_in_flight_count(0)
+		, m_requests(m_allocator)
+		, m_last_handle(INVALID_ASYNC_HANDLE)
 	{
-		m_task = LUMIX_NEW(m_allocator, FSTask)(&m_transaction_queue, m_allocator);
-		m_task->create("FSTask");
-		m_task->run();
+		m_io_thread_count = Math::clamp(io_thread_count, 1, MAX_IO_THREADS);
+		for (int i = 0; i < m_io_thread_count; ++i)
+		{
+			auto* task = LUMIX_NEW(m_allocator, FSTask)(*this, m_allocator);
+			task->create("FSTask");
+			task->run();
+			m_tasks.push(task);
+		}
 	}
 
 	~FileSystemImpl()
 	{
-		m_task->stop();
-		m_task->destroy();
-		while (!m_in_progress.empty())
-		{
-			auto* trans = m_in_progress.front();
-			m_in_progress.pop();
-			if (trans->data.m_file) close(*trans->data.m_file);
-		}
-		for (auto& i : m_pending)
-		{
-			close(*i.m_file);
-		}
-		LUMIX_DELETE(m_allocator, m_task);
+		stopTasks();
+		for (auto* item : m_work_queue) releaseItem(*item);
+		for (auto* item : m_completed) releaseItem(*item);
+		for (auto* item : m_pending) releaseItem(*item);
 	}
 
 	BaseProxyAllocator& getAllocator() { return m_allocator; }
 
 
-	bool hasWork() const override { return !m_in_progress.empty() || !m_pending.empty(); }
+	bool hasWork() const override { return m_in_flight_count > 0 || !m_pending.empty(); }
+
+
+	// returns false when the file system is being destroyed,
+	// count is 0 if the requests were cancelled
+	bool popWork(AsyncItem** items, int& count)
+	{
+		m_work_signal.wait();
+		MT::SpinLock lock(m_mutex);
+		count = 0;
+		if (m_is_aborted) return false;
+
+		// the queue is split between the threads, so one batch does not take all the work
+		int batch_size = (m_work_queue.size() + m_io_thread_count - 1) / m_io_thread_count;
+		batch_size = Math::minValue(batch_size, MAX_BATCH_SIZE);
+		while (count < batch_size)
+		{
+			// the most important request first, requests with the same priority in FIFO order
+			int best = 0;
+			for (int i = 1; i < m_work_queue.size(); ++i)
+			{
+				if (m_work_queue[i]->m_priority > m_work_queue[best]->m_priority) best = i;
+			}
+			items[count] = m_work_queue[best];
+			m_work_queue.erase(best);
+			++count;
+		}
+		return true;
+	}
+
+
+	void pushCompleted(AsyncItem** items, int count)
+	{
+		MT::SpinLock lock(m_mutex);
+		for (int i = 0; i < count; ++i) m_completed.push(items[i]);
+	}
 
 
 	bool mount(IFileDevice* device) override
@@ -189,7 +213,7 @@ public:
 
 		if (prev)
 		{
-			if (prev->open(file, mode))
+			if (prev->open(file, mode & ~Mode::PREFETCH))
 			{
 				return prev;
 			}
@@ -203,25 +227,74 @@ public:
 	}
 
 
-	bool openAsync(const DeviceList& device_list,
+	AsyncHandle openAsync(const DeviceList& device_list,
 		const Path& file,
 		int mode,
-		const ReadCallback& call_back) override
+		const ReadCallback& call_back,
+		int priority) override
 	{
 		IFile* prev = createFile(device_list);
+		if (!prev) return INVALID_ASYNC_HANDLE;
+
+		++m_last_handle;
+		if (m_last_handle == INVALID_ASYNC_HANDLE) ++m_last_handle;
+
+		AsyncItem* item = LUMIX_NEW(m_allocator, AsyncItem)();
+		item->m_file = prev;
+		item->m_cb = call_back;
+		item->m_mode = mode;
+		copyString(item->m_path, file.c_str());
+		item->m_flags = E_IS_OPEN;
+		item->m_handle = m_last_handle;
+		item->m_priority = priority;
+		item->m_is_cancelled = false;
+		m_pending.push(item);
+		m_requests.insert(item->m_handle, item);
+
+		return item->m_handle;
+	}
+
+
+	void setPriority(AsyncHandle handle, int priority) override
+	{
+		auto iter = m_requests.find(handle);
+		if (iter == m_requests.end()) return;
+
+		MT::SpinLock lock(m_mutex);
+		iter.value()->m_priority = priority;
+	}
 
-		if (prev)
-		{
-			AsyncItem& item = m_pending.pushEmpty();
 
-			item.m_file = prev;
-			item.m_cb = call_back;
-			item.m_mode = mode;
-			copyString(item.m_path, file.c_str());
-			item.m_flags = E_IS_OPEN;
+	void cancel(AsyncHandle handle) override
+	{
+		auto iter = m_requests.find(handle);
+		if (iter == m_requests.end()) return;
+
+		AsyncItem* item = iter.value();
+		int index = m_pending.indexOf(item);
+		if (index >= 0)
+		{
+			m_pending.erase(index);
+		}
+		else
+		{
+			{
+				MT::SpinLock lock(m_mutex);
+				index = m_work_queue.indexOf(item);
+				if (index >= 0) m_work_queue.erase(index);
+			}
+			if (index < 0)
+			{
+				// an I/O thread is already opening the file, the result is thrown away
+				item->m_is_cancelled = true;
+				return;
+			}
+			--m_in_flight_count;
 		}
 
-		return nullptr != prev;
+		m_requests.erase(handle);
+		item->m_file->release();
+		LUMIX_DELETE(m_allocator, item);
 	}
 
 
@@ -274,54 +347,55 @@ public:
 
 	void closeAsync(IFile& file) override
 	{
-		AsyncItem& item = m_pending.pushEmpty();
-
-		item.m_file = &file;
-		item.m_cb.bind<closeAsync>();
-		item.m_mode = 0;
-		item.m_flags = E_CLOSE;
+		AsyncItem* item = LUMIX_NEW(m_allocator, AsyncItem)();
+		item->m_file = &file;
+		item->m_cb.bind<closeAsync>();
+		item->m_mode = 0;
+		item->m_path[0] = '\0';
+		item->m_flags = E_CLOSE;
+		item->m_handle = INVALID_ASYNC_HANDLE;
+		item->m_priority = CLOSE_PRIORITY;
+		item->m_is_cancelled = false;
+		m_pending.push(item);
 	}
 
 
 	void updateAsyncTransactions() override
 	{
 		PROFILE_FUNCTION();
-		while (!m_in_progress.empty())
 		{
-			AsynTrans* tr = m_in_progress.front();
-			if (!tr->isCompleted()) break;
+			MT::SpinLock lock(m_mutex);
+			m_finished.swap(m_completed);
+		}
 
+		// I/O threads finish in any order, one slow file does not hold back the rest
+		for (auto* item : m_finished)
+		{
 			PROFILE_BLOCK("processAsyncTransaction");
-			m_in_progress.pop();
-
-			tr->data.m_cb.invoke(*tr->data.m_file, !!(tr->data.m_flags & E_SUCCESS));
-			if ((tr->data.m_flags & (E_SUCCESS | E_FAIL)) != 0)
+			--m_in_flight_count;
+			if (item->m_handle != INVALID_ASYNC_HANDLE) m_requests.erase(item->m_handle);
+			if (!item->m_is_cancelled)
 			{
-				closeAsync(*tr->data.m_file);
+				item->m_cb.invoke(*item->m_file, !!(item->m_flags & E_SUCCESS));
 			}
-			m_transaction_queue.dealoc(tr);
+			if ((item->m_flags & (E_SUCCESS | E_FAIL)) != 0)
+			{
+				closeAsync(*item->m_file);
+			}
+			LUMIX_DELETE(m_allocator, item);
 		}
+		m_finished.clear();
+
+		if (m_pending.empty()) return;
 
-		int32 can_add = C_MAX_TRANS - m_in_progress.size();
-		while (can_add && !m_pending.empty())
+		int count = m_pending.size();
 		{
-			AsynTrans* tr = m_transaction_queue.alloc(false);
-			if (tr)
-			{
-				AsyncItem& item = m_pending[0];
-				tr->data.m_file = item.m_file;
-				tr->data.m_cb = item.m_cb;
-				tr->data.m_mode = item.m_mode;
-				copyString(tr->data.m_path, sizeof(tr->data.m_path), item.m_path);
-				tr->data.m_flags = item.m_flags;
-				tr->reset();
-
-				m_transaction_queue.push(tr, true);
-				m_in_progress.push(tr);
-				m_pending.erase(0);
-			}
-			can_add--;
+			MT::SpinLock lock(m_mutex);
+			for (auto* item : m_pending) m_work_queue.push(item);
 		}
+		m_in_flight_count += count;
+		m_pending.clear();
+		for (int i = 0; i < count; ++i) m_work_signal.signal();
 	}
 
 	const DeviceList& getDefaultDevice() const override { return m_default_device; }
@@ -340,20 +414,45 @@ public:
 
 	static void closeAsync(IFile&, bool) {}
 
-	void destroy()
+private:
+	void releaseItem(AsyncItem& item)
+	{
+		if (item.m_file) close(*item.m_file);
+		LUMIX_DELETE(m_allocator, &item);
+	}
+
+
+	void stopTasks()
 	{
-		m_transaction_queue.abort();
-		m_task->destroy();
+		{
+			MT::SpinLock lock(m_mutex);
+			m_is_aborted = true;
+		}
+		for (int i = 0; i < m_tasks.size(); ++i) m_work_signal.signal();
+		for (auto* task : m_tasks)
+		{
+			task->destroy();
+			LUMIX_DELETE(m_allocator, task);
+		}
+		m_tasks.clear();
 	}
 
 private:
 	BaseProxyAllocator m_allocator;
-	FSTask* m_task;
 	DevicesTable m_devices;
+	Array<FSTask*> m_tasks;
 
 	ItemsTable m_pending;
-	TransQueue m_transaction_queue;
-	InProgressQueue m_in_progress;
+	ItemsTable m_work_queue;
+	ItemsTable m_completed;
+	ItemsTable m_finished;
+	MT::SpinMutex m_mutex;
+	MT::Semaphore m_work_signal;
+	bool m_is_aborted;
+	int m_in_flight_count;
+	int m_io_thread_count;
+	PODHashMap<AsyncHandle, AsyncItem*> m_requests;
+	AsyncHandle m_last_handle;
 
 	DeviceList m_disk_device;
 	DeviceList m_memory_device;
@@ -361,9 +460,53 @@ private:
 	DeviceList m_save_game_device;
 };
 
-FileSystem* FileSystem::create(IAllocator& allocator)
+
+int FSTask::task()
+{
+	AsyncItem* items[MAX_BATCH_SIZE];
+	OsFileMapping::Range ranges[MAX_BATCH_SIZE];
+	int count;
+	while (m_fs.popWork(items, count))
+	{
+		// the requests were cancelled while they were waiting in the queue
+		if (count == 0) continue;
+
+		PROFILE_BLOCK("transaction");
+		int range_count = 0;
+		for (int i = 0; i < count; ++i)
+		{
+			AsyncItem* item = items[i];
+			if ((item->m_flags & E_IS_OPEN) == E_IS_OPEN)
+			{
+				int mode = item->m_mode & ~Mode::PREFETCH;
+				bool success = item->m_file->open(Path(item->m_path), mode);
+				item->m_flags |= success ? E_SUCCESS : E_FAIL;
+				if (success && (item->m_mode & Mode::PREFETCH) && item->m_file->getBuffer())
+				{
+					ranges[range_count].data = item->m_file->getBuffer();
+					ranges[range_count].size = item->m_file->size();
+					++range_count;
+				}
+			}
+			else
+			{
+				item->m_file->close();
+				item->m_file->release();
+				item->m_file = nullptr;
+			}
+		}
+		// reads of the whole batch are queued at once and finished here, instead of faulting
+		// the mapped files in page by page on the thread which parses them
+		OsFileMapping::prefetch(ranges, range_count);
+		m_fs.pushCompleted(items, count);
+	}
+	return 0;
+}
+
+
+FileSystem* FileSystem::create(IAllocator& allocator, int io_thread_count)
 {
-	return LUMIX_NEW(allocator, FileSystemImpl)(allocator);
+	return LUMIX_NEW(allocator, FileSystemImpl)(allocator, io_thread_count);
 }
 
 void FileSystem::destroy(FileSystem* fs)
@@ -27,7 +27,9 @@ struct LUMIX_ENGINE_API DeviceList
 class LUMIX_ENGINE_API FileSystem
 {
 public:
-	static FileSystem* create(IAllocator& allocator);
+	static const int DEFAULT_IO_THREAD_COUNT = 4;
+
+	static FileSystem* create(IAllocator& allocator, int io_thread_count = DEFAULT_IO_THREAD_COUNT);
 	static void destroy(FileSystem* fs);
 
 	FileSystem() {}
@@ -37,10 +39,15 @@ public:
 	virtual bool unMount(IFileDevice* device) = 0;
 
 	virtual IFile* open(const DeviceList& device_list, const Path& file, Mode mode) = 0;
-	virtual bool openAsync(const DeviceList& device_list,
-						   const Path& file,
-						   int mode,
-						   const ReadCallback& call_back) = 0;
+	// requests with higher priority are opened first
+	virtual AsyncHandle openAsync(const DeviceList& device_list,
+								  const Path& file,
+								  int mode,
+								  const ReadCallback& call_back,
+								  int priority = 0) = 0;
+	virtual void setPriority(AsyncHandle handle, int priority) = 0;
+	// the callback of a cancelled request is not called
+	virtual void cancel(AsyncHandle handle) = 0;
 
 	virtual void close(IFile& file) = 0;
 	virtual void closeAsync(IFile& file) = 0;
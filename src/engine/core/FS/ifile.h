@@ -5,6 +5,7 @@
 
 namespace Lumix
 {
+	class IAllocator;
 	class Path;
 
 	namespace FS
@@ -25,6 +26,8 @@ namespace Lumix
 			virtual bool write(const void* buffer, size_t size) = 0;
 
 			virtual const void* getBuffer() const = 0;
+			// the caller takes ownership of the buffer and frees it with *allocator, nullptr if there is no buffer
+			virtual void* detachBuffer(IAllocator** allocator) = 0;
 			virtual size_t size() = 0;
 
 			virtual size_t seek(SeekMode base, size_t pos) = 0;
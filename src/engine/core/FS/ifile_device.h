@@ -21,6 +21,9 @@ public:
 	virtual void destroyFile(IFile* file) = 0;
 
 	virtual const char* name() const = 0;
+	// false if reading a file does not make the next read of it faster, e.g. a remote device
+	// without a local cache, then files are not read ahead
+	virtual bool isReadCached() const { return true; }
 };
 
 
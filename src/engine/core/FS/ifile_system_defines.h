@@ -11,6 +11,8 @@ namespace Lumix
 		class FileSystem;
 
 		typedef Delegate<void (IFile&, bool)> ReadCallback;
+		typedef uint32 AsyncHandle;
+		const AsyncHandle INVALID_ASYNC_HANDLE = 0;
 		struct Mode
 		{
 			enum Value
@@ -21,6 +23,9 @@ namespace Lumix
 				OPEN			= WRITE << 1,
 				CREATE			= OPEN << 1,
 				OPEN_OR_CREATE	= CREATE << 1,
+				// only for FileSystem::openAsync, the whole file is read by the I/O thread
+				// before the callback is called
+				PREFETCH		= OPEN_OR_CREATE << 1,
 
 				OPEN_AND_READ = OPEN | READ
 			};
@@ -21,7 +21,28 @@ namespace Lumix
 				, m_pos(0)
 				, m_file(file) 
 				, m_write(false)
+				, m_is_borrowed(false)
 				, m_allocator(allocator)
+				, m_buffer_allocator(&allocator)
+			{
+			}
+
+
+			MemoryFile(void* buffer,
+				size_t size,
+				IAllocator& buffer_allocator,
+				MemoryFileDevice& device,
+				IAllocator& allocator)
+				: m_device(device)
+				, m_buffer((uint8*)buffer)
+				, m_size(size)
+				, m_capacity(size)
+				, m_pos(0)
+				, m_file(nullptr)
+				, m_write(false)
+				, m_is_borrowed(false)
+				, m_allocator(allocator)
+				, m_buffer_allocator(&buffer_allocator)
 			{
 			}
 
@@ -31,7 +52,7 @@ namespace Lumix
 				{
 					m_file->release();
 				}
-				m_allocator.deallocate(m_buffer);
+				if (!m_is_borrowed) m_buffer_allocator->deallocate(m_buffer);
 			}
 
 
@@ -52,9 +73,18 @@ namespace Lumix
 						if(mode & Mode::READ)
 						{
 							m_capacity = m_size = m_file->size();
-							m_buffer = (uint8*)m_allocator.allocate(sizeof(uint8) * m_size);
-							m_file->read(m_buffer, m_size);
 							m_pos = 0;
+							// read-only files with a buffer, e.g. mapped ones, are not copied
+							m_is_borrowed = !m_write && m_file->getBuffer();
+							if (m_is_borrowed)
+							{
+								m_buffer = (uint8*)m_file->getBuffer();
+							}
+							else
+							{
+								m_buffer = (uint8*)m_buffer_allocator->allocate(sizeof(uint8) * m_size);
+								m_file->read(m_buffer, m_size);
+							}
 						}
 
 						return true;
@@ -83,8 +113,9 @@ namespace Lumix
 					m_file->close();
 				}
 
-				m_allocator.deallocate(m_buffer);
+				if (!m_is_borrowed) m_buffer_allocator->deallocate(m_buffer);
 				m_buffer = nullptr;
+				m_is_borrowed = false;
 			}
 
 			bool read(void* buffer, size_t size) override
@@ -97,15 +128,17 @@ namespace Lumix
 
 			bool write(const void* buffer, size_t size) override
 			{
+				if (m_is_borrowed) return false;
+
 				size_t pos = m_pos;
 				size_t cap = m_capacity;
 				size_t sz = m_size;
 				if(pos + size > cap)
 				{
 					size_t new_cap = Math::maxValue(cap * 2, pos + size);
-					uint8* new_data = (uint8*)m_allocator.allocate(sizeof(uint8) * new_cap);
+					uint8* new_data = (uint8*)m_buffer_allocator->allocate(sizeof(uint8) * new_cap);
 					copyMemory(new_data, m_buffer, (int)sz);
-					m_allocator.deallocate(m_buffer);
+					m_buffer_allocator->deallocate(m_buffer);
 					m_buffer = new_data;
 					m_capacity = new_cap;
 				}
@@ -122,6 +155,26 @@ namespace Lumix
 				return m_buffer;
 			}
 
+			void* detachBuffer(IAllocator** allocator) override
+			{
+				if (!m_buffer || m_write) return nullptr;
+
+				void* buffer = m_buffer;
+				if (m_is_borrowed)
+				{
+					buffer = m_file->detachBuffer(allocator);
+					if (!buffer) return nullptr;
+					m_is_borrowed = false;
+				}
+				else
+				{
+					*allocator = m_buffer_allocator;
+				}
+				m_buffer = nullptr;
+				m_size = m_capacity = m_pos = 0;
+				return buffer;
+			}
+
 			size_t size() override
 			{
 				return m_size;
@@ -159,6 +212,7 @@ namespace Lumix
 
 		private:
 			IAllocator& m_allocator;
+			IAllocator* m_buffer_allocator;
 			MemoryFileDevice& m_device;
 			uint8* m_buffer;
 			size_t m_size;
@@ -166,6 +220,7 @@ namespace Lumix
 			size_t m_pos;
 			IFile* m_file;
 			bool m_write;
+			bool m_is_borrowed;
 		};
 
 		void MemoryFileDevice::destroyFile(IFile* file)
@@ -177,5 +232,11 @@ namespace Lumix
 		{
 			return LUMIX_NEW(m_allocator, MemoryFile)(child, *this, m_allocator);
 		}
+
+		IFile* MemoryFileDevice::createFile(void* buffer, size_t size, IAllocator& buffer_allocator)
+		{
+			return LUMIX_NEW(m_allocator, MemoryFile)(
+				buffer, size, buffer_allocator, *this, m_allocator);
+		}
 	} // ~namespace FS
 } // ~namespace Lumix
@@ -18,6 +18,9 @@ namespace Lumix
 
 			void destroyFile(IFile* file) override;
 			IFile* createFile(IFile* child) override;
+			// the file is opened for reading, it takes ownership of the buffer and frees it
+			// with buffer_allocator
+			IFile* createFile(void* buffer, size_t size, IAllocator& buffer_allocator);
 
 			const char* name() const override { return "memory"; }
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "lumix.h"
+#include "core/delegate.h"
 #include "core/fs/ifile_system_defines.h"
 
 namespace Lumix
@@ -36,5 +37,43 @@ namespace Lumix
 		private:
 			struct OsFileImpl* m_impl;
 		};
+
+
+		// calls callback with the path of every file in dir and its subdirectories, paths are
+		// relative to dir and separated by '/', hidden files and directories are skipped
+		LUMIX_ENGINE_API void enumerateFiles(const char* dir,
+			const Delegate<void(const char*)>& callback);
+
+
+		// read-only view of a whole file, the data stay valid until close()
+		class LUMIX_ENGINE_API OsFileMapping
+		{
+		public:
+			struct Range
+			{
+				const void* data;
+				size_t size;
+			};
+
+		public:
+			// reads all the ranges of mapped files in one batch and waits until they are resident,
+			// so the thread which uses the data later does not wait for page faults
+			static void prefetch(const Range* ranges, int count);
+
+			OsFileMapping();
+			~OsFileMapping();
+
+			bool open(const char* path);
+			void close();
+			// the caller takes ownership of the view and unmaps it with (*allocator)->deallocate
+			void* detach(IAllocator** allocator);
+
+			const void* getData() const { return m_data; }
+			size_t size() const { return m_size; }
+
+		private:
+			const void* m_data;
+			size_t m_size;
+		};
 	} // ~namespace FS
 } // ~namespace Lumix
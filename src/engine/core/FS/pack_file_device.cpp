@@ -0,0 +1,505 @@
+#include "core/fs/pack_file_device.h"
+#include "core/array.h"
+#include "core/crc32.h"
+#include "core/iallocator.h"
+#include "core/fs/ifile.h"
+#include "core/fs/ifile_system_defines.h"
+#include "core/log.h"
+#include "core/lz4.h"
+#include "core/math_utils.h"
+#include "core/path.h"
+#include "core/path_utils.h"
+#include "core/string.h"
+#include <cstdlib>
+
+
+namespace Lumix
+{
+	namespace FS
+	{
+		class PackFile : public IFile
+		{
+		public:
+			PackFile(IFile* child, PackFileDevice& device, IAllocator& allocator)
+				: m_device(device)
+				, m_allocator(allocator)
+				, m_child(child)
+				, m_is_child_open(false)
+				, m_entry(nullptr)
+				, m_data(nullptr)
+				, m_pos(0)
+				, m_block(nullptr)
+				, m_block_index(-1)
+				, m_block_size(0)
+			{
+			}
+
+			~PackFile()
+			{
+				if (m_child) m_child->release();
+				m_allocator.deallocate(m_block);
+			}
+
+
+			IFileDevice& getDevice() override
+			{
+				return m_device;
+			}
+
+
+			bool open(const Path& path, Mode mode) override
+			{
+				ASSERT(!m_entry && !m_is_child_open);
+
+				const PackFileDevice::Entry* entry =
+					(mode & Mode::WRITE) || !m_device.isMounted() ? nullptr : m_device.find(path.getHash());
+				if (entry)
+				{
+					m_entry = entry;
+					m_data = m_device.getData(*entry);
+					m_pos = 0;
+					return true;
+				}
+
+				m_is_child_open = m_child && m_child->open(path, mode);
+				return m_is_child_open;
+			}
+
+
+			void close() override
+			{
+				if (m_is_child_open) m_child->close();
+				m_is_child_open = false;
+				m_entry = nullptr;
+				m_data = nullptr;
+				m_block_index = -1;
+			}
+
+
+			bool read(void* buffer, size_t size) override
+			{
+				if (m_is_child_open) return m_child->read(buffer, size);
+				if (!m_entry) return false;
+
+				size_t amount = Math::minValue(size, m_entry->size - m_pos);
+				if (m_entry->flags & PackFileDevice::COMPRESSED)
+				{
+					if (!readCompressed((uint8*)buffer, amount)) return false;
+				}
+				else
+				{
+					copyMemory(buffer, m_data + m_pos, (int)amount);
+				}
+				m_pos += amount;
+				return amount == size;
+			}
+
+
+			bool write(const void* buffer, size_t size) override
+			{
+				return m_is_child_open && m_child->write(buffer, size);
+			}
+
+
+			const void* getBuffer() const override
+			{
+				if (m_is_child_open) return m_child->getBuffer();
+				// stored entries are read directly from the mapped archive
+				if (m_entry && (m_entry->flags & PackFileDevice::COMPRESSED) == 0) return m_data;
+				return nullptr;
+			}
+
+
+			void* detachBuffer(IAllocator** allocator) override
+			{
+				if (m_is_child_open) return m_child->detachBuffer(allocator);
+				return nullptr;
+			}
+
+
+			size_t size() override
+			{
+				if (m_is_child_open) return m_child->size();
+				return m_entry ? m_entry->size : 0;
+			}
+
+
+			size_t seek(SeekMode base, size_t pos) override
+			{
+				if (m_is_child_open) return m_child->seek(base, pos);
+				if (!m_entry) return 0;
+
+				switch (base)
+				{
+					case SeekMode::BEGIN: m_pos = pos; break;
+					case SeekMode::CURRENT: m_pos += pos; break;
+					case SeekMode::END: m_pos = m_entry->size - pos; break;
+					default: ASSERT(false); break;
+				}
+				m_pos = Math::minValue(m_pos, (size_t)m_entry->size);
+				return m_pos;
+			}
+
+
+			size_t pos() override
+			{
+				if (m_is_child_open) return m_child->pos();
+				return m_pos;
+			}
+
+		private:
+			bool decompressBlock(int index)
+			{
+				uint32 block_size = m_device.getBlockSize();
+				if (!m_block)
+				{
+					m_block = (uint8*)m_allocator.allocate(block_size);
+				}
+
+				const uint32* offsets = (const uint32*)m_data;
+				uint32 block_count = (m_entry->size + block_size - 1) / block_size;
+				uint32 begin = offsets[index];
+				uint32 end = offsets[index + 1];
+				// a damaged offset table must not make us read outside of the entry
+				if (begin < (block_count + 1) * sizeof(uint32) || end < begin ||
+					end > m_entry->packed_size)
+				{
+					g_log_error.log("engine") << "Corrupted pack file block";
+					return false;
+				}
+				uint32 packed_size = end - begin;
+				int size = (int)Math::minValue(block_size, m_entry->size - index * block_size);
+				const uint8* packed = m_data + begin;
+				// incompressible blocks are stored as they are
+				if (packed_size == (uint32)size)
+				{
+					copyMemory(m_block, packed, size);
+				}
+				else if (LZ4::decompress(packed, packed_size, m_block, size) != size)
+				{
+					g_log_error.log("engine") << "Corrupted pack file block";
+					return false;
+				}
+				m_block_index = index;
+				m_block_size = size;
+				return true;
+			}
+
+
+			bool readCompressed(uint8* buffer, size_t size)
+			{
+				uint32 block_size = m_device.getBlockSize();
+				size_t pos = m_pos;
+				while (size > 0)
+				{
+					int index = int(pos / block_size);
+					if (index != m_block_index && !decompressBlock(index)) return false;
+
+					size_t offset = pos - index * (size_t)block_size;
+					size_t amount = Math::minValue(size, m_block_size - offset);
+					copyMemory(buffer, m_block + offset, (int)amount);
+					buffer += amount;
+					pos += amount;
+					size -= amount;
+				}
+				return true;
+			}
+
+		private:
+			PackFileDevice& m_device;
+			IAllocator& m_allocator;
+			IFile* m_child;
+			bool m_is_child_open;
+			const PackFileDevice::Entry* m_entry;
+			const uint8* m_data;
+			size_t m_pos;
+			uint8* m_block;
+			int m_block_index;
+			size_t m_block_size;
+		};
+
+
+		struct PackedFile
+		{
+			char path[MAX_PATH_LENGTH];
+			PackFileDevice::Entry entry;
+		};
+
+
+		struct PackedFileList
+		{
+			explicit PackedFileList(IAllocator& allocator)
+				: files(allocator)
+			{
+			}
+
+			void add(const char* path)
+			{
+				auto& file = files.pushEmpty();
+				copyString(file.path, path);
+				char normalized[MAX_PATH_LENGTH];
+				PathUtils::normalize(path, normalized, lengthOf(normalized));
+				file.entry.path_hash = crc32(normalized);
+				file.entry.flags = 0;
+			}
+
+			Array<PackedFile> files;
+		};
+
+
+		// textures and sounds are used through IFile::getBuffer, they must be stored
+		// so they can be read directly from the mapped archive
+		static bool canCompress(const char* path)
+		{
+			return !PathUtils::hasExtension(path, "dds") && !PathUtils::hasExtension(path, "ogg");
+		}
+
+
+		static bool compressFile(const uint8* data,
+			uint32 size,
+			uint32 block_size,
+			Array<uint8>& out)
+		{
+			int block_count = int((size + block_size - 1) / block_size);
+			int header_size = (block_count + 1) * sizeof(uint32);
+			out.resize(header_size + LZ4::compressBound(block_size) * block_count);
+
+			uint32 offset = header_size;
+			for (int i = 0; i < block_count; ++i)
+			{
+				((uint32*)&out[0])[i] = offset;
+				int raw_size = (int)Math::minValue(block_size, size - i * block_size);
+				const uint8* raw = data + i * block_size;
+				int packed_size = LZ4::compress(raw, raw_size, &out[offset], raw_size - 1);
+				// incompressible blocks are stored as they are
+				if (packed_size == 0)
+				{
+					copyMemory(&out[offset], raw, raw_size);
+					packed_size = raw_size;
+				}
+				offset += packed_size;
+			}
+			((uint32*)&out[0])[block_count] = offset;
+			out.resize(offset);
+
+			// not worth decompressing if it saves less than ~10%
+			return offset < size - size / 10;
+		}
+
+
+		static int compareHash(const void* a, const void* b)
+		{
+			uint32 hash_a = ((const PackedFile*)a)->entry.path_hash;
+			uint32 hash_b = ((const PackedFile*)b)->entry.path_hash;
+			return hash_a < hash_b ? -1 : (hash_a > hash_b ? 1 : 0);
+		}
+
+
+		bool PackFileDevice::pack(const char* input_dir,
+			const char* output_path,
+			IAllocator& allocator)
+		{
+			PackedFileList list(allocator);
+			Delegate<void(const char*)> callback;
+			callback.bind<PackedFileList, &PackedFileList::add>(&list);
+			enumerateFiles(input_dir, callback);
+			Array<PackedFile>& files = list.files;
+			if (files.empty())
+			{
+				g_log_error.log("engine") << "No files found in " << input_dir;
+				return false;
+			}
+
+			qsort(&files[0], files.size(), sizeof(files[0]), compareHash);
+			for (int i = 1; i < files.size(); ++i)
+			{
+				if (files[i].entry.path_hash == files[i - 1].entry.path_hash)
+				{
+					g_log_error.log("engine") << "Hash collision between " << files[i].path
+											  << " and " << files[i - 1].path;
+					return false;
+				}
+			}
+
+			OsFile out;
+			if (!out.open(output_path, Mode::CREATE | Mode::WRITE, allocator))
+			{
+				g_log_error.log("engine") << "Could not create " << output_path;
+				return false;
+			}
+
+			Header header;
+			header.magic = FILE_MAGIC;
+			header.version = (uint32)Version::LATEST;
+			header.entry_count = files.size();
+			header.block_size = DEFAULT_BLOCK_SIZE;
+			out.write(&header, sizeof(header));
+			// entries are rewritten once the offsets are known
+			for (auto& file : files) out.write(&file.entry, sizeof(file.entry));
+
+			Array<uint8> data(allocator);
+			Array<uint8> packed(allocator);
+			uint64 offset = sizeof(header) + files.size() * sizeof(Entry);
+			for (auto& file : files)
+			{
+				char path[MAX_PATH_LENGTH];
+				copyString(path, input_dir);
+				catString(path, "/");
+				catString(path, file.path);
+
+				OsFile in;
+				if (!in.open(path, Mode::OPEN_AND_READ, allocator))
+				{
+					g_log_error.log("engine") << "Could not open " << path;
+					out.close();
+					return false;
+				}
+				uint32 size = (uint32)in.size();
+				data.resize(size);
+				bool success = size == 0 || in.read(&data[0], size);
+				in.close();
+				if (!success)
+				{
+					g_log_error.log("engine") << "Could not read " << path;
+					out.close();
+					return false;
+				}
+
+				auto& entry = file.entry;
+				entry.offset = offset;
+				entry.size = size;
+				if (size > 0 && canCompress(file.path) &&
+					compressFile(&data[0], size, header.block_size, packed))
+				{
+					entry.flags |= COMPRESSED;
+					entry.packed_size = packed.size();
+					out.write(&packed[0], packed.size());
+				}
+				else
+				{
+					entry.packed_size = size;
+					if (size > 0) out.write(&data[0], size);
+				}
+				offset += entry.packed_size;
+			}
+
+			out.seek(SeekMode::BEGIN, sizeof(header));
+			for (auto& file : files) out.write(&file.entry, sizeof(file.entry));
+			out.close();
+			return true;
+		}
+
+
+		PackFileDevice::PackFileDevice(IAllocator& allocator)
+			: m_allocator(allocator)
+			, m_header(nullptr)
+			, m_entries(nullptr)
+		{
+		}
+
+
+		PackFileDevice::~PackFileDevice()
+		{
+			unmount();
+		}
+
+
+		bool PackFileDevice::mount(const char* archive_path)
+		{
+			unmount();
+			if (!m_mapping.open(archive_path))
+			{
+				g_log_error.log("engine") << "Could not open pack file " << archive_path;
+				return false;
+			}
+
+			const Header* header = (const Header*)m_mapping.getData();
+			bool is_valid = m_mapping.size() >= sizeof(Header) && header->magic == FILE_MAGIC &&
+							header->version <= (uint32)Version::LATEST && header->block_size > 0 &&
+							m_mapping.size() >= sizeof(Header) + header->entry_count * sizeof(Entry);
+			if (!is_valid)
+			{
+				g_log_error.log("engine") << archive_path << " is not a valid pack file";
+				m_mapping.close();
+				return false;
+			}
+
+			// a truncated or stale archive would make files read past the mapped view
+			const Entry* entries = (const Entry*)(header + 1);
+			for (uint32 i = 0; i < header->entry_count; ++i)
+			{
+				if (!isEntryValid(entries[i], header->block_size))
+				{
+					g_log_error.log("engine") << archive_path << " is damaged";
+					m_mapping.close();
+					return false;
+				}
+			}
+
+			m_header = header;
+			m_entries = entries;
+			return true;
+		}
+
+
+		bool PackFileDevice::isEntryValid(const Entry& entry, uint32 block_size) const
+		{
+			uint64 end = entry.offset + entry.packed_size;
+			if (entry.offset > m_mapping.size() || end > m_mapping.size()) return false;
+			if ((entry.flags & COMPRESSED) == 0) return entry.packed_size == entry.size;
+
+			uint64 block_count = (entry.size + (uint64)block_size - 1) / block_size;
+			return entry.packed_size >= (block_count + 1) * sizeof(uint32);
+		}
+
+
+		void PackFileDevice::unmount()
+		{
+			m_mapping.close();
+			m_header = nullptr;
+			m_entries = nullptr;
+		}
+
+
+		const PackFileDevice::Entry* PackFileDevice::find(uint32 path_hash) const
+		{
+			int from = 0;
+			int to = (int)m_header->entry_count;
+			while (from < to)
+			{
+				int mid = (from + to) >> 1;
+				if (m_entries[mid].path_hash < path_hash)
+				{
+					from = mid + 1;
+				}
+				else
+				{
+					to = mid;
+				}
+			}
+			if (from < (int)m_header->entry_count && m_entries[from].path_hash == path_hash)
+			{
+				return &m_entries[from];
+			}
+			return nullptr;
+		}
+
+
+		const uint8* PackFileDevice::getData(const Entry& entry) const
+		{
+			return (const uint8*)m_mapping.getData() + entry.offset;
+		}
+
+
+		void PackFileDevice::destroyFile(IFile* file)
+		{
+			LUMIX_DELETE(m_allocator, file);
+		}
+
+
+		IFile* PackFileDevice::createFile(IFile* child)
+		{
+			return LUMIX_NEW(m_allocator, PackFile)(child, *this, m_allocator);
+		}
+	} // ~namespace FS
+} // ~namespace Lumix
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "lumix.h"
+#include "core/fs/ifile_device.h"
+#include "core/fs/os_file.h"
+
+namespace Lumix
+{
+	class IAllocator;
+
+	namespace FS
+	{
+		class IFile;
+
+		// files are read from one memory-mapped archive, files which are not in the archive
+		// are opened by the child device, e.g. "pack:disk"
+		class LUMIX_ENGINE_API PackFileDevice : public IFileDevice
+		{
+		public:
+#pragma pack(1)
+			struct Header
+			{
+				uint32 magic;
+				uint32 version;
+				uint32 entry_count;
+				uint32 block_size;
+			};
+
+			// entries are sorted by path_hash, compressed entries start with a table
+			// of block_count + 1 uint32 offsets relative to the entry's offset
+			struct Entry
+			{
+				uint32 path_hash;
+				uint32 flags;
+				uint64 offset;
+				uint32 size;
+				uint32 packed_size;
+			};
+#pragma pack()
+
+			enum class Version : uint32
+			{
+				FIRST,
+
+				LATEST // keep this last
+			};
+
+			enum EntryFlags : uint32
+			{
+				COMPRESSED = 1 << 0
+			};
+
+			static const uint32 FILE_MAGIC = 0x5f4c504b; // == '_LPK'
+			static const uint32 DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+		public:
+			// writes all files of input_dir to a new archive, files used through IFile::getBuffer
+			// are stored, the others are compressed if it is worth it
+			static bool pack(const char* input_dir, const char* output_path, IAllocator& allocator);
+
+			PackFileDevice(IAllocator& allocator);
+			~PackFileDevice();
+
+			bool mount(const char* archive_path);
+			void unmount();
+			bool isMounted() const { return m_header != nullptr; }
+
+			const Entry* find(uint32 path_hash) const;
+			const uint8* getData(const Entry& entry) const;
+			uint32 getBlockSize() const { return m_header->block_size; }
+			int getEntryCount() const { return m_header ? (int)m_header->entry_count : 0; }
+
+			IFile* createFile(IFile* child) override;
+			void destroyFile(IFile* file) override;
+
+			const char* name() const override { return "pack"; }
+
+		private:
+			bool isEntryValid(const Entry& entry, uint32 block_size) const;
+
+		private:
+			IAllocator& m_allocator;
+			OsFileMapping m_mapping;
+			const Header* m_header;
+			const Entry* m_entries;
+		};
+	} // ~namespace FS
+} // ~namespace Lumix
@@ -162,5 +162,182 @@ void OsFile::writeEOF()
 }
 
 
+// views are unmapped through the allocator interface, so they can be handed out as detached file buffers
+class MappedViewAllocator : public IAllocator
+{
+public:
+	void* allocate(size_t) override
+	{
+		ASSERT(false);
+		return nullptr;
+	}
+
+	void deallocate(void* ptr) override
+	{
+		if (ptr) ::UnmapViewOfFile(ptr);
+	}
+
+	void* reallocate(void*, size_t) override
+	{
+		ASSERT(false);
+		return nullptr;
+	}
+
+	void* allocate_aligned(size_t, size_t) override
+	{
+		ASSERT(false);
+		return nullptr;
+	}
+
+	void deallocate_aligned(void* ptr) override { deallocate(ptr); }
+
+	void* reallocate_aligned(void*, size_t, size_t) override
+	{
+		ASSERT(false);
+		return nullptr;
+	}
+};
+
+
+static MappedViewAllocator g_mapped_view_allocator;
+
+
+static void enumerateFiles(const char* root,
+	const char* dir,
+	const Delegate<void(const char*)>& callback)
+{
+	char mask[MAX_PATH_LENGTH];
+	copyString(mask, root);
+	catString(mask, "/");
+	catString(mask, dir);
+	catString(mask, "*");
+
+	WIN32_FIND_DATAA data;
+	HANDLE handle = ::FindFirstFileA(mask, &data);
+	if (handle == INVALID_HANDLE_VALUE) return;
+	do
+	{
+		if (data.cFileName[0] == '.') continue;
+
+		char relative[MAX_PATH_LENGTH];
+		copyString(relative, dir);
+		catString(relative, data.cFileName);
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			catString(relative, "/");
+			enumerateFiles(root, relative, callback);
+		}
+		else
+		{
+			callback.invoke(relative);
+		}
+	} while (::FindNextFileA(handle, &data));
+	::FindClose(handle);
+}
+
+
+void enumerateFiles(const char* dir, const Delegate<void(const char*)>& callback)
+{
+	enumerateFiles(dir, "", callback);
+}
+
+
+// PrefetchVirtualMemory is not available before Windows 8, so it is not linked directly;
+// OsFileMapping::Range has the same layout as WIN32_MEMORY_RANGE_ENTRY
+typedef BOOL(WINAPI* PrefetchVirtualMemoryFunction)(HANDLE, ULONG_PTR, void*, ULONG);
+
+
+static PrefetchVirtualMemoryFunction getPrefetchVirtualMemory()
+{
+	static PrefetchVirtualMemoryFunction function = (PrefetchVirtualMemoryFunction)::GetProcAddress(
+		::GetModuleHandle("kernel32.dll"), "PrefetchVirtualMemory");
+	return function;
+}
+
+
+void OsFileMapping::prefetch(const Range* ranges, int count)
+{
+	if (count == 0) return;
+
+	// the reads are only queued, or page by page without PrefetchVirtualMemory
+	PrefetchVirtualMemoryFunction function = getPrefetchVirtualMemory();
+	if (function) function(::GetCurrentProcess(), (ULONG_PTR)count, (void*)ranges, 0);
+
+	static const size_t PAGE_SIZE = 4096;
+	uint8 sum = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		const volatile uint8* data = (const volatile uint8*)ranges[i].data;
+		for (size_t offset = 0; offset < ranges[i].size; offset += PAGE_SIZE)
+		{
+			sum += data[offset];
+		}
+	}
+	(void)sum;
+}
+
+
+OsFileMapping::OsFileMapping()
+	: m_data(nullptr)
+	, m_size(0)
+{
+}
+
+
+OsFileMapping::~OsFileMapping()
+{
+	close();
+}
+
+
+bool OsFileMapping::open(const char* path)
+{
+	ASSERT(!m_data);
+	HANDLE file = ::CreateFile(
+		path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size;
+	// empty files can not be mapped
+	if (!::GetFileSizeEx(file, &size) || size.QuadPart == 0)
+	{
+		::CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = ::CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping)
+	{
+		m_data = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		// the view keeps the mapping and the file open
+		::CloseHandle(mapping);
+	}
+	::CloseHandle(file);
+	if (!m_data) return false;
+
+	m_size = (size_t)size.QuadPart;
+	return true;
+}
+
+
+void OsFileMapping::close()
+{
+	if (m_data) ::UnmapViewOfFile(m_data);
+	m_data = nullptr;
+	m_size = 0;
+}
+
+
+void* OsFileMapping::detach(IAllocator** allocator)
+{
+	if (!m_data) return nullptr;
+
+	void* data = (void*)m_data;
+	*allocator = &g_mapped_view_allocator;
+	m_data = nullptr;
+	m_size = 0;
+	return data;
+}
+
+
 } // namespace FS
 } // namespace Lumix
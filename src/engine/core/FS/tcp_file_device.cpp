@@ -1,12 +1,21 @@
 #include "core/fs/tcp_file_device.h"
 #include "core/iallocator.h"
 #include "core/blob.h"
+#include "core/crc32.h"
 #include "core/fs/ifile.h"
 #include "core/fs/ifile_system_defines.h"
 #include "core/fs/file_system.h"
+#include "core/fs/os_file.h"
+#include "core/log.h"
+#include "core/lz4.h"
+#include "core/math_utils.h"
 #include "core/mt/sync.h"
+#include "core/mt/task.h"
+#include "core/mt/thread.h"
 #include "core/path.h"
 #include "core/network.h"
+#include "core/string.h"
+#include "core/system.h"
 
 
 namespace Lumix
@@ -14,18 +23,201 @@ namespace Lumix
 	namespace FS
 	{
 		static const uint32 INVALID_FILE = 0xffffFFFF;
+		static const int MAX_PENDING_REQUESTS = 64;
+		static const uint32 CACHE_MAGIC = 0x5f4c5443; // == '_LTC'
+
+
+		struct TCPRequest
+		{
+			MT::Event* m_done;
+			uint8* m_payload;
+			uint32 m_payload_size;
+			bool m_is_used;
+			bool m_is_failed;
+		};
+
+
+		class TCPReceiverTask : public MT::Task
+		{
+		public:
+			TCPReceiverTask(TCPImpl& impl, IAllocator& allocator)
+				: MT::Task(allocator)
+				, m_impl(impl)
+			{
+			}
+
+			int task() override;
+
+		private:
+			void operator=(const TCPReceiverTask&);
+			TCPReceiverTask(const TCPReceiverTask&);
+
+			TCPImpl& m_impl;
+		};
+
+
+		struct TCPImpl
+		{
+			TCPImpl(IAllocator& allocator)
+				: m_spin_mutex(false)
+				, m_write_mutex(false)
+				, m_allocator(allocator)
+				, m_connector(m_allocator)
+				, m_stream(nullptr)
+				, m_receiver(*this, allocator)
+				, m_is_connected(false)
+				, m_is_compression_enabled(false)
+			{
+				m_cache_dir[0] = '\0';
+				for (auto& request : m_requests)
+				{
+					request.m_done = LUMIX_NEW(m_allocator, MT::Event)(0);
+					request.m_payload = nullptr;
+					request.m_payload_size = 0;
+					request.m_is_used = false;
+					request.m_is_failed = false;
+				}
+			}
+
+
+			~TCPImpl()
+			{
+				for (auto& request : m_requests)
+				{
+					m_allocator.deallocate(request.m_payload);
+					LUMIX_DELETE(m_allocator, request.m_done);
+				}
+			}
+
+
+			// returns the request id, waits if too many requests are in flight
+			int beginRequest()
+			{
+				for (;;)
+				{
+					{
+						MT::SpinLock lock(m_spin_mutex);
+						if (!m_is_connected) return -1;
+						for (int i = 0; i < MAX_PENDING_REQUESTS; ++i)
+						{
+							if (m_requests[i].m_is_used) continue;
+							m_requests[i].m_is_used = true;
+							m_requests[i].m_is_failed = false;
+							return i;
+						}
+					}
+					MT::yield();
+				}
+			}
+
+
+			// requests are sent as one piece, so requests from different threads do not interleave
+			bool send(int request_id, const OutputBlob& request)
+			{
+				MT::SpinLock lock(m_write_mutex);
+				if (m_stream->write(request.getData(), request.getSize())) return true;
+
+				failRequest(request_id);
+				return false;
+			}
+
+
+			// the caller owns the returned payload, nullptr if the connection was lost
+			uint8* waitForResponse(int request_id, uint32& size)
+			{
+				TCPRequest& request = m_requests[request_id];
+				request.m_done->wait();
+
+				MT::SpinLock lock(m_spin_mutex);
+				uint8* payload = request.m_is_failed ? nullptr : request.m_payload;
+				if (!payload) m_allocator.deallocate(request.m_payload);
+				size = request.m_payload_size;
+				request.m_payload = nullptr;
+				request.m_payload_size = 0;
+				request.m_is_used = false;
+				return payload;
+			}
+
+
+			void failRequest(int request_id)
+			{
+				MT::SpinLock lock(m_spin_mutex);
+				m_requests[request_id].m_is_failed = true;
+				m_requests[request_id].m_done->trigger();
+			}
+
+
+			void getCachePath(const Path& path, char* out, int max_size)
+			{
+				char hash[20];
+				toCString(path.getHash(), hash, lengthOf(hash));
+				copyString(out, max_size, m_cache_dir);
+				catString(out, max_size, hash);
+				catString(out, max_size, ".cache");
+			}
+
+
+			IAllocator& m_allocator;
+			Net::TCPConnector m_connector;
+			Net::TCPStream* m_stream;
+			MT::SpinMutex m_spin_mutex;
+			MT::SpinMutex m_write_mutex;
+			TCPRequest m_requests[MAX_PENDING_REQUESTS];
+			TCPReceiverTask m_receiver;
+			volatile bool m_is_connected;
+			bool m_is_compression_enabled;
+			char m_cache_dir[MAX_PATH_LENGTH];
+		};
+
+
+		int TCPReceiverTask::task()
+		{
+			for (;;)
+			{
+				TCPResponseHeader header;
+				if (!m_impl.m_stream->read(&header, sizeof(header))) break;
+				if (header.request_id >= MAX_PENDING_REQUESTS) break;
+
+				uint8* payload = header.size > 0 ? (uint8*)m_impl.m_allocator.allocate(header.size) : nullptr;
+				if (header.size > 0 && !m_impl.m_stream->read(payload, header.size))
+				{
+					m_impl.m_allocator.deallocate(payload);
+					break;
+				}
+
+				MT::SpinLock lock(m_impl.m_spin_mutex);
+				TCPRequest& request = m_impl.m_requests[header.request_id];
+				request.m_payload = payload;
+				request.m_payload_size = header.size;
+				request.m_done->trigger();
+			}
+
+			// nobody answers the requests in flight anymore
+			MT::SpinLock lock(m_impl.m_spin_mutex);
+			m_impl.m_is_connected = false;
+			for (auto& request : m_impl.m_requests)
+			{
+				if (!request.m_is_used) continue;
+				request.m_is_failed = true;
+				request.m_done->trigger();
+			}
+			return 0;
+		}
+
 
 		class TCPFile : public IFile
 		{
 		public:
-			TCPFile(Net::TCPStream* stream, TCPFileDevice& device, MT::SpinMutex& spin_mutex) 
+			TCPFile(TCPImpl& impl, TCPFileDevice& device)
 				: m_device(device)
-				, m_stream(stream)
-				, m_spin_mutex(spin_mutex)
+				, m_impl(impl)
 				, m_file(INVALID_FILE)
+				, m_buffer(nullptr)
+				, m_size(0)
+				, m_pos(0)
 			{}
 
-			~TCPFile() {}
+			~TCPFile() { m_impl.m_allocator.deallocate(m_buffer); }
 
 			IFileDevice& getDevice() override
 			{
@@ -34,138 +226,293 @@ namespace Lumix
 
 			bool open(const Path& path, Mode mode) override
 			{
-				if (!m_stream)
+				if (!m_impl.m_is_connected)
 				{
 					return false;
 				}
 
-				int32 op = TCPCommand::OpenFile;
+				// read-only files are fetched whole in one round trip
+				if (mode == Mode::OPEN_AND_READ) return fetch(path);
 
-				MT::SpinLock lock(m_spin_mutex);
-				m_stream->write(op);
-				m_stream->write(mode);
-				m_stream->writeString(path.c_str());
-				m_stream->read(m_file);
+				OutputBlob request(m_impl.m_allocator);
+				request.write(mode.value);
+				request.writeString(path.c_str());
+				InputResponse response(m_impl);
+				if (!response.call(TCPCommand::OpenFile, request)) return false;
+				response.blob.read(m_file);
 
 				return INVALID_FILE != m_file;
 			}
 
 			void close() override
 			{
+				m_impl.m_allocator.deallocate(m_buffer);
+				m_buffer = nullptr;
+				m_size = m_pos = 0;
 				if (INVALID_FILE != m_file)
 				{
-					int32 op = TCPCommand::Close;
-
-					MT::SpinLock lock(m_spin_mutex);
-					m_stream->write(op);
-					m_stream->write(m_file);
+					OutputBlob request(m_impl.m_allocator);
+					request.write((int32)TCPCommand::Close);
+					request.write((uint32)0);
+					request.write(m_file);
+					MT::SpinLock lock(m_impl.m_write_mutex);
+					m_impl.m_stream->write(request.getData(), request.getSize());
+					m_file = INVALID_FILE;
 				}
 			}
 
 			bool read(void* buffer, size_t size) override
 			{
-				int32 op = TCPCommand::Read;
-
-				MT::SpinLock lock(m_spin_mutex);
-				m_stream->write(op);
-				m_stream->write(m_file);
-				m_stream->write(size);
-
-				m_stream->read(buffer, size);
-				bool successful = false;
-				m_stream->read(successful);
+				if (INVALID_FILE == m_file)
+				{
+					size_t amount = Math::minValue(size, m_size - m_pos);
+					copyMemory(buffer, m_buffer + m_pos, (int)amount);
+					m_pos += amount;
+					return amount == size;
+				}
 
-				return successful;
+				OutputBlob request(m_impl.m_allocator);
+				request.write(m_file);
+				request.write((uint32)size);
+				InputResponse response(m_impl);
+				if (!response.call(TCPCommand::Read, request)) return false;
+				// the data are followed by the success flag
+				if (response.size != size + 1) return false;
+				copyMemory(buffer, response.payload, (int)size);
+				return response.payload[size] != 0;
 			}
 
 			bool write(const void* buffer, size_t size) override
 			{
-				int32 op = TCPCommand::Write;
+				if (INVALID_FILE == m_file) return false;
+
+				OutputBlob request(m_impl.m_allocator);
+				request.write(m_file);
+				request.write((uint32)size);
+				request.write(buffer, (int)size);
+				InputResponse response(m_impl);
+				if (!response.call(TCPCommand::Write, request)) return false;
+				return response.blob.read<bool>();
+			}
 
-				MT::SpinLock lock(m_spin_mutex);
-				m_stream->write(op);
-				m_stream->write(m_file);
-				m_stream->write(size);
-				m_stream->write(buffer, size);
+			const void* getBuffer() const override
+			{
+				return m_buffer;
+			}
 
-				bool successful = false;
-				m_stream->read(successful);
+			void* detachBuffer(IAllocator** allocator) override
+			{
+				if (!m_buffer) return nullptr;
 
-				return successful;
+				void* buffer = m_buffer;
+				*allocator = &m_impl.m_allocator;
+				m_buffer = nullptr;
+				m_size = m_pos = 0;
+				return buffer;
 			}
 
-			const void* getBuffer() const override
+			size_t size() override
 			{
-				return nullptr;
+				if (INVALID_FILE == m_file) return m_size;
+
+				OutputBlob request(m_impl.m_allocator);
+				request.write(m_file);
+				InputResponse response(m_impl);
+				if (!response.call(TCPCommand::Size, request)) return 0;
+				return (size_t)response.blob.read<uint32>();
 			}
 
-			size_t size() override
+			size_t seek(SeekMode base, size_t pos) override
 			{
-				int32 op = TCPCommand::Size;
-				uint32 size = 0;
+				if (INVALID_FILE == m_file)
+				{
+					switch (base)
+					{
+						case SeekMode::BEGIN: m_pos = pos; break;
+						case SeekMode::CURRENT: m_pos += pos; break;
+						case SeekMode::END: m_pos = m_size - pos; break;
+						default: ASSERT(false); break;
+					}
+					m_pos = Math::minValue(m_pos, m_size);
+					return m_pos;
+				}
 
-				MT::SpinLock lock(m_spin_mutex);
-				m_stream->write(op);
-				m_stream->write(m_file);
+				OutputBlob request(m_impl.m_allocator);
+				request.write(m_file);
+				request.write(base.value);
+				request.write((int32)pos);
+				InputResponse response(m_impl);
+				if (!response.call(TCPCommand::Seek, request)) return 0;
+				return (size_t)response.blob.read<uint32>();
+			}
 
-				m_stream->read(size);
+			size_t pos() override
+			{
+				if (INVALID_FILE == m_file) return m_pos;
 
-				return (size_t)size;
+				OutputBlob request(m_impl.m_allocator);
+				request.write(m_file);
+				InputResponse response(m_impl);
+				if (!response.call(TCPCommand::Pos, request)) return 0;
+				return (size_t)response.blob.read<uint32>();
 			}
 
-			size_t seek(SeekMode base, size_t pos) override
+		private:
+			struct InputResponse
 			{
-				int32 op = TCPCommand::Seek;
+				InputResponse(TCPImpl& impl)
+					: impl(impl)
+					, payload(nullptr)
+					, size(0)
+					, blob(nullptr, 0)
+				{
+				}
 
-				MT::SpinLock lock(m_spin_mutex);
-				m_stream->write(op);
-				m_stream->write(m_file);
-				m_stream->write(base);
-				m_stream->write(pos);
+				~InputResponse() { impl.m_allocator.deallocate(payload); }
 
-				int32 ret = 0;
-				m_stream->read(ret);
+				bool call(TCPCommand command, const OutputBlob& args)
+				{
+					int request_id = impl.beginRequest();
+					if (request_id < 0) return false;
+
+					OutputBlob request(impl.m_allocator);
+					request.reserve(args.getSize() + 8);
+					request.write(command.value);
+					request.write((uint32)request_id);
+					request.write(args.getData(), args.getSize());
+					impl.send(request_id, request);
+					payload = impl.waitForResponse(request_id, size);
+					blob = InputBlob(payload, (int)size);
+					return payload != nullptr;
+				}
+
+				TCPImpl& impl;
+				uint8* payload;
+				uint32 size;
+				InputBlob blob;
+
+			private:
+				void operator=(const InputResponse&);
+			};
 
-				return (size_t)ret;
+
+			bool readCache(const Path& path, uint32& hash)
+			{
+				if (m_impl.m_cache_dir[0] == '\0') return false;
+
+				char cache_path[MAX_PATH_LENGTH];
+				m_impl.getCachePath(path, cache_path, lengthOf(cache_path));
+				OsFile file;
+				if (!file.open(cache_path, Mode::OPEN_AND_READ, m_impl.m_allocator)) return false;
+
+				uint32 header[3];
+				bool success = file.read(header, sizeof(header)) && header[0] == CACHE_MAGIC;
+				if (success)
+				{
+					hash = header[1];
+					m_size = header[2];
+					m_buffer = (uint8*)m_impl.m_allocator.allocate(m_size);
+					success = file.read(m_buffer, m_size);
+					// the server hashes the data the same way, a damaged cache would be
+					// reported as not modified
+					success = success && (m_size > 0 ? crc32(m_buffer, m_size) : 0) == hash;
+				}
+				file.close();
+				if (!success)
+				{
+					m_impl.m_allocator.deallocate(m_buffer);
+					m_buffer = nullptr;
+					m_size = 0;
+				}
+				return success;
 			}
 
-			size_t pos() override
+
+			void writeCache(const Path& path, uint32 hash)
 			{
-				int32 op = TCPCommand::Seek;
-				int32 pos = 0;
+				if (m_impl.m_cache_dir[0] == '\0') return;
+
+				char cache_path[MAX_PATH_LENGTH];
+				m_impl.getCachePath(path, cache_path, lengthOf(cache_path));
+				// concurrent fetches of the same file write their own temporary files,
+				// the cache is replaced at once, so it is never read half written
+				char tmp_path[MAX_PATH_LENGTH];
+				char thread_id[20];
+				toCString(MT::getCurrentThreadID(), thread_id, lengthOf(thread_id));
+				copyString(tmp_path, cache_path);
+				catString(tmp_path, ".");
+				catString(tmp_path, thread_id);
+				catString(tmp_path, ".tmp");
+				OsFile file;
+				if (!file.open(tmp_path, Mode::CREATE | Mode::WRITE, m_impl.m_allocator)) return;
+
+				uint32 header[] = { CACHE_MAGIC, hash, (uint32)m_size };
+				bool success = file.write(header, sizeof(header)) && file.write(m_buffer, m_size);
+				file.close();
+				if (!success || !moveFile(tmp_path, cache_path)) deleteFile(tmp_path);
+			}
 
-				MT::SpinLock lock(m_spin_mutex);
-				m_stream->write(op);
-				m_stream->write(m_file);
 
-				m_stream->read(pos);
+			bool fetch(const Path& path)
+			{
+				uint32 cached_hash = 0;
+				bool is_cached = readCache(path, cached_hash);
+
+				uint32 flags = m_impl.m_is_compression_enabled ? TCPFetchResult::COMPRESS : 0;
+				if (is_cached) flags |= TCPFetchResult::CACHED;
+				OutputBlob request(m_impl.m_allocator);
+				request.write(flags);
+				request.write(cached_hash);
+				request.writeString(path.c_str());
+				InputResponse response(m_impl);
+				bool success = response.call(TCPCommand::Fetch, request);
+
+				TCPFetchResult result;
+				success = success && response.blob.read(&result, sizeof(result));
+				if (success && result.status == TCPFetchResult::NOT_MODIFIED && is_cached)
+				{
+					m_pos = 0;
+					return true;
+				}
 
-				return (size_t)pos;
+				m_impl.m_allocator.deallocate(m_buffer);
+				m_buffer = nullptr;
+				m_size = m_pos = 0;
+				if (!success || result.status == TCPFetchResult::NOT_FOUND) return false;
+
+				if (response.size != sizeof(result) + result.packed_size) return false;
+				const void* packed = response.blob.skip(result.packed_size);
+
+				m_buffer = (uint8*)m_impl.m_allocator.allocate(result.size);
+				m_size = result.size;
+				if (result.status == TCPFetchResult::COMPRESSED_DATA)
+				{
+					if (LZ4::decompress(packed, result.packed_size, m_buffer, result.size) != (int)result.size)
+					{
+						g_log_error.log("engine") << "Corrupted data received for " << path.c_str();
+						m_impl.m_allocator.deallocate(m_buffer);
+						m_buffer = nullptr;
+						m_size = 0;
+						return false;
+					}
+				}
+				else
+				{
+					copyMemory(m_buffer, packed, result.size);
+				}
+				writeCache(path, result.hash);
+				return true;
 			}
 
-		private:
 			void operator=(const TCPFile&);
 			TCPFile(const TCPFile&);
 
 			TCPFileDevice& m_device;
-			Net::TCPStream* m_stream;
-			MT::SpinMutex& m_spin_mutex;
+			TCPImpl& m_impl;
 			uint32 m_file;
-		};
-
-		struct TCPImpl
-		{
-			TCPImpl(IAllocator& allocator)
-				: m_spin_mutex(false)
-				, m_allocator(allocator)
-				, m_connector(m_allocator)
-				, m_stream(nullptr)
-			{}
-
-			IAllocator& m_allocator;
-			Net::TCPConnector m_connector;
-			Net::TCPStream* m_stream;
-			MT::SpinMutex m_spin_mutex;
+			uint8* m_buffer;
+			size_t m_size;
+			size_t m_pos;
 		};
 
 		TCPFileDevice::TCPFileDevice()
@@ -175,7 +522,7 @@ namespace Lumix
 
 		IFile* TCPFileDevice::createFile(IFile*)
 		{
-			return LUMIX_NEW(m_impl->m_allocator, TCPFile)(m_impl->m_stream, *this, m_impl->m_spin_mutex);
+			return LUMIX_NEW(m_impl->m_allocator, TCPFile)(*m_impl, *this);
 		}
 
 		void TCPFileDevice::destroyFile(IFile* file)
@@ -187,13 +534,48 @@ namespace Lumix
 		{
 			m_impl = LUMIX_NEW(allocator, TCPImpl)(allocator);
 			m_impl->m_stream = m_impl->m_connector.connect(ip, port);
+			if (!m_impl->m_stream) return;
+
+			// responses are read by their own thread, so requests do not wait for each other
+			m_impl->m_is_connected = true;
+			m_impl->m_receiver.create("TCP file device receiver");
+			m_impl->m_receiver.run();
 		}
 
 		void TCPFileDevice::disconnect()
 		{
-			m_impl->m_stream->write(TCPCommand::Disconnect);
-			m_impl->m_connector.close(m_impl->m_stream);
+			if (m_impl->m_stream)
+			{
+				m_impl->m_stream->write((int32)TCPCommand::Disconnect);
+				m_impl->m_stream->write((uint32)0);
+				// the server closes the connection, which stops the receiver
+				m_impl->m_receiver.destroy();
+				m_impl->m_connector.close(m_impl->m_stream);
+			}
 			LUMIX_DELETE(m_impl->m_allocator, m_impl);
+			m_impl = nullptr;
+		}
+
+		bool TCPFileDevice::isReadCached() const
+		{
+			return m_impl->m_cache_dir[0] != '\0';
+		}
+
+		void TCPFileDevice::setCacheDir(const char* cache_dir)
+		{
+			copyString(m_impl->m_cache_dir, cache_dir);
+			int len = stringLength(m_impl->m_cache_dir);
+			if (len > 0 && m_impl->m_cache_dir[len - 1] != '/') catString(m_impl->m_cache_dir, "/");
+		}
+
+		void TCPFileDevice::enableCompression(bool enable)
+		{
+			m_impl->m_is_compression_enabled = enable;
+		}
+
+		Net::TCPStream* TCPFileDevice::getStream()
+		{
+			return m_impl ? m_impl->m_stream : nullptr;
 		}
 	} // namespace FS
 } // ~namespace Lumix
@@ -18,6 +18,7 @@ namespace Lumix
 		class TCPFileSystemTask;
 		struct TCPImpl;
 
+		// every request is the command, the request id and the command's arguments
 		struct TCPCommand
 		{
 			enum Value
@@ -30,6 +31,7 @@ namespace Lumix
 				Seek,
 				Pos,
 				Disconnect,
+				Fetch,
 			};
 
 			TCPCommand() : value(0) {}
@@ -39,6 +41,38 @@ namespace Lumix
 			int32 value;
 		};
 
+		// responses are matched to requests by request_id, so many requests can be in flight,
+		// Close and Disconnect have no response
+		struct TCPResponseHeader
+		{
+			uint32 request_id;
+			uint32 size;
+		};
+
+		// Fetch sends a whole file in one response, the client sends the hash of its cached copy
+		// so an unchanged file is not sent again
+		struct TCPFetchResult
+		{
+			enum Status : int32
+			{
+				NOT_FOUND,
+				NOT_MODIFIED,
+				DATA,
+				COMPRESSED_DATA
+			};
+
+			enum Flags : uint32
+			{
+				COMPRESS = 1 << 0,
+				CACHED = 1 << 1
+			};
+
+			int32 status;
+			uint32 hash;
+			uint32 size;
+			uint32 packed_size;
+		};
+
 		class LUMIX_ENGINE_API TCPFileDevice : public IFileDevice
 		{
 		public:
@@ -47,9 +81,13 @@ namespace Lumix
 			void destroyFile(IFile* file) override;
 			IFile* createFile(IFile* child) override;
 			const char* name() const override { return "tcp"; }
+			bool isReadCached() const override;
 
 			void connect(const char* ip, uint16 port, IAllocator& allocator);
 			void disconnect();
+			// fetched files are kept in cache_dir, which must exist, and revalidated by their hash
+			void setCacheDir(const char* cache_dir);
+			void enableCompression(bool enable);
 
 			Net::TCPStream* getStream();
 
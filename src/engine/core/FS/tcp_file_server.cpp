@@ -1,14 +1,20 @@
 #include "core/fs/tcp_file_server.h"
 
 #include "core/array.h"
-#include "core/free_list.h"
+#include "core/blob.h"
+#include "core/crc32.h"
 #include "core/fs/os_file.h"
 #include "core/fs/tcp_file_device.h"
+#include "core/log.h"
+#include "core/lz4.h"
+#include "core/math_utils.h"
+#include "core/mt/atomic.h"
+#include "core/mt/sync.h"
 #include "core/mt/task.h"
+#include "core/mt/thread.h"
 #include "core/path.h"
 #include "core/profiler.h"
 #include "core/stack_allocator.h"
-#include "core/static_array.h"
 #include "core/string.h"
 #include "core/network.h"
 
@@ -21,12 +27,190 @@ namespace FS
 {
 
 
+// the first poll item is the acceptor
+static const int MAX_CLIENTS = Net::MAX_POLL_ITEMS - 1;
+static const int MAX_WORKERS = 8;
+static const int POLL_TIMEOUT_MS = 100;
+// a client which does not read its responses holds a worker at most this long
+static const int SEND_TIMEOUT_MS = 5000;
+static const int RECEIVE_BUFFER_SIZE = 64 * 1024;
+static const uint32 MAX_WRITE_SIZE = 64 * 1024 * 1024;
+
+
+class TCPFileServerTask;
+struct TCPJob;
+
+
+struct TCPClient
+{
+	TCPClient(Net::TCPStream* stream, IAllocator& allocator)
+		: m_stream(stream)
+		, m_received(allocator)
+		, m_files(allocator)
+		, m_blocked_jobs(allocator)
+		, m_write_mutex(false)
+		, m_files_mutex(false)
+		, m_active_job_count(0)
+		, m_is_closing(false)
+		, m_is_broken(false)
+		, m_ref_count(1)
+	{
+	}
+
+
+	int32 addFile(OsFile* file)
+	{
+		MT::SpinLock lock(m_files_mutex);
+		for (int i = 0; i < m_files.size(); ++i)
+		{
+			if (!m_files[i])
+			{
+				m_files[i] = file;
+				return i;
+			}
+		}
+		m_files.push(file);
+		return m_files.size() - 1;
+	}
+
+
+	OsFile* getFile(uint32 id)
+	{
+		MT::SpinLock lock(m_files_mutex);
+		return id < (uint32)m_files.size() ? m_files[id] : nullptr;
+	}
+
+
+	OsFile* removeFile(uint32 id)
+	{
+		MT::SpinLock lock(m_files_mutex);
+		if (id >= (uint32)m_files.size()) return nullptr;
+		OsFile* file = m_files[id];
+		m_files[id] = nullptr;
+		return file;
+	}
+
+
+	Net::TCPStream* m_stream;
+	// received bytes of requests which are not complete yet
+	Array<uint8> m_received;
+	// indexed by the id the client uses
+	Array<OsFile*> m_files;
+	// jobs waiting for a close, they are queued in the order the client sent them,
+	// guarded by the server's jobs mutex like the members below
+	Array<TCPJob*> m_blocked_jobs;
+	// sending a response can block, so this is not a spin mutex
+	MT::Mutex m_write_mutex;
+	MT::SpinMutex m_files_mutex;
+	// jobs queued for the workers or running
+	int m_active_job_count;
+	// a close runs alone, the client does not wait for its response
+	bool m_is_closing;
+	// a send failed, the rest of the responses are dropped and the server disconnects the client
+	volatile bool m_is_broken;
+	// the server and every queued job of the client hold a reference
+	volatile int32 m_ref_count;
+};
+
+
+struct TCPJob
+{
+	TCPJob(TCPClient& client, IAllocator& allocator)
+		: m_client(client)
+		, m_data(allocator)
+		, m_op(0)
+		, m_request_id(0)
+		, m_file(0)
+		, m_mode(0)
+		, m_flags(0)
+		, m_hash(0)
+		, m_size(0)
+		, m_base(0)
+		, m_offset(0)
+	{
+		m_path[0] = '\0';
+	}
+
+
+	TCPClient& m_client;
+	Array<uint8> m_data;
+	int32 m_op;
+	uint32 m_request_id;
+	uint32 m_file;
+	int32 m_mode;
+	uint32 m_flags;
+	uint32 m_hash;
+	uint32 m_size;
+	uint32 m_base;
+	int32 m_offset;
+	char m_path[MAX_PATH_LENGTH];
+
+private:
+	void operator=(const TCPJob&);
+};
+
+
+// executes the requests, so slow disk reads of one client do not block the others
+class TCPFileServerWorker : public MT::Task
+{
+public:
+	TCPFileServerWorker(TCPFileServerTask& server, IAllocator& allocator)
+		: MT::Task(allocator)
+		, m_server(server)
+		, m_response(allocator)
+		, m_file_data(allocator)
+		, m_packed_data(allocator)
+	{
+	}
+
+
+	int task() override;
+
+private:
+	void execute(TCPJob& job);
+	void beginResponse(const TCPJob& job, uint32 size);
+	void sendResponse(TCPClient& client, const void* payload = nullptr, uint32 payload_size = 0);
+	void openFile(TCPJob& job);
+	void fetch(TCPJob& job);
+	void read(TCPJob& job);
+	void write(TCPJob& job);
+	void close(TCPJob& job);
+	void seek(TCPJob& job);
+	void size(TCPJob& job);
+	void pos(TCPJob& job);
+
+	void operator=(const TCPFileServerWorker&);
+	TCPFileServerWorker(const TCPFileServerWorker&);
+
+private:
+	TCPFileServerTask& m_server;
+	OutputBlob m_response;
+	Array<uint8> m_file_data;
+	Array<uint8> m_packed_data;
+};
+
+
+// waits for requests of all the clients and queues them for the workers
 class TCPFileServerTask : public MT::Task
 {
+public:
+	enum class ParseResult
+	{
+		DONE,
+		INCOMPLETE,
+		INVALID
+	};
+
 public:
 	TCPFileServerTask(IAllocator& allocator)
 		: MT::Task(allocator)
 		, m_acceptor(allocator)
+		, m_clients(allocator)
+		, m_workers(allocator)
+		, m_jobs(allocator)
+		, m_jobs_mutex(false)
+		, m_job_signal(0, 0x7fffFFFF)
+		, m_is_quitting(false)
 	{
 	}
 
@@ -36,210 +220,564 @@ public:
 	}
 
 
-	void openFile(Net::TCPStream* stream)
+	void getFullPath(const char* path, char* out, int max_size)
 	{
-		int32 mode = 0;
-		stream->read(mode);
-		stream->readString(m_buffer.data(), m_buffer.size());
+		if (compareStringN(path, m_base_path.c_str(), m_base_path.length()) != 0)
+		{
+			copyString(out, max_size, m_base_path.c_str());
+			catString(out, max_size, path);
+		}
+		else
+		{
+			copyString(out, max_size, path);
+		}
+	}
+
+
+	// returns nullptr when the server stops
+	TCPJob* popJob()
+	{
+		m_job_signal.wait();
+		MT::SpinLock lock(m_jobs_mutex);
+		if (m_is_quitting || m_jobs.empty()) return nullptr;
+		TCPJob* job = m_jobs[0];
+		m_jobs.erase(0);
+		return job;
+	}
+
+
+	void finishJob(TCPJob* job)
+	{
+		TCPClient& client = job->m_client;
+		int dispatched_count = 0;
+		{
+			MT::SpinLock lock(m_jobs_mutex);
+			--client.m_active_job_count;
+			if (job->m_op == TCPCommand::Close) client.m_is_closing = false;
+			while (!client.m_blocked_jobs.empty() && canDispatch(*client.m_blocked_jobs[0]))
+			{
+				dispatch(client.m_blocked_jobs[0]);
+				client.m_blocked_jobs.erase(0);
+				++dispatched_count;
+			}
+		}
+		for (int i = 0; i < dispatched_count; ++i) m_job_signal.signal();
+		discardJob(job);
+	}
+
+
+	void discardJob(TCPJob* job)
+	{
+		TCPClient& client = job->m_client;
+		LUMIX_DELETE(getAllocator(), job);
+		releaseClient(client);
+	}
+
+
+	void releaseClient(TCPClient& client)
+	{
+		if (MT::atomicDecrement(&client.m_ref_count) > 0) return;
+
+		// files the client did not close
+		for (auto* file : client.m_files)
+		{
+			if (!file) continue;
+			file->close();
+			LUMIX_DELETE(getAllocator(), file);
+		}
+		m_acceptor.close(client.m_stream);
+		LUMIX_DELETE(getAllocator(), &client);
+	}
+
+
+	int task() override
+	{
+		if (!m_acceptor.start("127.0.0.1", 10001))
+		{
+			g_log_error.log("engine") << "Could not start the file server";
+			return -1;
+		}
 
-		int32 ret = -2;
-		int32 id = m_ids.alloc();
-		if (id > 0)
+		int worker_count = Math::clamp((int)MT::getCPUsCount(), 1, MAX_WORKERS);
+		for (int i = 0; i < worker_count; ++i)
 		{
-			OsFile* file = LUMIX_NEW(getAllocator(), OsFile)();
-			m_files[id] = file;
+			auto* worker = LUMIX_NEW(getAllocator(), TCPFileServerWorker)(*this, getAllocator());
+			worker->create("TCP File Server Worker");
+			worker->run();
+			m_workers.push(worker);
+		}
 
-			char path[MAX_PATH_LENGTH];
-			if (compareStringN(m_buffer.data(), m_base_path.c_str(), m_base_path.length()) != 0)
+		Net::PollItem items[Net::MAX_POLL_ITEMS];
+		while (!m_is_quitting)
+		{
+			items[0].socket = m_acceptor.getSocket();
+			for (int i = 0; i < m_clients.size(); ++i)
 			{
-				copyString(path, m_base_path.c_str());
-				catString(path, m_buffer.data());
+				items[i + 1].socket = m_clients[i]->m_stream->getSocket();
 			}
-			else
+
+			int ready_count = Net::poll(items, m_clients.size() + 1, POLL_TIMEOUT_MS);
+			if (ready_count < 0)
 			{
-				copyString(path, m_buffer.data());
+				g_log_error.log("engine") << "File server could not wait for requests";
+				break;
 			}
-			ret = file->open(path, mode, getAllocator()) ? id : -1;
-			if (ret == -1)
+			if (ready_count == 0) continue;
+
+			PROFILE_BLOCK("File server receive")
+			for (int i = m_clients.size() - 1; i >= 0; --i)
 			{
-				m_ids.release(id);
-				file->close();
-				LUMIX_DELETE(getAllocator(), file);
+				TCPClient& client = *m_clients[i];
+				if (client.m_is_broken || (items[i + 1].is_ready && !receive(client)))
+				{
+					releaseClient(client);
+					m_clients.eraseFast(i);
+				}
 			}
+			if (items[0].is_ready) accept();
+		}
+
+		stopWorkers();
+		// a client has blocked jobs only while it has an active one
+		for (auto* job : m_jobs)
+		{
+			for (auto* blocked : job->m_client.m_blocked_jobs) discardJob(blocked);
+			job->m_client.m_blocked_jobs.clear();
+			discardJob(job);
 		}
-		stream->write(ret);
+		m_jobs.clear();
+		for (auto* client : m_clients) releaseClient(*client);
+		m_clients.clear();
+		return 0;
 	}
 
 
-	void read(Net::TCPStream* stream)
-	{
-		bool read_successful = true;
-		uint32 id = 0xffffFFFF;
-		stream->read(id);
-		OsFile* file = m_files[id];
+	void stop() { m_is_quitting = true; }
 
-		uint32 size = 0;
-		stream->read(size);
 
-		while (size > 0)
+	void setBasePath(const char* base_path)
+	{
+		StackAllocator<MAX_PATH_LENGTH> allocator;
+		string base_path_str(base_path, allocator);
+		if (base_path_str[base_path_str.length() - 1] != '/')
 		{
-			int32 read = (int32)size > m_buffer.size() ? m_buffer.size()
-														   : (int32)size;
-			read_successful &= file->read((void*)m_buffer.data(), read);
-			stream->write((const void*)m_buffer.data(), read);
-			size -= read;
+			base_path_str += "/";
 		}
+		m_base_path = base_path_str.c_str();
+	}
+
+
+	const char* getBasePath() const { return m_base_path.c_str(); }
 
-		stream->write(read_successful);
+private:
+	void accept()
+	{
+		Net::TCPStream* stream = m_acceptor.accept();
+		if (!stream)
+		{
+			g_log_warning.log("engine") << "File server could not accept a client";
+			return;
+		}
+		if (m_clients.size() == MAX_CLIENTS)
+		{
+			g_log_warning.log("engine") << "File server has too many clients";
+			m_acceptor.close(stream);
+			return;
+		}
+		if (!stream->setSendTimeout(SEND_TIMEOUT_MS))
+		{
+			g_log_warning.log("engine") << "File server could not set up a client";
+			m_acceptor.close(stream);
+			return;
+		}
+		m_clients.push(LUMIX_NEW(getAllocator(), TCPClient)(stream, getAllocator()));
 	}
 
 
-	void close(Net::TCPStream* stream)
+	void stopWorkers()
 	{
-		uint32 id = 0xffffFFFF;
-		stream->read(id);
-		OsFile* file = m_files[id];
-		m_ids.release(id);
+		{
+			MT::SpinLock lock(m_jobs_mutex);
+			m_is_quitting = true;
+		}
+		for (int i = 0; i < m_workers.size(); ++i) m_job_signal.signal();
+		for (auto* worker : m_workers)
+		{
+			worker->destroy();
+			LUMIX_DELETE(getAllocator(), worker);
+		}
+		m_workers.clear();
+	}
 
-		file->close();
-		LUMIX_DELETE(getAllocator(), file);
+
+	// jobs of one client run in parallel, except a close, which waits for the earlier jobs
+	// and blocks the later ones, e.g. a fetch of the file being closed
+	bool canDispatch(const TCPJob& job) const
+	{
+		const TCPClient& client = job.m_client;
+		if (client.m_is_closing) return false;
+		return job.m_op != TCPCommand::Close || client.m_active_job_count == 0;
 	}
 
 
-	void write(Net::TCPStream* stream)
+	void dispatch(TCPJob* job)
 	{
-		bool write_successful = true;
-		uint32 id = 0xffffFFFF;
-		stream->read(id);
-		OsFile* file = m_files[id];
+		++job->m_client.m_active_job_count;
+		if (job->m_op == TCPCommand::Close) job->m_client.m_is_closing = true;
+		m_jobs.push(job);
+	}
 
-		uint32 size = 0;
-		stream->read(size);
 
-		while (size > 0)
+	void pushJob(TCPJob* job)
+	{
+		MT::atomicIncrement(&job->m_client.m_ref_count);
 		{
-			int32 read = (int32)size > m_buffer.size() ? m_buffer.size()
-														   : (int32)size;
-			write_successful &= stream->read((void*)m_buffer.data(), read);
-			file->write(m_buffer.data(), read);
-			size -= read;
+			MT::SpinLock lock(m_jobs_mutex);
+			if (!job->m_client.m_blocked_jobs.empty() || !canDispatch(*job))
+			{
+				job->m_client.m_blocked_jobs.push(job);
+				return;
+			}
+			dispatch(job);
 		}
-
-		stream->write(write_successful);
+		m_job_signal.signal();
 	}
 
 
-	void seek(Net::TCPStream* stream)
+	static ParseResult readPath(InputBlob& blob, char* path)
 	{
-		uint32 id = 0xffffFFFF;
-		stream->read(id);
-		OsFile* file = m_files[id];
+		int32 size = 0;
+		if (!blob.read(&size, sizeof(size))) return ParseResult::INCOMPLETE;
+		if (size <= 0 || size > MAX_PATH_LENGTH) return ParseResult::INVALID;
+		if (!blob.read(path, size)) return ParseResult::INCOMPLETE;
+		path[size - 1] = '\0';
+		return ParseResult::DONE;
+	}
 
-		uint32 base = 0;
-		int32 offset = 0;
-		stream->read(base);
-		stream->read(offset);
 
-		uint32 pos = (uint32)file->seek((SeekMode)base, offset);
-		stream->write(pos);
+	static ParseResult parseRequest(InputBlob& blob, TCPJob& job)
+	{
+		if (!blob.read(&job.m_op, sizeof(job.m_op)) ||
+			!blob.read(&job.m_request_id, sizeof(job.m_request_id)))
+		{
+			return ParseResult::INCOMPLETE;
+		}
+
+		bool is_complete = true;
+		switch (job.m_op)
+		{
+			case TCPCommand::OpenFile:
+				if (!blob.read(&job.m_mode, sizeof(job.m_mode))) return ParseResult::INCOMPLETE;
+				return readPath(blob, job.m_path);
+			case TCPCommand::Fetch:
+				if (!blob.read(&job.m_flags, sizeof(job.m_flags)) ||
+					!blob.read(&job.m_hash, sizeof(job.m_hash)))
+				{
+					return ParseResult::INCOMPLETE;
+				}
+				return readPath(blob, job.m_path);
+			case TCPCommand::Close:
+			case TCPCommand::Size:
+			case TCPCommand::Pos:
+				is_complete = blob.read(&job.m_file, sizeof(job.m_file));
+				break;
+			case TCPCommand::Read:
+				if (!blob.read(&job.m_file, sizeof(job.m_file)) ||
+					!blob.read(&job.m_size, sizeof(job.m_size)))
+				{
+					return ParseResult::INCOMPLETE;
+				}
+				// the response buffer is allocated by the size the client asks for
+				if (job.m_size > MAX_WRITE_SIZE) return ParseResult::INVALID;
+				break;
+			case TCPCommand::Write:
+				if (!blob.read(&job.m_file, sizeof(job.m_file)) ||
+					!blob.read(&job.m_size, sizeof(job.m_size)))
+				{
+					return ParseResult::INCOMPLETE;
+				}
+				if (job.m_size > MAX_WRITE_SIZE) return ParseResult::INVALID;
+				if ((uint32)(blob.getSize() - blob.getPosition()) < job.m_size)
+				{
+					return ParseResult::INCOMPLETE;
+				}
+				job.m_data.resize(job.m_size);
+				if (job.m_size > 0) blob.read(&job.m_data[0], job.m_size);
+				break;
+			case TCPCommand::Seek:
+				is_complete = blob.read(&job.m_file, sizeof(job.m_file)) &&
+							  blob.read(&job.m_base, sizeof(job.m_base)) &&
+							  blob.read(&job.m_offset, sizeof(job.m_offset));
+				break;
+			case TCPCommand::Disconnect:
+				break;
+			default:
+				return ParseResult::INVALID;
+		}
+		return is_complete ? ParseResult::DONE : ParseResult::INCOMPLETE;
 	}
 
 
-	void size(Net::TCPStream* stream)
+	// returns false when the client should be disconnected
+	bool receive(TCPClient& client)
 	{
-		uint32 id = 0xffffFFFF;
-		stream->read(id);
-		OsFile* file = m_files[id];
+		int received = client.m_stream->readSome(m_receive_buffer, sizeof(m_receive_buffer));
+		if (received <= 0) return false;
+
+		Array<uint8>& data = client.m_received;
+		int old_size = data.size();
+		data.resize(old_size + received);
+		copyMemory(&data[old_size], m_receive_buffer, received);
+
+		// one receive can contain many requests, the last one can be incomplete
+		InputBlob blob(&data[0], data.size());
+		int parsed_size = 0;
+		for (;;)
+		{
+			TCPJob* job = LUMIX_NEW(getAllocator(), TCPJob)(client, getAllocator());
+			ParseResult result = parseRequest(blob, *job);
+			if (result == ParseResult::INCOMPLETE)
+			{
+				LUMIX_DELETE(getAllocator(), job);
+				break;
+			}
+			if (result == ParseResult::INVALID || job->m_op == TCPCommand::Disconnect)
+			{
+				if (result == ParseResult::INVALID)
+				{
+					g_log_error.log("engine") << "File server received an invalid request";
+				}
+				LUMIX_DELETE(getAllocator(), job);
+				return false;
+			}
+			parsed_size = blob.getPosition();
+			pushJob(job);
+		}
 
-		uint32 size = (uint32)file->size();
-		stream->write(size);
+		int rest = data.size() - parsed_size;
+		if (rest > 0 && parsed_size > 0) moveMemory(&data[0], &data[parsed_size], rest);
+		data.resize(rest);
+		return true;
 	}
 
+private:
+	Net::TCPAcceptor m_acceptor;
+	Array<TCPClient*> m_clients;
+	Array<TCPFileServerWorker*> m_workers;
+	Array<TCPJob*> m_jobs;
+	MT::SpinMutex m_jobs_mutex;
+	MT::Semaphore m_job_signal;
+	volatile bool m_is_quitting;
+	uint8 m_receive_buffer[RECEIVE_BUFFER_SIZE];
+	Path m_base_path;
+};
+
 
-	void pos(Net::TCPStream* stream)
+int TCPFileServerWorker::task()
+{
+	while (TCPJob* job = m_server.popJob())
 	{
-		uint32 id = 0xffffFFFF;
-		stream->read(id);
-		OsFile* file = m_files[id];
+		PROFILE_BLOCK("File server operation")
+		execute(*job);
+		m_server.finishJob(job);
+	}
+	return 0;
+}
+
 
-		uint32 pos = (uint32)file->pos();
-		stream->write(pos);
+void TCPFileServerWorker::execute(TCPJob& job)
+{
+	switch (job.m_op)
+	{
+		case TCPCommand::OpenFile: openFile(job); break;
+		case TCPCommand::Close: close(job); break;
+		case TCPCommand::Read: read(job); break;
+		case TCPCommand::Write: write(job); break;
+		case TCPCommand::Size: size(job); break;
+		case TCPCommand::Seek: seek(job); break;
+		case TCPCommand::Pos: pos(job); break;
+		case TCPCommand::Fetch: fetch(job); break;
+		default: ASSERT(false); break;
 	}
+}
 
 
-	int task()
+void TCPFileServerWorker::beginResponse(const TCPJob& job, uint32 size)
+{
+	TCPResponseHeader header = {job.m_request_id, size};
+	m_response.clear();
+	m_response.write(&header, sizeof(header));
+}
+
+
+// the response and the payload are sent at once, so small writes do not wait for acks
+void TCPFileServerWorker::sendResponse(TCPClient& client, const void* payload, uint32 payload_size)
+{
+	Net::TCPStream::Buffer buffers[] = {
+		{m_response.getData(), (size_t)m_response.getSize()}, {payload, payload_size}};
+	MT::Lock lock(client.m_write_mutex);
+	// a stalled send times out, so the workers are not held by a client which stopped reading
+	if (client.m_is_broken) return;
+	if (!client.m_stream->write(buffers, payload_size > 0 ? 2 : 1))
 	{
-		bool quit = false;
+		g_log_warning.log("engine") << "File server could not send a response";
+		client.m_is_broken = true;
+	}
+}
 
-		m_acceptor.start("127.0.0.1", 10001);
-		Net::TCPStream* stream = m_acceptor.accept();
 
-		while (!quit)
+void TCPFileServerWorker::openFile(TCPJob& job)
+{
+	char path[MAX_PATH_LENGTH];
+	m_server.getFullPath(job.m_path, path, lengthOf(path));
+
+	int32 ret = -1;
+	OsFile* file = LUMIX_NEW(getAllocator(), OsFile)();
+	if (file->open(path, job.m_mode, getAllocator()))
+	{
+		ret = job.m_client.addFile(file);
+	}
+	else
+	{
+		LUMIX_DELETE(getAllocator(), file);
+	}
+
+	beginResponse(job, sizeof(ret));
+	m_response.write(ret);
+	sendResponse(job.m_client);
+}
+
+
+void TCPFileServerWorker::fetch(TCPJob& job)
+{
+	char path[MAX_PATH_LENGTH];
+	m_server.getFullPath(job.m_path, path, lengthOf(path));
+
+	TCPFetchResult result = {TCPFetchResult::NOT_FOUND, 0, 0, 0};
+	const void* payload = nullptr;
+	// mapped files are sent from the page cache without reading them into a buffer
+	OsFileMapping mapping;
+	if (mapping.open(path))
+	{
+		result.status = TCPFetchResult::DATA;
+		result.size = (uint32)mapping.size();
+		payload = mapping.getData();
+	}
+	else
+	{
+		// e.g. empty files, they can not be mapped
+		OsFile file;
+		if (file.open(path, Mode::OPEN_AND_READ, getAllocator()))
 		{
-			PROFILE_BLOCK("File server operation")
-			int32 op = 0;
-			stream->read(op);
-			switch (op)
+			result.size = (uint32)file.size();
+			m_file_data.resize(result.size);
+			if (result.size == 0 || file.read(&m_file_data[0], result.size))
 			{
-				case TCPCommand::OpenFile:
-					openFile(stream);
-					break;
-				case TCPCommand::Close:
-					close(stream);
-					break;
-				case TCPCommand::Read:
-					read(stream);
-					break;
-				case TCPCommand::Write:
-					write(stream);
-					break;
-				case TCPCommand::Size:
-					size(stream);
-					break;
-				case TCPCommand::Seek:
-					seek(stream);
-					break;
-				case TCPCommand::Pos:
-					pos(stream);
-					break;
-				case TCPCommand::Disconnect:
-					quit = true;
-					break;
-				default:
-					ASSERT(0);
-					break;
+				result.status = TCPFetchResult::DATA;
+				payload = result.size > 0 ? &m_file_data[0] : nullptr;
 			}
+			file.close();
 		}
-
-		m_acceptor.close(stream);
-		return 0;
 	}
 
+	if (result.status == TCPFetchResult::DATA)
+	{
+		result.hash = result.size > 0 ? crc32(payload, result.size) : 0;
+		result.packed_size = result.size;
+	}
 
-	void stop() {}
-
-
-	void setBasePath(const char* base_path)
+	if (result.status == TCPFetchResult::DATA && (job.m_flags & TCPFetchResult::CACHED) &&
+		result.hash == job.m_hash)
 	{
-		StackAllocator<MAX_PATH_LENGTH> allocator;
-		string base_path_str(base_path, allocator);
-		if (base_path_str[base_path_str.length() - 1] != '/')
+		result.status = TCPFetchResult::NOT_MODIFIED;
+		result.packed_size = 0;
+		payload = nullptr;
+	}
+	else if (result.status == TCPFetchResult::DATA && (job.m_flags & TCPFetchResult::COMPRESS) &&
+			 result.size > 0)
+	{
+		m_packed_data.resize(LZ4::compressBound(result.size));
+		int packed_size = LZ4::compress(payload, result.size, &m_packed_data[0], result.size - 1);
+		if (packed_size > 0)
 		{
-			base_path_str += "/";
+			result.status = TCPFetchResult::COMPRESSED_DATA;
+			result.packed_size = packed_size;
+			payload = &m_packed_data[0];
 		}
-		m_base_path = base_path_str.c_str();
 	}
 
+	beginResponse(job, sizeof(result) + result.packed_size);
+	m_response.write(result);
+	sendResponse(job.m_client, payload, result.packed_size);
+}
 
-	const char* getBasePath() const { return m_base_path.c_str(); }
 
-private:
-	Net::TCPAcceptor m_acceptor;
-	StaticArray<char, 0x50000> m_buffer;
-	StaticArray<OsFile*, 0x50000> m_files;
-	FreeList<int32, 0x50000> m_ids;
-	Path m_base_path;
-};
+void TCPFileServerWorker::read(TCPJob& job)
+{
+	OsFile* file = job.m_client.getFile(job.m_file);
+
+	// the data are followed by the success flag
+	m_file_data.resize(job.m_size + 1);
+	bool read_successful = file && (job.m_size == 0 || file->read(&m_file_data[0], job.m_size));
+	m_file_data[job.m_size] = read_successful ? 1 : 0;
+
+	beginResponse(job, job.m_size + 1);
+	sendResponse(job.m_client, &m_file_data[0], job.m_size + 1);
+}
+
+
+void TCPFileServerWorker::close(TCPJob& job)
+{
+	OsFile* file = job.m_client.removeFile(job.m_file);
+	if (!file) return;
+
+	file->close();
+	LUMIX_DELETE(getAllocator(), file);
+}
+
+
+void TCPFileServerWorker::write(TCPJob& job)
+{
+	OsFile* file = job.m_client.getFile(job.m_file);
+	bool write_successful = file && (job.m_size == 0 || file->write(&job.m_data[0], job.m_size));
+
+	beginResponse(job, sizeof(write_successful));
+	m_response.write(write_successful);
+	sendResponse(job.m_client);
+}
+
+
+void TCPFileServerWorker::seek(TCPJob& job)
+{
+	OsFile* file = job.m_client.getFile(job.m_file);
+
+	uint32 pos = file ? (uint32)file->seek((SeekMode)job.m_base, job.m_offset) : 0;
+	beginResponse(job, sizeof(pos));
+	m_response.write(pos);
+	sendResponse(job.m_client);
+}
+
+
+void TCPFileServerWorker::size(TCPJob& job)
+{
+	OsFile* file = job.m_client.getFile(job.m_file);
+
+	uint32 size = file ? (uint32)file->size() : 0;
+	beginResponse(job, sizeof(size));
+	m_response.write(size);
+	sendResponse(job.m_client);
+}
+
+
+void TCPFileServerWorker::pos(TCPJob& job)
+{
+	OsFile* file = job.m_client.getFile(job.m_file);
+
+	uint32 pos = file ? (uint32)file->pos() : 0;
+	beginResponse(job, sizeof(pos));
+	m_response.write(pos);
+	sendResponse(job.m_client);
+}
 
 
 struct TCPFileServerImpl
@@ -265,7 +803,7 @@ TCPFileServer::~TCPFileServer()
 {
 	if (m_impl)
 	{
-		LUMIX_DELETE(m_impl->m_allocator, m_impl);
+		stop();
 	}
 }
 
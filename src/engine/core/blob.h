@@ -50,6 +50,7 @@ namespace Lumix
 			const void* getData() const { return (const void*)m_data; }
 			int getSize() const { return m_size; }
 			void setPosition(int pos) { m_pos = pos; }
+			int getPosition() const { return m_pos; }
 			void rewind() { m_pos = 0; }
 
 
@@ -0,0 +1,192 @@
+#include "core/lz4.h"
+#include "core/math_utils.h"
+#include "core/string.h"
+
+
+namespace Lumix
+{
+
+
+namespace LZ4
+{
+
+
+static const int MIN_MATCH = 4;
+static const int LAST_LITERALS = 5;
+static const int MF_LIMIT = 12;
+static const int MAX_OFFSET = 0xffff;
+static const int HASH_LOG = 12;
+static const int RUN_MASK = 15;
+
+
+static uint32 read32(const uint8* ptr)
+{
+	return ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | ((uint32)ptr[3] << 24);
+}
+
+
+static uint32 hash(uint32 sequence)
+{
+	return (sequence * 2654435761U) >> (32 - HASH_LOG);
+}
+
+
+static uint8* writeLength(uint8* op, int length)
+{
+	while (length >= 255)
+	{
+		*op++ = 255;
+		length -= 255;
+	}
+	*op++ = (uint8)length;
+	return op;
+}
+
+
+static bool readLength(const uint8*& ip, const uint8* ip_end, int& length)
+{
+	uint8 s;
+	do
+	{
+		if (ip >= ip_end) return false;
+		s = *ip++;
+		length += s;
+	} while (s == 255);
+	return true;
+}
+
+
+static uint8* writeSequence(uint8* op,
+	const uint8* op_end,
+	const uint8* literals,
+	int literal_length,
+	int offset,
+	int match_length)
+{
+	int needed = 1 + literal_length + literal_length / 255 + 1;
+	if (offset > 0) needed += 2 + match_length / 255 + 1;
+	if (op + needed > op_end) return nullptr;
+
+	uint8* token = op++;
+	*token = uint8(Math::minValue(literal_length, RUN_MASK) << 4);
+	if (literal_length >= RUN_MASK) op = writeLength(op, literal_length - RUN_MASK);
+	copyMemory(op, literals, literal_length);
+	op += literal_length;
+	if (offset == 0) return op;
+
+	*op++ = uint8(offset);
+	*op++ = uint8(offset >> 8);
+	int length = match_length - MIN_MATCH;
+	*token |= uint8(Math::minValue(length, RUN_MASK));
+	if (length >= RUN_MASK) op = writeLength(op, length - RUN_MASK);
+	return op;
+}
+
+
+int compressBound(int size)
+{
+	return size + size / 255 + 16;
+}
+
+
+int compress(const void* src, int src_size, void* dst, int dst_capacity)
+{
+	const uint8* base = (const uint8*)src;
+	const uint8* ip = base;
+	const uint8* anchor = base;
+	const uint8* end = base + src_size;
+	uint8* op = (uint8*)dst;
+	const uint8* op_end = op + dst_capacity;
+
+	if (src_size > MF_LIMIT)
+	{
+		int hash_table[1 << HASH_LOG];
+		for (int& i : hash_table) i = -1;
+
+		const uint8* match_limit = end - MF_LIMIT;
+		const uint8* match_end_limit = end - LAST_LITERALS;
+		while (ip < match_limit)
+		{
+			uint32 sequence = read32(ip);
+			int& slot = hash_table[hash(sequence)];
+			int ref = slot;
+			slot = int(ip - base);
+			if (ref < 0 || ip - base - ref > MAX_OFFSET || read32(base + ref) != sequence)
+			{
+				++ip;
+				continue;
+			}
+
+			const uint8* match = base + ref;
+			while (ip > anchor && match > base && ip[-1] == match[-1])
+			{
+				--ip;
+				--match;
+			}
+			const uint8* ip_match_end = ip + MIN_MATCH;
+			const uint8* ref_match_end = match + MIN_MATCH;
+			while (ip_match_end < match_end_limit && *ip_match_end == *ref_match_end)
+			{
+				++ip_match_end;
+				++ref_match_end;
+			}
+
+			op = writeSequence(
+				op, op_end, anchor, int(ip - anchor), int(ip - match), int(ip_match_end - ip));
+			if (!op) return 0;
+			ip = anchor = ip_match_end;
+		}
+	}
+
+	// the last sequence has only literals
+	op = writeSequence(op, op_end, anchor, int(end - anchor), 0, 0);
+	if (!op) return 0;
+	return int(op - (uint8*)dst);
+}
+
+
+int decompress(const void* src, int src_size, void* dst, int dst_capacity)
+{
+	const uint8* ip = (const uint8*)src;
+	const uint8* ip_end = ip + src_size;
+	uint8* const out = (uint8*)dst;
+	uint8* op = out;
+	const uint8* op_end = out + dst_capacity;
+
+	while (ip < ip_end)
+	{
+		uint8 token = *ip++;
+		int literal_length = token >> 4;
+		if (literal_length == RUN_MASK && !readLength(ip, ip_end, literal_length)) return -1;
+		if (literal_length > ip_end - ip || literal_length > op_end - op) return -1;
+		copyMemory(op, ip, literal_length);
+		op += literal_length;
+		ip += literal_length;
+		if (ip == ip_end) break;
+
+		if (ip_end - ip < 2) return -1;
+		int offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > op - out) return -1;
+
+		int match_length = token & RUN_MASK;
+		if (match_length == RUN_MASK && !readLength(ip, ip_end, match_length)) return -1;
+		match_length += MIN_MATCH;
+		if (match_length > op_end - op) return -1;
+
+		// byte by byte, the match can overlap the output
+		const uint8* match = op - offset;
+		for (int i = 0; i < match_length; ++i)
+		{
+			op[i] = match[i];
+		}
+		op += match_length;
+	}
+	return int(op - out);
+}
+
+
+} // namespace LZ4
+
+
+} // namespace Lumix
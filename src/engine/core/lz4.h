@@ -0,0 +1,26 @@
+#pragma once
+
+
+#include "lumix.h"
+
+
+namespace Lumix
+{
+
+
+// LZ4 block format, blocks are independent, there is no frame
+namespace LZ4
+{
+
+
+LUMIX_ENGINE_API int compressBound(int size);
+// returns the compressed size or 0 if it does not fit in dst_capacity
+LUMIX_ENGINE_API int compress(const void* src, int src_size, void* dst, int dst_capacity);
+// returns the decompressed size or -1 if the data are corrupted or do not fit in dst_capacity
+LUMIX_ENGINE_API int decompress(const void* src, int src_size, void* dst, int dst_capacity);
+
+
+} // namespace LZ4
+
+
+} // namespace Lumix
@@ -18,6 +18,21 @@ namespace Net
 class TCPStream;
 
 
+static const int MAX_POLL_ITEMS = 256;
+
+
+struct PollItem
+{
+	uintptr socket;
+	bool is_ready;
+};
+
+
+// waits at most timeout_ms until some of the sockets can be read, a listening socket is ready
+// when a connection can be accepted; returns the number of ready sockets or -1 on error
+LUMIX_ENGINE_API int poll(PollItem* items, int count, int timeout_ms);
+
+
 class LUMIX_ENGINE_API TCPAcceptor
 {
 public:
@@ -25,8 +40,10 @@ public:
 	~TCPAcceptor();
 
 	bool start(const char* ip, uint16 port);
+	// returns nullptr on error, e.g. the client closed the connection before it was accepted
 	TCPStream* accept();
 	void close(TCPStream* stream);
+	uintptr getSocket() const { return m_socket; }
 
 private:
 	IAllocator& m_allocator;
@@ -51,6 +68,13 @@ private:
 
 class LUMIX_ENGINE_API TCPStream
 {
+public:
+	struct Buffer
+	{
+		const void* data;
+		size_t size;
+	};
+
 public:
 	TCPStream(uintptr socket)
 		: m_socket(socket)
@@ -82,6 +106,15 @@ public:
 
 	bool read(void* buffer, size_t size);
 	bool write(const void* buffer, size_t size);
+	// sends all the buffers with one call, the data are not copied into one block
+	bool write(const Buffer* buffers, int count);
+	// returns up to size bytes which have already arrived, it blocks only when nothing has,
+	// returns 0 when the connection is closed and -1 on error
+	int readSome(void* buffer, size_t size);
+	// a write which can not send its data in timeout_ms fails, the stream should be closed then
+	bool setSendTimeout(int timeout_ms);
+
+	uintptr getSocket() const { return m_socket; }
 
 private:
 	TCPStream();
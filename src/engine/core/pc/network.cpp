@@ -3,6 +3,7 @@
 #include "core/string.h"
 #include "core/pc/simple_win.h"
 #undef WIN32_LEAN_AND_MEAN
+#include <WinSock2.h>
 #include <Windows.h>
 
 
@@ -15,6 +16,27 @@ namespace Net
 {
 
 
+int poll(PollItem* items, int count, int timeout_ms)
+{
+	ASSERT(count <= MAX_POLL_ITEMS);
+	WSAPOLLFD fds[MAX_POLL_ITEMS];
+	for (int i = 0; i < count; ++i)
+	{
+		fds[i].fd = (SOCKET)items[i].socket;
+		fds[i].events = POLLRDNORM;
+		fds[i].revents = 0;
+	}
+
+	int ret = ::WSAPoll(fds, count, timeout_ms);
+	for (int i = 0; i < count; ++i)
+	{
+		// closed and broken sockets are ready too, the following read reports the error
+		items[i].is_ready = ret > 0 && (fds[i].revents & (POLLRDNORM | POLLHUP | POLLERR)) != 0;
+	}
+	return ret == SOCKET_ERROR ? -1 : ret;
+}
+
+
 TCPAcceptor::TCPAcceptor(IAllocator& allocator)
 	: m_allocator(allocator)
 {
@@ -61,6 +83,7 @@ void TCPAcceptor::close(TCPStream* stream)
 TCPStream* TCPAcceptor::accept()
 {
 	SOCKET socket = ::accept(m_socket, nullptr, nullptr);
+	if (socket == INVALID_SOCKET) return nullptr;
 	return LUMIX_NEW(m_allocator, TCPStream)(socket);
 }
 
@@ -168,5 +191,39 @@ bool TCPStream::write(const void* buffer, size_t size)
 }
 
 
+bool TCPStream::write(const Buffer* buffers, int count)
+{
+	static const int MAX_BUFFERS = 16;
+	ASSERT(count <= MAX_BUFFERS);
+	WSABUF wsa_buffers[MAX_BUFFERS];
+	size_t size = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		wsa_buffers[i].buf = (char*)buffers[i].data;
+		wsa_buffers[i].len = (ULONG)buffers[i].size;
+		size += buffers[i].size;
+	}
+
+	DWORD sent = 0;
+	if (::WSASend(m_socket, wsa_buffers, count, &sent, 0, nullptr, nullptr) != 0) return false;
+	return sent == size;
+}
+
+
+int TCPStream::readSome(void* buffer, size_t size)
+{
+	int received = ::recv(m_socket, static_cast<char*>(buffer), (int)size, 0);
+	return received < 0 ? -1 : received;
+}
+
+
+bool TCPStream::setSendTimeout(int timeout_ms)
+{
+	DWORD timeout = (DWORD)timeout_ms;
+	const char* value = (const char*)&timeout;
+	return ::setsockopt(m_socket, SOL_SOCKET, SO_SNDTIMEO, value, sizeof(timeout)) == 0;
+}
+
+
 } // namespace Net
 } // namespace Lumix
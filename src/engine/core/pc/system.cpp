@@ -13,6 +13,18 @@ namespace Lumix
 	}
 
 
+	bool moveFile(const char* from, const char* to)
+	{
+		return MoveFileEx(from, to, MOVEFILE_REPLACE_EXISTING) == TRUE;
+	}
+
+
+	bool deleteFile(const char* path)
+	{
+		return DeleteFile(path) == TRUE;
+	}
+
+
 	void messageBox(const char* text)
 	{
 		MessageBox(NULL, text, "Message", MB_OK);
@@ -0,0 +1,157 @@
+#include "core/prefetch_manifest.h"
+#include "core/fs/ifile.h"
+#include "core/iallocator.h"
+#include "core/string.h"
+
+
+namespace Lumix
+{
+
+
+static const uint32 MANIFEST_MAGIC = 0x5f4c504d; // == '_LPM'
+static const uint32 MANIFEST_VERSION = 0;
+
+
+static void writePath(FS::IFile& file, const Path& path)
+{
+	int32 length = path.length();
+	file.write(&length, sizeof(length));
+	file.write(path.c_str(), length);
+}
+
+
+static bool readPath(FS::IFile& file, Path& path)
+{
+	int32 length = 0;
+	char tmp[MAX_PATH_LENGTH];
+	if (!file.read(&length, sizeof(length)) || length < 0 || length >= MAX_PATH_LENGTH) return false;
+	if (!file.read(tmp, length)) return false;
+	tmp[length] = '\0';
+	path = tmp;
+	return true;
+}
+
+
+PrefetchManifest::PrefetchManifest(IAllocator& allocator)
+	: m_allocator(allocator)
+	, m_entries(allocator)
+{
+}
+
+
+PrefetchManifest::~PrefetchManifest()
+{
+	clear();
+}
+
+
+void PrefetchManifest::addDependency(const Path& resource, uint32 type, const Path& dependency)
+{
+	Entry* entry;
+	auto iter = m_entries.find(resource.getHash());
+	if (iter == m_entries.end())
+	{
+		entry = LUMIX_NEW(m_allocator, Entry)(m_allocator);
+		entry->path = resource;
+		m_entries.insert(resource.getHash(), entry);
+	}
+	else
+	{
+		entry = iter.value();
+	}
+
+	for (auto& i : entry->dependencies)
+	{
+		if (i.path == dependency) return;
+	}
+	Dependency& dep = entry->dependencies.pushEmpty();
+	dep.type = type;
+	dep.path = dependency;
+}
+
+
+void PrefetchManifest::removeDependencies(const Path& resource)
+{
+	auto iter = m_entries.find(resource.getHash());
+	if (iter == m_entries.end()) return;
+
+	LUMIX_DELETE(m_allocator, iter.value());
+	m_entries.erase(iter);
+}
+
+
+const PrefetchManifest::Dependencies* PrefetchManifest::getDependencies(const Path& resource)
+{
+	auto iter = m_entries.find(resource.getHash());
+	return iter == m_entries.end() ? nullptr : &iter.value()->dependencies;
+}
+
+
+void PrefetchManifest::clear()
+{
+	for (auto* entry : m_entries)
+	{
+		LUMIX_DELETE(m_allocator, entry);
+	}
+	m_entries.clear();
+}
+
+
+bool PrefetchManifest::load(FS::IFile& file)
+{
+	clear();
+
+	uint32 magic = 0;
+	uint32 version = 0;
+	int32 count = 0;
+	file.read(&magic, sizeof(magic));
+	file.read(&version, sizeof(version));
+	if (magic != MANIFEST_MAGIC || version > MANIFEST_VERSION) return false;
+	if (!file.read(&count, sizeof(count))) return false;
+
+	Path resource;
+	Path dependency;
+	for (int i = 0; i < count; ++i)
+	{
+		int32 dependency_count = 0;
+		if (!readPath(file, resource) || !file.read(&dependency_count, sizeof(dependency_count)))
+		{
+			clear();
+			return false;
+		}
+		for (int j = 0; j < dependency_count; ++j)
+		{
+			uint32 type = 0;
+			if (!file.read(&type, sizeof(type)) || !readPath(file, dependency))
+			{
+				clear();
+				return false;
+			}
+			addDependency(resource, type, dependency);
+		}
+	}
+	return true;
+}
+
+
+void PrefetchManifest::save(FS::IFile& file)
+{
+	int32 count = m_entries.size();
+	file.write(&MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC));
+	file.write(&MANIFEST_VERSION, sizeof(MANIFEST_VERSION));
+	file.write(&count, sizeof(count));
+	for (auto* entry : m_entries)
+	{
+		int32 dependency_count = entry->dependencies.size();
+		writePath(file, entry->path);
+		file.write(&dependency_count, sizeof(dependency_count));
+		for (auto& dependency : entry->dependencies)
+		{
+			file.write(&dependency.type, sizeof(dependency.type));
+			writePath(file, dependency.path);
+		}
+	}
+}
+
+
+} // namespace Lumix
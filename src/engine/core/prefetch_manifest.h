@@ -0,0 +1,64 @@
+#pragma once
+
+
+#include "core/array.h"
+#include "core/path.h"
+#include "core/pod_hash_map.h"
+
+
+namespace Lumix
+{
+
+
+namespace FS
+{
+class IFile;
+}
+
+
+// dependencies of resources recorded while they were loaded, so the next load of a resource
+// can request all its dependencies at once instead of waiting for the resource to be parsed
+class LUMIX_ENGINE_API PrefetchManifest
+{
+public:
+	struct Dependency
+	{
+		// type of the resource manager, e.g. ResourceManager::TEXTURE
+		uint32 type;
+		Path path;
+	};
+
+	typedef Array<Dependency> Dependencies;
+
+public:
+	explicit PrefetchManifest(IAllocator& allocator);
+	~PrefetchManifest();
+
+	void addDependency(const Path& resource, uint32 type, const Path& dependency);
+	void removeDependencies(const Path& resource);
+	// returns nullptr if the resource has no recorded dependencies
+	const Dependencies* getDependencies(const Path& resource);
+	void clear();
+
+	bool load(FS::IFile& file);
+	void save(FS::IFile& file);
+
+private:
+	struct Entry
+	{
+		explicit Entry(IAllocator& allocator)
+			: dependencies(allocator)
+		{
+		}
+
+		Path path;
+		Dependencies dependencies;
+	};
+
+private:
+	IAllocator& m_allocator;
+	PODHashMap<uint32, Entry*> m_entries;
+};
+
+
+} // namespace Lumix
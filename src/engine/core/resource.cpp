@@ -4,6 +4,7 @@
 #include "core/log.h"
 #include "core/path.h"
 #include "core/resource_manager.h"
+#include "core/resource_manager_base.h"
 
 namespace Lumix
 {
@@ -19,6 +20,14 @@ Resource::Resource(const Path& path, ResourceManager& resource_manager, IAllocat
 	, m_cb(allocator)
 	, m_resource_manager(resource_manager)
 	, m_is_waiting_for_load(false)
+	, m_async_op(FS::INVALID_ASYNC_HANDLE)
+	, m_load_priority(0)
+	, m_manager(nullptr)
+	, m_counted_size(0)
+	, m_cache_prev(nullptr)
+	, m_cache_next(nullptr)
+	, m_cache_time(0)
+	, m_is_cached(false)
 {
 }
 
@@ -53,11 +62,23 @@ void Resource::checkState()
 			m_cb.invoke(old_state, m_current_state);
 		}
 	}
+	updateMemoryUsage();
+}
+
+
+void Resource::updateMemoryUsage()
+{
+	size_t size = isReady() ? m_size : 0;
+	if (!m_manager || size == m_counted_size) return;
+
+	m_manager->m_memory_usage = m_manager->m_memory_usage - m_counted_size + size;
+	m_counted_size = size;
 }
 
 
 void Resource::fileLoaded(FS::IFile& file, bool success)
 {
+	m_async_op = FS::INVALID_ASYNC_HANDLE;
 	m_is_waiting_for_load = false;
 	if (m_desired_state != State::READY) return;
 	
@@ -74,20 +95,60 @@ void Resource::fileLoaded(FS::IFile& file, bool success)
 		return;
 	}
 
-	if (!load(file))
+	if (isAsyncLoadSupported())
+	{
+		// ResourceManager::update() calls asyncLoaded() when the worker is done
+		m_is_waiting_for_load = true;
+		m_resource_manager.loadAsync(*this, file);
+		return;
+	}
+
+	loadFinished(load(file));
+}
+
+
+void Resource::asyncLoaded(bool success)
+{
+	m_is_waiting_for_load = false;
+	ASSERT(m_desired_state == State::READY);
+
+	success = success && finalize();
+	if (!success) g_log_error.log("resource") << "Could not load " << getPath().c_str();
+	loadFinished(success);
+}
+
+
+void Resource::loadFinished(bool success)
+{
+	if (!success)
 	{
 		++m_failed_dep_count;
 	}
 
 	--m_empty_dep_count;
 	checkState();
-	m_is_waiting_for_load = false;
+}
+
+
+void Resource::cancelLoad()
+{
+	if (m_async_op != FS::INVALID_ASYNC_HANDLE)
+	{
+		m_resource_manager.getFileSystem().cancel(m_async_op);
+		m_async_op = FS::INVALID_ASYNC_HANDLE;
+		m_is_waiting_for_load = false;
+	}
+	if (m_is_waiting_for_load && m_resource_manager.cancelAsyncLoad(*this))
+	{
+		m_is_waiting_for_load = false;
+	}
 }
 
 
 void Resource::doUnload()
 {
 	m_desired_state = State::EMPTY;
+	cancelLoad();
 	unload();
 	ASSERT(m_empty_dep_count <= 1);
 
@@ -110,17 +171,42 @@ void Resource::onCreated(State state)
 }
 
 
-void Resource::doLoad()
+void Resource::setLoadPriority(int priority)
 {
-	if (m_desired_state == State::READY) return;
+	m_load_priority = priority;
+	if (m_async_op != FS::INVALID_ASYNC_HANDLE)
+	{
+		m_resource_manager.getFileSystem().setPriority(m_async_op, priority);
+	}
+}
+
+
+void Resource::doLoad(int priority, bool prefetch)
+{
+	if (m_desired_state == State::READY)
+	{
+		// requested again, e.g. by a closer object, it can only become more important
+		if (priority > m_load_priority) setLoadPriority(priority);
+		return;
+	}
 	m_desired_state = State::READY;
+	m_load_priority = priority;
 
 	if (m_is_waiting_for_load) return;
 	m_is_waiting_for_load = true;
 	FS::FileSystem& fs = m_resource_manager.getFileSystem();
 	FS::ReadCallback cb;
 	cb.bind<Resource, &Resource::fileLoaded>(this);
-	fs.openAsync(fs.getDefaultDevice(), m_path, FS::Mode::OPEN_AND_READ, cb);
+	// resources loaded on the main thread get the whole file read by the I/O thread, so neither
+	// the main thread nor the render thread waits for the disk
+	prefetch = prefetch || !isAsyncLoadSupported();
+	int mode = FS::Mode::OPEN_AND_READ | (prefetch ? FS::Mode::PREFETCH : 0);
+	m_async_op = fs.openAsync(fs.getDefaultDevice(), m_path, mode, cb, priority);
+	if (m_async_op == FS::INVALID_ASYNC_HANDLE)
+	{
+		g_log_error.log("resource") << "Could not open " << m_path.c_str();
+		m_is_waiting_for_load = false;
+	}
 }
 
 
@@ -129,6 +215,7 @@ void Resource::addDependency(Resource& dependent_resource)
 	ASSERT(m_desired_state != State::EMPTY);
 
 	dependent_resource.m_cb.bind<Resource, &Resource::onStateChanged>(this);
+	m_resource_manager.recordDependency(*this, dependent_resource);
 	if (dependent_resource.isEmpty()) ++m_empty_dep_count;
 	if (dependent_resource.isFailure()) ++m_failed_dep_count;
 
@@ -11,11 +11,13 @@ namespace Lumix
 
 
 class ResourceManager;
+class ResourceManagerBase;
 
 
 class LUMIX_ENGINE_API Resource
 {
 public:
+	friend class ResourceManager;
 	friend class ResourceManagerBase;
 
 	enum class State : uint32
@@ -38,6 +40,9 @@ public:
 	size_t size() const { return m_size; }
 	const Path& getPath() const { return m_path; }
 	ResourceManager& getResourceManager() { return m_resource_manager; }
+	int getLoadPriority() const { return m_load_priority; }
+	// reprioritizes the file request if the resource is still waiting for it
+	void setLoadPriority(int priority);
 
 	template <typename C, void (C::*Function)(State, State)> void onLoaded(C* instance)
 	{
@@ -55,6 +60,11 @@ protected:
 	virtual void onBeforeReady() {}
 	virtual void unload(void) = 0;
 	virtual bool load(FS::IFile& file) = 0;
+	// resources which support it are parsed by loadAsync() on a worker thread and then finished
+	// by finalize() on the main thread, loadAsync() must not touch other resources nor the GPU
+	virtual bool isAsyncLoadSupported() const { return false; }
+	virtual bool loadAsync(FS::IFile& file) { return false; }
+	virtual bool finalize() { return true; }
 
 	void onCreated(State state);
 	void doUnload();
@@ -72,9 +82,13 @@ protected:
 	void checkState();
 
 private:
-	void doLoad();
+	void doLoad(int priority, bool prefetch);
+	void cancelLoad();
 	void fileLoaded(FS::IFile& file, bool success);
+	void asyncLoaded(bool success);
+	void loadFinished(bool success);
 	void onStateChanged(State old_state, State new_state);
+	void updateMemoryUsage();
 	uint32 addRef(void) { return ++m_ref_count; }
 	uint32 remRef(void) { return --m_ref_count; }
 
@@ -88,6 +102,16 @@ private:
 	uint16 m_failed_dep_count;
 	State m_current_state;
 	bool m_is_waiting_for_load;
+	FS::AsyncHandle m_async_op;
+	int m_load_priority;
+	// the manager which owns the resource, it counts the memory of its ready resources
+	ResourceManagerBase* m_manager;
+	size_t m_counted_size;
+	// neighbours in the manager's cache, the resource is cached while it is unreferenced
+	Resource* m_cache_prev;
+	Resource* m_cache_next;
+	float m_cache_time;
+	bool m_is_cached;
 }; // class Resource
 
 
@@ -1,27 +1,338 @@
 #include "lumix.h"
+#include "core/fs/file_system.h"
+#include "core/fs/ifile.h"
+#include "core/fs/ifile_device.h"
+#include "core/fs/memory_file_device.h"
+#include "core/mt/atomic.h"
+#include "core/mt/thread.h"
+#include "core/mtjd/generic_job.h"
+#include "core/mtjd/manager.h"
 #include "core/path.h"
+#include "core/profiler.h"
+#include "core/resource.h"
 #include "core/resource_manager.h"
 #include "core/resource_manager_base.h"
+#include "core/timer.h"
 
 namespace Lumix
 {
+	struct ResourceManager::AsyncLoad
+	{
+		Resource* resource; // nullptr if the load was cancelled
+		FS::IFile* file;
+		bool success;
+		volatile int32 is_done;
+	};
+
+
+	struct ResourceManager::Prefetch
+	{
+		Prefetch(IAllocator& allocator)
+			: requests(allocator)
+			, dependencies(allocator)
+		{
+		}
+
+		ResourceManagerBase* manager;
+		Resource* resource;
+		// reads of the dependencies' files
+		Array<FS::AsyncHandle> requests;
+		// the manifest entry of the resource, restored if the resource does not load
+		PrefetchManifest::Dependencies dependencies;
+	};
+
+
+	// the read only warms the OS or the remote file device's cache
+	static void prefetchedFileLoaded(FS::IFile&, bool) {}
+
+
 	ResourceManager::ResourceManager(IAllocator& allocator) 
 		: m_resource_managers(allocator)
 		, m_allocator(allocator)
+		, m_file_system(nullptr)
+		, m_memory_device(nullptr)
+		, m_mtjd_manager(nullptr)
+		, m_async_loads(allocator)
+		, m_prefetches(allocator)
+		, m_prefetch_manifest(allocator)
+		, m_time(0)
+		, m_memory_budget(0)
+		, m_is_cache_enabled(true)
 	{
+		m_timer = Timer::create(m_allocator);
 	}
 
 	ResourceManager::~ResourceManager()
 	{
+		ASSERT(m_async_loads.empty());
+		ASSERT(m_prefetches.empty());
+		Timer::destroy(m_timer);
 	}
 
-	void ResourceManager::create(FS::FileSystem& fs)
+	void ResourceManager::create(FS::FileSystem& fs, MTJD::Manager& mtjd_manager)
 	{
 		m_file_system = &fs;
+		m_mtjd_manager = &mtjd_manager;
+		m_memory_device = LUMIX_NEW(m_allocator, FS::MemoryFileDevice)(m_allocator);
 	}
 
 	void ResourceManager::destroy()
 	{
+		for (auto* load : m_async_loads)
+		{
+			while (!load->is_done) MT::yield();
+			load->file->release();
+			LUMIX_DELETE(m_allocator, load);
+		}
+		m_async_loads.clear();
+		LUMIX_DELETE(m_allocator, m_memory_device);
+		m_memory_device = nullptr;
+		// paths must be released before the path manager is destroyed
+		m_prefetch_manifest.clear();
+	}
+
+	void ResourceManager::loadAsync(Resource& resource, FS::IFile& file)
+	{
+		// take the file's buffer if possible, the file is closed right after the load callback
+		size_t size = file.size();
+		IAllocator* buffer_allocator = nullptr;
+		void* buffer = file.detachBuffer(&buffer_allocator);
+		if (!buffer)
+		{
+			buffer_allocator = &m_allocator;
+			buffer = m_allocator.allocate(size);
+			file.seek(FS::SeekMode::BEGIN, 0);
+			file.read(buffer, size);
+		}
+
+		auto* load = LUMIX_NEW(m_allocator, AsyncLoad);
+		load->resource = &resource;
+		load->file = m_memory_device->createFile(buffer, size, *buffer_allocator);
+		load->success = false;
+		load->is_done = 0;
+		m_async_loads.push(load);
+
+		auto* job = MTJD::makeJob(*m_mtjd_manager,
+			[load]() {
+				PROFILE_BLOCK("load resource");
+				load->success = load->resource->loadAsync(*load->file);
+				MT::atomicIncrement(&load->is_done);
+			},
+			m_allocator);
+		m_mtjd_manager->schedule(job);
+	}
+
+	bool ResourceManager::cancelAsyncLoad(Resource& resource)
+	{
+		for (auto* load : m_async_loads)
+		{
+			if (load->resource != &resource) continue;
+
+			while (!load->is_done) MT::yield();
+			load->resource = nullptr;
+			return true;
+		}
+		return false;
+	}
+
+	void ResourceManager::update()
+	{
+		PROFILE_FUNCTION();
+		for (int i = m_async_loads.size() - 1; i >= 0; --i)
+		{
+			AsyncLoad* load = m_async_loads[i];
+			if (!load->is_done) continue;
+
+			// finalize() can load or unload other resources, so the load is removed first
+			m_async_loads.eraseFast(i);
+			load->file->release();
+			if (load->resource) load->resource->asyncLoaded(load->success);
+			LUMIX_DELETE(m_allocator, load);
+		}
+
+		updatePrefetches();
+		updateCache();
+	}
+
+	void ResourceManager::prefetchFiles(Prefetch& prefetch,
+		const PrefetchManifest::Dependencies& dependencies,
+		Array<uint32>& visited,
+		int priority)
+	{
+		for (auto& dependency : dependencies)
+		{
+			uint32 hash = dependency.path.getHash();
+			if (visited.indexOf(hash) >= 0) continue;
+			visited.push(hash);
+
+			// e.g. the manifest is from a build with a plugin which is not loaded now
+			auto iter = m_resource_managers.find(dependency.type);
+			if (iter == m_resource_managers.end()) continue;
+			// its whole subtree is loaded too
+			Resource* loaded = iter.value()->get(dependency.path);
+			if (loaded && !loaded->isEmpty()) continue;
+
+			// opening a file which is read only partially reads nothing ahead
+			if (iter.value()->isParsedWhole(dependency.path))
+			{
+				FS::ReadCallback cb;
+				cb.bind<prefetchedFileLoaded>();
+				int mode = FS::Mode::OPEN_AND_READ | FS::Mode::PREFETCH;
+				auto handle = m_file_system->openAsync(
+					m_file_system->getDefaultDevice(), dependency.path, mode, cb, priority);
+				if (handle != FS::INVALID_ASYNC_HANDLE) prefetch.requests.push(handle);
+			}
+
+			auto* subdependencies = m_prefetch_manifest.getDependencies(dependency.path);
+			if (subdependencies) prefetchFiles(prefetch, *subdependencies, visited, priority);
+		}
+	}
+
+	void ResourceManager::prefetchDependencies(ResourceManagerBase& manager, Resource& resource, int priority)
+	{
+		auto* dependencies = m_prefetch_manifest.getDependencies(resource.getPath());
+		if (!dependencies) return;
+		// the read files would be thrown away and read again by the loads, e.g. downloaded twice
+		const FS::IFileDevice* device = m_file_system->getDefaultDevice().m_devices[0];
+		if (!device || !device->isReadCached()) return;
+
+		auto* prefetch = LUMIX_NEW(m_allocator, Prefetch)(m_allocator);
+		prefetch->manager = &manager;
+		prefetch->resource = &resource;
+		for (auto& dependency : *dependencies) prefetch->dependencies.push(dependency);
+		resource.addRef();
+		// only files of the whole tree are read, dependencies are not loaded as resources,
+		// because their owners set them up, e.g. texture flags, before they are loaded
+		Array<uint32> visited(m_allocator);
+		visited.push(resource.getPath().getHash());
+		prefetchFiles(*prefetch, *dependencies, visited, priority);
+		m_prefetches.push(prefetch);
+
+		// the resource records its current dependencies again while it loads
+		m_prefetch_manifest.removeDependencies(resource.getPath());
+	}
+
+	void ResourceManager::releasePrefetch(Prefetch& prefetch, bool cancel_requests)
+	{
+		if (cancel_requests)
+		{
+			// finished requests are ignored
+			for (auto handle : prefetch.requests) m_file_system->cancel(handle);
+		}
+		// a failed or cancelled load did not record all its dependencies again
+		if (!prefetch.resource->isReady())
+		{
+			for (auto& dependency : prefetch.dependencies)
+			{
+				m_prefetch_manifest.addDependency(
+					prefetch.resource->getPath(), dependency.type, dependency.path);
+			}
+		}
+		// force unloaded resources have no references
+		if (prefetch.resource->getRefCount() > 0) prefetch.manager->unload(*prefetch.resource);
+		LUMIX_DELETE(m_allocator, &prefetch);
+	}
+
+	void ResourceManager::updatePrefetches()
+	{
+		for (int i = m_prefetches.size() - 1; i >= 0; --i)
+		{
+			Prefetch* prefetch = m_prefetches[i];
+			// the loaded resource requests its dependencies now, their reads are not cancelled
+			if (prefetch->resource->isEmpty() && prefetch->resource->m_desired_state != Resource::State::EMPTY)
+			{
+				continue;
+			}
+			m_prefetches.eraseFast(i);
+			releasePrefetch(*prefetch, false);
+		}
+	}
+
+	void ResourceManager::cancelPrefetch(Resource& resource)
+	{
+		for (int i = 0; i < m_prefetches.size(); ++i)
+		{
+			Prefetch* prefetch = m_prefetches[i];
+			if (prefetch->resource != &resource) continue;
+
+			m_prefetches.eraseFast(i);
+			releasePrefetch(*prefetch, true);
+			return;
+		}
+	}
+
+	void ResourceManager::cancelPrefetches()
+	{
+		// unloading a resource can not start a new prefetch
+		for (auto* prefetch : m_prefetches)
+		{
+			releasePrefetch(*prefetch, true);
+		}
+		m_prefetches.clear();
+	}
+
+	void ResourceManager::recordDependency(Resource& resource, Resource& dependency)
+	{
+		for (auto iter = m_resource_managers.begin(), end = m_resource_managers.end(); iter != end; ++iter)
+		{
+			if (iter.value()->get(dependency.getPath()) == &dependency)
+			{
+				m_prefetch_manifest.addDependency(resource.getPath(), iter.key(), dependency.getPath());
+				return;
+			}
+		}
+	}
+
+	void ResourceManager::updateCache()
+	{
+		m_time = m_timer->getTimeSinceStart();
+		for (auto* manager : m_resource_managers)
+		{
+			manager->updateCache(m_time);
+		}
+		if (m_memory_budget == 0) return;
+
+		size_t memory = 0;
+		for (auto* manager : m_resource_managers)
+		{
+			memory += manager->getMemoryUsage();
+		}
+		while (memory > m_memory_budget)
+		{
+			// the least recently used resource of all types
+			ResourceManagerBase* oldest = nullptr;
+			for (auto* manager : m_resource_managers)
+			{
+				if (manager->isCacheEmpty()) continue;
+				if (!oldest || manager->getOldestCacheTime() < oldest->getOldestCacheTime())
+				{
+					oldest = manager;
+				}
+			}
+			if (!oldest) break;
+			memory -= oldest->evictOldest();
+		}
+	}
+
+	void ResourceManager::setCacheEnabled(bool enable)
+	{
+		m_is_cache_enabled = enable;
+		if (!enable) clearCache();
+	}
+
+	void ResourceManager::clearCache()
+	{
+		// unloaded resources release their dependencies, which can be cached in other managers
+		bool is_empty = false;
+		while (!is_empty)
+		{
+			is_empty = true;
+			for (auto* manager : m_resource_managers)
+			{
+				is_empty = is_empty && manager->isCacheEmpty();
+				manager->clearCache();
+			}
+		}
 	}
 	
 	ResourceManagerBase* ResourceManager::get(uint32 id)
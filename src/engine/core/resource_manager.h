@@ -1,6 +1,8 @@
 #pragma once
 
+#include "core/array.h"
 #include "core/pod_hash_map.h"
+#include "core/prefetch_manifest.h"
 
 namespace Lumix
 {
@@ -13,14 +15,25 @@ class Resource;
 namespace FS
 {
 class FileSystem;
+class IFile;
+class MemoryFileDevice;
+}
+
+
+namespace MTJD
+{
+class Manager;
 }
 
 
 class ResourceManagerBase;
+class Timer;
 
 
 class LUMIX_ENGINE_API ResourceManager final
 {
+	friend class Resource;
+
 	typedef PODHashMap<uint32, ResourceManagerBase*> ResourceManagerTable;
 
 public:
@@ -36,8 +49,11 @@ public:
 	ResourceManager(IAllocator& allocator);
 	~ResourceManager();
 
-	void create(FS::FileSystem& fs);
+	void create(FS::FileSystem& fs, MTJD::Manager& mtjd_manager);
 	void destroy();
+	// finishes resources parsed on worker threads
+	void update();
+	bool hasWork() const { return !m_async_loads.empty(); }
 
 	IAllocator& getAllocator() { return m_allocator; }
 	ResourceManagerBase* get(uint32 id);
@@ -48,12 +64,61 @@ public:
 	void reload(const Path& path);
 	void removeUnreferenced();
 
+	// see ResourceManagerBase::setGracePeriod, disabling the cache unloads all cached resources,
+	// it must be disabled before the resource managers are destroyed
+	void setCacheEnabled(bool enable);
+	bool isCacheEnabled() const { return m_is_cache_enabled; }
+	// cached resources of all types are unloaded, least recently used first, if all loaded
+	// resources need more memory than budget, 0 means no budget
+	void setMemoryBudget(size_t budget) { m_memory_budget = budget; }
+	size_t getMemoryBudget() const { return m_memory_budget; }
+	void clearCache();
+	// seconds since the start, updated by update()
+	float getTime() const { return m_time; }
+
+	// dependencies are recorded by Resource::addDependency, load it from a previous run
+	// to request whole dependency trees at once
+	PrefetchManifest& getPrefetchManifest() { return m_prefetch_manifest; }
+	// reads files of the recorded dependency tree of a resource which has just started loading,
+	// so they are in the cache when the resource requests them
+	void prefetchDependencies(ResourceManagerBase& manager, Resource& resource, int priority);
+	void cancelPrefetch(Resource& resource);
+	// must be called before the resource managers are destroyed
+	void cancelPrefetches();
+
 	FS::FileSystem& getFileSystem() { return *m_file_system; }
 
+	void loadAsync(Resource& resource, FS::IFile& file);
+	// waits for the worker, the result is thrown away, returns false if resource is not loading
+	bool cancelAsyncLoad(Resource& resource);
+
+private:
+	struct AsyncLoad;
+	struct Prefetch;
+
+private:
+	void updateCache();
+	void updatePrefetches();
+	void prefetchFiles(Prefetch& prefetch,
+		const PrefetchManifest::Dependencies& dependencies,
+		Array<uint32>& visited,
+		int priority);
+	void releasePrefetch(Prefetch& prefetch, bool cancel_requests);
+	void recordDependency(Resource& resource, Resource& dependency);
+
 private:
 	IAllocator& m_allocator;
 	ResourceManagerTable m_resource_managers;
 	FS::FileSystem* m_file_system;
+	FS::MemoryFileDevice* m_memory_device;
+	MTJD::Manager* m_mtjd_manager;
+	Array<AsyncLoad*> m_async_loads;
+	Array<Prefetch*> m_prefetches;
+	PrefetchManifest m_prefetch_manifest;
+	Timer* m_timer;
+	float m_time;
+	size_t m_memory_budget;
+	bool m_is_cache_enabled;
 };
 
 
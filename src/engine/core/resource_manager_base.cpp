@@ -17,10 +17,12 @@ namespace Lumix
 
 	void ResourceManagerBase::destroy(void)
 	{ 
+		clearCache();
 		for (auto iter = m_resources.begin(), end = m_resources.end(); iter != end; ++iter)
 		{
 			Resource* resource = iter.value();
 			ASSERT(resource->isEmpty());
+			resource->cancelLoad();
 			destroyResource(*resource);
 		}
 		m_resources.clear();
@@ -42,6 +44,7 @@ namespace Lumix
 	{
 		ASSERT(resource->isEmpty());
 		m_resources.erase(resource->getPath().getHash());
+		resource->m_manager = nullptr;
 		resource->remRef();
 	}
 
@@ -49,25 +52,23 @@ namespace Lumix
 	{
 		ASSERT(resource && resource->isReady());
 		m_resources.insert(resource->getPath().getHash(), resource);
+		resource->m_manager = this;
+		resource->updateMemoryUsage();
 		resource->addRef();
 	}
 
-	Resource* ResourceManagerBase::load(const Path& path)
+	Resource* ResourceManagerBase::load(const Path& path, int priority)
 	{
 		Resource* resource = get(path);
 
 		if(nullptr == resource)
 		{
 			resource = createResource(path);
+			resource->m_manager = this;
 			m_resources.insert(path.getHash(), resource);
 		}
-		
-		if(resource->isEmpty())
-		{
-			resource->doLoad();
-		}
 
-		resource->addRef();
+		load(*resource, priority);
 		return resource;
 	}
 
@@ -76,7 +77,8 @@ namespace Lumix
 		Array<Resource*> to_remove(m_allocator);
 		for (auto* i : m_resources)
 		{
-			if (i->getRefCount() == 0) to_remove.push(i);
+			// cached resources are unloaded when they are evicted
+			if (i->getRefCount() == 0 && i->isEmpty()) to_remove.push(i);
 		}
 
 		for (auto* i : to_remove)
@@ -86,11 +88,19 @@ namespace Lumix
 		}
 	}
 
-	void ResourceManagerBase::load(Resource& resource)
+	void ResourceManagerBase::load(Resource& resource, int priority)
 	{
-		if(resource.isEmpty())
+		if (resource.getRefCount() == 0 && removeFromCache(resource))
 		{
-			resource.doLoad();
+			++m_stats.hits;
+			if (resource.isEmpty()) resource.doLoad(priority, isParsedWhole(resource.getPath()));
+		}
+		else if(resource.isEmpty())
+		{
+			// a resource which is still loading was counted when it was requested
+			if (resource.m_desired_state != Resource::State::READY) ++m_stats.misses;
+			resource.doLoad(priority, isParsedWhole(resource.getPath()));
+			if (m_owner) m_owner->prefetchDependencies(*this, resource, priority);
 		}
 
 		resource.addRef();
@@ -109,7 +119,15 @@ namespace Lumix
 	{
 		if(0 == resource.remRef())
 		{
-			resource.doUnload();
+			// failed resources are not cached, so the next load tries again
+			if (isCacheEnabled() && !resource.isFailure())
+			{
+				addToCache(resource);
+			}
+			else
+			{
+				resource.doUnload();
+			}
 		}
 	}
 
@@ -124,6 +142,9 @@ namespace Lumix
 
 	void ResourceManagerBase::forceUnload(Resource& resource)
 	{
+		// releasing the prefetch can move the resource to the cache
+		if (m_owner) m_owner->cancelPrefetch(resource);
+		if (resource.getRefCount() == 0) removeFromCache(resource);
 		resource.doUnload();
 		resource.m_ref_count = 0;
 	}
@@ -140,17 +161,112 @@ namespace Lumix
 	void ResourceManagerBase::reload(Resource& resource)
 	{
 		resource.doUnload();
-		resource.doLoad();
+		resource.doLoad(resource.getLoadPriority(), isParsedWhole(resource.getPath()));
+	}
+
+	size_t ResourceManagerBase::getCachedMemoryUsage() const
+	{
+		size_t size = 0;
+		for (Resource* resource = m_cache_head; resource; resource = resource->m_cache_next)
+		{
+			size += resource->size();
+		}
+		return size;
+	}
+
+	bool ResourceManagerBase::isCacheEnabled() const
+	{
+		return m_grace_period > 0 && m_owner && m_owner->isCacheEnabled();
+	}
+
+	void ResourceManagerBase::addToCache(Resource& resource)
+	{
+		ASSERT(!resource.m_is_cached);
+		resource.m_is_cached = true;
+		resource.m_cache_time = m_owner->getTime();
+		resource.m_cache_prev = m_cache_tail;
+		resource.m_cache_next = nullptr;
+		if (m_cache_tail) m_cache_tail->m_cache_next = &resource;
+		else m_cache_head = &resource;
+		m_cache_tail = &resource;
+	}
+
+	bool ResourceManagerBase::removeFromCache(Resource& resource)
+	{
+		if (!resource.m_is_cached) return false;
+
+		if (resource.m_cache_prev) resource.m_cache_prev->m_cache_next = resource.m_cache_next;
+		else m_cache_head = resource.m_cache_next;
+		if (resource.m_cache_next) resource.m_cache_next->m_cache_prev = resource.m_cache_prev;
+		else m_cache_tail = resource.m_cache_prev;
+		resource.m_cache_prev = nullptr;
+		resource.m_cache_next = nullptr;
+		resource.m_is_cached = false;
+		return true;
+	}
+
+	float ResourceManagerBase::getOldestCacheTime() const
+	{
+		return m_cache_head->m_cache_time;
+	}
+
+	size_t ResourceManagerBase::evictOldest()
+	{
+		Resource* resource = m_cache_head;
+		removeFromCache(*resource);
+
+		size_t size = resource->size();
+		++m_stats.evictions;
+		m_stats.evicted_bytes += size;
+		resource->doUnload();
+		return size;
+	}
+
+	void ResourceManagerBase::updateCache(float time)
+	{
+		while (m_cache_head && time - m_cache_head->m_cache_time > m_grace_period)
+		{
+			evictOldest();
+		}
+
+		if (m_memory_budget == 0 || !m_cache_head) return;
+
+		size_t memory = getMemoryUsage();
+		while (memory > m_memory_budget && m_cache_head)
+		{
+			memory -= evictOldest();
+		}
+	}
+
+	void ResourceManagerBase::clearCache()
+	{
+		while (m_cache_tail)
+		{
+			Resource* resource = m_cache_tail;
+			removeFromCache(*resource);
+			resource->doUnload();
+		}
 	}
 
 	ResourceManagerBase::ResourceManagerBase(IAllocator& allocator)
-		: m_size(0)
+		: m_allocator(allocator)
 		, m_resources(allocator)
-		, m_allocator(allocator)
-	{ }
+		, m_owner(nullptr)
+		, m_cache_head(nullptr)
+		, m_cache_tail(nullptr)
+		, m_grace_period(0)
+		, m_memory_budget(0)
+		, m_memory_usage(0)
+	{
+		m_stats.hits = 0;
+		m_stats.misses = 0;
+		m_stats.evictions = 0;
+		m_stats.evicted_bytes = 0;
+	}
 
 	ResourceManagerBase::~ResourceManagerBase()
 	{ 
 		ASSERT(m_resources.empty());
+		ASSERT(!m_cache_head);
 	}
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 
+#include "core/array.h"
 #include "core/pod_hash_map.h"
 
 
@@ -22,18 +23,30 @@ class ResourceManager;
 class LUMIX_ENGINE_API ResourceManagerBase
 {
 	friend class Resource;
+	friend class ResourceManager;
 public:
 	typedef PODHashMap<uint32, Resource*> ResourceTable;
 
+	struct Stats
+	{
+		// load() of an unreferenced resource which was still in the cache
+		uint32 hits;
+		// load() which had to read the resource
+		uint32 misses;
+		uint32 evictions;
+		uint64 evicted_bytes;
+	};
+
 public:
 	void create(uint32 id, ResourceManager& owner);
 	void destroy();
 
 	Resource* get(const Path& path);
-	Resource* load(const Path& path);
+	// resources with higher priority are loaded first
+	Resource* load(const Path& path, int priority = 0);
 	void add(Resource* resource);
 	void remove(Resource* resource);
-	void load(Resource& resource);
+	void load(Resource& resource, int priority = 0);
 	void removeUnreferenced();
 
 	void unload(const Path& path);
@@ -46,19 +59,53 @@ public:
 	void reload(Resource& resource);
 	ResourceTable& getResourceTable() { return m_resources; }
 
+	// unreferenced resources stay loaded for grace_period seconds, so they are not read again
+	// if they are needed soon, 0 unloads them immediately
+	void setGracePeriod(float grace_period) { m_grace_period = grace_period; }
+	float getGracePeriod() const { return m_grace_period; }
+	// cached resources are unloaded before their grace period ends if the loaded resources
+	// of this type need more memory than budget, 0 means no budget
+	void setMemoryBudget(size_t budget) { m_memory_budget = budget; }
+	size_t getMemoryBudget() const { return m_memory_budget; }
+	size_t getMemoryUsage() const { return m_memory_usage; }
+	size_t getCachedMemoryUsage() const;
+	const Stats& getStats() const { return m_stats; }
+	// unloads all unreferenced resources
+	void clearCache();
+
 	ResourceManagerBase(IAllocator& allocator);
 	virtual ~ResourceManagerBase();
 
 protected:
 	virtual Resource* createResource(const Path& path) = 0;
 	virtual void destroyResource(Resource& resource) = 0;
+	// false if load() parses only a part of the file, so the rest is not read ahead, it is
+	// ignored for resources loaded on the main thread, see Resource::isAsyncLoadSupported
+	virtual bool isParsedWhole(const Path& path) const { return true; }
 
 	ResourceManager& getOwner() const { return *m_owner; }
+
+private:
+	bool isCacheEnabled() const;
+	void addToCache(Resource& resource);
+	bool removeFromCache(Resource& resource);
+	void updateCache(float time);
+	bool isCacheEmpty() const { return !m_cache_head; }
+	float getOldestCacheTime() const;
+	size_t evictOldest();
+
 private:
 	IAllocator& m_allocator;
-	uint32 m_size;
 	ResourceTable m_resources;
 	ResourceManager* m_owner;
+	// a list linked through the resources, least recently used first
+	Resource* m_cache_head;
+	Resource* m_cache_tail;
+	float m_grace_period;
+	size_t m_memory_budget;
+	// sum of the sizes of the ready resources, kept up to date by the resources
+	size_t m_memory_usage;
+	Stats m_stats;
 };
 
 
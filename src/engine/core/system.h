@@ -7,6 +7,9 @@
 namespace Lumix
 {
 	LUMIX_ENGINE_API bool copyFile(const char* from, const char* to);
+	// replaces the destination atomically if both are on the same volume
+	LUMIX_ENGINE_API bool moveFile(const char* from, const char* to);
+	LUMIX_ENGINE_API bool deleteFile(const char* path);
 	LUMIX_ENGINE_API void messageBox(const char* text);
 	LUMIX_ENGINE_API bool getCommandLine(char* output, int max_size);
 	LUMIX_ENGINE_API void* loadLibrary(const char* path);
@@ -1,6 +1,7 @@
 #include "lumix.h"
 #include "engine.h"
 #include "core/blob.h"
+#include "core/command_line_parser.h"
 #include "core/crc32.h"
 #include "core/fs/os_file.h"
 #include "core/input_system.h"
@@ -8,10 +9,12 @@
 #include "core/path.h"
 #include "core/profiler.h"
 #include "core/resource_manager.h"
+#include "core/system.h"
 #include "core/timer.h"
 #include "core/fs/disk_file_device.h"
 #include "core/fs/file_system.h"
 #include "core/fs/memory_file_device.h"
+#include "core/fs/pack_file_device.h"
 #include "core/mtjd/manager.h"
 #include "debug/debug.h"
 #include "engine/iplugin.h"
@@ -70,6 +73,7 @@ class EngineImpl : public Engine
 public:
 	EngineImpl(FS::FileSystem* fs, IAllocator& allocator)
 		: m_allocator(allocator)
+		, m_pack_file_device(nullptr)
 		, m_resource_manager(m_allocator)
 		, m_mtjd_manager(nullptr)
 		, m_fps(0)
@@ -90,6 +94,7 @@ public:
 			m_file_system->mount(m_disk_file_device);
 			m_file_system->setDefaultDevice("memory:disk");
 			m_file_system->setSaveGameDevice("memory:disk");
+			mountCommandLinePack();
 		}
 		else
 		{
@@ -98,7 +103,7 @@ public:
 			m_disk_file_device = nullptr;
 		}
 
-		m_resource_manager.create(*m_file_system);
+		m_resource_manager.create(*m_file_system, *m_mtjd_manager);
 
 		m_timer = Timer::create(m_allocator);
 		m_fps_timer = Timer::create(m_allocator);
@@ -130,6 +135,9 @@ public:
 	{
 		Timer::destroy(m_timer);
 		Timer::destroy(m_fps_timer);
+		// cached and prefetched resources can depend on resources of other plugins
+		m_resource_manager.cancelPrefetches();
+		m_resource_manager.setCacheEnabled(false);
 		PluginManager::destroy(m_plugin_manager);
 		if (m_input_system) InputSystem::destroy(*m_input_system);
 		if (m_disk_file_device)
@@ -137,6 +145,7 @@ public:
 			FS::FileSystem::destroy(m_file_system);
 			LUMIX_DELETE(m_allocator, m_mem_file_device);
 			LUMIX_DELETE(m_allocator, m_disk_file_device);
+			LUMIX_DELETE(m_allocator, m_pack_file_device);
 		}
 
 		m_resource_manager.destroy();
@@ -203,6 +212,45 @@ public:
 	FS::FileSystem& getFileSystem() override { return *m_file_system; }
 
 
+	bool mountPack(const char* path) override
+	{
+		if (!m_disk_file_device) return false;
+
+		if (!m_pack_file_device)
+		{
+			m_pack_file_device = LUMIX_NEW(m_allocator, FS::PackFileDevice)(m_allocator);
+			m_file_system->mount(m_pack_file_device);
+		}
+		if (!m_pack_file_device->mount(path)) return false;
+
+		// saved games are not in the archive
+		m_file_system->setDefaultDevice("memory:pack:disk");
+		return true;
+	}
+
+
+	void mountCommandLinePack()
+	{
+		char cmd_line[2048];
+		getCommandLine(cmd_line, lengthOf(cmd_line));
+		CommandLineParser parser(cmd_line);
+		while (parser.next())
+		{
+			if (!parser.currentEquals("-pack")) continue;
+			if (!parser.next()) break;
+
+			char path[MAX_PATH_LENGTH];
+			parser.getCurrent(path, lengthOf(path));
+			if (!mountPack(path))
+			{
+				g_log_error.log("engine") << "Could not mount " << path
+										  << " requested by command line";
+			}
+			break;
+		}
+	}
+
+
 	void startGame(UniverseContext& context) override
 	{
 		ASSERT(!m_is_game_running);
@@ -247,6 +295,7 @@ public:
 		m_plugin_manager->update(dt);
 		m_input_system->update(dt);
 		getFileSystem().updateAsyncTransactions();
+		m_resource_manager.update();
 	}
 
 
@@ -424,6 +473,7 @@ private:
 	FS::FileSystem* m_file_system;
 	FS::MemoryFileDevice* m_mem_file_device;
 	FS::DiskFileDevice* m_disk_file_device;
+	FS::PackFileDevice* m_pack_file_device;
 
 	ResourceManager m_resource_manager;
 	
@@ -67,6 +67,9 @@ public:
 	virtual const PlatformData& getPlatformData() = 0;
 
 	virtual FS::FileSystem& getFileSystem() = 0;
+	// files in the archive are read from it, the others from the disk, it is mounted at startup
+	// if the command line contains -pack <path>, fails if the file system is not the engine's
+	virtual bool mountPack(const char* path) = 0;
 	virtual InputSystem& getInputSystem() = 0;
 	virtual PluginManager& getPluginManager() = 0;
 	virtual MTJD::Manager& getMTJDManager() = 0;
@@ -0,0 +1,30 @@
+#include "core/default_allocator.h"
+#include "core/fs/pack_file_device.h"
+#include "core/log.h"
+#include <cstdio>
+
+
+using namespace Lumix;
+
+
+static void logError(const char* system, const char* message)
+{
+	printf("%s\n", message);
+}
+
+
+int main(int argc, const char* argv[])
+{
+	if (argc != 3)
+	{
+		printf("Usage: packer <input_dir> <output.pack>\n");
+		return 1;
+	}
+
+	g_log_error.getCallback().bind<logError>();
+	DefaultAllocator allocator;
+	if (!FS::PackFileDevice::pack(argv[1], argv[2], allocator)) return 1;
+
+	printf("Packed %s into %s\n", argv[1], argv[2]);
+	return 0;
+}
@@ -1,6 +1,7 @@
 #include "physics_geometry_manager.h"
 #include "core/fs/file_system.h"
 #include "core/fs/ifile.h"
+#include "core/mt/sync.h"
 #include "core/resource_manager.h"
 #include "core/vec.h"
 #include "physics/physics_system.h"
@@ -98,6 +99,8 @@ namespace Lumix
 	PhysicsGeometry::PhysicsGeometry(const Path& path, ResourceManager& resource_manager, IAllocator& allocator)
 		: Resource(path, resource_manager, allocator)
 		, m_geometry(nullptr)
+		, m_cooked_data(nullptr)
+		, m_cooked_size(0)
 	{
 
 	}
@@ -105,10 +108,17 @@ namespace Lumix
 	PhysicsGeometry::~PhysicsGeometry()
 	{
 		LUMIX_DELETE(getAllocator(), m_geometry);
+		freeCookedData();
 	}
 
 
 	bool PhysicsGeometry::load(FS::IFile& file)
+	{
+		return loadAsync(file) && finalize();
+	}
+
+
+	bool PhysicsGeometry::loadAsync(FS::IFile& file)
 	{
 		Header header;
 		file.read(&header, sizeof(header));
@@ -117,8 +127,9 @@ namespace Lumix
 			return false;
 		}
 
-		auto* phy_manager = m_resource_manager.get(ResourceManager::PHYSICS);
-		PhysicsSystem& system = static_cast<PhysicsGeometryManager*>(phy_manager)->getSystem();
+		auto* phy_manager =
+			static_cast<PhysicsGeometryManager*>(m_resource_manager.get(ResourceManager::PHYSICS));
+		PhysicsSystem& system = phy_manager->getSystem();
 
 		uint32 num_verts;
 		Array<Vec3> verts(getAllocator());
@@ -127,11 +138,9 @@ namespace Lumix
 		file.read(&verts[0], sizeof(verts[0]) * verts.size());
 
 		m_is_convex = header.m_convex != 0;
+		OutputStream writeBuffer(getAllocator());
 		if (!m_is_convex)
 		{
-			physx::PxTriangleMeshGeometry* geom =
-				LUMIX_NEW(getAllocator(), physx::PxTriangleMeshGeometry)();
-			m_geometry = geom;
 			uint32 num_indices;
 			Array<uint32> tris(getAllocator());
 			file.read(&num_indices, sizeof(num_indices));
@@ -147,42 +156,65 @@ namespace Lumix
 			meshDesc.triangles.stride = 3 * sizeof(physx::PxU32);
 			meshDesc.triangles.data = &tris[0];
 
-			OutputStream writeBuffer(getAllocator());
-			system.getCooking()->cookTriangleMesh(meshDesc, writeBuffer);
-
-			InputStream readBuffer(writeBuffer.data, writeBuffer.size);
-			geom->triangleMesh = system.getPhysics()->createTriangleMesh(readBuffer);
+			MT::Lock lock(phy_manager->getCookingMutex());
+			if (!system.getCooking()->cookTriangleMesh(meshDesc, writeBuffer)) return false;
 		}
 		else
 		{
-			physx::PxConvexMeshGeometry* geom =
-				LUMIX_NEW(getAllocator(), physx::PxConvexMeshGeometry)();
-			m_geometry = geom;
 			physx::PxConvexMeshDesc meshDesc;
 			meshDesc.points.count = verts.size();
 			meshDesc.points.stride = sizeof(Vec3);
 			meshDesc.points.data = &verts[0];
 			meshDesc.flags = physx::PxConvexFlag::eCOMPUTE_CONVEX;
 
-			OutputStream writeBuffer(getAllocator());
-			bool status = system.getCooking()->cookConvexMesh(meshDesc, writeBuffer);
-			if (!status)
-			{
-				LUMIX_DELETE(getAllocator(), geom);
-				m_geometry = nullptr;
-				return false;
-			}
-
-			InputStream readBuffer(writeBuffer.data, writeBuffer.size);
-			physx::PxConvexMesh* mesh = system.getPhysics()->createConvexMesh(readBuffer);
-			geom->convexMesh = mesh;
+			MT::Lock lock(phy_manager->getCookingMutex());
+			if (!system.getCooking()->cookConvexMesh(meshDesc, writeBuffer)) return false;
 		}
 
+		// the cooked data are turned into a PhysX mesh in finalize()
+		freeCookedData();
+		m_cooked_data = writeBuffer.data;
+		m_cooked_size = writeBuffer.size;
+		writeBuffer.data = nullptr;
+
 		m_size = file.size();
 		return true;
 	}
 
 
+	bool PhysicsGeometry::finalize()
+	{
+		auto* phy_manager = m_resource_manager.get(ResourceManager::PHYSICS);
+		PhysicsSystem& system = static_cast<PhysicsGeometryManager*>(phy_manager)->getSystem();
+
+		InputStream readBuffer(m_cooked_data, m_cooked_size);
+		if (!m_is_convex)
+		{
+			physx::PxTriangleMeshGeometry* geom =
+				LUMIX_NEW(getAllocator(), physx::PxTriangleMeshGeometry)();
+			m_geometry = geom;
+			geom->triangleMesh = system.getPhysics()->createTriangleMesh(readBuffer);
+		}
+		else
+		{
+			physx::PxConvexMeshGeometry* geom =
+				LUMIX_NEW(getAllocator(), physx::PxConvexMeshGeometry)();
+			m_geometry = geom;
+			geom->convexMesh = system.getPhysics()->createConvexMesh(readBuffer);
+		}
+		freeCookedData();
+		return true;
+	}
+
+
+	void PhysicsGeometry::freeCookedData()
+	{
+		getAllocator().deallocate(m_cooked_data);
+		m_cooked_data = nullptr;
+		m_cooked_size = 0;
+	}
+
+
 	IAllocator& PhysicsGeometry::getAllocator()
 	{
 		return static_cast<PhysicsGeometryManager*>(m_resource_manager.get(ResourceManager::PHYSICS))->getAllocator();
@@ -193,6 +225,7 @@ namespace Lumix
 	{
 		LUMIX_DELETE(getAllocator(), m_geometry);
 		m_geometry = nullptr;
+		freeCookedData();
 	}
 
 
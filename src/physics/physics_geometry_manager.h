@@ -2,6 +2,7 @@
 
 
 #include "lumix.h"
+#include "core/mt/sync.h"
 #include "core/resource.h"
 #include "core/resource_manager_base.h"
 
@@ -26,10 +27,13 @@ class LUMIX_PHYSICS_API PhysicsGeometryManager : public ResourceManagerBase
 			: ResourceManagerBase(allocator)
 			, m_allocator(allocator)
 			, m_system(system)
+			, m_cooking_mutex(false)
 		{}
 		~PhysicsGeometryManager() {}
 		IAllocator& getAllocator() { return m_allocator; }
 		PhysicsSystem& getSystem() { return m_system; }
+		// geometries are cooked on worker threads, one at a time
+		MT::Mutex& getCookingMutex() { return m_cooking_mutex; }
 
 	protected:
 		Resource* createResource(const Path& path) override;
@@ -38,6 +42,7 @@ class LUMIX_PHYSICS_API PhysicsGeometryManager : public ResourceManagerBase
 	private:
 		IAllocator& m_allocator;
 		PhysicsSystem& m_system;
+		MT::Mutex m_cooking_mutex;
 };
 
 
@@ -70,9 +75,15 @@ class LUMIX_PHYSICS_API PhysicsGeometry : public Resource
 
 		void unload(void) override;
 		bool load(FS::IFile& file) override;
+		bool isAsyncLoadSupported() const override { return true; }
+		bool loadAsync(FS::IFile& file) override;
+		bool finalize() override;
+		void freeCookedData();
 
 	private:
 		physx::PxGeometry* m_geometry;
+		uint8* m_cooked_data;
+		int m_cooked_size;
 		bool m_is_convex;
 };
 
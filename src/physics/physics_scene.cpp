@@ -15,6 +15,7 @@
 #include "engine.h"
 #include "lua_script/lua_script_system.h"
 #include "renderer/render_scene.h"
+#include "renderer/terrain_tiles.h"
 #include "renderer/texture.h"
 #include "physics/physics_system.h"
 #include "physics/physics_geometry_manager.h"
@@ -30,11 +31,13 @@ static const uint32 BOX_ACTOR_HASH = crc32("box_rigid_actor");
 static const uint32 MESH_ACTOR_HASH = crc32("mesh_rigid_actor");
 static const uint32 CONTROLLER_HASH = crc32("physical_controller");
 static const uint32 HEIGHTFIELD_HASH = crc32("physical_heightfield");
+static const float TILES_STREAMING_RADIUS = 1.5f; // in tiles
 
 
 enum class PhysicsSceneVersion : int
 {
 	LAYERS,
+	HEIGHTFIELD_TILES,
 
 	LATEST
 };
@@ -199,14 +202,20 @@ static void matrix2Transform(const Matrix& mtx, physx::PxTransform& transform)
 
 struct Heightfield
 {
-	Heightfield();
+	Heightfield(IAllocator& allocator);
 	~Heightfield();
 	void heightmapLoaded(Resource::State, Resource::State new_state);
+	void tileLoaded(int x, int z);
+	void tileUnloaded(int x, int z);
+	void destroyTiles();
 
 	struct PhysicsSceneImpl* m_scene;
 	Entity m_entity;
 	physx::PxRigidActor* m_actor;
 	Texture* m_heightmap;
+	TerrainTiles* m_tiles;
+	Array<physx::PxRigidActor*> m_tile_actors;
+	IAllocator& m_allocator;
 	float m_xz_scale;
 	float m_y_scale;
 	int m_layer;
@@ -471,14 +480,28 @@ struct PhysicsSceneImpl : public PhysicsScene
 	{
 		ASSERT(layer < lengthOf(m_layers_names));
 		m_terrains[cmp]->m_layer = layer;
+		updateHeightfieldFilterData(*m_terrains[cmp]);
+	}
+
 
-		if (m_terrains[cmp]->m_actor)
+	void updateHeightfieldFilterData(const Heightfield& terrain)
+	{
+		physx::PxFilterData data;
+		data.word0 = 1 << terrain.m_layer;
+		data.word1 = m_collision_filter[terrain.m_layer];
+		physx::PxShape* shapes[8];
+		if (terrain.m_actor)
 		{
-			physx::PxFilterData data;
-			data.word0 = 1 << layer;
-			data.word1 = m_collision_filter[layer];
-			physx::PxShape* shapes[8];
-			int shapes_count = m_terrains[cmp]->m_actor->getShapes(shapes, lengthOf(shapes));
+			int shapes_count = terrain.m_actor->getShapes(shapes, lengthOf(shapes));
+			for (int i = 0; i < shapes_count; ++i)
+			{
+				shapes[i]->setSimulationFilterData(data);
+			}
+		}
+		for (auto* actor : terrain.m_tile_actors)
+		{
+			if (!actor) continue;
+			int shapes_count = actor->getShapes(shapes, lengthOf(shapes));
 			for (int i = 0; i < shapes_count; ++i)
 			{
 				shapes[i]->setSimulationFilterData(data);
@@ -514,6 +537,8 @@ struct PhysicsSceneImpl : public PhysicsScene
 		if (type == HEIGHTFIELD_HASH)
 		{
 			Entity entity = m_terrains[cmp]->m_entity;
+			releaseHeightfieldActor(m_terrains[cmp]);
+			releaseHeightfieldTiles(m_terrains[cmp]);
 			LUMIX_DELETE(m_allocator, m_terrains[cmp]);
 			m_terrains[cmp] = nullptr;
 			m_universe.destroyComponent(entity, type, this, cmp);
@@ -541,7 +566,7 @@ struct PhysicsSceneImpl : public PhysicsScene
 
 	ComponentIndex createHeightfield(Entity entity)
 	{
-		Heightfield* terrain = LUMIX_NEW(m_allocator, Heightfield)();
+		Heightfield* terrain = LUMIX_NEW(m_allocator, Heightfield)(m_allocator);
 		m_terrains.push(terrain);
 		terrain->m_heightmap = nullptr;
 		terrain->m_scene = this;
@@ -645,11 +670,7 @@ struct PhysicsSceneImpl : public PhysicsScene
 		if (scale != m_terrains[cmp]->m_xz_scale)
 		{
 			m_terrains[cmp]->m_xz_scale = scale;
-			if (m_terrains[cmp]->m_heightmap &&
-				m_terrains[cmp]->m_heightmap->isReady())
-			{
-				heightmapLoaded(m_terrains[cmp]);
-			}
+			rebuildHeightfield(m_terrains[cmp]);
 		}
 	}
 
@@ -665,11 +686,27 @@ struct PhysicsSceneImpl : public PhysicsScene
 		if (scale != m_terrains[cmp]->m_y_scale)
 		{
 			m_terrains[cmp]->m_y_scale = scale;
-			if (m_terrains[cmp]->m_heightmap && m_terrains[cmp]->m_heightmap->isReady())
+			rebuildHeightfield(m_terrains[cmp]);
+		}
+	}
+
+
+	void rebuildHeightfield(Heightfield* terrain)
+	{
+		if (terrain->m_tiles)
+		{
+			const TerrainTiles& tiles = *terrain->m_tiles;
+			for (int i = 0; i < terrain->m_tile_actors.size(); ++i)
 			{
-				heightmapLoaded(m_terrains[cmp]);
+				if (!terrain->m_tile_actors[i]) continue;
+				heightfieldTileUnloaded(terrain, i % tiles.getTilesX(), i / tiles.getTilesX());
+				createHeightfieldTile(terrain, i % tiles.getTilesX(), i / tiles.getTilesX());
 			}
 		}
+		else if (terrain->m_heightmap && terrain->m_heightmap->isReady())
+		{
+			heightmapLoaded(terrain);
+		}
 	}
 
 
@@ -691,6 +728,176 @@ struct PhysicsSceneImpl : public PhysicsScene
 	}
 
 
+	Path getHeightfieldTiles(ComponentIndex cmp) override
+	{
+		auto* tiles = m_terrains[cmp]->m_tiles;
+		return tiles ? tiles->getPath() : Path("");
+	}
+
+
+	void setHeightfieldTiles(ComponentIndex cmp, const Path& path) override
+	{
+		Heightfield* terrain = m_terrains[cmp];
+		if (!path.isValid())
+		{
+			releaseHeightfieldTiles(terrain);
+			if (terrain->m_heightmap && terrain->m_heightmap->isReady())
+			{
+				heightmapLoaded(terrain);
+			}
+			return;
+		}
+
+		// tiles are the only colliders and the only source of the size
+		releaseHeightfieldActor(terrain);
+		if (!terrain->m_tiles)
+		{
+			terrain->m_tiles =
+				LUMIX_NEW(m_allocator, TerrainTiles)(m_engine->getFileSystem(), m_allocator);
+			terrain->m_tiles->tileLoaded().bind<Heightfield, &Heightfield::tileLoaded>(terrain);
+			terrain->m_tiles->tileUnloaded().bind<Heightfield, &Heightfield::tileUnloaded>(
+				terrain);
+		}
+		terrain->m_tiles->load(path);
+	}
+
+
+	void releaseHeightfieldTiles(Heightfield* terrain)
+	{
+		for (int i = 0; i < terrain->m_tile_actors.size(); ++i)
+		{
+			physx::PxRigidActor* actor = terrain->m_tile_actors[i];
+			if (!actor) continue;
+			m_scene->removeActor(*actor);
+			actor->release();
+		}
+		terrain->m_tile_actors.clear();
+		terrain->destroyTiles();
+	}
+
+
+	void releaseHeightfieldActor(Heightfield* terrain)
+	{
+		if (!terrain->m_actor) return;
+		m_scene->removeActor(*terrain->m_actor);
+		terrain->m_actor->release();
+		terrain->m_actor = nullptr;
+	}
+
+
+	// heightfield tiles are streamed around character controllers, the only objects that need
+	// to walk on them
+	void updateHeightfieldTiles()
+	{
+		PROFILE_FUNCTION();
+		for (auto* terrain : m_terrains)
+		{
+			if (!terrain || !terrain->m_tiles || !terrain->m_tiles->isReady()) continue;
+
+			Matrix inv_mtx = m_universe.getMatrix(terrain->m_entity);
+			inv_mtx.fastInverse();
+			float radius = TILES_STREAMING_RADIUS * terrain->m_tiles->getTileSize();
+			for (auto& controller : m_controllers)
+			{
+				if (controller.m_is_free) continue;
+
+				Vec3 pos = inv_mtx.multiplyPosition(m_universe.getPosition(controller.m_entity));
+				Vec2 center(pos.x / terrain->m_xz_scale, pos.z / terrain->m_xz_scale);
+				terrain->m_tiles->update(center, radius);
+			}
+			terrain->m_tiles->nextFrame();
+		}
+	}
+
+
+	void heightfieldTileLoaded(Heightfield* terrain, int tile_x, int tile_z)
+	{
+		PROFILE_FUNCTION();
+		createHeightfieldTile(terrain, tile_x, tile_z);
+
+		// neighbours on the left and top filled their seam with their own last row or column
+		const TerrainTiles& tiles = *terrain->m_tiles;
+		int neighbours[][2] = {{tile_x - 1, tile_z}, {tile_x, tile_z - 1}, {tile_x - 1, tile_z - 1}};
+		for (auto& neighbour : neighbours)
+		{
+			if (neighbour[0] < 0 || neighbour[1] < 0) continue;
+			int index = neighbour[0] + neighbour[1] * tiles.getTilesX();
+			if (index >= terrain->m_tile_actors.size() || !terrain->m_tile_actors[index]) continue;
+
+			heightfieldTileUnloaded(terrain, neighbour[0], neighbour[1]);
+			createHeightfieldTile(terrain, neighbour[0], neighbour[1]);
+		}
+	}
+
+
+	void createHeightfieldTile(Heightfield* terrain, int tile_x, int tile_z)
+	{
+		const TerrainTiles& tiles = *terrain->m_tiles;
+		int tile_size = tiles.getTileSize();
+		// one extra row and column from the neighbours, so there are no gaps between tiles
+		int size = tile_size + 1;
+		int from_x = tile_x * tile_size;
+		int from_z = tile_z * tile_size;
+		bool has_right = tiles.getTile(tile_x + 1, tile_z) != nullptr;
+		bool has_bottom = tiles.getTile(tile_x, tile_z + 1) != nullptr;
+		bool has_corner = tiles.getTile(tile_x + 1, tile_z + 1) != nullptr;
+
+		Array<physx::PxHeightFieldSample> heights(m_allocator);
+		heights.resize(size * size);
+		for (int j = 0; j < size; ++j)
+		{
+			for (int i = 0; i < size; ++i)
+			{
+				int x = i;
+				int z = j;
+				if (i == tile_size && (!has_right || (j == tile_size && !has_corner))) x = i - 1;
+				if (j == tile_size && (!has_bottom || (i == tile_size && !has_corner))) z = j - 1;
+				int idx = j + i * size;
+				heights[idx].height = tiles.getHeight(from_x + x, from_z + z);
+				heights[idx].materialIndex0 = heights[idx].materialIndex1 = 0;
+				heights[idx].setTessFlag();
+			}
+		}
+
+		Matrix mtx = m_universe.getMatrix(terrain->m_entity);
+		mtx.setTranslation(mtx.multiplyPosition(
+			Vec3(from_x * terrain->m_xz_scale, 0, from_z * terrain->m_xz_scale)));
+		physx::PxRigidActor* actor = createHeightfieldActor(
+			*terrain, &heights[0], size, size, 1 / (256 * 256.0f - 1), mtx);
+		if (!actor)
+		{
+			g_log_error.log("PhysX") << "Could not create PhysX heightfield tile " << tile_x
+									 << ", " << tile_z << " of " << tiles.getPath();
+			return;
+		}
+
+		int tile_index = tile_x + tile_z * tiles.getTilesX();
+		if (terrain->m_tile_actors.size() <= tile_index)
+		{
+			int old_size = terrain->m_tile_actors.size();
+			terrain->m_tile_actors.resize(tiles.getTilesX() * tiles.getTilesZ());
+			for (int i = old_size; i < terrain->m_tile_actors.size(); ++i)
+			{
+				terrain->m_tile_actors[i] = nullptr;
+			}
+		}
+		terrain->m_tile_actors[tile_index] = actor;
+	}
+
+
+	void heightfieldTileUnloaded(Heightfield* terrain, int tile_x, int tile_z)
+	{
+		int tile_index = tile_x + tile_z * terrain->m_tiles->getTilesX();
+		if (tile_index >= terrain->m_tile_actors.size()) return;
+
+		physx::PxRigidActor* actor = terrain->m_tile_actors[tile_index];
+		if (!actor) return;
+		m_scene->removeActor(*actor);
+		actor->release();
+		terrain->m_tile_actors[tile_index] = nullptr;
+	}
+
+
 	Path getShapeSource(ComponentIndex cmp) override
 	{
 		return m_actors[cmp]->getResource() ? m_actors[cmp]->getResource()->getPath() : Path("");
@@ -817,6 +1024,7 @@ struct PhysicsSceneImpl : public PhysicsScene
 
 	void update(float time_delta) override
 	{
+		updateHeightfieldTiles();
 		if (!m_is_game_running) return;
 		
 		applyQueuedForces();
@@ -979,6 +1187,9 @@ struct PhysicsSceneImpl : public PhysicsScene
 	void heightmapLoaded(Heightfield* terrain)
 	{
 		PROFILE_FUNCTION();
+		// colliders come from the tiles
+		if (terrain->m_tiles) return;
+
 		Array<physx::PxHeightFieldSample> heights(m_allocator);
 
 		int width = terrain->m_heightmap->getWidth();
@@ -1022,69 +1233,65 @@ struct PhysicsSceneImpl : public PhysicsScene
 			}
 		}
 
-		{ // PROFILE_BLOCK scope
-			PROFILE_BLOCK("PhysX");
-			physx::PxHeightFieldDesc hfDesc;
-			hfDesc.format = physx::PxHeightFieldFormat::eS16_TM;
-			hfDesc.nbColumns = width;
-			hfDesc.nbRows = height;
-			hfDesc.samples.data = &heights[0];
-			hfDesc.samples.stride = sizeof(physx::PxHeightFieldSample);
-			hfDesc.thickness = -1;
-
-			physx::PxHeightField* heightfield =
-				m_system->getPhysics()->createHeightField(hfDesc);
-			float height_scale =
-				bytes_per_pixel == 2 ? 1 / (256 * 256.0f - 1) : 1 / 255.0f;
-			physx::PxHeightFieldGeometry hfGeom(heightfield,
-												physx::PxMeshGeometryFlags(),
-												height_scale *
-													terrain->m_y_scale,
-												terrain->m_xz_scale,
-												terrain->m_xz_scale);
-			if (terrain->m_actor)
-			{
-				physx::PxRigidActor* actor = terrain->m_actor;
-				m_scene->removeActor(*actor);
-				actor->release();
-				terrain->m_actor = nullptr;
-			}
+		float height_scale = bytes_per_pixel == 2 ? 1 / (256 * 256.0f - 1) : 1 / 255.0f;
+		releaseHeightfieldActor(terrain);
+
+		Matrix mtx = m_universe.getMatrix(terrain->m_entity);
+		terrain->m_actor =
+			createHeightfieldActor(*terrain, &heights[0], width, height, height_scale, mtx);
+		if (!terrain->m_actor)
+		{
+			g_log_error.log("PhysX") << "Could not create PhysX heightfield "
+									 << terrain->m_heightmap->getPath();
+		}
+	}
 
-			physx::PxTransform transform;
-			Matrix mtx = m_universe.getMatrix(terrain->m_entity);
-			matrix2Transform(mtx, transform);
 
-			physx::PxRigidActor* actor;
-			actor = PxCreateStatic(*m_system->getPhysics(),
-								   transform,
-								   hfGeom,
-								   *m_default_material);
-			if (actor)
-			{
-				actor->setActorFlag(physx::PxActorFlag::eVISUALIZATION,
-									width <= 1024);
-				actor->userData = (void*)terrain->m_entity;
-				m_scene->addActor(*actor);
-				terrain->m_actor = actor;
-
-				physx::PxFilterData data;
-				int terrain_layer = terrain->m_layer;
-				data.word0 = 1 << terrain_layer;
-				data.word1 = m_collision_filter[terrain_layer];
-				physx::PxShape* shapes[8];
-				int shapes_count = actor->getShapes(shapes, lengthOf(shapes));
-				for (int i = 0; i < shapes_count; ++i)
-				{
-					shapes[i]->setSimulationFilterData(data);
-				}
-			}
-			else
-			{
-				g_log_error.log("PhysX")
-					<< "Could not create PhysX heightfield "
-					<< terrain->m_heightmap->getPath();
-			}
+	physx::PxRigidActor* createHeightfieldActor(const Heightfield& terrain,
+		const physx::PxHeightFieldSample* samples,
+		int width,
+		int height,
+		float height_scale,
+		const Matrix& mtx)
+	{
+		PROFILE_FUNCTION();
+		physx::PxHeightFieldDesc hfDesc;
+		hfDesc.format = physx::PxHeightFieldFormat::eS16_TM;
+		hfDesc.nbColumns = width;
+		hfDesc.nbRows = height;
+		hfDesc.samples.data = samples;
+		hfDesc.samples.stride = sizeof(physx::PxHeightFieldSample);
+		hfDesc.thickness = -1;
+
+		physx::PxHeightField* heightfield = m_system->getPhysics()->createHeightField(hfDesc);
+		physx::PxHeightFieldGeometry hfGeom(heightfield,
+			physx::PxMeshGeometryFlags(),
+			height_scale * terrain.m_y_scale,
+			terrain.m_xz_scale,
+			terrain.m_xz_scale);
+
+		physx::PxTransform transform;
+		matrix2Transform(mtx, transform);
+
+		physx::PxRigidActor* actor =
+			PxCreateStatic(*m_system->getPhysics(), transform, hfGeom, *m_default_material);
+		if (!actor) return nullptr;
+
+		actor->setActorFlag(physx::PxActorFlag::eVISUALIZATION, width <= 1024);
+		actor->userData = (void*)terrain.m_entity;
+		m_scene->addActor(*actor);
+
+		physx::PxFilterData data;
+		int terrain_layer = terrain.m_layer;
+		data.word0 = 1 << terrain_layer;
+		data.word1 = m_collision_filter[terrain_layer];
+		physx::PxShape* shapes[8];
+		int shapes_count = actor->getShapes(shapes, lengthOf(shapes));
+		for (int i = 0; i < shapes_count; ++i)
+		{
+			shapes[i]->setSimulationFilterData(data);
 		}
+		return actor;
 	}
 
 
@@ -1111,7 +1318,6 @@ struct PhysicsSceneImpl : public PhysicsScene
 		for (auto* terrain : m_terrains)
 		{
 			if (!terrain) continue;
-			if (!terrain->m_actor) continue;
 			terrain->m_layer = Math::minValue(m_layers_count - 1, terrain->m_layer);
 		}
 
@@ -1206,18 +1412,7 @@ struct PhysicsSceneImpl : public PhysicsScene
 		for (auto* terrain : m_terrains)
 		{
 			if (!terrain) continue;
-			if (!terrain->m_actor) continue;
-
-			physx::PxFilterData data;
-			int terrain_layer = terrain->m_layer;
-			data.word0 = 1 << terrain_layer;
-			data.word1 = m_collision_filter[terrain_layer];
-			physx::PxShape* shapes[8];
-			int shapes_count = terrain->m_actor->getShapes(shapes, lengthOf(shapes));
-			for (int i = 0; i < shapes_count; ++i)
-			{
-				shapes[i]->setSimulationFilterData(data);
-			}
+			updateHeightfieldFilterData(*terrain);
 		}
 	}
 
@@ -1473,6 +1668,9 @@ struct PhysicsSceneImpl : public PhysicsScene
 				serializer.write(m_terrains[i]->m_xz_scale);
 				serializer.write(m_terrains[i]->m_y_scale);
 				serializer.write(m_terrains[i]->m_layer);
+				serializer.writeString(m_terrains[i]->m_tiles
+										   ? m_terrains[i]->m_tiles->getPath().c_str()
+										   : "");
 			}
 			else
 			{
@@ -1580,6 +1778,9 @@ struct PhysicsSceneImpl : public PhysicsScene
 		serializer.read(count);
 		for (int i = count; i < m_terrains.size(); ++i)
 		{
+			if (!m_terrains[i]) continue;
+			releaseHeightfieldActor(m_terrains[i]);
+			releaseHeightfieldTiles(m_terrains[i]);
 			LUMIX_DELETE(m_allocator, m_terrains[i]);
 			m_terrains[i] = nullptr;
 		}
@@ -1597,7 +1798,7 @@ struct PhysicsSceneImpl : public PhysicsScene
 			{
 				if (!m_terrains[i])
 				{
-					m_terrains[i] = LUMIX_NEW(m_allocator, Heightfield);
+					m_terrains[i] = LUMIX_NEW(m_allocator, Heightfield)(m_allocator);
 				}
 				m_terrains[i]->m_scene = this;
 				serializer.read(m_terrains[i]->m_entity);
@@ -1619,6 +1820,11 @@ struct PhysicsSceneImpl : public PhysicsScene
 				{
 					setHeightmap(i, Path(tmp));
 				}
+				if (version > (int)PhysicsSceneVersion::HEIGHTFIELD_TILES)
+				{
+					serializer.readString(tmp, MAX_PATH_LENGTH);
+					setHeightfieldTiles(i, Path(tmp));
+				}
 				m_universe.addComponent(m_terrains[i]->m_entity, HEIGHTFIELD_HASH, this, i);
 			}
 		}
@@ -1872,9 +2078,12 @@ void PhysicsSceneImpl::RigidActor::setResource(PhysicsGeometry* resource)
 }
 
 
-Heightfield::Heightfield()
+Heightfield::Heightfield(IAllocator& allocator)
+	: m_allocator(allocator)
+	, m_tile_actors(allocator)
 {
 	m_heightmap = nullptr;
+	m_tiles = nullptr;
 	m_xz_scale = 1.0f;
 	m_y_scale = 1.0f;
 	m_actor = nullptr;
@@ -1884,6 +2093,7 @@ Heightfield::Heightfield()
 
 Heightfield::~Heightfield()
 {
+	destroyTiles();
 	if (m_heightmap)
 	{
 		m_heightmap->getResourceManager()
@@ -1895,6 +2105,17 @@ Heightfield::~Heightfield()
 }
 
 
+// the tiles fire tileUnloaded for every resident tile when deleted
+void Heightfield::destroyTiles()
+{
+	if (!m_tiles) return;
+	m_tiles->tileLoaded().unbind<Heightfield, &Heightfield::tileLoaded>(this);
+	m_tiles->tileUnloaded().unbind<Heightfield, &Heightfield::tileUnloaded>(this);
+	LUMIX_DELETE(m_allocator, m_tiles);
+	m_tiles = nullptr;
+}
+
+
 void Heightfield::heightmapLoaded(Resource::State, Resource::State new_state)
 {
 	if (new_state == Resource::State::READY)
@@ -1904,4 +2125,16 @@ void Heightfield::heightmapLoaded(Resource::State, Resource::State new_state)
 }
 
 
+void Heightfield::tileLoaded(int x, int z)
+{
+	m_scene->heightfieldTileLoaded(this, x, z);
+}
+
+
+void Heightfield::tileUnloaded(int x, int z)
+{
+	m_scene->heightfieldTileUnloaded(this, x, z);
+}
+
+
 } // !namespace Lumix
@@ -56,6 +56,8 @@ class LUMIX_PHYSICS_API PhysicsScene : public IScene
 		virtual void setHeightmapXZScale(ComponentIndex cmp, float scale) = 0;
 		virtual float getHeightmapYScale(ComponentIndex cmp) = 0;
 		virtual void setHeightmapYScale(ComponentIndex cmp, float scale) = 0;
+		virtual Path getHeightfieldTiles(ComponentIndex cmp) = 0;
+		virtual void setHeightfieldTiles(ComponentIndex cmp, const Path& path) = 0;
 		virtual int getHeightfieldLayer(ComponentIndex cmp) = 0;
 		virtual void setHeightfieldLayer(ComponentIndex cmp, int layer) = 0;
 
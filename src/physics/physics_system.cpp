@@ -358,6 +358,12 @@ static void registerProperties(Lumix::IAllocator& allocator)
 		"Image (*.raw)",
 		ResourceManager::TEXTURE,
 		allocator));
+	PropertyRegister::add("physical_heightfield",
+		LUMIX_NEW(allocator, FilePropertyDescriptor<PhysicsScene>)("Tiles",
+		&PhysicsScene::getHeightfieldTiles,
+		&PhysicsScene::setHeightfieldTiles,
+		"Terrain tiles (*.ltiles)",
+		allocator));
 	PropertyRegister::add("physical_heightfield",
 		LUMIX_NEW(allocator, DecimalPropertyDescriptor<PhysicsScene>)("XZ scale",
 		&PhysicsScene::getHeightmapXZScale,
@@ -221,7 +221,8 @@ public:
 		Lumix::FS::FileSystem& fs = m_engine->getFileSystem();
 
 		bool can_do_next_test = m_current_test == -1 ||
-								(!m_engine->getFileSystem().hasWork() && m_is_test_universe_loaded);
+								(!m_engine->getFileSystem().hasWork() &&
+									!m_engine->getResourceManager().hasWork() && m_is_test_universe_loaded);
 		if (can_do_next_test)
 		{
 			char path[Lumix::MAX_PATH_LENGTH];
@@ -302,7 +303,7 @@ public:
 			m_pipeline->render();
 			auto* renderer = m_engine->getPluginManager().getPlugin("renderer");
 			static_cast<Lumix::Renderer*>(renderer)->frame();
-			if (!m_engine->getFileSystem().hasWork())
+			if (!m_engine->getFileSystem().hasWork() && !m_engine->getResourceManager().hasWork())
 			{
 				if (!nextTest()) return;
 			}
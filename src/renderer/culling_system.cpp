@@ -288,6 +288,13 @@ public:
 	}
 
 
+	bool isAdded(ComponentIndex renderable) const override
+	{
+		return renderable < m_renderable_to_sphere_map.size() &&
+			   m_renderable_to_sphere_map[renderable] >= 0;
+	}
+
+
 	void updateBoundingRadius(float radius, ComponentIndex renderable) override
 	{
 		m_spheres[m_renderable_to_sphere_map[renderable]].m_radius = radius;
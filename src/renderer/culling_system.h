@@ -32,6 +32,7 @@ namespace Lumix
 
 		virtual void addStatic(ComponentIndex renderable, const Sphere& sphere) = 0;
 		virtual void removeStatic(ComponentIndex renderable) = 0;
+		virtual bool isAdded(ComponentIndex renderable) const = 0;
 
 		virtual void setLayerMask(ComponentIndex renderable, int64 layer) = 0;
 		virtual int64 getLayerMask(ComponentIndex renderable) = 0;
@@ -484,7 +484,8 @@ bool Material::deserializeTexture(JsonSerializer& serializer, const char* materi
 					copyString(texture_path, path);
 				}
 				auto* mng = m_resource_manager.get(ResourceManager::TEXTURE);
-				m_textures[m_texture_count] = static_cast<Texture*>(mng->load(Path(texture_path)));
+				m_textures[m_texture_count] =
+					static_cast<Texture*>(mng->load(Path(texture_path), getLoadPriority()));
 				addDependency(*m_textures[m_texture_count]);
 			}
 		}
@@ -680,7 +681,7 @@ bool Material::load(FS::IFile& file)
 			Path path;
 			serializer.deserialize(path, Path(""));
 			auto* manager = m_resource_manager.get(ResourceManager::SHADER);
-			setShader(static_cast<Shader*>(manager->load(Path(path))));
+			setShader(static_cast<Shader*>(manager->load(Path(path), getLoadPriority())));
 		}
 		else if (compareString(label, "z_test") == 0)
 		{
@@ -0,0 +1,694 @@
+#include "mesh_optimizer.h"
+#include "core/math_utils.h"
+#include "core/string.h"
+#include "core/vec.h"
+#include <cmath>
+#include <cstdlib>
+
+
+namespace Lumix
+{
+
+
+namespace MeshOptimizer
+{
+
+
+static const float BORDER_WEIGHT = 10.0f;
+
+
+enum class VertexKind : uint8
+{
+	MANIFOLD,
+	BORDER,
+	LOCKED
+};
+
+
+struct Quadric
+{
+	float a00, a11, a22;
+	float a01, a02, a12;
+	float b0, b1, b2;
+	float c;
+};
+
+
+struct SortedVertex
+{
+	Vec3 position;
+	uint32 index;
+};
+
+
+struct Collapse
+{
+	uint32 from;
+	uint32 to;
+	float error;
+};
+
+
+static int compareSortedVertices(const void* a, const void* b)
+{
+	const Vec3& lhs = static_cast<const SortedVertex*>(a)->position;
+	const Vec3& rhs = static_cast<const SortedVertex*>(b)->position;
+	if (lhs.x != rhs.x) return lhs.x < rhs.x ? -1 : 1;
+	if (lhs.y != rhs.y) return lhs.y < rhs.y ? -1 : 1;
+	if (lhs.z != rhs.z) return lhs.z < rhs.z ? -1 : 1;
+	return 0;
+}
+
+
+static int compareEdges(const void* a, const void* b)
+{
+	uint64 lhs = *static_cast<const uint64*>(a);
+	uint64 rhs = *static_cast<const uint64*>(b);
+	if (lhs == rhs) return 0;
+	return lhs < rhs ? -1 : 1;
+}
+
+
+static int compareCollapses(const void* a, const void* b)
+{
+	float lhs = static_cast<const Collapse*>(a)->error;
+	float rhs = static_cast<const Collapse*>(b)->error;
+	if (lhs == rhs) return 0;
+	return lhs < rhs ? -1 : 1;
+}
+
+
+static uint64 getEdgeKey(uint32 a, uint32 b)
+{
+	return a < b ? ((uint64)a << 32) | b : ((uint64)b << 32) | a;
+}
+
+
+static bool isBorderEdge(const Array<uint64>& sorted_edges, uint64 key)
+{
+	int from = 0;
+	int to = sorted_edges.size();
+	while (from < to)
+	{
+		int mid = (from + to) / 2;
+		if (sorted_edges[mid] < key)
+		{
+			from = mid + 1;
+		}
+		else
+		{
+			to = mid;
+		}
+	}
+	if (from >= sorted_edges.size() || sorted_edges[from] != key) return false;
+	return from + 1 == sorted_edges.size() || sorted_edges[from + 1] != key;
+}
+
+
+static void addPlane(Quadric& q, const Vec3& normal, float d, float weight)
+{
+	q.a00 += weight * normal.x * normal.x;
+	q.a11 += weight * normal.y * normal.y;
+	q.a22 += weight * normal.z * normal.z;
+	q.a01 += weight * normal.x * normal.y;
+	q.a02 += weight * normal.x * normal.z;
+	q.a12 += weight * normal.y * normal.z;
+	q.b0 += weight * normal.x * d;
+	q.b1 += weight * normal.y * d;
+	q.b2 += weight * normal.z * d;
+	q.c += weight * d * d;
+}
+
+
+static void addQuadric(Quadric& q, const Quadric& r)
+{
+	q.a00 += r.a00;
+	q.a11 += r.a11;
+	q.a22 += r.a22;
+	q.a01 += r.a01;
+	q.a02 += r.a02;
+	q.a12 += r.a12;
+	q.b0 += r.b0;
+	q.b1 += r.b1;
+	q.b2 += r.b2;
+	q.c += r.c;
+}
+
+
+static float getError(const Quadric& q, const Vec3& p)
+{
+	float error = q.a00 * p.x * p.x + q.a11 * p.y * p.y + q.a22 * p.z * p.z;
+	error += 2 * (q.a01 * p.x * p.y + q.a02 * p.x * p.z + q.a12 * p.y * p.z);
+	error += 2 * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z);
+	error += q.c;
+	return Math::abs(error);
+}
+
+
+static bool isFlipping(const uint32* indices,
+	const Array<int>& triangle_offsets,
+	const Array<int>& triangles,
+	const Vec3* positions,
+	uint32 from,
+	uint32 to)
+{
+	for (int i = triangle_offsets[from]; i < triangle_offsets[from + 1]; ++i)
+	{
+		const uint32* tri = indices + triangles[i] * 3;
+		if (tri[0] == to || tri[1] == to || tri[2] == to) continue;
+
+		Vec3 p0 = positions[tri[0]];
+		Vec3 p1 = positions[tri[1]];
+		Vec3 p2 = positions[tri[2]];
+		Vec3 old_normal = crossProduct(p1 - p0, p2 - p0);
+		if (tri[0] == from) p0 = positions[to];
+		if (tri[1] == from) p1 = positions[to];
+		if (tri[2] == from) p2 = positions[to];
+		Vec3 new_normal = crossProduct(p1 - p0, p2 - p0);
+		if (dotProduct(old_normal, new_normal) <= 0) return true;
+	}
+	return false;
+}
+
+
+static void buildTriangleAdjacency(Array<int>& offsets,
+	Array<int>& triangles,
+	const uint32* indices,
+	int index_count,
+	int vertex_count,
+	IAllocator& allocator)
+{
+	offsets.resize(vertex_count + 1);
+	setMemory(&offsets[0], 0, offsets.size() * sizeof(offsets[0]));
+	for (int i = 0; i < index_count; ++i) ++offsets[indices[i] + 1];
+	for (int i = 0; i < vertex_count; ++i) offsets[i + 1] += offsets[i];
+
+	triangles.resize(index_count);
+	Array<int> fill(allocator);
+	fill.resize(vertex_count);
+	for (int i = 0; i < vertex_count; ++i) fill[i] = offsets[i];
+	for (int i = 0; i < index_count; ++i) triangles[fill[indices[i]]++] = i / 3;
+}
+
+
+void simplify(Array<uint32>& out_indices,
+	const uint32* indices,
+	int index_count,
+	const Vec3* positions,
+	int vertex_count,
+	int target_index_count,
+	IAllocator& allocator)
+{
+	out_indices.resize(index_count);
+	if (index_count == 0) return;
+	copyMemory(&out_indices[0], indices, index_count * sizeof(indices[0]));
+	if (index_count <= target_index_count) return;
+
+	// vertices with the same position are split by other attributes,
+	// moving them would tear the mesh
+	Array<SortedVertex> sorted(allocator);
+	sorted.resize(vertex_count);
+	for (int i = 0; i < vertex_count; ++i)
+	{
+		sorted[i].position = positions[i];
+		sorted[i].index = i;
+	}
+	qsort(&sorted[0], vertex_count, sizeof(sorted[0]), compareSortedVertices);
+
+	Array<uint32> position_ids(allocator);
+	Array<VertexKind> kinds(allocator);
+	position_ids.resize(vertex_count);
+	kinds.resize(vertex_count);
+	for (int i = 0; i < vertex_count;)
+	{
+		int end = i + 1;
+		while (end < vertex_count && compareSortedVertices(&sorted[i], &sorted[end]) == 0) ++end;
+		for (int j = i; j < end; ++j)
+		{
+			position_ids[sorted[j].index] = sorted[i].index;
+			kinds[sorted[j].index] = end - i > 1 ? VertexKind::LOCKED : VertexKind::MANIFOLD;
+		}
+		i = end;
+	}
+
+	Array<uint64> edges(allocator);
+	edges.resize(index_count);
+	for (int i = 0; i < index_count; i += 3)
+	{
+		for (int j = 0; j < 3; ++j)
+		{
+			uint32 a = position_ids[indices[i + j]];
+			uint32 b = position_ids[indices[i + (j + 1) % 3]];
+			edges[i + j] = getEdgeKey(a, b);
+		}
+	}
+	qsort(&edges[0], edges.size(), sizeof(edges[0]), compareEdges);
+
+	Array<Quadric> quadrics(allocator);
+	quadrics.resize(vertex_count);
+	setMemory(&quadrics[0], 0, vertex_count * sizeof(quadrics[0]));
+	for (int i = 0; i < index_count; i += 3)
+	{
+		const uint32* tri = indices + i;
+		Vec3 normal = crossProduct(positions[tri[1]] - positions[tri[0]],
+			positions[tri[2]] - positions[tri[0]]);
+		float area = normal.length();
+		if (area == 0) continue;
+		normal *= 1 / area;
+		float d = -dotProduct(normal, positions[tri[0]]);
+		for (int j = 0; j < 3; ++j) addPlane(quadrics[tri[j]], normal, d, area);
+
+		for (int j = 0; j < 3; ++j)
+		{
+			uint32 a = tri[j];
+			uint32 b = tri[(j + 1) % 3];
+			if (!isBorderEdge(edges, getEdgeKey(position_ids[a], position_ids[b]))) continue;
+
+			if (kinds[a] == VertexKind::MANIFOLD) kinds[a] = VertexKind::BORDER;
+			if (kinds[b] == VertexKind::MANIFOLD) kinds[b] = VertexKind::BORDER;
+
+			// a plane perpendicular to the triangle keeps the border from sliding inwards
+			Vec3 edge = positions[b] - positions[a];
+			float length = edge.length();
+			if (length == 0) continue;
+			Vec3 border_normal = crossProduct(edge, normal);
+			border_normal.normalize();
+			float border_d = -dotProduct(border_normal, positions[a]);
+			addPlane(quadrics[a], border_normal, border_d, length * length * BORDER_WEIGHT);
+			addPlane(quadrics[b], border_normal, border_d, length * length * BORDER_WEIGHT);
+		}
+	}
+
+	Array<int> triangle_offsets(allocator);
+	Array<int> triangles(allocator);
+	Array<Collapse> collapses(allocator);
+	Array<uint32> remap(allocator);
+	Array<bool> is_touched(allocator);
+	remap.resize(vertex_count);
+	is_touched.resize(vertex_count);
+
+	int current_index_count = index_count;
+	while (current_index_count > target_index_count)
+	{
+		uint32* current = &out_indices[0];
+
+		buildTriangleAdjacency(
+			triangle_offsets, triangles, current, current_index_count, vertex_count, allocator);
+
+		collapses.clear();
+		for (int i = 0; i < current_index_count; i += 3)
+		{
+			for (int j = 0; j < 3; ++j)
+			{
+				uint32 from = current[i + j];
+				uint32 to = current[i + (j + 1) % 3];
+				if (kinds[from] == VertexKind::LOCKED) continue;
+				if (kinds[from] == VertexKind::BORDER &&
+					!isBorderEdge(edges, getEdgeKey(position_ids[from], position_ids[to])))
+				{
+					continue;
+				}
+
+				Quadric q = quadrics[from];
+				addQuadric(q, quadrics[to]);
+				Collapse& collapse = collapses.pushEmpty();
+				collapse.from = from;
+				collapse.to = to;
+				collapse.error = getError(q, positions[to]);
+			}
+		}
+		if (collapses.empty()) break;
+		qsort(&collapses[0], collapses.size(), sizeof(collapses[0]), compareCollapses);
+
+		for (int i = 0; i < vertex_count; ++i)
+		{
+			remap[i] = i;
+			is_touched[i] = false;
+		}
+
+		int triangles_to_remove = (current_index_count - target_index_count) / 3;
+		int removed_triangles = 0;
+		// every edge is listed twice and an interior collapse removes two triangles, so the first
+		// triangles_to_remove candidates are about enough; pricier ones wait until the next pass
+		int limit_idx = Math::minValue(collapses.size() - 1, triangles_to_remove);
+		float error_limit = collapses[limit_idx].error;
+		for (const Collapse& collapse : collapses)
+		{
+			if (removed_triangles >= triangles_to_remove || collapse.error > error_limit) break;
+			if (is_touched[collapse.from] || is_touched[collapse.to]) continue;
+			if (isFlipping(
+					current, triangle_offsets, triangles, positions, collapse.from, collapse.to))
+			{
+				continue;
+			}
+
+			remap[collapse.from] = collapse.to;
+			addQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+			removed_triangles += kinds[collapse.from] == VertexKind::BORDER ? 1 : 2;
+
+			// the whole one-ring changes shape, its vertices wait for the next pass
+			int ring_end = triangle_offsets[collapse.from + 1];
+			for (int j = triangle_offsets[collapse.from]; j < ring_end; ++j)
+			{
+				const uint32* tri = current + triangles[j] * 3;
+				is_touched[tri[0]] = is_touched[tri[1]] = is_touched[tri[2]] = true;
+			}
+		}
+		if (removed_triangles == 0) break;
+
+		int write = 0;
+		for (int i = 0; i < current_index_count; i += 3)
+		{
+			uint32 a = remap[current[i]];
+			uint32 b = remap[current[i + 1]];
+			uint32 c = remap[current[i + 2]];
+			if (a == b || b == c || a == c) continue;
+			current[write] = a;
+			current[write + 1] = b;
+			current[write + 2] = c;
+			write += 3;
+		}
+		current_index_count = write;
+	}
+
+	out_indices.resize(current_index_count);
+}
+
+
+static int getNextVertex(const Array<int>& candidates,
+	const Array<int>& live_triangles,
+	const Array<uint32>& cache_timestamps,
+	uint32 timestamp,
+	Array<int>& dead_ends,
+	int& cursor)
+{
+	int best = -1;
+	int best_priority = -1;
+	for (int v : candidates)
+	{
+		if (live_triangles[v] == 0) continue;
+
+		// prefer vertices which stay in the cache even after their remaining triangles are emitted
+		int priority = 0;
+		if (int(timestamp - cache_timestamps[v]) + 2 * live_triangles[v] <= CACHE_SIZE)
+		{
+			priority = timestamp - cache_timestamps[v];
+		}
+		if (priority > best_priority)
+		{
+			best_priority = priority;
+			best = v;
+		}
+	}
+	if (best >= 0) return best;
+
+	while (!dead_ends.empty())
+	{
+		int v = dead_ends.back();
+		dead_ends.pop();
+		if (live_triangles[v] > 0) return v;
+	}
+	while (cursor < live_triangles.size())
+	{
+		if (live_triangles[cursor] > 0) return cursor;
+		++cursor;
+	}
+	return -1;
+}
+
+
+void optimizeVertexCache(Array<uint32>& out_indices,
+	const uint32* indices,
+	int index_count,
+	int vertex_count,
+	IAllocator& allocator)
+{
+	out_indices.clear();
+	out_indices.reserve(index_count);
+	if (index_count == 0) return;
+
+	Array<int> offsets(allocator);
+	Array<int> triangles(allocator);
+	buildTriangleAdjacency(offsets, triangles, indices, index_count, vertex_count, allocator);
+
+	Array<int> live_triangles(allocator);
+	Array<uint32> cache_timestamps(allocator);
+	Array<bool> is_emitted(allocator);
+	Array<int> dead_ends(allocator);
+	Array<int> candidates(allocator);
+	live_triangles.resize(vertex_count);
+	cache_timestamps.resize(vertex_count);
+	is_emitted.resize(index_count / 3);
+	for (int i = 0; i < vertex_count; ++i)
+	{
+		live_triangles[i] = offsets[i + 1] - offsets[i];
+		cache_timestamps[i] = 0;
+	}
+	for (int i = 0; i < is_emitted.size(); ++i) is_emitted[i] = false;
+
+	uint32 timestamp = CACHE_SIZE + 1;
+	int cursor = 0;
+	int fanning_vertex =
+		getNextVertex(candidates, live_triangles, cache_timestamps, timestamp, dead_ends, cursor);
+	while (fanning_vertex >= 0)
+	{
+		candidates.clear();
+		for (int i = offsets[fanning_vertex]; i < offsets[fanning_vertex + 1]; ++i)
+		{
+			int triangle = triangles[i];
+			if (is_emitted[triangle]) continue;
+
+			is_emitted[triangle] = true;
+			for (int j = 0; j < 3; ++j)
+			{
+				uint32 v = indices[triangle * 3 + j];
+				out_indices.push(v);
+				dead_ends.push(v);
+				candidates.push(v);
+				--live_triangles[v];
+				if (timestamp - cache_timestamps[v] > CACHE_SIZE)
+				{
+					cache_timestamps[v] = timestamp;
+					++timestamp;
+				}
+			}
+		}
+		fanning_vertex = getNextVertex(
+			candidates, live_triangles, cache_timestamps, timestamp, dead_ends, cursor);
+	}
+}
+
+
+static Vec3 getTriangleNormal(const uint32* tri, const Vec3* positions, const Vec3* normals)
+{
+	Vec3 normal = crossProduct(positions[tri[1]] - positions[tri[0]],
+		positions[tri[2]] - positions[tri[0]]);
+	if (normals)
+	{
+		Vec3 shading_normal = normals[tri[0]] + normals[tri[1]] + normals[tri[2]];
+		if (dotProduct(normal, shading_normal) < 0) normal = -normal;
+	}
+	return normal;
+}
+
+
+struct OverdrawCluster
+{
+	int from_triangle;
+	int to_triangle;
+	float sort_key;
+};
+
+
+static int compareOverdrawClusters(const void* a, const void* b)
+{
+	float lhs = static_cast<const OverdrawCluster*>(a)->sort_key;
+	float rhs = static_cast<const OverdrawCluster*>(b)->sort_key;
+	if (lhs == rhs) return 0;
+	return lhs > rhs ? -1 : 1;
+}
+
+
+void optimizeOverdraw(uint32* indices,
+	int index_count,
+	const Vec3* positions,
+	const Vec3* normals,
+	int vertex_count,
+	IAllocator& allocator)
+{
+	int triangle_count = index_count / 3;
+	if (triangle_count == 0) return;
+
+	// a triangle with three cache misses starts a run, reordering runs does not hurt the cache
+	Array<OverdrawCluster> clusters(allocator);
+	Array<uint32> cache_timestamps(allocator);
+	cache_timestamps.resize(vertex_count);
+	for (int i = 0; i < vertex_count; ++i) cache_timestamps[i] = 0;
+	uint32 timestamp = CACHE_SIZE + 1;
+	for (int i = 0; i < triangle_count; ++i)
+	{
+		int misses = 0;
+		for (int j = 0; j < 3; ++j)
+		{
+			uint32 v = indices[i * 3 + j];
+			if (timestamp - cache_timestamps[v] > CACHE_SIZE)
+			{
+				cache_timestamps[v] = timestamp;
+				++timestamp;
+				++misses;
+			}
+		}
+		if (misses == 3 || clusters.empty())
+		{
+			OverdrawCluster& cluster = clusters.pushEmpty();
+			cluster.from_triangle = i;
+		}
+		clusters.back().to_triangle = i + 1;
+	}
+
+	Vec3 mesh_centroid(0, 0, 0);
+	float mesh_area = 0;
+	for (int i = 0; i < triangle_count; ++i)
+	{
+		const uint32* tri = indices + i * 3;
+		float area = getTriangleNormal(tri, positions, nullptr).length();
+		mesh_centroid += (positions[tri[0]] + positions[tri[1]] + positions[tri[2]]) * area;
+		mesh_area += area;
+	}
+	if (mesh_area == 0) return;
+	mesh_centroid *= 1 / (3 * mesh_area);
+
+	for (OverdrawCluster& cluster : clusters)
+	{
+		Vec3 centroid(0, 0, 0);
+		Vec3 normal(0, 0, 0);
+		float area = 0;
+		for (int i = cluster.from_triangle; i < cluster.to_triangle; ++i)
+		{
+			const uint32* tri = indices + i * 3;
+			Vec3 triangle_normal = getTriangleNormal(tri, positions, normals);
+			float triangle_area = triangle_normal.length();
+			centroid += (positions[tri[0]] + positions[tri[1]] + positions[tri[2]]) * triangle_area;
+			normal += triangle_normal;
+			area += triangle_area;
+		}
+		cluster.sort_key = 0;
+		if (area == 0) continue;
+		centroid *= 1 / (3 * area);
+		cluster.sort_key = dotProduct(centroid - mesh_centroid, normal) / area;
+	}
+	qsort(&clusters[0], clusters.size(), sizeof(clusters[0]), compareOverdrawClusters);
+
+	Array<uint32> sorted(allocator);
+	sorted.reserve(index_count);
+	for (const OverdrawCluster& cluster : clusters)
+	{
+		for (int i = cluster.from_triangle * 3; i < cluster.to_triangle * 3; ++i)
+		{
+			sorted.push(indices[i]);
+		}
+	}
+	copyMemory(indices, &sorted[0], sorted.size() * sizeof(sorted[0]));
+}
+
+
+float getACMR(const uint32* indices,
+	int index_count,
+	int vertex_count,
+	int cache_size,
+	IAllocator& allocator)
+{
+	if (index_count == 0) return 0;
+
+	Array<uint32> cache_timestamps(allocator);
+	cache_timestamps.resize(vertex_count);
+	for (int i = 0; i < vertex_count; ++i) cache_timestamps[i] = 0;
+	uint32 timestamp = cache_size + 1;
+	int misses = 0;
+	for (int i = 0; i < index_count; ++i)
+	{
+		uint32 v = indices[i];
+		if (timestamp - cache_timestamps[v] > (uint32)cache_size)
+		{
+			cache_timestamps[v] = timestamp;
+			++timestamp;
+			++misses;
+		}
+	}
+	return misses / (index_count / 3.0f);
+}
+
+
+void buildClusters(Array<Cluster>& clusters,
+	const uint32* indices,
+	int index_count,
+	const Vec3* positions,
+	const Vec3* normals,
+	int max_triangles)
+{
+	clusters.clear();
+	int max_indices = max_triangles * 3;
+	for (int from = 0; from < index_count; from += max_indices)
+	{
+		int to = Math::minValue(from + max_indices, index_count);
+		Cluster& cluster = clusters.pushEmpty();
+		cluster.indices_offset = from;
+		cluster.index_count = to - from;
+
+		Vec3 min = positions[indices[from]];
+		Vec3 max = min;
+		for (int i = from + 1; i < to; ++i)
+		{
+			const Vec3& p = positions[indices[i]];
+			min.set(
+				Math::minValue(min.x, p.x), Math::minValue(min.y, p.y), Math::minValue(min.z, p.z));
+			max.set(
+				Math::maxValue(max.x, p.x), Math::maxValue(max.y, p.y), Math::maxValue(max.z, p.z));
+		}
+		cluster.center = (min + max) * 0.5f;
+		float radius_squared = 0;
+		for (int i = from; i < to; ++i)
+		{
+			float distance_squared = (positions[indices[i]] - cluster.center).squaredLength();
+			radius_squared = Math::maxValue(radius_squared, distance_squared);
+		}
+		cluster.radius = sqrtf(radius_squared);
+
+		Vec3 axis(0, 0, 0);
+		for (int i = from; i < to; i += 3)
+		{
+			Vec3 normal = getTriangleNormal(indices + i, positions, normals);
+			float length = normal.length();
+			if (length > 0) axis += normal * (1 / length);
+		}
+		float axis_length = axis.length();
+		// cone_cutoff == 1 never passes the backface test
+		cluster.cone_axis = axis_length > 0 ? axis * (1 / axis_length) : Vec3(0, 0, 1);
+		cluster.cone_cutoff = 1;
+		if (axis_length == 0) continue;
+
+		float min_dot = 1;
+		for (int i = from; i < to; i += 3)
+		{
+			Vec3 normal = getTriangleNormal(indices + i, positions, normals);
+			float length = normal.length();
+			if (length == 0) continue;
+			min_dot = Math::minValue(min_dot, dotProduct(normal, cluster.cone_axis) / length);
+		}
+		if (min_dot > 0) cluster.cone_cutoff = sqrtf(1 - min_dot * min_dot);
+	}
+}
+
+
+bool isClusterBackfacing(const Cluster& cluster, const Vec3& camera_pos)
+{
+	Vec3 to_center = cluster.center - camera_pos;
+	return dotProduct(to_center, cluster.cone_axis) >=
+		   cluster.cone_cutoff * to_center.length() + cluster.radius;
+}
+
+
+} // namespace MeshOptimizer
+
+
+} // namespace Lumix
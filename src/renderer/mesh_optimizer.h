@@ -0,0 +1,91 @@
+#pragma once
+
+
+#include "lumix.h"
+#include "core/array.h"
+#include "core/vec.h"
+
+
+namespace Lumix
+{
+
+
+namespace MeshOptimizer
+{
+
+
+static const int CACHE_SIZE = 16;
+static const int CLUSTER_TRIANGLES = 256;
+
+
+// a contiguous range of a mesh's indices, stored in model files as it is
+struct Cluster
+{
+	Vec3 center;
+	float radius;
+	Vec3 cone_axis;
+	float cone_cutoff;
+	int32 indices_offset;
+	int32 index_count;
+};
+
+
+// Reduces a triangle list to about target_index_count indices by collapsing the edges with
+// the lowest quadric error. Only the input vertices are referenced by the result, so it can
+// share the vertex buffer with the source mesh. Vertices sharing a position with another
+// vertex (UV or normal seams) are never moved and open borders are kept in place.
+LUMIX_RENDERER_API void simplify(Array<uint32>& out_indices,
+	const uint32* indices,
+	int index_count,
+	const Vec3* positions,
+	int vertex_count,
+	int target_index_count,
+	IAllocator& allocator);
+
+
+// Reorders triangles for a post-transform vertex cache of CACHE_SIZE entries (Tipsify).
+LUMIX_RENDERER_API void optimizeVertexCache(Array<uint32>& out_indices,
+	const uint32* indices,
+	int index_count,
+	int vertex_count,
+	IAllocator& allocator);
+
+
+// Sorts the runs of triangles that start with a cold cache so outward facing ones are drawn
+// first, the vertex cache order inside the runs is kept. normals are optional, when set they
+// decide which side of a triangle is the front one.
+LUMIX_RENDERER_API void optimizeOverdraw(uint32* indices,
+	int index_count,
+	const Vec3* positions,
+	const Vec3* normals,
+	int vertex_count,
+	IAllocator& allocator);
+
+
+// Average number of vertex shader invocations per triangle with a FIFO cache of cache_size.
+LUMIX_RENDERER_API float getACMR(const uint32* indices,
+	int index_count,
+	int vertex_count,
+	int cache_size,
+	IAllocator& allocator);
+
+
+// Splits indices into consecutive clusters of up to max_triangles with bounding spheres and
+// normal cones. normals are optional, see optimizeOverdraw.
+LUMIX_RENDERER_API void buildClusters(Array<Cluster>& clusters,
+	const uint32* indices,
+	int index_count,
+	const Vec3* positions,
+	const Vec3* normals,
+	int max_triangles);
+
+
+// Conservative test whether every triangle of the cluster faces away from camera_pos,
+// both are in the same space.
+LUMIX_RENDERER_API bool isClusterBackfacing(const Cluster& cluster, const Vec3& camera_pos);
+
+
+} // namespace MeshOptimizer
+
+
+} // namespace Lumix
@@ -42,6 +42,15 @@ Mesh::Mesh(const bgfx::VertexDecl& def,
 	m_name_hash = crc32(name);
 	m_name = name;
 	m_instance_idx = -1;
+	m_clusters = nullptr;
+	m_cluster_count = 0;
+}
+
+
+void Mesh::setClusters(const MeshOptimizer::Cluster* clusters, int count)
+{
+	m_clusters = clusters;
+	m_cluster_count = count;
 }
 
 
@@ -55,8 +64,16 @@ Model::Model(const Path& path, ResourceManager& resource_manager, IAllocator& al
 	, m_indices(m_allocator)
 	, m_vertices(m_allocator)
 	, m_lods(m_allocator)
+	, m_clusters(m_allocator)
+	, m_material_paths(m_allocator)
+	, m_loaded_vertices_buffer(nullptr)
+	, m_loaded_vertices_allocator(nullptr)
+	, m_loaded_vertices(nullptr)
 	, m_vertices_handle(BGFX_INVALID_HANDLE)
 	, m_indices_handle(BGFX_INVALID_HANDLE)
+	, m_index_size(sizeof(int32))
+	, m_indices_file_offset(0)
+	, m_vertices_file_offset(0)
 {
 }
 
@@ -78,13 +95,21 @@ RayCastModelHit Model::castRay(const Vec3& origin,
 		return hit;
 	}
 
+	auto* manager = static_cast<ModelManager*>(m_resource_manager.get(ResourceManager::MODEL));
+	if (!hasCPUGeometry() && !loadCPUGeometry()) return hit;
+	manager->onCPUGeometryUsed(*this);
+
 	Matrix inv = model_transform;
 	inv.inverse();
 	Vec3 local_origin = inv.multiplyPosition(origin);
 	Vec3 local_dir = static_cast<Vec3>(inv * Vec4(dir.x, dir.y, dir.z, 0));
 
 	const Array<Vec3>& vertices = m_vertices;
-	const Array<int32>& indices = m_indices;
+	const uint16* indices16 = m_index_size == sizeof(uint16) ? (const uint16*)&m_indices[0] : nullptr;
+	const int32* indices32 = (const int32*)&m_indices[0];
+	auto getIndex = [indices16, indices32](int i) -> int {
+		return indices16 ? indices16[i] : indices32[i];
+	};
 	int vertex_offset = 0;
 	for (int mesh_index = 0; mesh_index < m_meshes.size(); ++mesh_index)
 	{
@@ -93,9 +118,9 @@ RayCastModelHit Model::castRay(const Vec3& origin,
 		for (int i = m_meshes[mesh_index].getIndicesOffset(); i < indices_end;
 			 i += 3)
 		{
-			Vec3 p0 = vertices[vertex_offset + indices[i]];
-			Vec3 p1 = vertices[vertex_offset + indices[i + 1]];
-			Vec3 p2 = vertices[vertex_offset + indices[i + 2]];
+			Vec3 p0 = vertices[vertex_offset + getIndex(i)];
+			Vec3 p1 = vertices[vertex_offset + getIndex(i + 1)];
+			Vec3 p2 = vertices[vertex_offset + getIndex(i + 2)];
 			Vec3 normal = crossProduct(p1 - p0, p2 - p0);
 			float q = dotProduct(normal, local_dir);
 			if (q == 0)
@@ -193,6 +218,9 @@ bool Model::parseVertexDef(FS::IFile& file, bgfx::VertexDecl* vertex_definition)
 		file.read(tmp, len);
 		tmp[len] = '\0';
 
+		VertexAttributeDef type;
+		file.read(&type, sizeof(type));
+
 		if (compareString(tmp, "in_position") == 0)
 		{
 			vertex_definition->add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float);
@@ -203,7 +231,9 @@ bool Model::parseVertexDef(FS::IFile& file, bgfx::VertexDecl* vertex_definition)
 		}
 		else if (compareString(tmp, "in_tex_coords") == 0)
 		{
-			vertex_definition->add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float);
+			auto attrib_type =
+				type == VertexAttributeDef::HALF2 ? bgfx::AttribType::Half : bgfx::AttribType::Float;
+			vertex_definition->add(bgfx::Attrib::TexCoord0, 2, attrib_type);
 		}
 		else if (compareString(tmp, "in_normal") == 0)
 		{
@@ -226,9 +256,6 @@ bool Model::parseVertexDef(FS::IFile& file, bgfx::VertexDecl* vertex_definition)
 			ASSERT(false);
 			return false;
 		}
-
-		uint32 type;
-		file.read(&type, sizeof(type));
 	}
 
 	vertex_definition->end();
@@ -252,6 +279,8 @@ void Model::create(const bgfx::VertexDecl& def,
 	m_indices_handle = bgfx::createIndexBuffer(mem, BGFX_BUFFER_INDEX32);
 	m_indices_size = indices_size;
 
+	// unload() releases the material
+	m_resource_manager.get(ResourceManager::MATERIAL)->load(*material);
 	m_meshes.emplace(def,
 					 material,
 					 0,
@@ -267,19 +296,34 @@ void Model::create(const bgfx::VertexDecl& def,
 	lod.m_to_mesh = 0;
 	m_lods.push(lod);
 
-	m_indices.resize(indices_size / sizeof(m_indices[0]));
+	// there is no file to reload the geometry from, so the CPU copy is always kept
+	m_indices_file_offset = m_vertices_file_offset = 0;
+	m_index_size = sizeof(int32);
+	m_indices.resize(indices_size);
 	copyMemory(&m_indices[0], indices_data, indices_size);
 
-	m_vertices.resize(attributes_size / def.getStride());
 	computeRuntimeData((const uint8*)attributes_data);
+	copyPositions((const uint8*)attributes_data);
 
 	onCreated(State::READY);
+	addDependency(*material);
+}
+
+
+int Model::getVertexCount() const
+{
+	int vertex_count = 0;
+	for (int i = 0; i < m_meshes.size(); ++i)
+	{
+		vertex_count += m_meshes[i].getAttributeArraySize() /
+						m_meshes[i].getVertexDefinition().getStride();
+	}
+	return vertex_count;
 }
 
 
 void Model::computeRuntimeData(const uint8* vertices)
 {
-	int index = 0;
 	float bounding_radius_squared = 0;
 	Vec3 min_vertex(0, 0, 0);
 	Vec3 max_vertex(0, 0, 0);
@@ -295,22 +339,18 @@ void Model::computeRuntimeData(const uint8* vertices)
 			m_meshes[i].getVertexDefinition().getOffset(bgfx::Attrib::Position);
 		for (int j = 0; j < mesh_vertex_count; ++j)
 		{
-			m_vertices[index] =
-				*(const Vec3*)&vertices[mesh_attributes_array_offset +
-										j * mesh_vertex_size +
-										mesh_position_attribute_offset];
+			Vec3 vertex = *(const Vec3*)&vertices[mesh_attributes_array_offset +
+												   j * mesh_vertex_size +
+												   mesh_position_attribute_offset];
 			bounding_radius_squared = Math::maxValue(
 				bounding_radius_squared,
-				dotProduct(m_vertices[index], m_vertices[index]) > 0
-					? m_vertices[index].squaredLength()
-					: 0);
-			min_vertex.x = Math::minValue(min_vertex.x, m_vertices[index].x);
-			min_vertex.y = Math::minValue(min_vertex.y, m_vertices[index].y);
-			min_vertex.z = Math::minValue(min_vertex.z, m_vertices[index].z);
-			max_vertex.x = Math::maxValue(max_vertex.x, m_vertices[index].x);
-			max_vertex.y = Math::maxValue(max_vertex.y, m_vertices[index].y);
-			max_vertex.z = Math::maxValue(max_vertex.z, m_vertices[index].z);
-			++index;
+				dotProduct(vertex, vertex) > 0 ? vertex.squaredLength() : 0);
+			min_vertex.x = Math::minValue(min_vertex.x, vertex.x);
+			min_vertex.y = Math::minValue(min_vertex.y, vertex.y);
+			min_vertex.z = Math::minValue(min_vertex.z, vertex.z);
+			max_vertex.x = Math::maxValue(max_vertex.x, vertex.x);
+			max_vertex.y = Math::maxValue(max_vertex.y, vertex.y);
+			max_vertex.z = Math::maxValue(max_vertex.z, vertex.z);
 		}
 	}
 
@@ -319,39 +359,187 @@ void Model::computeRuntimeData(const uint8* vertices)
 }
 
 
+void Model::copyPositions(const uint8* vertices)
+{
+	m_vertices.resize(getVertexCount());
+	int index = 0;
+	for (int i = 0; i < m_meshes.size(); ++i)
+	{
+		const bgfx::VertexDecl& def = m_meshes[i].getVertexDefinition();
+		int mesh_vertex_count = m_meshes[i].getAttributeArraySize() / def.getStride();
+		const uint8* position = vertices + m_meshes[i].getAttributeArrayOffset() +
+								def.getOffset(bgfx::Attrib::Position);
+		for (int j = 0; j < mesh_vertex_count; ++j)
+		{
+			m_vertices[index] = *(const Vec3*)position;
+			position += def.getStride();
+			++index;
+		}
+	}
+}
+
+
+void Model::onVerticesLoaded(void* buffer, IAllocator& allocator, const uint8* vertices)
+{
+	m_loaded_vertices_buffer = buffer;
+	m_loaded_vertices_allocator = &allocator;
+	m_loaded_vertices = vertices;
+
+	computeRuntimeData(vertices);
+	auto* manager = static_cast<ModelManager*>(m_resource_manager.get(ResourceManager::MODEL));
+	if (manager->isKeepingCPUGeometry()) copyPositions(vertices);
+}
+
+
+void Model::freeLoadedVertices()
+{
+	if (m_loaded_vertices_buffer) m_loaded_vertices_allocator->deallocate(m_loaded_vertices_buffer);
+	m_loaded_vertices_buffer = nullptr;
+	m_loaded_vertices_allocator = nullptr;
+	m_loaded_vertices = nullptr;
+}
+
+
+bool Model::readGeometry(Array<uint8>& vertices, Array<uint8>& indices)
+{
+	if (m_vertices_file_offset == 0) return false;
+
+	PROFILE_FUNCTION();
+	FS::FileSystem& fs = m_resource_manager.getFileSystem();
+	FS::IFile* file = fs.open(fs.getDefaultDevice(), getPath(), FS::Mode::OPEN_AND_READ);
+	if (!file)
+	{
+		g_log_error.log("renderer") << "Could not reload geometry of " << getPath().c_str();
+		return false;
+	}
+
+	vertices.resize(m_vertices_size);
+	indices.resize(m_indices_size);
+	file->seek(FS::SeekMode::BEGIN, m_indices_file_offset);
+	bool success = file->read(&indices[0], m_indices_size);
+	file->seek(FS::SeekMode::BEGIN, m_vertices_file_offset);
+	success = success && file->read(&vertices[0], m_vertices_size);
+	fs.close(*file);
+	if (!success)
+	{
+		g_log_error.log("renderer") << "Could not reload geometry of " << getPath().c_str();
+		return false;
+	}
+	return true;
+}
+
+
+bool Model::loadCPUGeometry()
+{
+	if (hasCPUGeometry()) return true;
+
+	Array<uint8> vertices(m_allocator);
+	if (!readGeometry(vertices, m_indices))
+	{
+		m_indices.clear();
+		return false;
+	}
+
+	copyPositions(&vertices[0]);
+	auto* manager = static_cast<ModelManager*>(m_resource_manager.get(ResourceManager::MODEL));
+	manager->onCPUGeometryLoaded(*this);
+	return true;
+}
+
+
+void Model::freeCPUGeometry()
+{
+	Array<Vec3> vertices(m_allocator);
+	Array<uint8> indices(m_allocator);
+	m_vertices.swap(vertices);
+	m_indices.swap(indices);
+}
+
+
+size_t Model::getCPUGeometrySize() const
+{
+	return m_vertices.capacity() * sizeof(m_vertices[0]) + m_indices.capacity();
+}
+
+
 bool Model::parseGeometry(FS::IFile& file)
 {
 	int32 indices_count = 0;
 	file.read(&indices_count, sizeof(indices_count));
 	if (indices_count <= 0) return false;
 
-	m_indices.resize(indices_count);
-	file.read(&m_indices[0], sizeof(m_indices[0]) * indices_count);
+	m_index_size = sizeof(int32);
+	m_indices_file_offset = file.pos();
+	m_indices.resize(indices_count * m_index_size);
+	m_indices_size = m_indices.size();
+	file.read(&m_indices[0], m_indices.size());
 
 	int32 vertices_size = 0;
 	file.read(&vertices_size, sizeof(vertices_size));
 	if (vertices_size <= 0) return false;
 
-	ASSERT(!bgfx::isValid(m_vertices_handle));
-	const bgfx::Memory* vertices_mem = bgfx::alloc(vertices_size);
-	file.read(vertices_mem->data, vertices_size);
-	m_vertices_handle = bgfx::createVertexBuffer(vertices_mem, m_meshes[0].getVertexDefinition());
+	m_vertices_file_offset = file.pos();
 	m_vertices_size = vertices_size;
+	uint8* vertices = (uint8*)m_allocator.allocate(vertices_size);
+	file.read(vertices, vertices_size);
+	onVerticesLoaded(vertices, m_allocator, vertices);
 
-	ASSERT(!bgfx::isValid(m_indices_handle));
-	m_indices_size = sizeof(m_indices[0]) * indices_count;
-	const bgfx::Memory* mem = bgfx::copy(&m_indices[0], m_indices_size);
-	m_indices_handle = bgfx::createIndexBuffer(mem, BGFX_BUFFER_INDEX32);
+	return true;
+}
 
-	int vertex_count = 0;
-	for (int i = 0; i < m_meshes.size(); ++i)
+
+// the data can be a mapped file view, which can only be released by its allocator,
+// so the struct itself is allocated by the model's allocator
+struct DetachedFileBuffer
+{
+	void* data;
+	IAllocator* data_allocator;
+	IAllocator* allocator;
+};
+
+
+static void releaseFileBuffer(void*, void* user_data)
+{
+	auto* buffer = static_cast<DetachedFileBuffer*>(user_data);
+	buffer->data_allocator->deallocate(buffer->data);
+	LUMIX_DELETE(*buffer->allocator, buffer);
+}
+
+
+bool Model::parseGeometryBlobs(FS::IFile& file)
+{
+	int32 index_size = 0;
+	file.read(&index_size, sizeof(index_size));
+	if (index_size != sizeof(uint16) && index_size != sizeof(uint32)) return false;
+	int32 indices_count = 0;
+	file.read(&indices_count, sizeof(indices_count));
+	if (indices_count <= 0) return false;
+
+	m_index_size = index_size;
+	m_indices_file_offset = file.pos();
+	m_indices.resize(indices_count * index_size);
+	m_indices_size = m_indices.size();
+	file.read(&m_indices[0], m_indices.size());
+
+	int32 vertices_size = 0;
+	file.read(&vertices_size, sizeof(vertices_size));
+	// the vertex blob is the rest of the file
+	m_vertices_file_offset = file.pos();
+	if (vertices_size <= 0 || m_vertices_file_offset + vertices_size != file.size()) return false;
+	m_vertices_size = vertices_size;
+
+	IAllocator* allocator = nullptr;
+	void* buffer = file.detachBuffer(&allocator);
+	if (buffer)
 	{
-		vertex_count += m_meshes[i].getAttributeArraySize() /
-						m_meshes[i].getVertexDefinition().getStride();
+		onVerticesLoaded(buffer, *allocator, (uint8*)buffer + m_vertices_file_offset);
+	}
+	else
+	{
+		uint8* vertices = (uint8*)m_allocator.allocate(vertices_size);
+		file.read(vertices, vertices_size);
+		onVerticesLoaded(vertices, m_allocator, vertices);
 	}
-	m_vertices.resize(vertex_count);
-
-	computeRuntimeData(vertices_mem->data);
 
 	return true;
 }
@@ -467,9 +655,7 @@ bool Model::parseMeshes(FS::IFile& file)
 		copyString(material_path, model_dir);
 		catString(material_path, material_name);
 		catString(material_path, ".mat");
-
-		auto* material_manager = m_resource_manager.get(ResourceManager::MATERIAL);
-		Material* material = static_cast<Material*>(material_manager->load(Path(material_path)));
+		m_material_paths.emplace(material_path);
 
 		int32 attribute_array_offset = 0;
 		file.read(&attribute_array_offset, sizeof(attribute_array_offset));
@@ -481,11 +667,7 @@ bool Model::parseMeshes(FS::IFile& file)
 		file.read(&mesh_tri_count, sizeof(mesh_tri_count));
 
 		file.read(&str_size, sizeof(str_size));
-		if (str_size >= MAX_PATH_LENGTH)
-		{
-			material_manager->unload(*material);
-			return false;
-		}
+		if (str_size >= MAX_PATH_LENGTH) return false;
 		
 		char mesh_name[MAX_PATH_LENGTH];
 		mesh_name[str_size] = 0;
@@ -494,14 +676,13 @@ bool Model::parseMeshes(FS::IFile& file)
 		bgfx::VertexDecl def;
 		parseVertexDef(file, &def);
 		m_meshes.emplace(def,
-						 material,
+						 nullptr,
 						 attribute_array_offset,
 						 attribute_array_size,
 						 indices_offset,
 						 mesh_tri_count * 3,
 						 mesh_name,
 						 m_allocator);
-		addDependency(*material);
 	}
 	return true;
 }
@@ -526,24 +707,107 @@ bool Model::parseLODs(FS::IFile& file)
 }
 
 
+bool Model::parseClusters(FS::IFile& file)
+{
+	Array<int32> counts(m_allocator);
+	counts.resize(m_meshes.size());
+	int total_count = 0;
+	for (int i = 0; i < m_meshes.size(); ++i)
+	{
+		file.read(&counts[i], sizeof(counts[i]));
+		if (counts[i] < 0) return false;
+		total_count += counts[i];
+	}
+	m_clusters.resize(total_count);
+	if (total_count == 0) return true;
+
+	if (!file.read(&m_clusters[0], total_count * sizeof(m_clusters[0]))) return false;
+	int offset = 0;
+	for (int i = 0; i < m_meshes.size(); ++i)
+	{
+		if (counts[i] > 0) m_meshes[i].setClusters(&m_clusters[offset], counts[i]);
+		offset += counts[i];
+	}
+	return true;
+}
+
+
 bool Model::load(FS::IFile& file)
+{
+	if (loadAsync(file) && finalize()) return true;
+
+	g_log_warning.log("renderer") << "Error loading model " << getPath().c_str();
+	return false;
+}
+
+
+bool Model::loadAsync(FS::IFile& file)
 {
 	PROFILE_FUNCTION();
 	FileHeader header;
+	size_t file_size = file.size();
 	file.read(&header, sizeof(header));
-	if (header.m_magic == FILE_MAGIC 
-		&& header.m_version <= (uint32)FileVersion::LATEST 
-		&& parseMeshes(file) 
-		&& parseGeometry(file) 
-		&& parseBones(file) 
-		&& parseLODs(file))
+	bool is_valid = header.m_magic == FILE_MAGIC && header.m_version <= (uint32)FileVersion::LATEST;
+	if (is_valid && header.m_version > (uint32)FileVersion::GEOMETRY_BLOBS)
+	{
+		is_valid = parseMeshes(file) && parseBones(file) && parseLODs(file);
+		if (is_valid && header.m_version > (uint32)FileVersion::CLUSTERS)
+		{
+			is_valid = parseClusters(file);
+		}
+		// geometry is last so its blobs can be taken from the file's buffer
+		is_valid = is_valid && parseGeometryBlobs(file);
+	}
+	else if (is_valid)
 	{
-		m_size = file.size();
-		return true;
+		is_valid = parseMeshes(file) && parseGeometry(file) && parseBones(file) && parseLODs(file);
 	}
+	if (!is_valid) return false;
 
-	g_log_warning.log("renderer") << "Error loading model " << getPath().c_str();
-	return false;
+	m_size = file_size;
+	return true;
+}
+
+
+bool Model::finalize()
+{
+	PROFILE_FUNCTION();
+	auto* material_manager = m_resource_manager.get(ResourceManager::MATERIAL);
+	for (int i = 0; i < m_meshes.size(); ++i)
+	{
+		// materials are as important as the model which needs them
+		Material* material =
+			static_cast<Material*>(material_manager->load(m_material_paths[i], getLoadPriority()));
+		m_meshes[i].setMaterial(material);
+		addDependency(*material);
+	}
+	m_material_paths.clear();
+
+	// bgfx takes the loaded vertices and frees them in frame()
+	auto* detached = LUMIX_NEW(m_allocator, DetachedFileBuffer);
+	detached->data = m_loaded_vertices_buffer;
+	detached->data_allocator = m_loaded_vertices_allocator;
+	detached->allocator = &m_allocator;
+	const bgfx::Memory* vertices_mem =
+		bgfx::makeRef(m_loaded_vertices, m_vertices_size, releaseFileBuffer, detached);
+	m_loaded_vertices_buffer = nullptr;
+	m_loaded_vertices_allocator = nullptr;
+	m_loaded_vertices = nullptr;
+
+	ASSERT(!bgfx::isValid(m_vertices_handle));
+	m_vertices_handle = bgfx::createVertexBuffer(vertices_mem, m_meshes[0].getVertexDefinition());
+
+	ASSERT(!bgfx::isValid(m_indices_handle));
+	m_indices_handle = bgfx::createIndexBuffer(bgfx::copy(&m_indices[0], m_indices_size),
+		m_index_size == sizeof(uint32) ? BGFX_BUFFER_INDEX32 : BGFX_BUFFER_NONE);
+
+	auto* manager = static_cast<ModelManager*>(m_resource_manager.get(ResourceManager::MODEL));
+	if (!manager->isKeepingCPUGeometry())
+	{
+		// castRay reloads the geometry from the file if it needs it
+		freeCPUGeometry();
+	}
+	return true;
 }
 
 void Model::unload(void)
@@ -551,12 +815,24 @@ void Model::unload(void)
 	auto* material_manager = m_resource_manager.get(ResourceManager::MATERIAL);
 	for (int i = 0; i < m_meshes.size(); ++i)
 	{
-		removeDependency(*m_meshes[i].getMaterial());
-		material_manager->unload(*m_meshes[i].getMaterial());
+		// materials are not loaded if the model was unloaded before finalize()
+		Material* material = m_meshes[i].getMaterial();
+		if (!material) continue;
+		removeDependency(*material);
+		material_manager->unload(*material);
+	}
+	if (hasCPUGeometry())
+	{
+		auto* manager = static_cast<ModelManager*>(m_resource_manager.get(ResourceManager::MODEL));
+		manager->onCPUGeometryFreed(*this);
+		freeCPUGeometry();
 	}
 	m_meshes.clear();
 	m_bones.clear();
 	m_lods.clear();
+	m_clusters.clear();
+	m_material_paths.clear();
+	freeLoadedVertices();
 
 	if(bgfx::isValid(m_vertices_handle)) bgfx::destroyVertexBuffer(m_vertices_handle);
 	if(bgfx::isValid(m_indices_handle)) bgfx::destroyIndexBuffer(m_indices_handle);
@@ -9,6 +9,7 @@
 #include "core/string.h"
 #include "core/vec.h"
 #include "core/resource.h"
+#include "renderer/mesh_optimizer.h"
 #include "renderer/ray_cast_model_hit.h"
 #include <bgfx/bgfx.h>
 
@@ -54,6 +55,10 @@ public:
 	const bgfx::VertexDecl& getVertexDefinition() const { return m_vertex_def; }
 	int getInstanceIdx() const { return m_instance_idx; }
 	void setInstanceIdx(int value) { m_instance_idx = value; }
+	// only large meshes have clusters, their index offsets are relative to the mesh
+	const MeshOptimizer::Cluster* getClusters() const { return m_clusters; }
+	int getClusterCount() const { return m_cluster_count; }
+	void setClusters(const MeshOptimizer::Cluster* clusters, int count);
 
 private:
 	Mesh(const Mesh&);
@@ -68,6 +73,8 @@ private:
 	int32 m_index_count;
 	uint32 m_name_hash;
 	Material* m_material;
+	const MeshOptimizer::Cluster* m_clusters;
+	int32 m_cluster_count;
 	string m_name;
 };
 
@@ -107,10 +114,30 @@ public:
 	enum class FileVersion : uint32
 	{
 		FIRST,
+		GEOMETRY_BLOBS,
+		CLUSTERS,
 
 		LATEST // keep this last
 	};
 
+	enum class VertexAttributeDef : uint32
+	{
+		POSITION,
+		FLOAT1,
+		FLOAT2,
+		FLOAT3,
+		FLOAT4,
+		INT1,
+		INT2,
+		INT3,
+		INT4,
+		SHORT2,
+		SHORT4,
+		BYTE4,
+		HALF2,
+		NONE
+	};
+
 	class LOD
 	{
 	public:
@@ -151,6 +178,7 @@ public:
 	Mesh& getMesh(int index) { return m_meshes[index]; }
 	bgfx::VertexBufferHandle getVerticesHandle() const { return m_vertices_handle; }
 	bgfx::IndexBufferHandle getIndicesHandle() const { return m_indices_handle; }
+	int getIndexSize() const { return m_index_size; }
 	const Mesh& getMesh(int index) const { return m_meshes[index]; }
 	const Mesh* getMeshPtr(int index) const { return &m_meshes[index]; }
 	int getMeshCount() const { return m_meshes.size(); }
@@ -164,6 +192,14 @@ public:
 	const AABB& getAABB() const { return m_aabb; }
 	Array<LOD>& getLODs() { return m_lods; }
 
+	// CPU copy of positions and indices, used by castRay
+	bool hasCPUGeometry() const { return !m_vertices.empty(); }
+	bool loadCPUGeometry();
+	void freeCPUGeometry();
+	size_t getCPUGeometrySize() const;
+	// rereads the whole vertex and index buffers from the file, indices are getIndexSize() wide
+	bool readGeometry(Array<uint8>& vertices, Array<uint8>& indices);
+
 public:
 	static const uint32 FILE_MAGIC = 0x5f4c4d4f; // == '_LMO'
 
@@ -173,14 +209,23 @@ private:
 
 	bool parseVertexDef(FS::IFile& file, bgfx::VertexDecl* vertex_definition);
 	bool parseGeometry(FS::IFile& file);
+	bool parseGeometryBlobs(FS::IFile& file);
 	bool parseBones(FS::IFile& file);
 	bool parseMeshes(FS::IFile& file);
 	bool parseLODs(FS::IFile& file);
+	bool parseClusters(FS::IFile& file);
 	int getBoneIdx(const char* name);
+	int getVertexCount() const;
 	void computeRuntimeData(const uint8* vertices);
+	void copyPositions(const uint8* vertices);
+	void onVerticesLoaded(void* buffer, IAllocator& allocator, const uint8* vertices);
+	void freeLoadedVertices();
 
 	void unload(void) override;
 	bool load(FS::IFile& file) override;
+	bool isAsyncLoadSupported() const override { return true; }
+	bool loadAsync(FS::IFile& file) override;
+	bool finalize() override;
 
 private:
 	IAllocator& m_allocator;
@@ -188,11 +233,20 @@ private:
 	bgfx::VertexBufferHandle m_vertices_handle;
 	int m_indices_size;
 	int m_vertices_size;
+	int m_index_size;
+	size_t m_indices_file_offset;
+	size_t m_vertices_file_offset;
 	Array<Mesh> m_meshes;
 	Array<Bone> m_bones;
-	Array<int32> m_indices;
+	Array<uint8> m_indices;
 	Array<Vec3> m_vertices;
 	Array<LOD> m_lods;
+	Array<MeshOptimizer::Cluster> m_clusters;
+	// filled by loadAsync(), materials and GPU buffers are created in finalize()
+	Array<Path> m_material_paths;
+	void* m_loaded_vertices_buffer;
+	IAllocator* m_loaded_vertices_allocator;
+	const uint8* m_loaded_vertices;
 	float m_bounding_radius;
 	BoneMap m_bone_map;
 	AABB m_aabb;
@@ -6,6 +6,21 @@
 
 namespace Lumix
 {
+	static const size_t DEFAULT_CPU_GEOMETRY_BUDGET = 16 * 1024 * 1024;
+
+
+	ModelManager::ModelManager(IAllocator& allocator, Renderer& renderer)
+		: ResourceManagerBase(allocator)
+		, m_allocator(allocator)
+		, m_renderer(renderer)
+		, m_keep_cpu_geometry(true)
+		, m_cpu_geometry_budget(DEFAULT_CPU_GEOMETRY_BUDGET)
+		, m_cpu_geometry_size(0)
+		, m_lazy_geometry_models(allocator)
+	{
+	}
+
+
 	Resource* ModelManager::createResource(const Path& path)
 	{
 		return LUMIX_NEW(m_allocator, Model)(path, getOwner(), m_allocator);
@@ -15,4 +30,39 @@ namespace Lumix
 	{
 		LUMIX_DELETE(m_allocator, static_cast<Model*>(&resource));
 	}
-}
\ No newline at end of file
+
+
+	void ModelManager::onCPUGeometryLoaded(Model& model)
+	{
+		m_lazy_geometry_models.push(&model);
+		m_cpu_geometry_size += model.getCPUGeometrySize();
+
+		while (m_cpu_geometry_size > m_cpu_geometry_budget && m_lazy_geometry_models.size() > 1)
+		{
+			Model* lru = m_lazy_geometry_models[0];
+			m_cpu_geometry_size -= lru->getCPUGeometrySize();
+			m_lazy_geometry_models.erase(0);
+			lru->freeCPUGeometry();
+		}
+	}
+
+
+	void ModelManager::onCPUGeometryUsed(Model& model)
+	{
+		int idx = m_lazy_geometry_models.indexOf(&model);
+		if (idx < 0 || idx == m_lazy_geometry_models.size() - 1) return;
+
+		m_lazy_geometry_models.erase(idx);
+		m_lazy_geometry_models.push(&model);
+	}
+
+
+	void ModelManager::onCPUGeometryFreed(Model& model)
+	{
+		int idx = m_lazy_geometry_models.indexOf(&model);
+		if (idx < 0) return;
+
+		m_cpu_geometry_size -= model.getCPUGeometrySize();
+		m_lazy_geometry_models.erase(idx);
+	}
+}
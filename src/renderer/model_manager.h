@@ -1,32 +1,45 @@
 #pragma once
 
+#include "core/array.h"
 #include "core/resource_manager_base.h"
 
 namespace Lumix
 {
 
+	class Model;
 	class Renderer;
 
 
 	class LUMIX_RENDERER_API ModelManager : public ResourceManagerBase
 	{
 	public:
-		ModelManager(IAllocator& allocator, Renderer& renderer)
-			: ResourceManagerBase(allocator)
-			, m_allocator(allocator)
-			, m_renderer(renderer)
-		{}
-
+		ModelManager(IAllocator& allocator, Renderer& renderer);
 		~ModelManager() {}
 
 		Renderer& getRenderer() { return m_renderer; }
 
+		// if false, CPU geometry is loaded only when a raycast needs it and evicted over the budget
+		void setKeepCPUGeometry(bool keep) { m_keep_cpu_geometry = keep; }
+		bool isKeepingCPUGeometry() const { return m_keep_cpu_geometry; }
+		void setCPUGeometryBudget(size_t bytes) { m_cpu_geometry_budget = bytes; }
+		size_t getCPUGeometryBudget() const { return m_cpu_geometry_budget; }
+		size_t getCPUGeometrySize() const { return m_cpu_geometry_size; }
+
+		void onCPUGeometryLoaded(Model& model);
+		void onCPUGeometryUsed(Model& model);
+		void onCPUGeometryFreed(Model& model);
+
 	protected:
 		Resource* createResource(const Path& path) override;
 		void destroyResource(Resource& resource) override;
+		bool isParsedWhole(const Path&) const override { return m_keep_cpu_geometry; }
 
 	private:
 		IAllocator& m_allocator;
 		Renderer& m_renderer;
+		bool m_keep_cpu_geometry;
+		size_t m_cpu_geometry_budget;
+		size_t m_cpu_geometry_size;
+		Array<Model*> m_lazy_geometry_models; // least recently used first
 	};
-}
\ No newline at end of file
+}
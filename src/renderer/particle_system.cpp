@@ -5,10 +5,12 @@
 #include "core/profiler.h"
 #include "core/resource_manager.h"
 #include "core/resource_manager_base.h"
+#include "core/string.h"
 #include "renderer/material.h"
 #include "renderer/render_scene.h"
 #include "universe/universe.h"
 #include <cmath>
+#include <emmintrin.h>
 
 
 enum class ParticleEmitterVersion : int
@@ -25,6 +27,72 @@ namespace Lumix
 {
 
 
+static const int INITIAL_CAPACITY = 64;
+
+
+static LUMIX_FORCE_INLINE __m128 selectSIMD(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+
+static float horizontalMin(__m128 v)
+{
+	float tmp[4];
+	_mm_storeu_ps(tmp, v);
+	return Math::minValue(Math::minValue(tmp[0], tmp[1]), Math::minValue(tmp[2], tmp[3]));
+}
+
+
+static float horizontalMax(__m128 v)
+{
+	float tmp[4];
+	_mm_storeu_ps(tmp, v);
+	return Math::maxValue(Math::maxValue(tmp[0], tmp[1]), Math::maxValue(tmp[2], tmp[3]));
+}
+
+
+// LSD radix sort, 8 bits per pass; tmp_keys and tmp_values must have room for size elements
+static void radixSort(uint32* keys, int* values, uint32* tmp_keys, int* tmp_values, int size)
+{
+	int* result_values = values;
+	for (int shift = 0; shift < 32; shift += 8)
+	{
+		int histogram[256];
+		setMemory(histogram, 0, sizeof(histogram));
+		for (int i = 0; i < size; ++i)
+		{
+			++histogram[(keys[i] >> shift) & 0xff];
+		}
+		if (histogram[(keys[0] >> shift) & 0xff] == size) continue;
+
+		int offset = 0;
+		for (auto& bucket : histogram)
+		{
+			int count = bucket;
+			bucket = offset;
+			offset += count;
+		}
+
+		for (int i = 0; i < size; ++i)
+		{
+			int dst = histogram[(keys[i] >> shift) & 0xff]++;
+			tmp_keys[dst] = keys[i];
+			tmp_values[dst] = values[i];
+		}
+
+		uint32* swap_keys = keys;
+		keys = tmp_keys;
+		tmp_keys = swap_keys;
+		int* swap_values = values;
+		values = tmp_values;
+		tmp_values = swap_values;
+	}
+
+	if (values != result_values) copyMemory(result_values, values, sizeof(values[0]) * size);
+}
+
+
 template <typename T>
 static ParticleEmitter::ModuleBase* create(ParticleEmitter& emitter)
 {
@@ -85,12 +153,19 @@ void ParticleEmitter::ForceModule::deserialize(InputBlob& blob, int)
 
 void ParticleEmitter::ForceModule::update(float time_delta)
 {
-	if (m_emitter.m_velocity.empty()) return;
-
-	Vec3* LUMIX_RESTRICT particle_velocity = &m_emitter.m_velocity[0];
-	for (int i = 0, c = m_emitter.m_velocity.size(); i < c; ++i)
+	if (m_emitter.getParticlesCount() == 0) return;
+
+	float* LUMIX_RESTRICT vel_x = m_emitter.getChannel(VELOCITY_X);
+	float* LUMIX_RESTRICT vel_y = m_emitter.getChannel(VELOCITY_Y);
+	float* LUMIX_RESTRICT vel_z = m_emitter.getChannel(VELOCITY_Z);
+	const __m128 acc_x = _mm_set_ps1(m_acceleration.x * time_delta);
+	const __m128 acc_y = _mm_set_ps1(m_acceleration.y * time_delta);
+	const __m128 acc_z = _mm_set_ps1(m_acceleration.z * time_delta);
+	for (int i = 0, c = m_emitter.getSIMDCount(); i < c; i += SIMD_WIDTH)
 	{
-		particle_velocity[i] += m_acceleration * time_delta;
+		_mm_store_ps(vel_x + i, _mm_add_ps(_mm_load_ps(vel_x + i), acc_x));
+		_mm_store_ps(vel_y + i, _mm_add_ps(_mm_load_ps(vel_y + i), acc_y));
+		_mm_store_ps(vel_z + i, _mm_add_ps(_mm_load_ps(vel_z + i), acc_z));
 	}
 }
 
@@ -121,10 +196,16 @@ ParticleEmitter::AttractorModule::AttractorModule(ParticleEmitter& emitter)
 
 void ParticleEmitter::AttractorModule::update(float time_delta)
 {
-	if(m_emitter.m_alpha.empty()) return;
+	if (m_emitter.getParticlesCount() == 0) return;
 
-	Vec3* LUMIX_RESTRICT particle_pos = &m_emitter.m_position[0];
-	Vec3* LUMIX_RESTRICT particle_vel = &m_emitter.m_velocity[0];
+	const float* LUMIX_RESTRICT pos_x = m_emitter.getChannel(POSITION_X);
+	const float* LUMIX_RESTRICT pos_y = m_emitter.getChannel(POSITION_Y);
+	const float* LUMIX_RESTRICT pos_z = m_emitter.getChannel(POSITION_Z);
+	float* LUMIX_RESTRICT vel_x = m_emitter.getChannel(VELOCITY_X);
+	float* LUMIX_RESTRICT vel_y = m_emitter.getChannel(VELOCITY_Y);
+	float* LUMIX_RESTRICT vel_z = m_emitter.getChannel(VELOCITY_Z);
+	const __m128 force = _mm_set_ps1(m_force * time_delta);
+	const __m128 one = _mm_set_ps1(1.0f);
 
 	for(int i = 0; i < m_count; ++i)
 	{
@@ -132,13 +213,22 @@ void ParticleEmitter::AttractorModule::update(float time_delta)
 		if(entity == INVALID_ENTITY) continue;
 		if (!m_emitter.m_universe.hasEntity(entity)) continue;
 		Vec3 pos = m_emitter.m_universe.getPosition(entity);
+		const __m128 center_x = _mm_set_ps1(pos.x);
+		const __m128 center_y = _mm_set_ps1(pos.y);
+		const __m128 center_z = _mm_set_ps1(pos.z);
 
-		for(int i = m_emitter.m_position.size() - 1; i >= 0; --i)
+		for (int j = 0, c = m_emitter.getSIMDCount(); j < c; j += SIMD_WIDTH)
 		{
-			Vec3 to_center = pos - particle_pos[i];
-			float dist2 = to_center.squaredLength();
-			to_center *= 1 / sqrt(dist2);
-			particle_vel[i] = particle_vel[i] + to_center * (m_force / dist2) * time_delta;
+			__m128 dx = _mm_sub_ps(center_x, _mm_load_ps(pos_x + j));
+			__m128 dy = _mm_sub_ps(center_y, _mm_load_ps(pos_y + j));
+			__m128 dz = _mm_sub_ps(center_z, _mm_load_ps(pos_z + j));
+			__m128 dist2 = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			__m128 inv_dist = _mm_div_ps(one, _mm_sqrt_ps(dist2));
+			__m128 k = _mm_div_ps(_mm_mul_ps(force, inv_dist), dist2);
+			_mm_store_ps(vel_x + j, _mm_add_ps(_mm_load_ps(vel_x + j), _mm_mul_ps(dx, k)));
+			_mm_store_ps(vel_y + j, _mm_add_ps(_mm_load_ps(vel_y + j), _mm_mul_ps(dy, k)));
+			_mm_store_ps(vel_z + j, _mm_add_ps(_mm_load_ps(vel_z + j), _mm_mul_ps(dz, k)));
 		}
 	}
 }
@@ -209,10 +299,16 @@ void ParticleEmitter::PlaneModule::drawGizmo(RenderScene& scene)
 
 void ParticleEmitter::PlaneModule::update(float time_delta)
 {
-	if (m_emitter.m_alpha.empty()) return;
+	if (m_emitter.getParticlesCount() == 0) return;
 
-	Vec3* LUMIX_RESTRICT particle_pos = &m_emitter.m_position[0];
-	Vec3* LUMIX_RESTRICT particle_vel = &m_emitter.m_velocity[0];
+	const float* LUMIX_RESTRICT pos_x = m_emitter.getChannel(POSITION_X);
+	const float* LUMIX_RESTRICT pos_y = m_emitter.getChannel(POSITION_Y);
+	const float* LUMIX_RESTRICT pos_z = m_emitter.getChannel(POSITION_Z);
+	float* LUMIX_RESTRICT vel_x = m_emitter.getChannel(VELOCITY_X);
+	float* LUMIX_RESTRICT vel_y = m_emitter.getChannel(VELOCITY_Y);
+	float* LUMIX_RESTRICT vel_z = m_emitter.getChannel(VELOCITY_Z);
+	const __m128 bounce = _mm_set_ps1(m_bounce);
+	const __m128 zero = _mm_setzero_ps();
 
 	for (int i = 0; i < m_count; ++i)
 	{
@@ -221,15 +317,31 @@ void ParticleEmitter::PlaneModule::update(float time_delta)
 		if (!m_emitter.m_universe.hasEntity(entity)) continue;
 		Vec3 normal = m_emitter.m_universe.getRotation(entity) * Vec3(0, 1, 0);
 		float D = -dotProduct(normal, m_emitter.m_universe.getPosition(entity));
+		const __m128 normal_x = _mm_set_ps1(normal.x);
+		const __m128 normal_y = _mm_set_ps1(normal.y);
+		const __m128 normal_z = _mm_set_ps1(normal.z);
+		const __m128 d = _mm_set_ps1(D);
 
-		for (int i = m_emitter.m_position.size() - 1; i >= 0; --i)
+		for (int j = 0, c = m_emitter.getSIMDCount(); j < c; j += SIMD_WIDTH)
 		{
-			const auto& pos = particle_pos[i];
-			if (dotProduct(normal, pos) + D < 0)
-			{
-				float NdotV = dotProduct(normal, particle_vel[i]);
-				particle_vel[i] = (particle_vel[i] - normal * (2 * NdotV)) * m_bounce;
-			}
+			__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normal_x, _mm_load_ps(pos_x + j)),
+										 _mm_mul_ps(normal_y, _mm_load_ps(pos_y + j))),
+				_mm_add_ps(_mm_mul_ps(normal_z, _mm_load_ps(pos_z + j)), d));
+			__m128 below = _mm_cmplt_ps(dist, zero);
+			if (_mm_movemask_ps(below) == 0) continue;
+
+			__m128 vx = _mm_load_ps(vel_x + j);
+			__m128 vy = _mm_load_ps(vel_y + j);
+			__m128 vz = _mm_load_ps(vel_z + j);
+			__m128 NdotV = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normal_x, vx), _mm_mul_ps(normal_y, vy)),
+				_mm_mul_ps(normal_z, vz));
+			__m128 NdotV2 = _mm_add_ps(NdotV, NdotV);
+			__m128 bounced_x = _mm_mul_ps(_mm_sub_ps(vx, _mm_mul_ps(normal_x, NdotV2)), bounce);
+			__m128 bounced_y = _mm_mul_ps(_mm_sub_ps(vy, _mm_mul_ps(normal_y, NdotV2)), bounce);
+			__m128 bounced_z = _mm_mul_ps(_mm_sub_ps(vz, _mm_mul_ps(normal_z, NdotV2)), bounce);
+			_mm_store_ps(vel_x + j, selectSIMD(below, bounced_x, vx));
+			_mm_store_ps(vel_y + j, selectSIMD(below, bounced_y, vy));
+			_mm_store_ps(vel_z + j, selectSIMD(below, bounced_z, vz));
 		}
 	}
 }
@@ -280,7 +392,9 @@ void ParticleEmitter::SpawnShapeModule::spawnParticle(int index)
 
 		if (v.squaredLength() < r2)
 		{
-			m_emitter.m_position[index] += v;
+			m_emitter.getChannel(POSITION_X)[index] += v.x;
+			m_emitter.getChannel(POSITION_Y)[index] += v.y;
+			m_emitter.getChannel(POSITION_Z)[index] += v.z;
 			return;
 		}
 	}
@@ -312,9 +426,9 @@ ParticleEmitter::LinearMovementModule::LinearMovementModule(ParticleEmitter& emi
 
 void ParticleEmitter::LinearMovementModule::spawnParticle(int index)
 {
-	m_emitter.m_velocity[index].x = m_x.getRandom();
-	m_emitter.m_velocity[index].y = m_y.getRandom();
-	m_emitter.m_velocity[index].z = m_z.getRandom();
+	m_emitter.getChannel(VELOCITY_X)[index] = m_x.getRandom();
+	m_emitter.getChannel(VELOCITY_Y)[index] = m_y.getRandom();
+	m_emitter.getChannel(VELOCITY_Z)[index] = m_z.getRandom();
 }
 
 
@@ -418,13 +532,13 @@ void ParticleEmitter::AlphaModule::sample()
 
 void ParticleEmitter::AlphaModule::update(float)
 {
-	if(m_emitter.m_alpha.empty()) return;
+	if (m_emitter.getParticlesCount() == 0) return;
 
-	float* LUMIX_RESTRICT particle_alpha = &m_emitter.m_alpha[0];
-	float* LUMIX_RESTRICT rel_life = &m_emitter.m_rel_life[0];
+	float* LUMIX_RESTRICT particle_alpha = m_emitter.getChannel(ALPHA);
+	const float* LUMIX_RESTRICT rel_life = m_emitter.getChannel(REL_LIFE);
 	int size = m_sampled.size() - 1;
 	float float_size = (float)size;
-	for(int i = 0, c = m_emitter.m_size.size(); i < c; ++i)
+	for (int i = 0, c = m_emitter.getParticlesCount(); i < c; ++i)
 	{
 		float float_idx = float_size * rel_life[i];
 		int idx = (int)float_idx;
@@ -484,20 +598,19 @@ void ParticleEmitter::SizeModule::sample()
 
 void ParticleEmitter::SizeModule::update(float)
 {
-	if (m_emitter.m_size.empty()) return;
+	if (m_emitter.getParticlesCount() == 0) return;
 
-	float* LUMIX_RESTRICT particle_size = &m_emitter.m_size[0];
-	float* LUMIX_RESTRICT rel_life = &m_emitter.m_rel_life[0];
+	float* LUMIX_RESTRICT particle_size = m_emitter.getChannel(SIZE);
+	const float* LUMIX_RESTRICT rel_life = m_emitter.getChannel(REL_LIFE);
 	int size = m_sampled.size() - 1;
 	float float_size = (float)size;
-	for (int i = 0, c = m_emitter.m_size.size(); i < c; ++i)
+	for (int i = 0, c = m_emitter.getParticlesCount(); i < c; ++i)
 	{
 		float float_idx = float_size * rel_life[i];
 		int idx = (int)float_idx;
 		int next_idx = Math::minValue(idx + 1, size);
 		float w = float_idx - idx;
 		particle_size[i] = m_sampled[idx] * (1 - w) + m_sampled[next_idx] * w;
-		PROFILE_INT("Test", int(particle_size[i] * 1000));
 	}
 }
 
@@ -513,7 +626,7 @@ ParticleEmitter::RandomRotationModule::RandomRotationModule(ParticleEmitter& emi
 
 void ParticleEmitter::RandomRotationModule::spawnParticle(int index)
 {
-	m_emitter.m_rotation[index] = Math::randFloat(0, Math::PI * 2);
+	m_emitter.getChannel(ROTATION)[index] = Math::randFloat(0, Math::PI * 2);
 }
 
 
@@ -563,19 +676,25 @@ float Interval::getRandom() const
 ParticleEmitter::ParticleEmitter(Entity entity, Universe& universe, IAllocator& allocator)
 	: m_next_spawn_time(0)
 	, m_allocator(allocator)
-	, m_rel_life(allocator)
-	, m_life(allocator)
+	, m_storage(nullptr)
+	, m_particles_count(0)
+	, m_capacity(0)
+	, m_max_size(0)
+	, m_sort_keys(allocator)
+	, m_sort_order(allocator)
 	, m_modules(allocator)
-	, m_position(allocator)
-	, m_velocity(allocator)
-	, m_rotation(allocator)
-	, m_rotational_speed(allocator)
-	, m_alpha(allocator)
 	, m_universe(universe)
 	, m_entity(entity)
-	, m_size(allocator)
+	, m_pending_time(0)
+	, m_invisible_time(0)
 	, m_material(nullptr)
 {
+	for (auto& channel : m_channels)
+	{
+		channel = nullptr;
+	}
+	m_bounds_min.set(0, 0, 0);
+	m_bounds_max.set(0, 0, 0);
 	m_spawn_period.from = 1;
 	m_spawn_period.to = 2;
 	m_initial_life.from = 1;
@@ -593,19 +712,16 @@ ParticleEmitter::~ParticleEmitter()
 	{
 		LUMIX_DELETE(m_allocator, module);
 	}
+	if (m_storage) m_allocator.deallocate_aligned(m_storage);
 }
 
 
 void ParticleEmitter::reset()
 {
-	m_rel_life.clear();
-	m_life.clear();
-	m_size.clear();
-	m_position.clear();
-	m_velocity.clear();
-	m_alpha.clear();
-	m_rotation.clear();
-	m_rotational_speed.clear();
+	m_particles_count = 0;
+	m_pending_time = 0;
+	m_invisible_time = 0;
+	updateBounds();
 }
 
 
@@ -620,59 +736,81 @@ void ParticleEmitter::setMaterial(Material* material)
 }
 
 
-void ParticleEmitter::spawnParticle()
+void ParticleEmitter::grow()
 {
-	m_position.push(m_universe.getPosition(m_entity));
-	m_rotation.push(0);
-	m_rotational_speed.push(0);
-	m_life.push(m_initial_life.getRandom());
-	m_rel_life.push(0.0f);
-	m_alpha.push(1);
-	m_velocity.push(Vec3(0, 0, 0));
-	m_size.push(m_initial_size.getRandom());
-	for (auto* module : m_modules)
+	int capacity = m_capacity == 0 ? INITIAL_CAPACITY : m_capacity * 2;
+	ASSERT(capacity % SIMD_WIDTH == 0);
+
+	size_t channel_size = sizeof(float) * capacity;
+	float* storage = (float*)m_allocator.allocate_aligned(channel_size * CHANNEL_COUNT, 16);
+	setMemory(storage, 0, channel_size * CHANNEL_COUNT);
+	for (int i = 0; i < CHANNEL_COUNT; ++i)
 	{
-		module->spawnParticle(m_life.size() - 1);
+		float* channel = storage + i * capacity;
+		if (m_particles_count > 0)
+		{
+			copyMemory(channel, m_channels[i], sizeof(float) * m_particles_count);
+		}
+		m_channels[i] = channel;
 	}
+	if (m_storage) m_allocator.deallocate_aligned(m_storage);
+	m_storage = storage;
+	m_capacity = capacity;
 }
 
 
-void ParticleEmitter::addModule(ModuleBase* module)
+void ParticleEmitter::spawnParticle(const Vec3& position)
 {
-	m_modules.push(module);
+	if (m_particles_count == m_capacity) grow();
+
+	int index = m_particles_count;
+	++m_particles_count;
+	m_channels[POSITION_X][index] = position.x;
+	m_channels[POSITION_Y][index] = position.y;
+	m_channels[POSITION_Z][index] = position.z;
+	m_channels[ROTATION][index] = 0;
+	m_channels[ROTATIONAL_SPEED][index] = 0;
+	m_channels[LIFE][index] = m_initial_life.getRandom();
+	m_channels[REL_LIFE][index] = 0;
+	m_channels[ALPHA][index] = 1;
+	m_channels[VELOCITY_X][index] = 0;
+	m_channels[VELOCITY_Y][index] = 0;
+	m_channels[VELOCITY_Z][index] = 0;
+	m_channels[SIZE][index] = m_initial_size.getRandom();
+	for (auto* module : m_modules)
+	{
+		module->spawnParticle(index);
+	}
 }
 
 
-void ParticleEmitter::destroyParticle(int index)
+void ParticleEmitter::addModule(ModuleBase* module)
 {
-	for (auto* module : m_modules)
-	{
-		module->destoryParticle(index);
-	}
-	m_life.eraseFast(index);
-	m_rel_life.eraseFast(index);
-	m_position.eraseFast(index);
-	m_velocity.eraseFast(index);
-	m_rotation.eraseFast(index);
-	m_rotational_speed.eraseFast(index);
-	m_alpha.eraseFast(index);
-	m_size.eraseFast(index);
+	m_modules.push(module);
 }
 
 
-void ParticleEmitter::updateLives(float time_delta)
+void ParticleEmitter::compact()
 {
-	for (int i = 0, c = m_rel_life.size(); i < c; ++i)
+	PROFILE_FUNCTION();
+	const float* LUMIX_RESTRICT rel_life = m_channels[REL_LIFE];
+	int i = 0;
+	while (i < m_particles_count)
 	{
-		float rel_life = m_rel_life[i];
-		rel_life += time_delta / m_life[i];
-		m_rel_life[i] = rel_life;
+		if (rel_life[i] <= 1)
+		{
+			++i;
+			continue;
+		}
 
-		if (rel_life > 1)
+		for (auto* module : m_modules)
 		{
-			destroyParticle(i);
-			--i;
-			--c;
+			module->destoryParticle(i);
+		}
+		--m_particles_count;
+		for (auto* channel : m_channels)
+		{
+			channel[i] = channel[m_particles_count];
 		}
 	}
 }
@@ -732,41 +870,206 @@ void ParticleEmitter::deserialize(InputBlob& blob, ResourceManager& manager, boo
 }
 
 
-void ParticleEmitter::updatePositions(float time_delta)
+void ParticleEmitter::simulate(float time_delta)
 {
-	for (int i = 0, c = m_position.size(); i < c; ++i)
+	PROFILE_FUNCTION();
+	if (m_particles_count == 0)
+	{
+		updateBounds();
+		return;
+	}
+
+	const float* LUMIX_RESTRICT life = m_channels[LIFE];
+	float* LUMIX_RESTRICT rel_life = m_channels[REL_LIFE];
+	float* LUMIX_RESTRICT pos_x = m_channels[POSITION_X];
+	float* LUMIX_RESTRICT pos_y = m_channels[POSITION_Y];
+	float* LUMIX_RESTRICT pos_z = m_channels[POSITION_Z];
+	const float* LUMIX_RESTRICT vel_x = m_channels[VELOCITY_X];
+	const float* LUMIX_RESTRICT vel_y = m_channels[VELOCITY_Y];
+	const float* LUMIX_RESTRICT vel_z = m_channels[VELOCITY_Z];
+	float* LUMIX_RESTRICT rotation = m_channels[ROTATION];
+	const float* LUMIX_RESTRICT rotational_speed = m_channels[ROTATIONAL_SPEED];
+	const __m128 dt = _mm_set_ps1(time_delta);
+	const __m128 one = _mm_set_ps1(1.0f);
+
+	int dead_mask = 0;
+	for (int i = 0, c = getSIMDCount(); i < c; i += SIMD_WIDTH)
 	{
-		m_position[i] += m_velocity[i] * time_delta;
+		__m128 rel = _mm_add_ps(_mm_load_ps(rel_life + i), _mm_div_ps(dt, _mm_load_ps(life + i)));
+		_mm_store_ps(rel_life + i, rel);
+		int mask = _mm_movemask_ps(_mm_cmpgt_ps(rel, one));
+		if (i + SIMD_WIDTH > m_particles_count) mask &= (1 << (m_particles_count - i)) - 1;
+		dead_mask |= mask;
+
+		__m128 x = _mm_add_ps(_mm_load_ps(pos_x + i), _mm_mul_ps(_mm_load_ps(vel_x + i), dt));
+		__m128 y = _mm_add_ps(_mm_load_ps(pos_y + i), _mm_mul_ps(_mm_load_ps(vel_y + i), dt));
+		__m128 z = _mm_add_ps(_mm_load_ps(pos_z + i), _mm_mul_ps(_mm_load_ps(vel_z + i), dt));
+		__m128 rot = _mm_add_ps(
+			_mm_load_ps(rotation + i), _mm_mul_ps(_mm_load_ps(rotational_speed + i), dt));
+		_mm_store_ps(pos_x + i, x);
+		_mm_store_ps(pos_y + i, y);
+		_mm_store_ps(pos_z + i, z);
+		_mm_store_ps(rotation + i, rot);
 	}
+
+	if (dead_mask != 0) compact();
+
+	for (auto* module : m_modules)
+	{
+		module->update(time_delta);
+	}
+
+	updateBounds();
 }
 
 
-void ParticleEmitter::updateRotations(float time_delta)
+void ParticleEmitter::updateBounds()
 {
-	for (int i = 0, c = m_rotation.size(); i < c; ++i)
+	if (m_particles_count == 0)
+	{
+		m_bounds_min = m_bounds_max = m_universe.getPosition(m_entity);
+		m_max_size = 0;
+		return;
+	}
+
+	const float* LUMIX_RESTRICT pos_x = m_channels[POSITION_X];
+	const float* LUMIX_RESTRICT pos_y = m_channels[POSITION_Y];
+	const float* LUMIX_RESTRICT pos_z = m_channels[POSITION_Z];
+	const float* LUMIX_RESTRICT size = m_channels[SIZE];
+	__m128 min_x = _mm_set_ps1(pos_x[0]);
+	__m128 min_y = _mm_set_ps1(pos_y[0]);
+	__m128 min_z = _mm_set_ps1(pos_z[0]);
+	__m128 max_x = min_x;
+	__m128 max_y = min_y;
+	__m128 max_z = min_z;
+	__m128 max_size = _mm_set_ps1(size[0]);
+	int simd_end = m_particles_count & ~(SIMD_WIDTH - 1);
+	for (int i = 0; i < simd_end; i += SIMD_WIDTH)
 	{
-		m_rotation[i] += m_rotational_speed[i] * time_delta;
+		__m128 x = _mm_load_ps(pos_x + i);
+		__m128 y = _mm_load_ps(pos_y + i);
+		__m128 z = _mm_load_ps(pos_z + i);
+		min_x = _mm_min_ps(min_x, x);
+		min_y = _mm_min_ps(min_y, y);
+		min_z = _mm_min_ps(min_z, z);
+		max_x = _mm_max_ps(max_x, x);
+		max_y = _mm_max_ps(max_y, y);
+		max_z = _mm_max_ps(max_z, z);
+		max_size = _mm_max_ps(max_size, _mm_load_ps(size + i));
+	}
+
+	m_bounds_min.set(horizontalMin(min_x), horizontalMin(min_y), horizontalMin(min_z));
+	m_bounds_max.set(horizontalMax(max_x), horizontalMax(max_y), horizontalMax(max_z));
+	m_max_size = horizontalMax(max_size);
+	for (int i = simd_end; i < m_particles_count; ++i)
+	{
+		m_bounds_min.set(Math::minValue(m_bounds_min.x, pos_x[i]),
+			Math::minValue(m_bounds_min.y, pos_y[i]),
+			Math::minValue(m_bounds_min.z, pos_z[i]));
+		m_bounds_max.set(Math::maxValue(m_bounds_max.x, pos_x[i]),
+			Math::maxValue(m_bounds_max.y, pos_y[i]),
+			Math::maxValue(m_bounds_max.z, pos_z[i]));
+		m_max_size = Math::maxValue(m_max_size, size[i]);
 	}
 }
 
 
-void ParticleEmitter::update(float time_delta)
+Sphere ParticleEmitter::getBoundingSphere() const
 {
-	spawnParticles(time_delta);
-	updateLives(time_delta);
-	updatePositions(time_delta);
-	updateRotations(time_delta);
-	for (auto* module : m_modules)
+	// the bounds are not updated while the emitter sleeps, but its entity can move meanwhile
+	Vec3 position = m_universe.getPosition(m_entity);
+	Vec3 bounds_min(Math::minValue(m_bounds_min.x, position.x),
+		Math::minValue(m_bounds_min.y, position.y),
+		Math::minValue(m_bounds_min.z, position.z));
+	Vec3 bounds_max(Math::maxValue(m_bounds_max.x, position.x),
+		Math::maxValue(m_bounds_max.y, position.y),
+		Math::maxValue(m_bounds_max.z, position.z));
+	Vec3 center = (bounds_min + bounds_max) * 0.5f;
+	return Sphere(center, (bounds_max - bounds_min).length() * 0.5f + m_max_size);
+}
+
+
+void ParticleEmitter::sortByDepth(const Vec3& view_pos, const Vec3& view_dir)
+{
+	int simd_count = getSIMDCount();
+	m_sort_keys.resize(simd_count * 2);
+	m_sort_order.resize(simd_count * 2);
+
+	uint32* keys = &m_sort_keys[0];
+	int* order = &m_sort_order[0];
+	const float* LUMIX_RESTRICT pos_x = m_channels[POSITION_X];
+	const float* LUMIX_RESTRICT pos_y = m_channels[POSITION_Y];
+	const float* LUMIX_RESTRICT pos_z = m_channels[POSITION_Z];
+	const __m128 dir_x = _mm_set_ps1(view_dir.x);
+	const __m128 dir_y = _mm_set_ps1(view_dir.y);
+	const __m128 dir_z = _mm_set_ps1(view_dir.z);
+	const __m128 offset = _mm_set_ps1(-dotProduct(view_pos, view_dir));
+	const __m128i sign = _mm_set1_epi32((int)0x80000000);
+	const __m128i all_bits = _mm_set1_epi32(-1);
+	for (int i = 0; i < simd_count; i += SIMD_WIDTH)
 	{
-		module->update(time_delta);
+		__m128 depth = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(pos_x + i), dir_x),
+									  _mm_mul_ps(_mm_load_ps(pos_y + i), dir_y)),
+			_mm_add_ps(_mm_mul_ps(_mm_load_ps(pos_z + i), dir_z), offset));
+		// flip sign of positive floats and all bits of negative ones so they sort as uints,
+		// then invert everything so the farthest particles come first
+		__m128i bits = _mm_castps_si128(depth);
+		__m128i key = _mm_xor_si128(bits, _mm_or_si128(_mm_srai_epi32(bits, 31), sign));
+		_mm_storeu_si128((__m128i*)(keys + i), _mm_xor_si128(key, all_bits));
 	}
+	for (int i = 0; i < m_particles_count; ++i)
+	{
+		order[i] = i;
+	}
+
+	radixSort(keys, order, keys + simd_count, order + simd_count, m_particles_count);
+}
+
+
+void ParticleEmitter::fillInstances(const Vec3& view_pos,
+	const Vec3& view_dir,
+	RenderInstance* const* batches,
+	int batch_size)
+{
+	PROFILE_FUNCTION();
+	if (m_particles_count == 0) return;
+
+	sortByDepth(view_pos, view_dir);
+
+	const int* LUMIX_RESTRICT order = &m_sort_order[0];
+	const float* LUMIX_RESTRICT pos_x = m_channels[POSITION_X];
+	const float* LUMIX_RESTRICT pos_y = m_channels[POSITION_Y];
+	const float* LUMIX_RESTRICT pos_z = m_channels[POSITION_Z];
+	const float* LUMIX_RESTRICT size = m_channels[SIZE];
+	const float* LUMIX_RESTRICT alpha = m_channels[ALPHA];
+	const float* LUMIX_RESTRICT rotation = m_channels[ROTATION];
+	for (int batch = 0, i = 0; i < m_particles_count; ++batch)
+	{
+		RenderInstance* LUMIX_RESTRICT instance = batches[batch];
+		for (int end = Math::minValue(i + batch_size, m_particles_count); i < end; ++i)
+		{
+			int idx = order[i];
+			instance->pos = Vec4(pos_x[idx], pos_y[idx], pos_z[idx], size[idx]);
+			instance->alpha_and_rotation = Vec4(alpha[idx], rotation[idx], 0, 0);
+			++instance;
+		}
+	}
+}
+
+
+void ParticleEmitter::update(float time_delta)
+{
+	spawnParticles(time_delta);
+	simulate(time_delta);
 }
 
 
 void ParticleEmitter::spawnParticles(float time_delta)
 {
 	m_next_spawn_time -= time_delta;
+	if (m_next_spawn_time >= 0) return;
 
+	Vec3 position = m_universe.getPosition(m_entity);
 	while (m_next_spawn_time < 0)
 	{
 		m_next_spawn_time += m_spawn_period.getRandom();
@@ -774,7 +1077,7 @@ void ParticleEmitter::spawnParticles(float time_delta)
 		int spawn_count = m_spawn_count.getRandom();
 		for (int i = 0; i < spawn_count; ++i)
 		{
-			spawnParticle();
+			spawnParticle(position);
 		}
 	}
 }
@@ -797,11 +1100,9 @@ struct InitialVelocityModule : public ParticleEmitter::ModuleBase
 
 	void spawnParticle(int index) override
 	{
-		Vec3 v;
-		v.x = m_x.getRandom();
-		v.y = m_y.getRandom();
-		v.z = m_z.getRandom();
-		m_emitter.m_velocity[index] = v;
+		m_emitter.getChannel(ParticleEmitter::VELOCITY_X)[index] = m_x.getRandom();
+		m_emitter.getChannel(ParticleEmitter::VELOCITY_Y)[index] = m_y.getRandom();
+		m_emitter.getChannel(ParticleEmitter::VELOCITY_Z)[index] = m_z.getRandom();
 	}
 };
 
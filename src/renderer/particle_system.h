@@ -3,6 +3,7 @@
 
 #include "lumix.h"
 #include "core/array.h"
+#include "core/sphere.h"
 #include "core/vec.h"
 
 
@@ -197,6 +198,33 @@ public:
 	};
 
 
+public:
+	enum Channel
+	{
+		LIFE,
+		REL_LIFE,
+		SIZE,
+		POSITION_X,
+		POSITION_Y,
+		POSITION_Z,
+		VELOCITY_X,
+		VELOCITY_Y,
+		VELOCITY_Z,
+		ALPHA,
+		ROTATION,
+		ROTATIONAL_SPEED,
+
+		CHANNEL_COUNT
+	};
+
+	static const int SIMD_WIDTH = 4;
+
+	struct RenderInstance
+	{
+		Vec4 pos;
+		Vec4 alpha_and_rotation;
+	};
+
 public:
 	ParticleEmitter(Entity entity, Universe& universe, IAllocator& allocator);
 	~ParticleEmitter();
@@ -206,21 +234,31 @@ public:
 	void serialize(OutputBlob& blob);
 	void deserialize(InputBlob& blob, ResourceManager& manager, bool has_version);
 	void update(float time_delta);
+	void spawnParticles(float time_delta);
+	void simulate(float time_delta);
 	Material* getMaterial() const { return m_material; }
 	void setMaterial(Material* material);
 	IAllocator& getAllocator() { return m_allocator; }
 	void addModule(ModuleBase* module);
+	int getParticlesCount() const { return m_particles_count; }
+	// particles count rounded up to SIMD_WIDTH, channels are always allocated to this size
+	int getSIMDCount() const { return (m_particles_count + SIMD_WIDTH - 1) & ~(SIMD_WIDTH - 1); }
+	float* getChannel(Channel channel) { return m_channels[channel]; }
+	const float* getChannel(Channel channel) const { return m_channels[channel]; }
+	// bounds of the particles and of the point where new ones spawn
+	Sphere getBoundingSphere() const;
+	// simulation time not applied yet, see RenderScene's update-rate LOD and sleeping
+	float getPendingTime() const { return m_pending_time; }
+	void setPendingTime(float time) { m_pending_time = time; }
+	float getInvisibleTime() const { return m_invisible_time; }
+	void setInvisibleTime(float time) { m_invisible_time = time; }
+	// sorts particles back to front along view_dir and writes them to batches of batch_size instances
+	void fillInstances(const Vec3& view_pos,
+		const Vec3& view_dir,
+		RenderInstance* const* batches,
+		int batch_size);
 
 public:
-	Array<float> m_rel_life;
-	Array<float> m_life;
-	Array<float> m_size;
-	Array<Vec3> m_position;
-	Array<Vec3> m_velocity;
-	Array<float> m_alpha;
-	Array<float> m_rotation;
-	Array<float> m_rotational_speed;
-
 	Interval m_spawn_period;
 	Interval m_initial_life;
 	Interval m_initial_size;
@@ -230,17 +268,30 @@ public:
 	Entity m_entity;
 
 private:
-	void spawnParticle();
-	void destroyParticle(int index);
-	void spawnParticles(float time_delta);
-	void updateLives(float time_delta);
-	void updatePositions(float time_delta);
-	void updateRotations(float time_delta);
+	ParticleEmitter(const ParticleEmitter&);
+	void operator=(const ParticleEmitter&);
+
+	void spawnParticle(const Vec3& position);
+	void grow();
+	void compact();
+	void updateBounds();
+	void sortByDepth(const Vec3& view_pos, const Vec3& view_dir);
 
 private:
 	IAllocator& m_allocator;
+	float* m_storage;
+	float* m_channels[CHANNEL_COUNT];
+	int m_particles_count;
+	int m_capacity;
+	Vec3 m_bounds_min;
+	Vec3 m_bounds_max;
+	float m_max_size;
+	Array<uint32> m_sort_keys;
+	Array<int> m_sort_order;
 	float m_next_spawn_time;
 	Universe& m_universe;
+	float m_pending_time;
+	float m_invisible_time;
 	Material* m_material;
 };
 
@@ -8,6 +8,8 @@
 #include "core/lifo_allocator.h"
 #include "core/log.h"
 #include "core/lua_wrapper.h"
+#include "core/mtjd/generic_job.h"
+#include "core/mtjd/manager.h"
 #include "core/profiler.h"
 #include "core/static_array.h"
 #include "engine.h"
@@ -34,6 +36,17 @@ namespace Lumix
 
 static const float SHADOW_CAM_NEAR = 50.0f;
 static const float SHADOW_CAM_FAR = 5000.0f;
+static const uint32 HEIGHTMAP_UNIFORM_HASH = crc32("u_texHeightmap");
+static const uint32 SPLATMAP_UNIFORM_HASH = crc32("u_texSplatmap");
+
+
+struct VisibleParticleEmitter
+{
+	ParticleEmitter* emitter;
+	float depth;
+	int first_batch;
+	int batches_count;
+};
 
 
 struct InstanceData
@@ -50,6 +63,47 @@ struct InstanceData
 
 struct PipelineImpl : public Pipeline
 {
+	struct Command
+	{
+		enum Type : uint8
+		{
+			BEGIN_NEW_VIEW, // string = debug name
+			SET_PASS, // index = pass, string = pass name
+			SET_FRAMEBUFFER, // framebuffer, null and index = 1 for the default framebuffer
+			ENABLE_ALPHA_WRITE,
+			DISABLE_ALPHA_WRITE,
+			ENABLE_DEPTH_WRITE,
+			DISABLE_DEPTH_WRITE,
+			ENABLE_RGB_WRITE,
+			DISABLE_RGB_WRITE,
+			ENABLE_BLENDING, // value = blend state
+			DISABLE_BLENDING,
+			APPLY_CAMERA, // index = camera
+			CLEAR, // value = clear flags, index = color
+			RENDER_MODELS, // value = layer mask
+			RENDER_POINT_LIGHT_INFLUENCED_GEOMETRY, // value = layer mask
+			RENDER_SHADOWMAP, // index = camera, value = layer mask
+			RENDER_LOCAL_LIGHTS_SHADOWMAPS, // index = camera, value = layer mask, framebuffers
+			EXECUTE_CUSTOM_COMMAND, // index = handler
+			RENDER_DEBUG_SHAPES,
+			RENDER_PARTICLES,
+			BIND_FRAMEBUFFER_TEXTURE, // framebuffer, index = renderbuffer, count = uniform
+			DRAW_QUAD, // rect, index = material
+			PRINT, // rect[0], rect[1] = position, string = text
+			CALL_LUA_FUNCTION // string = function name
+		};
+
+		Type type;
+		int index;
+		int count;
+		int string; // offset in m_command_strings
+		int framebuffers; // offset in m_command_framebuffers, count framebuffers
+		uint64 value;
+		FrameBuffer* framebuffer;
+		float rect[4];
+	};
+
+
 	PipelineImpl(Renderer& renderer, const Path& path, IAllocator& allocator)
 		: m_allocator(allocator)
 		, m_path(path)
@@ -60,6 +114,18 @@ struct PipelineImpl : public Pipeline
 		, m_tmp_terrains(allocator)
 		, m_tmp_grasses(allocator)
 		, m_tmp_meshes(allocator)
+		, m_tmp_emitters(allocator)
+		, m_tmp_particle_buffers(allocator)
+		, m_tmp_particle_batches(allocator)
+		, m_particle_jobs(allocator)
+		, m_particles_sync_point(true, allocator)
+		, m_commands(allocator)
+		, m_command_strings(allocator)
+		, m_command_framebuffers(allocator)
+		, m_is_recording(false)
+		, m_is_command_list_dirty(true)
+		, m_is_command_list_dynamic(false)
+		, m_recorded_camera_slots_change_count(0)
 		, m_uniforms(allocator)
 		, m_renderer(renderer)
 		, m_default_framebuffer(nullptr)
@@ -68,6 +134,7 @@ struct PipelineImpl : public Pipeline
 		, m_point_light_shadowmaps(allocator)
 		, m_materials(allocator)
 		, m_is_rendering_in_shadowmap(false)
+		, m_cluster_frustum(nullptr)
 		, m_is_ready(false)
 	{
 		m_base_vertex_decl.begin()
@@ -77,6 +144,9 @@ struct PipelineImpl : public Pipeline
 			.end();
 
 		m_is_wireframe = false;
+		m_last_material = nullptr;
+		m_light_state.is_valid = false;
+		setMemory(&m_stats, 0, sizeof(m_stats));
 		m_view_x = m_view_y = 0;
 		m_has_shadowmap_define_idx = m_renderer.getShaderDefineIdx("HAS_SHADOWMAP");
 
@@ -237,6 +307,7 @@ struct PipelineImpl : public Pipeline
 		{
 			lua_pop(m_lua_state, 1);
 		}
+		m_is_command_list_dirty = true;
 		m_is_ready = true;
 	}
 
@@ -287,6 +358,7 @@ struct PipelineImpl : public Pipeline
 			lua_setfield(L, -2, m_parameters[index].c_str());
 		}
 		lua_pop(L, -1);
+		m_is_command_list_dirty = true;
 	}
 
 
@@ -396,75 +468,98 @@ struct PipelineImpl : public Pipeline
 	}
 
 
-	void renderParticles(const ParticleEmitter& emitter)
+	void renderParticles()
 	{
+		PROFILE_FUNCTION();
 		static const int PARTICLE_BATCH_SIZE = 256;
 
-		if (emitter.m_life.empty()) return;
-		if (!emitter.getMaterial()) return;
-		if (!emitter.getMaterial()->isReady()) return;
-
-		Material* material = emitter.getMaterial();
-
-		const bgfx::InstanceDataBuffer* instance_buffer = nullptr;
-		struct Instance
+		Vec3 view_pos = m_camera_frustum.getPosition();
+		Vec3 view_dir = m_camera_frustum.getDirection();
+		m_tmp_emitters.clear();
+		m_tmp_particle_buffers.clear();
+		m_tmp_particle_batches.clear();
+		for (auto* emitter : m_scene->getParticleEmitters())
 		{
-			Vec4 pos;
-			Vec4 alpha_and_rotation;
-		};
-		Instance* instance = nullptr;
-
-		for (int i = 0, c = emitter.m_life.size(); i < c; ++i)
-		{
-			if (i % PARTICLE_BATCH_SIZE == 0)
+			if (!emitter) continue;
+			int particles_count = emitter->getParticlesCount();
+			if (particles_count == 0) continue;
+			if (!emitter->getMaterial()) continue;
+			if (!emitter->getMaterial()->isReady()) continue;
+			Sphere sphere = emitter->getBoundingSphere();
+			if (!m_camera_frustum.isSphereInside(sphere.m_position, sphere.m_radius)) continue;
+
+			auto& visible = m_tmp_emitters.pushEmpty();
+			visible.emitter = emitter;
+			visible.depth = dotProduct(sphere.m_position - view_pos, view_dir);
+			visible.first_batch = m_tmp_particle_buffers.size();
+			visible.batches_count = 0;
+			for (int i = 0; i < particles_count; i += PARTICLE_BATCH_SIZE)
 			{
-				if (instance_buffer)
-				{
-					setMaterial(material);
-					bgfx::setInstanceDataBuffer(instance_buffer, PARTICLE_BATCH_SIZE);
-					bgfx::setVertexBuffer(m_particle_vertex_buffer);
-					bgfx::setIndexBuffer(m_particle_index_buffer);
-					bgfx::submit(m_view_idx, material->getShaderInstance().m_program_handles[m_pass_idx]);
-				}
-
-				instance_buffer = bgfx::allocInstanceDataBuffer(PARTICLE_BATCH_SIZE, sizeof(Instance));
-				instance = (Instance*)instance_buffer->data;
+				int batch_size = Math::minValue(PARTICLE_BATCH_SIZE, particles_count - i);
+				int stride = sizeof(ParticleEmitter::RenderInstance);
+				const bgfx::InstanceDataBuffer* buffer =
+					bgfx::allocInstanceDataBuffer(batch_size, stride);
+				m_tmp_particle_buffers.push(buffer);
+				m_tmp_particle_batches.push((ParticleEmitter::RenderInstance*)buffer->data);
+				++visible.batches_count;
 			}
+		}
+		if (m_tmp_emitters.empty()) return;
 
-			instance->pos = Vec4(emitter.m_position[i], emitter.m_size[i]);
-			instance->alpha_and_rotation = Vec4(emitter.m_alpha[i], emitter.m_rotation[i], 0, 0);
-			++instance;
+		MTJD::Manager& mtjd_manager = m_renderer.getEngine().getMTJDManager();
+		m_particle_jobs.clear();
+		for (auto& visible : m_tmp_emitters)
+		{
+			ParticleEmitter* emitter = visible.emitter;
+			ParticleEmitter::RenderInstance* const* batches =
+				&m_tmp_particle_batches[visible.first_batch];
+			MTJD::Job* job = MTJD::makeJob(mtjd_manager,
+				[emitter, batches, view_pos, view_dir]()
+				{
+					PROFILE_BLOCK("Particle Render Data Job");
+					emitter->fillInstances(view_pos, view_dir, batches, PARTICLE_BATCH_SIZE);
+				},
+				m_allocator);
+			job->addDependency(&m_particles_sync_point);
+			m_particle_jobs.push(job);
+		}
+		for (auto* job : m_particle_jobs)
+		{
+			mtjd_manager.schedule(job);
 		}
 
-		if (emitter.m_life.size() % PARTICLE_BATCH_SIZE)
+		// emitters are blended back to front, particles inside an emitter are sorted by the jobs
+		for (int i = 1; i < m_tmp_emitters.size(); ++i)
 		{
-			setMaterial(material);
-			bgfx::setInstanceDataBuffer(instance_buffer, emitter.m_life.size() % PARTICLE_BATCH_SIZE);
-			bgfx::setVertexBuffer(m_particle_vertex_buffer);
-			bgfx::setIndexBuffer(m_particle_index_buffer);
-			bgfx::setState(m_render_state | material->getRenderStates());
-			bgfx::submit(m_view_idx, material->getShaderInstance().m_program_handles[m_pass_idx]);
+			VisibleParticleEmitter tmp = m_tmp_emitters[i];
+			int j = i;
+			for (; j > 0 && m_tmp_emitters[j - 1].depth < tmp.depth; --j)
+			{
+				m_tmp_emitters[j] = m_tmp_emitters[j - 1];
+			}
+			m_tmp_emitters[j] = tmp;
 		}
-	}
 
+		m_particles_sync_point.sync();
 
-	void renderParticles()
-	{
-		const auto& emitters = m_scene->getParticleEmitters();
-		for (const auto* emitter : emitters)
+		for (auto& visible : m_tmp_emitters)
 		{
-			if (!emitter) continue;
-
-			renderParticles(*emitter);
+			Material* material = visible.emitter->getMaterial();
+			for (int i = 0; i < visible.batches_count; ++i)
+			{
+				setMaterial(material);
+				bgfx::setInstanceDataBuffer(m_tmp_particle_buffers[visible.first_batch + i]);
+				bgfx::setVertexBuffer(m_particle_vertex_buffer);
+				bgfx::setIndexBuffer(m_particle_index_buffer);
+				bgfx::setState(m_render_state | material->getRenderStates());
+				submit(material->getShaderInstance().getProgramHandle(m_pass_idx));
+			}
 		}
 	}
 
 
-	void bindFramebufferTexture(const char* framebuffer_name,
-		int renderbuffer_idx,
-		int uniform_idx)
+	void bindFramebufferTexture(FrameBuffer* fb, int renderbuffer_idx, int uniform_idx)
 	{
-		FrameBuffer* fb = getFramebuffer(framebuffer_name);
 		if (!fb) return;
 
 		Vec4 size;
@@ -503,7 +598,7 @@ struct PipelineImpl : public Pipeline
 		bgfx::setInstanceDataBuffer(data.buffer, data.instance_count);
 		ShaderInstance& shader_instance =
 			mesh.getMaterial()->getShaderInstance();
-		bgfx::submit(m_view_idx, shader_instance.m_program_handles[m_pass_idx]);
+		submit(shader_instance.getProgramHandle(m_pass_idx));
 
 		data.buffer = nullptr;
 		data.instance_count = 0;
@@ -511,9 +606,8 @@ struct PipelineImpl : public Pipeline
 	}
 
 
-	void applyCamera(const char* slot)
+	void applyCamera(ComponentIndex cmp)
 	{
-		ComponentIndex cmp = m_scene->getCameraInSlot(slot);
 		if (cmp < 0) return;
 
 		m_scene->setCameraSize(cmp, m_width, m_height);
@@ -548,9 +642,9 @@ struct PipelineImpl : public Pipeline
 	}
 
 
-	void setPass(const char* name)
+	void setPass(int pass_idx, const char* name)
 	{
-		m_pass_idx = m_renderer.getPassIdx(name);
+		m_pass_idx = pass_idx;
 		for (int i = 0; i < m_view2pass_map.size(); ++i)
 		{
 			if (m_view2pass_map[i] == m_pass_idx)
@@ -570,6 +664,7 @@ struct PipelineImpl : public Pipeline
 		copyString(handler.name, name);
 		handler.hash = crc32(name);
 		exposeCustomCommandToLua(handler);
+		m_is_command_list_dirty = true;
 		return handler;
 	}
 
@@ -587,32 +682,17 @@ struct PipelineImpl : public Pipeline
 	}
 
 
-	void setCurrentFramebuffer(const char* framebuffer_name)
+	void setCurrentFramebuffer(FrameBuffer* framebuffer, bool is_default)
 	{
-		if (compareString(framebuffer_name, "default") == 0)
-		{
-			m_current_framebuffer = m_default_framebuffer;
-			if (m_current_framebuffer)
-			{
-				bgfx::setViewFrameBuffer(m_view_idx,
-										 m_current_framebuffer->getHandle());
-			}
-			else
-			{
-				bgfx::setViewFrameBuffer(m_view_idx, BGFX_INVALID_HANDLE);
-			}
-			return;
-		}
-		m_current_framebuffer = getFramebuffer(framebuffer_name);
+		m_current_framebuffer = framebuffer;
 		if (m_current_framebuffer)
 		{
 			bgfx::setViewFrameBuffer(m_view_idx,
 									 m_current_framebuffer->getHandle());
 		}
-		else
+		else if (is_default)
 		{
-			g_log_warning.log("renderer") << "Framebuffer " << framebuffer_name
-										  << " not found";
+			bgfx::setViewFrameBuffer(m_view_idx, BGFX_INVALID_HANDLE);
 		}
 	}
 
@@ -623,17 +703,19 @@ struct PipelineImpl : public Pipeline
 	int getHeight() override { return m_height; }
 
 
-	void executeCustomCommand(uint32 name)
+	int getCustomCommandHandlerIndex(uint32 name) const
 	{
-		CustomCommandHandler handler;
-		for(auto& handler : m_custom_commands_handlers)
+		for (int i = 0, c = m_custom_commands_handlers.size(); i < c; ++i)
 		{
-			if(handler.hash == name)
-			{
-				handler.callback.invoke();
-				break;
-			}
+			if (m_custom_commands_handlers[i].hash == name) return i;
 		}
+		return -1;
+	}
+
+
+	void executeCustomCommand(int handler_index)
+	{
+		if (handler_index >= 0) m_custom_commands_handlers[handler_index].callback.invoke();
 		finishInstances();
 	}
 
@@ -655,6 +737,15 @@ struct PipelineImpl : public Pipeline
 		}
 		bgfx::setViewClear(m_view_idx, 0);
 		bgfx::setViewName(m_view_idx, debug_name);
+		invalidateStateCache();
+	}
+
+
+	// shadowmap matrices and light lists change between views
+	void invalidateStateCache()
+	{
+		m_light_state.is_valid = false;
+		m_last_material = nullptr;
 	}
 
 
@@ -794,7 +885,7 @@ struct PipelineImpl : public Pipeline
 		m_scene->getPointLightInfluencedGeometry(
 			light, frustum, m_tmp_meshes, layer_mask);
 
-		renderMeshes(m_tmp_meshes);
+		renderMeshes(m_tmp_meshes, m_scene->getRenderables());
 		m_current_light = -1;
 	}
 
@@ -959,8 +1050,7 @@ struct PipelineImpl : public Pipeline
 			bgfx::setIndexBuffer(&tib);
 			bgfx::setState(
 				m_render_state | m_debug_line_material->getRenderStates() | BGFX_STATE_PT_POINTS);
-			bgfx::submit(m_view_idx,
-				m_debug_line_material->getShaderInstance().m_program_handles[m_pass_idx]);
+			submit(m_debug_line_material->getShaderInstance().getProgramHandle(m_pass_idx));
 		}
 	}
 
@@ -1002,8 +1092,7 @@ struct PipelineImpl : public Pipeline
 			bgfx::setIndexBuffer(&tib);
 			bgfx::setState(
 				m_render_state | m_debug_line_material->getRenderStates() | BGFX_STATE_PT_LINES);
-			bgfx::submit(m_view_idx,
-				m_debug_line_material->getShaderInstance().m_program_handles[m_pass_idx]);
+			submit(m_debug_line_material->getShaderInstance().getProgramHandle(m_pass_idx));
 		}
 	}
 
@@ -1014,69 +1103,69 @@ struct PipelineImpl : public Pipeline
 	}
 
 
-	void setPointLightUniforms(Material* material, ComponentIndex light_cmp)
+	// light uniforms are computed only when the light changes, bgfx still needs them for every draw
+	void updateLightState()
 	{
-		if (light_cmp < 0) return;
-
-		Universe& universe = m_scene->getUniverse();
-		Entity light_entity = m_scene->getPointLightEntity(light_cmp);
-		Vec3 light_pos = universe.getPosition(light_entity);
-		Vec3 light_dir = universe.getRotation(light_entity) * Vec3(0, 0, 1);
-		float fov = Math::degreesToRadians(m_scene->getLightFOV(light_cmp));
-		Vec3 color = m_scene->getPointLightColor(light_cmp) *
-					 m_scene->getPointLightIntensity(light_cmp);
-		float range = m_scene->getLightRange(light_cmp);
-		float attenuation = m_scene->getLightAttenuation(light_cmp);
-		Vec4 attenuation_params(range, attenuation, 0, 1);
-		Vec4 light_pos_radius(light_pos, range);
-		Vec4 light_color(color, 0);
-		Vec4 light_dir_fov(light_dir, fov);
-		Vec4 light_specular(m_scene->getPointLightSpecularColor(light_cmp), 1);
+		LightState& state = m_light_state;
+		if (state.is_valid && state.light == m_current_light &&
+			state.is_global == m_is_current_light_global)
+		{
+			++m_stats.light_state_reuses;
+			return;
+		}
 
-		bgfx::setUniform(m_attenuation_params_uniform, &attenuation_params);
-		bgfx::setUniform(m_light_pos_radius_uniform, &light_pos_radius);
-		bgfx::setUniform(m_light_color_uniform, &light_color);
-		bgfx::setUniform(m_light_dir_fov_uniform, &light_dir_fov);
-		bgfx::setUniform(m_light_specular_uniform, &light_specular);
+		++m_stats.light_state_changes;
+		state.is_valid = true;
+		state.light = m_current_light;
+		state.is_global = m_is_current_light_global;
+		state.shadowmap = -1;
+		if (m_current_light < 0) return;
 
-		if (m_scene->getLightCastShadows(light_cmp))
+		if (m_is_current_light_global)
 		{
-			setPointLightShadowmapUniforms(material, light_cmp);
+			computeDirectionalLightState(m_current_light);
 		}
 		else
 		{
-			material->unsetUserDefine(m_has_shadowmap_define_idx);
+			computePointLightState(m_current_light);
 		}
 	}
 
 
-	void setPointLightShadowmapUniforms(Material* material, ComponentIndex light)
+	void computePointLightState(ComponentIndex light_cmp)
 	{
-		for (auto& info : m_point_light_shadowmaps)
+		LightState& state = m_light_state;
+		Universe& universe = m_scene->getUniverse();
+		Entity light_entity = m_scene->getPointLightEntity(light_cmp);
+		Vec3 light_pos = universe.getPosition(light_entity);
+		Vec3 light_dir = universe.getRotation(light_entity) * Vec3(0, 0, 1);
+		float fov = Math::degreesToRadians(m_scene->getLightFOV(light_cmp));
+		Vec3 color = m_scene->getPointLightColor(light_cmp) *
+					 m_scene->getPointLightIntensity(light_cmp);
+		float range = m_scene->getLightRange(light_cmp);
+		float attenuation = m_scene->getLightAttenuation(light_cmp);
+		state.attenuation_params.set(range, attenuation, 0, 1);
+		state.light_pos_radius = Vec4(light_pos, range);
+		state.light_color = Vec4(color, 0);
+		state.light_dir_fov = Vec4(light_dir, fov);
+		state.light_specular = Vec4(m_scene->getPointLightSpecularColor(light_cmp), 1);
+
+		if (!m_scene->getLightCastShadows(light_cmp)) return;
+		for (int i = 0, c = m_point_light_shadowmaps.size(); i < c; ++i)
 		{
-			if (info.m_light == light)
+			if (m_point_light_shadowmaps[i].m_light == light_cmp)
 			{
-				material->setUserDefine(m_has_shadowmap_define_idx);
-
-				bgfx::setUniform(m_shadowmap_matrices_uniform,
-					&info.m_matrices[0].m11,
-					m_scene->getLightFOV(light) > 180 ? 4 : 1);
-
-				int texture_offset = material->getShader()->getTextureSlotCount();
-				bgfx::setTexture(texture_offset,
-					m_tex_shadowmap_uniform,
-					info.m_framebuffer->getRenderbufferHandle(0));
-				return;
+				state.shadowmap = i;
+				state.shadowmap_matrices_count = m_scene->getLightFOV(light_cmp) > 180 ? 4 : 1;
+				break;
 			}
 		}
-		material->unsetUserDefine(m_has_shadowmap_define_idx);
 	}
 
 
-	void setDirectionalLightUniforms(ComponentIndex light_cmp) const
+	void computeDirectionalLightState(ComponentIndex light_cmp)
 	{
-		if (light_cmp < 0) return;
-
+		LightState& state = m_light_state;
 		Universe& universe = m_scene->getUniverse();
 		Entity light_entity = m_scene->getGlobalLightEntity(light_cmp);
 		Vec3 light_dir = universe.getRotation(light_entity) * Vec3(0, 0, 1);
@@ -1084,20 +1173,56 @@ struct PipelineImpl : public Pipeline
 							 m_scene->getGlobalLightIntensity(light_cmp);
 		Vec3 ambient_color = m_scene->getLightAmbientColor(light_cmp) *
 							 m_scene->getLightAmbientIntensity(light_cmp);
-		Vec4 diffuse_light_color(diffuse_color, 1);
 		Vec3 fog_color = m_scene->getFogColor(light_cmp);
 		float fog_density = m_scene->getFogDensity(light_cmp);
-		Vec4 ambient_light_color(ambient_color, 1);
-		Vec4 light_dir_fov(light_dir, 0);
 		fog_density *= fog_density * fog_density;
-		Vec4 fog_color_density(fog_color, fog_density);
-		Vec4 fog_params(m_scene->getFogBottom(light_cmp), m_scene->getFogHeight(light_cmp), 0, 0);
-
-		bgfx::setUniform(m_light_color_uniform, &diffuse_light_color);
-		bgfx::setUniform(m_ambient_color_uniform, &ambient_light_color);
-		bgfx::setUniform(m_light_dir_fov_uniform, &light_dir_fov);
-		bgfx::setUniform(m_fog_color_density_uniform, &fog_color_density);
-		bgfx::setUniform(m_fog_params_uniform, &fog_params);
+		state.light_color = Vec4(diffuse_color, 1);
+		state.ambient_color = Vec4(ambient_color, 1);
+		state.light_dir_fov = Vec4(light_dir, 0);
+		state.fog_color_density = Vec4(fog_color, fog_density);
+		state.fog_params.set(
+			m_scene->getFogBottom(light_cmp), m_scene->getFogHeight(light_cmp), 0, 0);
+	}
+
+
+	void setPointLightUniforms(Material* material)
+	{
+		const LightState& state = m_light_state;
+		if (state.light < 0) return;
+
+		bgfx::setUniform(m_attenuation_params_uniform, &state.attenuation_params);
+		bgfx::setUniform(m_light_pos_radius_uniform, &state.light_pos_radius);
+		bgfx::setUniform(m_light_color_uniform, &state.light_color);
+		bgfx::setUniform(m_light_dir_fov_uniform, &state.light_dir_fov);
+		bgfx::setUniform(m_light_specular_uniform, &state.light_specular);
+
+		if (state.shadowmap < 0)
+		{
+			material->unsetUserDefine(m_has_shadowmap_define_idx);
+			return;
+		}
+
+		const PointLightShadowmap& info = m_point_light_shadowmaps[state.shadowmap];
+		material->setUserDefine(m_has_shadowmap_define_idx);
+		bgfx::setUniform(
+			m_shadowmap_matrices_uniform, &info.m_matrices[0].m11, state.shadowmap_matrices_count);
+
+		int texture_offset = material->getShader()->getTextureSlotCount();
+		bgfx::setTexture(
+			texture_offset, m_tex_shadowmap_uniform, info.m_framebuffer->getRenderbufferHandle(0));
+	}
+
+
+	void setDirectionalLightUniforms() const
+	{
+		const LightState& state = m_light_state;
+		if (state.light < 0) return;
+
+		bgfx::setUniform(m_light_color_uniform, &state.light_color);
+		bgfx::setUniform(m_ambient_color_uniform, &state.ambient_color);
+		bgfx::setUniform(m_light_dir_fov_uniform, &state.light_dir_fov);
+		bgfx::setUniform(m_fog_color_density_uniform, &state.fog_color_density);
+		bgfx::setUniform(m_fog_params_uniform, &state.fog_params);
 		bgfx::setUniform(m_shadowmap_matrices_uniform, &m_shadow_viewprojection, 4);
 	}
 
@@ -1123,7 +1248,7 @@ struct PipelineImpl : public Pipeline
 
 		m_scene->getPointLightInfluencedGeometry(light, m_tmp_meshes, layer_mask);
 
-		renderMeshes(m_tmp_meshes);
+		renderMeshes(m_tmp_meshes, m_scene->getRenderables());
 	}
 
 
@@ -1151,7 +1276,7 @@ struct PipelineImpl : public Pipeline
 				m_renderer.getFrameAllocator());
 
 			m_scene->getGrassInfos(frustum, m_tmp_grasses, layer_mask, m_applied_camera);
-			renderMeshes(m_tmp_meshes);
+			renderMeshes(m_tmp_meshes, m_scene->getRenderables());
 			renderTerrains(m_tmp_terrains);
 			renderGrasses(m_tmp_grasses);
 		}
@@ -1287,7 +1412,7 @@ struct PipelineImpl : public Pipeline
 
 		bgfx::setState(m_render_state | material->getRenderStates());
 		bgfx::setVertexBuffer(&vb);
-		bgfx::submit(m_view_idx, material->getShaderInstance().m_program_handles[m_pass_idx]);
+		submit(material->getShaderInstance().getProgramHandle(m_pass_idx));
 	}
 
 
@@ -1310,7 +1435,24 @@ struct PipelineImpl : public Pipeline
 		m_is_current_light_global = true;
 		m_current_light = m_scene->getActiveGlobalLight();
 
-		renderMeshes(m_tmp_meshes);
+		// clusters of large meshes are culled only against the frustum which selected the meshes
+		m_cluster_frustum = &frustum;
+		Renderable* renderables = m_scene->getRenderables();
+		if (!m_is_rendering_in_shadowmap)
+		{
+			requestTextureSizes(m_tmp_meshes, renderables, camera_pos);
+		}
+		renderMeshes(m_tmp_meshes, renderables);
+
+		m_tmp_meshes.clear();
+		m_scene->getStaticBatchInfos(frustum, m_tmp_meshes, layer_mask);
+		Renderable* static_batches = m_scene->getStaticBatches();
+		if (!m_is_rendering_in_shadowmap)
+		{
+			requestTextureSizes(m_tmp_meshes, static_batches, camera_pos);
+		}
+		renderMeshes(m_tmp_meshes, static_batches);
+		m_cluster_frustum = nullptr;
 		renderTerrains(m_tmp_terrains);
 		if (render_grass)
 		{
@@ -1409,8 +1551,7 @@ struct PipelineImpl : public Pipeline
 		bgfx::setIndexBuffer(
 			renderable.model->getIndicesHandle(), mesh.getIndicesOffset(), mesh.getIndexCount());
 		bgfx::setState(m_render_state | material->getRenderStates());
-		bgfx::submit(m_view_idx,
-			mesh.getMaterial()->getShaderInstance().m_program_handles[m_pass_idx]);
+		submit(mesh.getMaterial()->getShaderInstance().getProgramHandle(m_pass_idx));
 	}
 
 
@@ -1437,12 +1578,87 @@ struct PipelineImpl : public Pipeline
 		bgfx::setTransform(&mtx.m11);
 		bgfx::setVertexBuffer(&geom.getVertexBuffer());
 		bgfx::setIndexBuffer(&geom.getIndexBuffer(), first_index, num_indices);
-		bgfx::submit(m_view_idx, program_handle);
+		submit(program_handle);
+	}
+
+
+	void submitClusters(const Renderable& renderable,
+		const Mesh& mesh,
+		int indices_offset,
+		int index_count)
+	{
+		if (!bgfx::checkAvailInstanceDataBuffer(1, sizeof(Matrix))) return;
+
+		Material* material = mesh.getMaterial();
+		const uint16 stride = mesh.getVertexDefinition().getStride();
+		const bgfx::InstanceDataBuffer* instance_buffer =
+			bgfx::allocInstanceDataBuffer(1, sizeof(Matrix));
+		*(Matrix*)instance_buffer->data = renderable.matrix;
+
+		setMaterial(material);
+		bgfx::setVertexBuffer(renderable.model->getVerticesHandle(),
+			mesh.getAttributeArrayOffset() / stride,
+			mesh.getAttributeArraySize() / stride);
+		bgfx::setIndexBuffer(renderable.model->getIndicesHandle(),
+			mesh.getIndicesOffset() + indices_offset,
+			index_count);
+		bgfx::setState(m_render_state | material->getRenderStates());
+		bgfx::setInstanceDataBuffer(instance_buffer, 1);
+		submit(material->getShaderInstance().getProgramHandle(m_pass_idx));
+	}
+
+
+	void renderClusteredMesh(const Renderable& renderable, const Mesh& mesh)
+	{
+		const Matrix& mtx = renderable.matrix;
+		float scale = mtx.getXVector().length();
+		// backfacing clusters still cast shadows
+		bool cull_backfaces =
+			!m_is_rendering_in_shadowmap && mesh.getMaterial()->isBackfaceCulling();
+		Matrix inv_mtx = mtx;
+		inv_mtx.inverse();
+		Vec3 local_camera_pos = inv_mtx.multiplyPosition(m_cluster_frustum->getPosition());
+
+		// neighbouring visible clusters are continuous in the index buffer and share a draw call
+		const MeshOptimizer::Cluster* clusters = mesh.getClusters();
+		int range_from = -1;
+		int range_to = -1;
+		for (int i = 0, c = mesh.getClusterCount(); i < c; ++i)
+		{
+			const MeshOptimizer::Cluster& cluster = clusters[i];
+			Vec3 center = mtx.multiplyPosition(cluster.center);
+			bool is_visible = m_cluster_frustum->isSphereInside(center, cluster.radius * scale) &&
+							  !(cull_backfaces &&
+								  MeshOptimizer::isClusterBackfacing(cluster, local_camera_pos));
+			if (!is_visible)
+			{
+				++m_stats.culled_clusters;
+				continue;
+			}
+
+			++m_stats.visible_clusters;
+			if (range_to != cluster.indices_offset)
+			{
+				if (range_from >= 0)
+				{
+					submitClusters(renderable, mesh, range_from, range_to - range_from);
+				}
+				range_from = cluster.indices_offset;
+			}
+			range_to = cluster.indices_offset + cluster.index_count;
+		}
+		if (range_from >= 0) submitClusters(renderable, mesh, range_from, range_to - range_from);
 	}
 
 
 	void renderRigidMesh(const Renderable& renderable, const RenderableMesh& info)
 	{
+		if (m_cluster_frustum && info.mesh->getClusterCount() > 0)
+		{
+			renderClusteredMesh(renderable, *info.mesh);
+			return;
+		}
+
 		int instance_idx = info.mesh->getInstanceIdx();
 		if (instance_idx == -1)
 		{
@@ -1474,15 +1690,33 @@ struct PipelineImpl : public Pipeline
 	}
 
 
+	void submit(bgfx::ProgramHandle program)
+	{
+		++m_stats.draw_calls;
+		bgfx::submit(m_view_idx, program);
+	}
+
+
 	void setMaterial(Material* material)
 	{
+		updateLightState();
 		if (m_is_current_light_global)
 		{
-			setDirectionalLightUniforms(m_current_light);
+			setDirectionalLightUniforms();
 		}
 		else
 		{
-			setPointLightUniforms(material, m_current_light);
+			setPointLightUniforms(material);
+		}
+
+		if (material == m_last_material)
+		{
+			++m_stats.material_reuses;
+		}
+		else
+		{
+			++m_stats.material_changes;
+			m_last_material = material;
 		}
 
 		for (int i = 0; i < material->getUniformCount(); ++i)
@@ -1541,6 +1775,24 @@ struct PipelineImpl : public Pipeline
 	}
 
 
+	// streamed tiles replace the heightmap and the splatmap of the material
+	void setTerrainTilesTextures(const Terrain& terrain, const Shader& shader)
+	{
+		for (int i = 0; i < shader.getTextureSlotCount(); ++i)
+		{
+			const Shader::TextureSlot& slot = shader.getTextureSlot(i);
+			if (slot.m_uniform_hash == HEIGHTMAP_UNIFORM_HASH)
+			{
+				bgfx::setTexture(i, slot.m_uniform_handle, terrain.getTilesHeightmap());
+			}
+			else if (slot.m_uniform_hash == SPLATMAP_UNIFORM_HASH)
+			{
+				bgfx::setTexture(i, slot.m_uniform_handle, terrain.getTilesSplatmap());
+			}
+		}
+	}
+
+
 	void finishTerrainInstances(int index)
 	{
 		if (m_terrain_instances[index].m_count == 0) return;
@@ -1551,8 +1803,8 @@ struct PipelineImpl : public Pipeline
 
 		Texture* detail_texture = info.m_terrain->getDetailTexture();
 		if (!detail_texture) return;
-		Texture* splat_texture = info.m_terrain->getSplatmap();
-		if (!splat_texture) return;
+		int splatmap_width = info.m_terrain->getSplatmapWidth();
+		if (splatmap_width == 0) return;
 
 		Matrix inv_world_matrix;
 		inv_world_matrix = info.m_world_matrix;
@@ -1568,13 +1820,17 @@ struct PipelineImpl : public Pipeline
 		Vec4 terrain_params(info.m_terrain->getRootSize(),
 			(float)detail_texture->getWidth(),
 			(float)detail_texture->getAtlasSize(),
-			(float)splat_texture->getWidth());
+			(float)splatmap_width);
 		bgfx::setUniform(m_terrain_params_uniform, &terrain_params);
 		bgfx::setUniform(m_rel_camera_pos_uniform, &rel_cam_pos);
 		bgfx::setUniform(m_terrain_scale_uniform, &terrain_scale);
 		bgfx::setUniform(m_terrain_matrix_uniform, &info.m_world_matrix.m11);
 
 		setMaterial(material);
+		if (bgfx::isValid(info.m_terrain->getTilesHeightmap()))
+		{
+			setTerrainTilesTextures(*info.m_terrain, *material->getShader());
+		}
 
 		struct TerrainInstanceData
 		{
@@ -1601,8 +1857,8 @@ struct PipelineImpl : public Pipeline
 			mesh_part_indices_count);
 		bgfx::setState(m_render_state | mesh.getMaterial()->getRenderStates());
 		bgfx::setInstanceDataBuffer(instance_buffer, m_terrain_instances[index].m_count);
-		auto shader_instance = material->getShaderInstance().m_program_handles[m_pass_idx];
-		bgfx::submit(m_view_idx, shader_instance);
+		auto shader_instance = material->getShaderInstance().getProgramHandle(m_pass_idx);
+		submit(shader_instance);
 
 		m_terrain_instances[index].m_count = 0;
 	}
@@ -1624,7 +1880,7 @@ struct PipelineImpl : public Pipeline
 			grass.m_model->getIndicesHandle(), mesh.getIndicesOffset(), mesh.getIndexCount());
 		bgfx::setState(m_render_state | material->getRenderStates());
 		bgfx::setInstanceDataBuffer(idb, grass.m_matrix_count);
-		bgfx::submit(m_view_idx, material->getShaderInstance().m_program_handles[m_pass_idx]);
+		submit(material->getShaderInstance().getProgramHandle(m_pass_idx));
 	}
 
 
@@ -1653,12 +1909,38 @@ struct PipelineImpl : public Pipeline
 	}
 
 
-	void renderMeshes(const Array<RenderableMesh>& meshes)
+	void requestTextureSizes(const Array<RenderableMesh>& meshes,
+		Renderable* renderables,
+		const Vec3& camera_pos)
+	{
+		PROFILE_FUNCTION();
+		if (meshes.empty() || m_height <= 0) return;
+
+		float fov = Math::degreesToRadians(m_scene->getCameraFOV(m_applied_camera));
+		float near_plane = m_scene->getCameraNearPlane(m_applied_camera);
+		float pixels_per_unit = m_height / (2 * tanf(fov * 0.5f));
+		for (auto& mesh : meshes)
+		{
+			Renderable& renderable = renderables[mesh.renderable];
+			Material* material = mesh.mesh->getMaterial();
+			float scale = renderable.matrix.getXVector().length();
+			float radius = renderable.model->getBoundingRadius() * scale;
+			float dist = (renderable.matrix.getTranslation() - camera_pos).length() - radius;
+			int size = int(2 * radius * pixels_per_unit / Math::maxValue(dist, near_plane));
+			for (int i = 0; i < material->getTextureCount(); ++i)
+			{
+				Texture* texture = material->getTexture(i);
+				if (texture && texture->isStreamed()) texture->requestSize(size);
+			}
+		}
+	}
+
+
+	void renderMeshes(const Array<RenderableMesh>& meshes, Renderable* renderables)
 	{
 		PROFILE_FUNCTION();
 		if (meshes.empty()) return;
 
-		Renderable* renderables = m_scene->getRenderables();
 		PROFILE_INT("mesh count", meshes.size());
 		for (auto& mesh : meshes)
 		{
@@ -1706,6 +1988,8 @@ struct PipelineImpl : public Pipeline
 		m_pass_idx = -1;
 		m_current_framebuffer = m_default_framebuffer;
 		m_current_light = -1;
+		invalidateStateCache();
+		setMemory(&m_stats, 0, sizeof(m_stats));
 		m_view2pass_map.assign(0xFF);
 		m_instance_data_idx = 0;
 		m_point_light_shadowmaps.clear();
@@ -1719,6 +2003,46 @@ struct PipelineImpl : public Pipeline
 			m_instances_data[i].instance_count = 0;
 		}
 
+		if (isCommandListDirty()) recordCommands();
+		for (const auto& command : m_commands)
+		{
+			executeCommand(command);
+		}
+		finishInstances();
+
+		PROFILE_INT("draw calls", m_stats.draw_calls);
+		PROFILE_INT("material changes", m_stats.material_changes);
+		PROFILE_INT("repeated materials", m_stats.material_reuses);
+		PROFILE_INT("light state changes", m_stats.light_state_changes);
+		PROFILE_INT("skipped light state updates", m_stats.light_state_reuses);
+		PROFILE_INT("visible clusters", m_stats.visible_clusters);
+		PROFILE_INT("culled clusters", m_stats.culled_clusters);
+
+		m_renderer.getFrameAllocator().clear();
+	}
+
+
+	bool isCommandListDirty() const
+	{
+		if (m_is_command_list_dirty || m_is_command_list_dynamic) return true;
+		return m_scene &&
+			   m_scene->getCameraSlotsChangeCount() != m_recorded_camera_slots_change_count;
+	}
+
+
+	// runs the Lua render function once, functions called from it only record commands
+	void recordCommands()
+	{
+		PROFILE_FUNCTION();
+		m_commands.clear();
+		m_command_strings.clear();
+		m_command_framebuffers.clear();
+		m_is_command_list_dirty = false;
+		m_is_command_list_dynamic = false;
+		m_recorded_camera_slots_change_count = m_scene ? m_scene->getCameraSlotsChangeCount() : 0;
+
+		m_is_recording = true;
+		s_recording_pipeline = this;
 		if (lua_getglobal(m_lua_state, "render") == LUA_TFUNCTION)
 		{
 			lua_pushlightuserdata(m_lua_state, this);
@@ -1732,9 +2056,134 @@ struct PipelineImpl : public Pipeline
 		{
 			lua_pop(m_lua_state, 1);
 		}
-		finishInstances();
+		s_recording_pipeline = nullptr;
+		m_is_recording = false;
+	}
 
-		m_renderer.getFrameAllocator().clear();
+
+	// outside of recording, e.g. in functions called by CALL_LUA_FUNCTION, commands run immediately
+	Command& beginCommand(Command::Type type)
+	{
+		Command& cmd = m_is_recording ? m_commands.pushEmpty() : m_immediate_command;
+		if (!m_is_recording)
+		{
+			m_immediate_strings_size = m_command_strings.size();
+			m_immediate_framebuffers_size = m_command_framebuffers.size();
+		}
+		cmd.type = type;
+		cmd.index = -1;
+		cmd.count = 0;
+		cmd.string = -1;
+		cmd.framebuffers = -1;
+		cmd.value = 0;
+		cmd.framebuffer = nullptr;
+		cmd.rect[0] = cmd.rect[1] = cmd.rect[2] = cmd.rect[3] = 0;
+		return cmd;
+	}
+
+
+	void endCommand()
+	{
+		if (m_is_recording) return;
+
+		Command cmd = m_immediate_command;
+		int strings_size = m_immediate_strings_size;
+		int framebuffers_size = m_immediate_framebuffers_size;
+		executeCommand(cmd);
+		m_command_strings.resize(strings_size);
+		m_command_framebuffers.resize(framebuffers_size);
+	}
+
+
+	int addCommandString(const char* value)
+	{
+		int offset = m_command_strings.size();
+		int len = stringLength(value);
+		m_command_strings.resize(offset + len + 1);
+		copyMemory(&m_command_strings[offset], value, len + 1);
+		return offset;
+	}
+
+
+	const char* getCommandString(const Command& cmd) const
+	{
+		return cmd.string < 0 ? "" : &m_command_strings[cmd.string];
+	}
+
+
+	void callLuaFunction(const char* name)
+	{
+		if (lua_getglobal(m_lua_state, name) == LUA_TFUNCTION)
+		{
+			lua_pushlightuserdata(m_lua_state, this);
+			if (lua_pcall(m_lua_state, 1, 0, 0) != LUA_OK)
+			{
+				g_log_error.log("lua") << lua_tostring(m_lua_state, -1);
+				lua_pop(m_lua_state, 1);
+			}
+		}
+		else
+		{
+			lua_pop(m_lua_state, 1);
+		}
+	}
+
+
+	void executeCommand(const Command& cmd)
+	{
+		switch (cmd.type)
+		{
+			case Command::BEGIN_NEW_VIEW:
+				beginNewView(m_current_framebuffer, getCommandString(cmd));
+				break;
+			case Command::SET_PASS: setPass(cmd.index, getCommandString(cmd)); break;
+			case Command::SET_FRAMEBUFFER:
+				if (cmd.index != 0) setCurrentFramebuffer(m_default_framebuffer, true);
+				else setCurrentFramebuffer(cmd.framebuffer, false);
+				break;
+			case Command::ENABLE_ALPHA_WRITE: enableAlphaWrite(); break;
+			case Command::DISABLE_ALPHA_WRITE: disableAlphaWrite(); break;
+			case Command::ENABLE_DEPTH_WRITE: enableDepthWrite(); break;
+			case Command::DISABLE_DEPTH_WRITE: disableDepthWrite(); break;
+			case Command::ENABLE_RGB_WRITE: enableRGBWrite(); break;
+			case Command::DISABLE_RGB_WRITE: disableRGBWrite(); break;
+			case Command::ENABLE_BLENDING: enableBlending(cmd.value); break;
+			case Command::DISABLE_BLENDING: disableBlending(); break;
+			case Command::APPLY_CAMERA: applyCamera(cmd.index); break;
+			case Command::CLEAR:
+				bgfx::setViewClear(m_view_idx, (uint16)cmd.value, (uint32)cmd.index, 1.0f, 0);
+				bgfx::touch(m_view_idx);
+				break;
+			case Command::RENDER_MODELS: renderAll(m_camera_frustum, cmd.value, true); break;
+			case Command::RENDER_POINT_LIGHT_INFLUENCED_GEOMETRY:
+				renderPointLightInfluencedGeometry(m_camera_frustum, cmd.value);
+				break;
+			case Command::RENDER_SHADOWMAP: renderShadowmap(cmd.index, cmd.value); break;
+			case Command::RENDER_LOCAL_LIGHTS_SHADOWMAPS:
+				renderLocalLightShadowmaps(cmd.index,
+					cmd.count > 0 ? &m_command_framebuffers[cmd.framebuffers] : nullptr,
+					cmd.count,
+					cmd.value);
+				break;
+			case Command::EXECUTE_CUSTOM_COMMAND: executeCustomCommand(cmd.index); break;
+			case Command::RENDER_DEBUG_SHAPES:
+				renderDebugLines();
+				renderDebugPoints();
+				break;
+			case Command::RENDER_PARTICLES: renderParticles(); break;
+			case Command::BIND_FRAMEBUFFER_TEXTURE:
+				bindFramebufferTexture(cmd.framebuffer, cmd.index, cmd.count);
+				break;
+			case Command::DRAW_QUAD:
+				drawQuad(cmd.rect[0], cmd.rect[1], cmd.rect[2], cmd.rect[3], cmd.index);
+				break;
+			case Command::PRINT:
+				bgfx::dbgTextPrintf(
+					(uint16)cmd.rect[0], (uint16)cmd.rect[1], 0x4f, getCommandString(cmd));
+				break;
+			case Command::CALL_LUA_FUNCTION: callLuaFunction(getCommandString(cmd)); break;
+			default: ASSERT(false); break;
+		}
 	}
 
 
@@ -1761,7 +2210,11 @@ struct PipelineImpl : public Pipeline
 
 
 	bool isReady() const override { return m_is_ready; }
-	void setScene(RenderScene* scene) override { m_scene = scene; }
+	void setScene(RenderScene* scene) override
+	{
+		m_scene = scene;
+		m_is_command_list_dirty = true;
+	}
 	void setWireframe(bool wireframe) override { m_is_wireframe = wireframe; }
 
 
@@ -1780,6 +2233,36 @@ struct PipelineImpl : public Pipeline
 	};
 
 
+	struct LightState
+	{
+		bool is_valid;
+		bool is_global;
+		ComponentIndex light;
+		int shadowmap; // index in m_point_light_shadowmaps
+		int shadowmap_matrices_count;
+		Vec4 attenuation_params;
+		Vec4 light_pos_radius;
+		Vec4 light_color;
+		Vec4 light_dir_fov;
+		Vec4 light_specular;
+		Vec4 ambient_color;
+		Vec4 fog_color_density;
+		Vec4 fog_params;
+	};
+
+
+	struct Stats
+	{
+		int draw_calls;
+		int material_changes;
+		int material_reuses;
+		int light_state_changes;
+		int light_state_reuses;
+		int visible_clusters;
+		int culled_clusters;
+	};
+
+
 	struct BaseVertex
 	{
 		float m_x, m_y, m_z;
@@ -1812,8 +2295,12 @@ struct PipelineImpl : public Pipeline
 	ComponentIndex m_applied_camera;
 	ComponentIndex m_current_light;
 	bool m_is_current_light_global;
+	LightState m_light_state;
+	Material* m_last_material;
+	Stats m_stats;
 	bool m_is_wireframe;
 	bool m_is_rendering_in_shadowmap;
+	const Frustum* m_cluster_frustum;
 	bool m_is_ready;
 	Frustum m_camera_frustum;
 
@@ -1828,6 +2315,22 @@ struct PipelineImpl : public Pipeline
 	Array<RenderableMesh> m_tmp_meshes;
 	Array<const TerrainInfo*> m_tmp_terrains;
 	Array<GrassInfo> m_tmp_grasses;
+	Array<VisibleParticleEmitter> m_tmp_emitters;
+	Array<const bgfx::InstanceDataBuffer*> m_tmp_particle_buffers;
+	Array<ParticleEmitter::RenderInstance*> m_tmp_particle_batches;
+	Array<MTJD::Job*> m_particle_jobs;
+	MTJD::Group m_particles_sync_point;
+	Array<Command> m_commands;
+	Array<char> m_command_strings;
+	Array<FrameBuffer*> m_command_framebuffers;
+	Command m_immediate_command;
+	int m_immediate_strings_size;
+	int m_immediate_framebuffers_size;
+	bool m_is_recording;
+	bool m_is_command_list_dirty;
+	bool m_is_command_list_dynamic;
+	int m_recorded_camera_slots_change_count;
+	static PipelineImpl* s_recording_pipeline;
 
 	bgfx::UniformHandle m_specular_shininess_uniform;
 	bgfx::UniformHandle m_bone_matrices_uniform;
@@ -1854,6 +2357,9 @@ struct PipelineImpl : public Pipeline
 };
 
 
+PipelineImpl* PipelineImpl::s_recording_pipeline = nullptr;
+
+
 Pipeline* Pipeline::create(Renderer& renderer, const Path& path, IAllocator& allocator)
 {
 	return LUMIX_NEW(allocator, PipelineImpl)(renderer, path, allocator);
@@ -1872,55 +2378,77 @@ namespace LuaAPI
 
 void beginNewView(PipelineImpl* pipeline, const char* debug_name)
 {
-	pipeline->beginNewView(pipeline->m_current_framebuffer, debug_name);
+	auto& cmd = pipeline->beginCommand(PipelineImpl::Command::BEGIN_NEW_VIEW);
+	cmd.string = pipeline->addCommandString(debug_name);
+	pipeline->endCommand();
 }
 
 
 void setPass(PipelineImpl* pipeline, const char* pass)
 {
-	pipeline->setPass(pass);
+	auto& cmd = pipeline->beginCommand(PipelineImpl::Command::SET_PASS);
+	cmd.index = pipeline->m_renderer.getPassIdx(pass);
+	cmd.string = pipeline->addCommandString(pass);
+	pipeline->endCommand();
 }
 
 
 void setFramebuffer(PipelineImpl* pipeline, const char* framebuffer_name)
 {
-	pipeline->setCurrentFramebuffer(framebuffer_name);
+	bool is_default = compareString(framebuffer_name, "default") == 0;
+	FrameBuffer* framebuffer = is_default ? nullptr : pipeline->getFramebuffer(framebuffer_name);
+	if (!is_default && !framebuffer)
+	{
+		g_log_warning.log("renderer") << "Framebuffer " << framebuffer_name << " not found";
+		return;
+	}
+
+	auto& cmd = pipeline->beginCommand(PipelineImpl::Command::SET_FRAMEBUFFER);
+	cmd.framebuffer = framebuffer;
+	cmd.index = is_default ? 1 : 0;
+	pipeline->endCommand();
 }
 
 
 void enableAlphaWrite(PipelineImpl* pipeline)
 {
-	pipeline->enableAlphaWrite();
+	pipeline->beginCommand(PipelineImpl::Command::ENABLE_ALPHA_WRITE);
+	pipeline->endCommand();
 }
 
 
 void disableAlphaWrite(PipelineImpl* pipeline)
 {
-	pipeline->disableAlphaWrite();
+	pipeline->beginCommand(PipelineImpl::Command::DISABLE_ALPHA_WRITE);
+	pipeline->endCommand();
 }
 
 
 void enableDepthWrite(PipelineImpl* pipeline)
 {
-	pipeline->enableDepthWrite();
+	pipeline->beginCommand(PipelineImpl::Command::ENABLE_DEPTH_WRITE);
+	pipeline->endCommand();
 }
 
 
 void disableDepthWrite(PipelineImpl* pipeline)
 {
-	pipeline->disableDepthWrite();
+	pipeline->beginCommand(PipelineImpl::Command::DISABLE_DEPTH_WRITE);
+	pipeline->endCommand();
 }
 
 
 void enableRGBWrite(PipelineImpl* pipeline)
 {
-	pipeline->enableRGBWrite();
+	pipeline->beginCommand(PipelineImpl::Command::ENABLE_RGB_WRITE);
+	pipeline->endCommand();
 }
 
 
 void disableRGBWrite(PipelineImpl* pipeline)
 {
-	pipeline->disableRGBWrite();
+	pipeline->beginCommand(PipelineImpl::Command::DISABLE_RGB_WRITE);
+	pipeline->endCommand();
 }
 
 
@@ -1931,13 +2459,16 @@ void enableBlending(PipelineImpl* pipeline, const char* mode)
 	else if (compareString(mode, "add") == 0) mode_value = BGFX_STATE_BLEND_ADD;
 	else if (compareString(mode, "multiply") == 0) mode_value = BGFX_STATE_BLEND_MULTIPLY;
 
-	pipeline->enableBlending(mode_value);
+	auto& cmd = pipeline->beginCommand(PipelineImpl::Command::ENABLE_BLENDING);
+	cmd.value = mode_value;
+	pipeline->endCommand();
 }
 
 
 void disableBlending(PipelineImpl* pipeline)
 {
-	pipeline->disableBlending();
+	pipeline->beginCommand(PipelineImpl::Command::DISABLE_BLENDING);
+	pipeline->endCommand();
 }
 
 
@@ -1949,7 +2480,9 @@ void logError(const char* message)
 
 void applyCamera(PipelineImpl* pipeline, const char* slot)
 {
-	pipeline->applyCamera(slot);
+	auto& cmd = pipeline->beginCommand(PipelineImpl::Command::APPLY_CAMERA);
+	cmd.index = pipeline->m_scene->getCameraInSlot(slot);
+	pipeline->endCommand();
 }
 
 
@@ -1964,8 +2497,10 @@ void clear(PipelineImpl* pipeline, const char* buffers, int color)
 	{
 		flags = BGFX_CLEAR_DEPTH;
 	}
-	bgfx::setViewClear(pipeline->m_view_idx, flags, color, 1.0f, 0);
-	bgfx::touch(pipeline->m_view_idx);
+	auto& cmd = pipeline->beginCommand(PipelineImpl::Command::CLEAR);
+	cmd.value = flags;
+	cmd.index = color;
+	pipeline->endCommand();
 }
 
 
@@ -1973,20 +2508,19 @@ void renderModels(PipelineImpl* pipeline,
 				  int64 layer_mask,
 				  bool is_point_light_render)
 {
-	if (is_point_light_render)
-	{
-		pipeline->renderPointLightInfluencedGeometry(pipeline->m_camera_frustum, layer_mask);
-	}
-	else
-	{
-		pipeline->renderAll(pipeline->m_camera_frustum, layer_mask, true);
-	}
+	auto type = PipelineImpl::Command::RENDER_MODELS;
+	if (is_point_light_render) type = PipelineImpl::Command::RENDER_POINT_LIGHT_INFLUENCED_GEOMETRY;
+	auto& cmd = pipeline->beginCommand(type);
+	cmd.value = layer_mask;
+	pipeline->endCommand();
 }
 
 
 void executeCustomCommand(PipelineImpl* pipeline, const char* command)
 {
-	pipeline->executeCustomCommand(crc32(command));
+	auto& cmd = pipeline->beginCommand(PipelineImpl::Command::EXECUTE_CUSTOM_COMMAND);
+	cmd.index = pipeline->getCustomCommandHandlerIndex(crc32(command));
+	pipeline->endCommand();
 }
 
 
@@ -2004,14 +2538,16 @@ bool cameraExists(PipelineImpl* pipeline, const char* slot_name)
 
 float getFPS(PipelineImpl* pipeline)
 {
+	// the script depends on per-frame data, it has to be recorded every frame
+	if (pipeline->m_is_recording) pipeline->m_is_command_list_dynamic = true;
 	return pipeline->m_renderer.getEngine().getFPS();
 }
 
 
 void renderDebugShapes(PipelineImpl* pipeline)
 {
-	pipeline->renderDebugLines();
-	pipeline->renderDebugPoints();
+	pipeline->beginCommand(PipelineImpl::Command::RENDER_DEBUG_SHAPES);
+	pipeline->endCommand();
 }
 
 
@@ -2024,23 +2560,26 @@ int renderLocalLightsShadowmaps(lua_State* L)
 		return 0;
 	}
 
-	FrameBuffer* fbs[16];
 	auto* pipeline = (PipelineImpl*)lua_touserdata(L, 1);
-	int len = Math::minValue((int)lua_rawlen(L, 3), lengthOf(fbs));
-	for (int i = 0; i < len; ++i)
-	{
+	RenderScene* scene = pipeline->m_scene;
+	auto& cmd = pipeline->beginCommand(PipelineImpl::Command::RENDER_LOCAL_LIGHTS_SHADOWMAPS);
+	cmd.value = (int64)lua_tonumber(L, 2);
+	cmd.index = scene->getCameraInSlot(lua_tostring(L, 4));
+	cmd.framebuffers = pipeline->m_command_framebuffers.size();
+	cmd.count = Math::minValue((int)lua_rawlen(L, 3), 16);
+	for (int i = 0; i < cmd.count; ++i)
+	{
+		FrameBuffer* fb = nullptr;
 		if (lua_rawgeti(L, 3, 1 + i) == LUA_TSTRING)
 		{
 			const char* fb_name = lua_tostring(L, -1);
-			fbs[i] = pipeline->getFramebuffer(fb_name);
+			fb = pipeline->getFramebuffer(fb_name);
 		}
+		pipeline->m_command_framebuffers.push(fb);
 		lua_pop(L, 1);
 	}
-
-	RenderScene* scene = pipeline->m_scene;
-	int64 layer_mask = (int64)lua_tonumber(L, 2);
-	ComponentIndex camera = scene->getCameraInSlot(lua_tostring(L, 4));
-	pipeline->renderLocalLightShadowmaps(camera, fbs, len, layer_mask);
+	if (cmd.count == 0) cmd.framebuffers = -1;
+	pipeline->endCommand();
 
 	return 0;
 }
@@ -2048,7 +2587,10 @@ int renderLocalLightsShadowmaps(lua_State* L)
 
 void renderShadowmap(PipelineImpl* pipeline, int64 layer_mask, const char* slot)
 {
-	pipeline->renderShadowmap(pipeline->m_scene->getCameraInSlot(slot), layer_mask);
+	auto& cmd = pipeline->beginCommand(PipelineImpl::Command::RENDER_SHADOWMAP);
+	cmd.index = pipeline->m_scene->getCameraInSlot(slot);
+	cmd.value = layer_mask;
+	pipeline->endCommand();
 }
 
 
@@ -2072,7 +2614,8 @@ int loadMaterial(PipelineImpl* pipeline, const char* path)
 
 void renderParticles(PipelineImpl* pipeline)
 {
-	pipeline->renderParticles();
+	pipeline->beginCommand(PipelineImpl::Command::RENDER_PARTICLES);
+	pipeline->endCommand();
 }
 
 
@@ -2081,7 +2624,14 @@ void bindFramebufferTexture(PipelineImpl* pipeline,
 	int renderbuffer_index,
 	int uniform_idx)
 {
-	pipeline->bindFramebufferTexture(framebuffer_name, renderbuffer_index, uniform_idx);
+	FrameBuffer* fb = pipeline->getFramebuffer(framebuffer_name);
+	if (!fb) return;
+
+	auto& cmd = pipeline->beginCommand(PipelineImpl::Command::BIND_FRAMEBUFFER_TEXTURE);
+	cmd.framebuffer = fb;
+	cmd.index = renderbuffer_index;
+	cmd.count = uniform_idx;
+	pipeline->endCommand();
 }
 
 
@@ -2092,13 +2642,38 @@ void drawQuad(PipelineImpl* pipeline,
 	float h,
 	int material_index)
 {
-	pipeline->drawQuad(x, y, w, h, material_index);
+	auto& cmd = pipeline->beginCommand(PipelineImpl::Command::DRAW_QUAD);
+	cmd.rect[0] = x;
+	cmd.rect[1] = y;
+	cmd.rect[2] = w;
+	cmd.rect[3] = h;
+	cmd.index = material_index;
+	pipeline->endCommand();
 }
 
 
 void print(int x, int y, const char* text)
 {
-	bgfx::dbgTextPrintf(x, y, 0x4f, text);
+	// print does not get the pipeline, record it into the one currently recording
+	PipelineImpl* pipeline = PipelineImpl::s_recording_pipeline;
+	if (!pipeline)
+	{
+		bgfx::dbgTextPrintf(x, y, 0x4f, text);
+		return;
+	}
+	auto& cmd = pipeline->beginCommand(PipelineImpl::Command::PRINT);
+	cmd.rect[0] = (float)x;
+	cmd.rect[1] = (float)y;
+	cmd.string = pipeline->addCommandString(text);
+	pipeline->endCommand();
+}
+
+
+void callLuaFunction(PipelineImpl* pipeline, const char* function_name)
+{
+	auto& cmd = pipeline->beginCommand(PipelineImpl::Command::CALL_LUA_FUNCTION);
+	cmd.string = pipeline->addCommandString(function_name);
+	pipeline->endCommand();
 }
 
 
@@ -2138,6 +2713,7 @@ void PipelineImpl::registerCFunctions()
 	REGISTER_FUNCTION(hasScene);
 	REGISTER_FUNCTION(bindFramebufferTexture);
 	REGISTER_FUNCTION(renderParticles);
+	REGISTER_FUNCTION(callLuaFunction);
 
 	#undef REGISTER_FUNCTION
 	
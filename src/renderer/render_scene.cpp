@@ -24,14 +24,17 @@
 #include "renderer/culling_system.h"
 #include "renderer/material.h"
 #include "renderer/model.h"
+#include "renderer/model_generator.h"
 #include "renderer/particle_system.h"
 #include "renderer/pose.h"
 #include "renderer/renderer.h"
 #include "renderer/shader.h"
 #include "renderer/terrain.h"
+#include "renderer/terrain_tiles.h"
 #include "renderer/texture.h"
 
 #include "universe/universe.h"
+#include <cfloat>
 #include <cmath>
 
 
@@ -57,6 +60,14 @@ static const uint32 PARTICLE_EMITTER_SIZE_HASH = crc32("particle_emitter_size");
 static const uint32 GLOBAL_LIGHT_HASH = crc32("global_light");
 static const uint32 CAMERA_HASH = crc32("camera");
 static const uint32 TERRAIN_HASH = crc32("terrain");
+static const float PARTICLE_SLEEP_DELAY = 2.0f;
+static const float PARTICLE_LOD_DISTANCE = 30.0f;
+static const float PARTICLE_LOD_INTERVAL = 1 / 30.0f;
+static const float PARTICLE_MAX_TIME_STEP = 0.25f;
+static const float STATIC_BATCH_CELL_SIZE = 64.0f;
+static const int VISIBLE_LOAD_PRIORITY = 1 << 20;
+// bounding spheres are not known before the models are loaded
+static const float LOAD_PRIORITY_RADIUS = 10.0f;
 
 
 enum class RenderSceneVersion : int32
@@ -66,6 +77,8 @@ enum class RenderSceneVersion : int32
 	PARTICLE_EMITTERS_SPAWN_COUNT,
 	PARTICLES_FORCE_MODULE,
 	PARTICLES_SAVE_SIZE_ALPHA,
+	TERRAIN_TILES,
+	STATIC_RENDERABLES,
 
 	LATEST,
 	INVALID = -1,
@@ -119,6 +132,146 @@ struct Camera
 };
 
 
+struct StaticBatchEntry
+{
+	int32 cell[3];
+	Material* material;
+	uint32 vertex_decl_hash;
+	int64 layer_mask;
+	// squared camera distances of the mesh's LOD, as in Model::getLODMeshIndices
+	float lod_from;
+	float lod_to;
+	ComponentIndex renderable;
+	int32 mesh;
+};
+
+
+struct StaticBatchLOD
+{
+	float from;
+	float to;
+};
+
+
+struct StaticBatchSource
+{
+	ComponentIndex renderable;
+	Sphere sphere;
+	int64 layer_mask;
+};
+
+
+struct StaticBatchCell
+{
+	explicit StaticBatchCell(IAllocator& allocator)
+		: batches(allocator)
+		, sources(allocator)
+	{
+	}
+
+	Array<int> batches;
+	Array<StaticBatchSource> sources;
+};
+
+
+struct StaticBatchGeometry
+{
+	explicit StaticBatchGeometry(IAllocator& allocator)
+		: vertices(allocator)
+		, indices(allocator)
+	{
+	}
+
+	Model* model;
+	bool is_valid;
+	Array<uint8> vertices;
+	Array<uint8> indices;
+};
+
+
+static int compareStaticBatchEntries(const void* a, const void* b)
+{
+	auto* lhs = static_cast<const StaticBatchEntry*>(a);
+	auto* rhs = static_cast<const StaticBatchEntry*>(b);
+	for (int i = 0; i < lengthOf(lhs->cell); ++i)
+	{
+		if (lhs->cell[i] != rhs->cell[i]) return lhs->cell[i] < rhs->cell[i] ? -1 : 1;
+	}
+	if (lhs->material != rhs->material) return lhs->material < rhs->material ? -1 : 1;
+	if (lhs->vertex_decl_hash != rhs->vertex_decl_hash)
+	{
+		return lhs->vertex_decl_hash < rhs->vertex_decl_hash ? -1 : 1;
+	}
+	if (lhs->layer_mask != rhs->layer_mask) return lhs->layer_mask < rhs->layer_mask ? -1 : 1;
+	if (lhs->lod_from != rhs->lod_from) return lhs->lod_from < rhs->lod_from ? -1 : 1;
+	if (lhs->lod_to != rhs->lod_to) return lhs->lod_to < rhs->lod_to ? -1 : 1;
+	return lhs->renderable - rhs->renderable;
+}
+
+
+static bool isSameStaticBatchCell(const StaticBatchEntry& a, const StaticBatchEntry& b)
+{
+	return a.cell[0] == b.cell[0] && a.cell[1] == b.cell[1] && a.cell[2] == b.cell[2];
+}
+
+
+struct ModelLoadPriority
+{
+	Model* model;
+	int priority;
+};
+
+
+static int compareModelLoadPriorities(const void* a, const void* b)
+{
+	auto* lhs = static_cast<const ModelLoadPriority*>(a);
+	auto* rhs = static_cast<const ModelLoadPriority*>(b);
+	if (lhs->model != rhs->model) return lhs->model < rhs->model ? -1 : 1;
+	return lhs->priority < rhs->priority ? 1 : (lhs->priority > rhs->priority ? -1 : 0);
+}
+
+
+static bool isSameStaticBatch(const StaticBatchEntry& a, const StaticBatchEntry& b)
+{
+	return isSameStaticBatchCell(a, b) && a.material == b.material &&
+		   a.vertex_decl_hash == b.vertex_decl_hash && a.layer_mask == b.layer_mask &&
+		   a.lod_from == b.lod_from && a.lod_to == b.lod_to;
+}
+
+
+static void transformPackedNormal(uint8* packed, const Matrix& mtx)
+{
+	Vec3 normal((packed[0] - 128) / 127.0f, (packed[1] - 128) / 127.0f, (packed[2] - 128) / 127.0f);
+	normal = static_cast<Vec3>(mtx * Vec4(normal.x, normal.y, normal.z, 0));
+	normal.normalize();
+	packed[0] = uint8(normal.x * 127.0f + 128.0f);
+	packed[1] = uint8(normal.y * 127.0f + 128.0f);
+	packed[2] = uint8(normal.z * 127.0f + 128.0f);
+}
+
+
+static void transformVertices(uint8* vertices,
+	int count,
+	const bgfx::VertexDecl& decl,
+	const Matrix& mtx)
+{
+	uint16 stride = decl.getStride();
+	uint16 position_offset = decl.getOffset(bgfx::Attrib::Position);
+	bool has_normal = decl.has(bgfx::Attrib::Normal);
+	bool has_tangent = decl.has(bgfx::Attrib::Tangent);
+	uint16 normal_offset = decl.getOffset(bgfx::Attrib::Normal);
+	uint16 tangent_offset = decl.getOffset(bgfx::Attrib::Tangent);
+	for (int i = 0; i < count; ++i)
+	{
+		uint8* vertex = vertices + i * stride;
+		Vec3& position = *(Vec3*)(vertex + position_offset);
+		position = mtx.multiplyPosition(position);
+		if (has_normal) transformPackedNormal(vertex + normal_offset, mtx);
+		if (has_tangent) transformPackedNormal(vertex + tangent_offset, mtx);
+	}
+}
+
+
 class RenderSceneImpl : public RenderScene
 {
 private:
@@ -168,8 +321,10 @@ public:
 		, m_renderer(renderer)
 		, m_allocator(allocator)
 		, m_model_loaded_callbacks(m_allocator)
+		, m_model_load_priorities(m_allocator)
 		, m_renderables(m_allocator)
 		, m_cameras(m_allocator)
+		, m_camera_slots_change_count(0)
 		, m_terrains(m_allocator)
 		, m_point_lights(m_allocator)
 		, m_light_influenced_geometry(m_allocator)
@@ -188,11 +343,20 @@ public:
 		, m_is_grass_enabled(true)
 		, m_is_game_running(false)
 		, m_particle_emitters(m_allocator)
+		, m_particle_time_steps(m_allocator)
+		, m_particle_frusta(m_allocator)
+		, m_model_generator(engine.getResourceManager(), m_allocator)
+		, m_static_batches(m_allocator)
+		, m_static_batch_lods(m_allocator)
+		, m_static_batch_cells(m_allocator)
+		, m_renderable_batch_cell(m_allocator)
 	{
 		m_universe.entityTransformed()
 			.bind<RenderSceneImpl, &RenderSceneImpl::onEntityMoved>(this);
 		m_culling_system =
 			CullingSystem::create(m_engine.getMTJDManager(), m_allocator);
+		m_static_batch_culling_system =
+			CullingSystem::create(m_engine.getMTJDManager(), m_allocator);
 		m_time = 0;
 		m_renderables.reserve(5000);
 	}
@@ -203,6 +367,8 @@ public:
 		m_universe.entityTransformed()
 			.unbind<RenderSceneImpl, &RenderSceneImpl::onEntityMoved>(this);
 
+		clearStaticBatches();
+
 		for (int i = 0; i < m_model_loaded_callbacks.size(); ++i)
 		{
 			LUMIX_DELETE(m_allocator, m_model_loaded_callbacks[i]);
@@ -229,6 +395,7 @@ public:
 		}
 
 		CullingSystem::destroy(*m_culling_system);
+		CullingSystem::destroy(*m_static_batch_culling_system);
 	}
 
 
@@ -383,12 +550,287 @@ public:
 	void startGame() override
 	{
 		m_is_game_running = true;
+		buildStaticBatches(STATIC_BATCH_CELL_SIZE);
 	}
 
 
 	void stopGame() override
 	{
 		m_is_game_running = false;
+		clearStaticBatches();
+	}
+
+
+	StaticBatchGeometry* getStaticBatchGeometry(Array<StaticBatchGeometry>& geometries, Model* model)
+	{
+		for (auto& geometry : geometries)
+		{
+			if (geometry.model == model) return geometry.is_valid ? &geometry : nullptr;
+		}
+		auto& geometry = geometries.emplace(m_allocator);
+		geometry.model = model;
+		geometry.is_valid = model->readGeometry(geometry.vertices, geometry.indices);
+		return geometry.is_valid ? &geometry : nullptr;
+	}
+
+
+	void buildStaticBatches(float cell_size) override
+	{
+		PROFILE_FUNCTION();
+		clearStaticBatches();
+
+		// static batch vertices are merged from copies reread from the model files
+		Array<StaticBatchGeometry> geometries(m_allocator);
+		Array<StaticBatchEntry> entries(m_allocator);
+		for (int i = 0, c = m_renderables.size(); i < c; ++i)
+		{
+			const Renderable& r = m_renderables[i];
+			if (r.entity == INVALID_ENTITY || !r.model || !r.model->isReady()) continue;
+			// anything else can be moved by scripts or physics, that would dissolve its cell
+			if (!r.is_static) continue;
+			if (r.pose) continue;
+			if (!m_culling_system->isAdded(i)) continue;
+			if (!getStaticBatchGeometry(geometries, r.model)) continue;
+
+			// each LOD is batched separately, the batch picks its LOD by its own distance
+			Vec3 pos = r.matrix.getTranslation();
+			const Array<Model::LOD>& lods = r.model->getLODs();
+			for (int lod_idx = 0; lod_idx < lods.size(); ++lod_idx)
+			{
+				const Model::LOD& lod = lods[lod_idx];
+				for (int j = lod.m_from_mesh; j <= lod.m_to_mesh; ++j)
+				{
+					const Mesh& mesh = r.model->getMesh(j);
+					auto& entry = entries.pushEmpty();
+					entry.cell[0] = (int32)floorf(pos.x / cell_size);
+					entry.cell[1] = (int32)floorf(pos.y / cell_size);
+					entry.cell[2] = (int32)floorf(pos.z / cell_size);
+					entry.material = mesh.getMaterial();
+					entry.vertex_decl_hash = mesh.getVertexDefinition().m_hash;
+					entry.layer_mask = m_culling_system->getLayerMask(i);
+					entry.lod_from = lod_idx > 0 ? lods[lod_idx - 1].m_distance : 0;
+					entry.lod_to = lod.m_distance;
+					entry.renderable = i;
+					entry.mesh = j;
+				}
+			}
+		}
+		if (entries.empty()) return;
+
+		qsort(&entries[0], entries.size(), sizeof(entries[0]), compareStaticBatchEntries);
+
+		m_renderable_batch_cell.resize(m_renderables.size());
+		for (int& cell : m_renderable_batch_cell) cell = -1;
+
+		for (int cell_begin = 0; cell_begin < entries.size();)
+		{
+			int cell_end = cell_begin + 1;
+			while (cell_end < entries.size() &&
+				   isSameStaticBatchCell(entries[cell_begin], entries[cell_end]))
+			{
+				++cell_end;
+			}
+
+			int cell_idx = m_static_batch_cells.size();
+			StaticBatchCell& cell = m_static_batch_cells.emplace(m_allocator);
+			for (int i = cell_begin; i < cell_end;)
+			{
+				int end = i + 1;
+				while (end < cell_end && isSameStaticBatch(entries[i], entries[end])) ++end;
+				cell.batches.push(createStaticBatch(&entries[i], end - i, geometries));
+				i = end;
+			}
+
+			for (int i = cell_begin; i < cell_end; ++i)
+			{
+				ComponentIndex renderable = entries[i].renderable;
+				if (m_renderable_batch_cell[renderable] >= 0) continue;
+
+				m_renderable_batch_cell[renderable] = cell_idx;
+				StaticBatchSource source = {renderable,
+					m_culling_system->getSphere(renderable),
+					m_culling_system->getLayerMask(renderable)};
+				cell.sources.push(source);
+				m_culling_system->removeStatic(renderable);
+			}
+			cell_begin = cell_end;
+		}
+	}
+
+
+	int createStaticBatch(const StaticBatchEntry* entries,
+		int count,
+		Array<StaticBatchGeometry>& geometries)
+	{
+		Vec3 min = m_renderables[entries[0].renderable].matrix.getTranslation();
+		Vec3 max = min;
+		for (int i = 1; i < count; ++i)
+		{
+			Vec3 pos = m_renderables[entries[i].renderable].matrix.getTranslation();
+			min.set(Math::minValue(min.x, pos.x), Math::minValue(min.y, pos.y), Math::minValue(min.z, pos.z));
+			max.set(Math::maxValue(max.x, pos.x), Math::maxValue(max.y, pos.y), Math::maxValue(max.z, pos.z));
+		}
+		// vertices are relative to the center so the batch's bounding sphere stays tight
+		Vec3 center = (min + max) * 0.5f;
+
+		const Renderable& first = m_renderables[entries[0].renderable];
+		const Mesh& first_mesh = first.model->getMesh(entries[0].mesh);
+		bgfx::VertexDecl decl = first_mesh.getVertexDefinition();
+		int stride = decl.getStride();
+
+		Array<uint8> vertices(m_allocator);
+		Array<int> indices(m_allocator);
+		for (int i = 0; i < count; ++i)
+		{
+			const Renderable& r = m_renderables[entries[i].renderable];
+			const Mesh& mesh = r.model->getMesh(entries[i].mesh);
+			StaticBatchGeometry* geometry = getStaticBatchGeometry(geometries, r.model);
+
+			int base_vertex = vertices.size() / stride;
+			int vertex_count = mesh.getAttributeArraySize() / stride;
+			vertices.resize(vertices.size() + mesh.getAttributeArraySize());
+			uint8* dst = &vertices[base_vertex * stride];
+			copyMemory(dst,
+				&geometry->vertices[mesh.getAttributeArrayOffset()],
+				mesh.getAttributeArraySize());
+			Matrix mtx = r.matrix;
+			mtx.setTranslation(mtx.getTranslation() - center);
+			transformVertices(dst, vertex_count, decl, mtx);
+
+			int index_size = r.model->getIndexSize();
+			const uint8* src_indices = &geometry->indices[0];
+			for (int j = 0; j < mesh.getIndexCount(); ++j)
+			{
+				int src_idx = mesh.getIndicesOffset() + j;
+				int index = index_size == sizeof(uint16) ? ((const uint16*)src_indices)[src_idx]
+														 : ((const int32*)src_indices)[src_idx];
+				indices.push(base_vertex + index);
+			}
+		}
+
+		Model* model = m_model_generator.createModel(first_mesh.getMaterial(),
+			decl,
+			&indices[0],
+			indices.size() * sizeof(indices[0]),
+			&vertices[0],
+			vertices.size());
+
+		int batch_idx = m_static_batches.size();
+		Renderable& batch = m_static_batches.pushEmpty();
+		batch.model = model;
+		batch.pose = nullptr;
+		batch.entity = INVALID_ENTITY;
+		batch.layer_mask = entries[0].layer_mask;
+		batch.is_static = true;
+		StaticBatchLOD& lod = m_static_batch_lods.emplace();
+		lod.from = entries[0].lod_from;
+		lod.to = entries[0].lod_to;
+		batch.matrix = Matrix::IDENTITY;
+		batch.matrix.setTranslation(center);
+		m_static_batch_culling_system->addStatic(batch_idx, Sphere(center, model->getBoundingRadius()));
+		m_static_batch_culling_system->setLayerMask(batch_idx, batch.layer_mask);
+		return batch_idx;
+	}
+
+
+	void dissolveStaticBatchCell(int cell_idx)
+	{
+		StaticBatchCell& cell = m_static_batch_cells[cell_idx];
+		for (int batch_idx : cell.batches)
+		{
+			Renderable& batch = m_static_batches[batch_idx];
+			m_static_batch_culling_system->removeStatic(batch_idx);
+			m_model_generator.destroyModel(batch.model);
+			batch.model = nullptr;
+		}
+		for (const StaticBatchSource& source : cell.sources)
+		{
+			m_culling_system->addStatic(source.renderable, source.sphere);
+			m_culling_system->setLayerMask(source.renderable, source.layer_mask);
+			m_renderable_batch_cell[source.renderable] = -1;
+		}
+		cell.batches.clear();
+		cell.sources.clear();
+	}
+
+
+	void unbatchRenderable(ComponentIndex cmp)
+	{
+		if (cmp >= m_renderable_batch_cell.size() || m_renderable_batch_cell[cmp] < 0) return;
+
+		// the whole cell goes back to per object rendering, all meshes of the renderable are in it
+		dissolveStaticBatchCell(m_renderable_batch_cell[cmp]);
+	}
+
+
+	bool isRenderableBatched(ComponentIndex cmp) const
+	{
+		return cmp < m_renderable_batch_cell.size() && m_renderable_batch_cell[cmp] >= 0;
+	}
+
+
+	// culling data of the renderable from the time it was batched
+	const StaticBatchSource* getStaticBatchSource(ComponentIndex cmp) const
+	{
+		if (!isRenderableBatched(cmp)) return nullptr;
+		const StaticBatchCell& cell = m_static_batch_cells[m_renderable_batch_cell[cmp]];
+		for (const StaticBatchSource& source : cell.sources)
+		{
+			if (source.renderable == cmp) return &source;
+		}
+		return nullptr;
+	}
+
+
+	void clearStaticBatches() override
+	{
+		for (int i = 0; i < m_static_batch_cells.size(); ++i)
+		{
+			dissolveStaticBatchCell(i);
+		}
+		m_static_batch_cells.clear();
+		m_static_batches.clear();
+		m_static_batch_lods.clear();
+		m_renderable_batch_cell.clear();
+		m_static_batch_culling_system->clear();
+	}
+
+
+	Renderable* getStaticBatches() override
+	{
+		return m_static_batches.empty() ? nullptr : &m_static_batches[0];
+	}
+
+
+	void getStaticBatchInfos(const Frustum& frustum,
+		Array<RenderableMesh>& meshes,
+		int64 layer_mask) override
+	{
+		PROFILE_FUNCTION();
+		if (m_static_batches.empty()) return;
+
+		m_static_batch_culling_system->cullToFrustum(frustum, layer_mask);
+		const CullingSystem::Results& results = m_static_batch_culling_system->getResult();
+		Vec3 frustum_position = frustum.getPosition();
+		for (auto& subresults : results)
+		{
+			for (int batch_idx : subresults)
+			{
+				const Renderable& batch = m_static_batches[batch_idx];
+				const StaticBatchLOD& lod = m_static_batch_lods[batch_idx];
+				float squared_distance =
+					(batch.matrix.getTranslation() - frustum_position).squaredLength();
+				if (squared_distance < lod.from || squared_distance >= lod.to) continue;
+
+				Model* model = batch.model;
+				for (int i = 0, c = model->getMeshCount(); i < c; ++i)
+				{
+					auto& info = meshes.pushEmpty();
+					info.renderable = batch_idx;
+					info.mesh = &model->getMesh(i);
+				}
+			}
+		}
 	}
 
 
@@ -424,15 +866,193 @@ public:
 			}
 		}
 
-		if (m_is_game_running)
+		if (m_is_game_running) updateParticleEmitters(dt);
+		updateLoadPriorities();
+
+		// tiles are used by all cameras during the last frame's rendering
+		for (auto* terrain : m_terrains)
 		{
-			for (auto* emitter : m_particle_emitters)
+			if (terrain && terrain->getTiles()) terrain->getTiles()->nextFrame();
+		}
+	}
+
+
+	// visible renderables are loaded first, closer ones before farther ones
+	int getLoadPriority(ComponentIndex camera, const Frustum& frustum, Entity entity)
+	{
+		Vec3 camera_pos = m_universe.getPosition(m_cameras[camera].m_entity);
+		Vec3 pos = m_universe.getPosition(entity);
+		int priority = -(int)(pos - camera_pos).length();
+		if (frustum.isSphereInside(pos, LOAD_PRIORITY_RADIUS)) priority += VISIBLE_LOAD_PRIORITY;
+		return priority;
+	}
+
+
+	// models still being loaded get the priority of their most important renderable,
+	// so requests follow the camera when it turns around
+	void updateLoadPriorities()
+	{
+		PROFILE_FUNCTION();
+		bool is_loading = false;
+		for (auto* callback : m_model_loaded_callbacks)
+		{
+			is_loading = is_loading || callback->m_model->isEmpty();
+		}
+		if (!is_loading) return;
+
+		ComponentIndex camera = getCameraInSlot("main");
+		if (camera == INVALID_COMPONENT) return;
+
+		Frustum frustum = getCameraFrustum(camera);
+		m_model_load_priorities.clear();
+		for (const Renderable& r : m_renderables)
+		{
+			if (r.entity == INVALID_ENTITY || !r.model || !r.model->isEmpty()) continue;
+
+			auto& load_priority = m_model_load_priorities.pushEmpty();
+			load_priority.model = r.model;
+			load_priority.priority = getLoadPriority(camera, frustum, r.entity);
+		}
+		if (m_model_load_priorities.empty()) return;
+
+		qsort(&m_model_load_priorities[0],
+			m_model_load_priorities.size(),
+			sizeof(m_model_load_priorities[0]),
+			compareModelLoadPriorities);
+		for (int i = 0; i < m_model_load_priorities.size(); ++i)
+		{
+			const ModelLoadPriority& load_priority = m_model_load_priorities[i];
+			if (i > 0 && m_model_load_priorities[i - 1].model == load_priority.model) continue;
+			if (load_priority.model->getLoadPriority() != load_priority.priority)
 			{
-				if (!emitter) continue;
+				load_priority.model->setLoadPriority(load_priority.priority);
+			}
+		}
+	}
+
 
-				emitter->update(dt);
+	void gatherParticleFrusta()
+	{
+		m_particle_frusta.clear();
+		for (int i = 0, c = m_cameras.size(); i < c; ++i)
+		{
+			const Camera& camera = m_cameras[i];
+			if (camera.m_is_free || !camera.m_is_active) continue;
+			if (camera.m_width <= 0 || camera.m_height <= 0) continue;
+
+			m_particle_frusta.push(getCameraFrustum(i));
+		}
+	}
+
+
+	// returns time the emitter should be simulated by in this frame, 0 if it should be skipped
+	float getParticleEmitterTimeStep(ParticleEmitter& emitter, float dt)
+	{
+		emitter.setPendingTime(emitter.getPendingTime() + dt);
+		if (m_particle_frusta.empty())
+		{
+			float time_step = emitter.getPendingTime();
+			emitter.setPendingTime(0);
+			return time_step;
+		}
+
+		Sphere sphere = emitter.getBoundingSphere();
+		bool is_visible = false;
+		float min_squared_distance = FLT_MAX;
+		for (const auto& frustum : m_particle_frusta)
+		{
+			is_visible = is_visible || frustum.isSphereInside(sphere.m_position, sphere.m_radius);
+			float squared_distance = (sphere.m_position - frustum.getPosition()).squaredLength();
+			min_squared_distance = Math::minValue(min_squared_distance, squared_distance);
+		}
+
+		if (is_visible)
+		{
+			emitter.setInvisibleTime(0);
+		}
+		else
+		{
+			emitter.setInvisibleTime(emitter.getInvisibleTime() + dt);
+			if (emitter.getInvisibleTime() > PARTICLE_SLEEP_DELAY)
+			{
+				// no particle outlives the max life, so there is no point in catching up more
+				float max_life = emitter.m_initial_life.to;
+				emitter.setPendingTime(Math::minValue(emitter.getPendingTime(), max_life));
+				return 0;
 			}
 		}
+
+		float distance = Math::maxValue(0.0f, sqrtf(min_squared_distance) - sphere.m_radius);
+		float interval = Math::minValue(
+			int(distance / PARTICLE_LOD_DISTANCE) * PARTICLE_LOD_INTERVAL, PARTICLE_MAX_TIME_STEP);
+		if (emitter.getPendingTime() < interval) return 0;
+
+		float time_step = emitter.getPendingTime();
+		emitter.setPendingTime(0);
+		return time_step;
+	}
+
+
+	void updateParticleEmitters(float dt)
+	{
+		PROFILE_FUNCTION();
+		static const int PARTICLES_PER_JOB = 4096;
+
+		gatherParticleFrusta();
+		m_particle_time_steps.resize(m_particle_emitters.size());
+
+		// spawning uses the shared random generator, so it stays on this thread
+		for (int i = 0, c = m_particle_emitters.size(); i < c; ++i)
+		{
+			ParticleEmitter* emitter = m_particle_emitters[i];
+			m_particle_time_steps[i] = 0;
+			if (!emitter) continue;
+
+			float time_step = getParticleEmitterTimeStep(*emitter, dt);
+			if (time_step <= 0) continue;
+
+			// emitter woke up or was throttled for long, catch up in coarse steps
+			while (time_step > PARTICLE_MAX_TIME_STEP)
+			{
+				emitter->spawnParticles(PARTICLE_MAX_TIME_STEP);
+				emitter->simulate(PARTICLE_MAX_TIME_STEP);
+				time_step -= PARTICLE_MAX_TIME_STEP;
+			}
+			emitter->spawnParticles(time_step);
+			m_particle_time_steps[i] = time_step;
+		}
+
+		m_jobs.clear();
+		int from = 0;
+		int particles_count = 0;
+		for (int i = 0, c = m_particle_emitters.size(); i < c; ++i)
+		{
+			if (m_particle_time_steps[i] > 0)
+			{
+				particles_count += m_particle_emitters[i]->getParticlesCount();
+			}
+			if (particles_count < PARTICLES_PER_JOB && i < c - 1) continue;
+
+			if (particles_count > 0)
+			{
+				MTJD::Job* job = MTJD::makeJob(m_engine.getMTJDManager(),
+					[this, from, i]()
+					{
+						PROFILE_BLOCK("Particle Job");
+						for (int j = from; j <= i; ++j)
+						{
+							float time_step = m_particle_time_steps[j];
+							if (time_step > 0) m_particle_emitters[j]->simulate(time_step);
+						}
+					},
+					m_allocator);
+				job->addDependency(&m_sync_point);
+				m_jobs.push(job);
+			}
+			from = i + 1;
+			particles_count = 0;
+		}
+		runJobs(m_jobs, m_sync_point);
 	}
 
 	void serializeCameras(OutputBlob& serializer)
@@ -478,6 +1098,7 @@ public:
 			if(m_renderables[i].entity != INVALID_ENTITY)
 			{
 				serializer.write(m_renderables[i].layer_mask);
+				serializer.write(m_renderables[i].is_static);
 				serializer.write(m_renderables[i].model ? m_renderables[i].model->getPath().getHash() : 0);
 			}
 		}
@@ -617,10 +1238,12 @@ public:
 				m_universe.addComponent(m_cameras[i].m_entity, CAMERA_HASH, this, i);
 			}
 		}
+		++m_camera_slots_change_count;
 	}
 
-	void deserializeRenderables(InputBlob& serializer)
+	void deserializeRenderables(InputBlob& serializer, RenderSceneVersion version)
 	{
+		clearStaticBatches();
 		int32 size = 0;
 		serializer.read(size);
 		for (int i = 0; i < m_renderables.size(); ++i)
@@ -641,10 +1264,12 @@ public:
 			ASSERT(r.entity == i || r.entity == INVALID_ENTITY);
 			r.model = nullptr;
 			r.pose = nullptr;
+			r.is_static = false;
 
 			if(r.entity != INVALID_ENTITY)
 			{
 				serializer.read(r.layer_mask);
+				if (version > RenderSceneVersion::STATIC_RENDERABLES) serializer.read(r.is_static);
 				r.matrix = m_universe.getMatrix(r.entity);
 
 				uint32 path;
@@ -722,7 +1347,7 @@ public:
 		serializer.read(m_active_global_light_uid);
 	}
 
-	void deserializeTerrains(InputBlob& serializer)
+	void deserializeTerrains(InputBlob& serializer, RenderSceneVersion version)
 	{
 		int32 size = 0;
 		serializer.read(size);
@@ -749,7 +1374,11 @@ public:
 						m_renderer, INVALID_ENTITY, *this, m_allocator);
 				}
 				Terrain* terrain = m_terrains[i];
-				terrain->deserialize(serializer, m_universe, *this, i);
+				terrain->deserialize(serializer,
+					m_universe,
+					*this,
+					i,
+					version > RenderSceneVersion::TERRAIN_TILES);
 			}
 			else
 			{
@@ -768,9 +1397,9 @@ public:
 	void deserialize(InputBlob& serializer, int version) override
 	{
 		deserializeCameras(serializer);
-		deserializeRenderables(serializer);
+		deserializeRenderables(serializer, (RenderSceneVersion)version);
 		deserializeLights(serializer, (RenderSceneVersion)version);
-		deserializeTerrains(serializer);
+		deserializeTerrains(serializer, (RenderSceneVersion)version);
 		if (version >= 0) deserializeParticleEmitters(serializer, version);
 	}
 
@@ -831,6 +1460,7 @@ public:
 	{
 		Entity entity = m_cameras[component].m_entity;
 		m_cameras[component].m_is_free = true;
+		++m_camera_slots_change_count;
 		m_universe.destroyComponent(entity, CAMERA_HASH, this, component);
 	}
 
@@ -1246,6 +1876,7 @@ public:
 		camera.m_near = 0.1f;
 		camera.m_far = 10000.0f;
 		camera.m_slot[0] = '\0';
+		++m_camera_slots_change_count;
 		m_universe.addComponent(entity, CAMERA_HASH, this, m_cameras.size() - 1);
 		return m_cameras.size() - 1;
 	}
@@ -1473,6 +2104,7 @@ public:
 		{
 			Renderable& r = m_renderables[cmp];
 			r.matrix = m_universe.getMatrix(entity);
+			unbatchRenderable(cmp);
 			m_culling_system->updateBoundingPosition(m_universe.getPosition(entity), cmp);
 
 			if(m_is_forward_rendered)
@@ -1538,6 +2170,18 @@ public:
 	}
 
 
+	void getTerrainHeightsAt(ComponentIndex cmp, const Vec2* xz, float* out, int count) override
+	{
+		m_terrains[cmp]->getHeights(xz, out, count);
+	}
+
+
+	void getTerrainNormalsAt(ComponentIndex cmp, const Vec2* xz, Vec3* out, int count) override
+	{
+		m_terrains[cmp]->getNormals(xz, out, count);
+	}
+
+
 	void getTerrainSize(ComponentIndex cmp, float* width, float* height) override
 	{
 		m_terrains[cmp]->getSize(width, height);
@@ -1552,6 +2196,24 @@ public:
 	}
 
 
+	void setTerrainTilesPath(ComponentIndex cmp, const Path& path) override
+	{
+		m_terrains[cmp]->setTilesPath(path);
+	}
+
+
+	Path getTerrainTilesPath(ComponentIndex cmp) override
+	{
+		return m_terrains[cmp]->getTilesPath();
+	}
+
+
+	TerrainTiles* getTerrainTiles(ComponentIndex cmp) override
+	{
+		return m_terrains[cmp]->getTiles();
+	}
+
+
 	Material* getTerrainMaterial(ComponentIndex cmp) override
 	{
 		return m_terrains[cmp]->getMaterial();
@@ -1608,6 +2270,7 @@ public:
 
 	void hideRenderable(ComponentIndex cmp) override
 	{
+		unbatchRenderable(cmp);
 		m_culling_system->removeStatic(cmp);
 	}
 
@@ -1620,16 +2283,31 @@ public:
 
 	void setRenderableLayer(ComponentIndex cmp, const int32& layer) override
 	{
+		unbatchRenderable(cmp);
 		m_culling_system->setLayerMask(cmp, (int64)1 << (int64)layer);
 	}
 
 
+	bool isRenderableStatic(ComponentIndex cmp) override { return m_renderables[cmp].is_static; }
+
+
+	void setRenderableStatic(ComponentIndex cmp, bool is_static) override
+	{
+		if (!is_static) unbatchRenderable(cmp);
+		m_renderables[cmp].is_static = is_static;
+	}
+
+
 	void setRenderablePath(ComponentIndex cmp, const Path& path) override
 	{
 		Renderable& r = m_renderables[cmp];
 
+		ComponentIndex camera = getCameraInSlot("main");
+		int priority = camera == INVALID_COMPONENT
+						   ? 0
+						   : getLoadPriority(camera, getCameraFrustum(camera), r.entity);
 		auto* manager = m_engine.getResourceManager().get(ResourceManager::MODEL);
-		Model* model = static_cast<Model*>(manager->load(path));
+		Model* model = static_cast<Model*>(manager->load(path, priority));
 		setModel(cmp, model);
 		r.matrix = m_universe.getMatrix(r.entity);
 	}
@@ -1980,8 +2658,24 @@ public:
 		{
 			ComponentIndex renderable_cmp = m_light_influenced_geometry[light_index][j];
 			Renderable& renderable = m_renderables[renderable_cmp];
-			bool is_layer = (layer_mask & m_culling_system->getLayerMask(renderable_cmp)) != 0;
-			const Sphere& sphere = m_culling_system->getSphere(renderable_cmp);
+			Sphere sphere(0, 0, 0, 0);
+			int64 renderable_layer_mask;
+			if (m_culling_system->isAdded(renderable_cmp))
+			{
+				sphere = m_culling_system->getSphere(renderable_cmp);
+				renderable_layer_mask = m_culling_system->getLayerMask(renderable_cmp);
+			}
+			else if (const StaticBatchSource* source = getStaticBatchSource(renderable_cmp))
+			{
+				// batches are lit only by the global light, point lights still draw the originals
+				sphere = source->sphere;
+				renderable_layer_mask = source->layer_mask;
+			}
+			else
+			{
+				continue;
+			}
+			bool is_layer = (layer_mask & renderable_layer_mask) != 0;
 			if (is_layer && frustum.isSphereInside(sphere.m_position, sphere.m_radius))
 			{
 				for (int k = 0, kc = renderable.model->getMeshCount(); k < kc; ++k)
@@ -2052,6 +2746,7 @@ public:
 	void setCameraSlot(ComponentIndex camera, const char* slot) override
 	{
 		copyString(m_cameras[camera].m_slot, Camera::MAX_SLOT_LENGTH, slot);
+		++m_camera_slots_change_count;
 	}
 
 	const char* getCameraSlot(ComponentIndex camera) override
@@ -2784,11 +3479,14 @@ public:
 		return INVALID_COMPONENT;
 	}
 
+	int getCameraSlotsChangeCount() const override { return m_camera_slots_change_count; }
+
 	float getTime() const override { return m_time; }
 
 
 	void modelUnloaded(Model*, ComponentIndex component)
 	{
+		unbatchRenderable(component);
 		m_culling_system->removeStatic(component);
 	}
 
@@ -2870,6 +3568,7 @@ public:
 	{
 		ASSERT(m_renderables[component].entity != INVALID_ENTITY);
 
+		unbatchRenderable(component);
 		Model* old_model = m_renderables[component].model;
 		bool no_change = model == old_model && old_model;
 		if (no_change)
@@ -3136,12 +3835,14 @@ public:
 			r.entity = INVALID_ENTITY;
 			r.model = nullptr;
 			r.pose = nullptr;
+			r.is_static = false;
 		}
 		auto& r = m_renderables[entity];
 		r.entity = entity;
 		r.model = nullptr;
 		r.layer_mask = 1;
 		r.pose = nullptr;
+		r.is_static = false;
 		r.matrix = m_universe.getMatrix(entity);
 		m_universe.addComponent(entity, RENDERABLE_HASH, this, entity);
 		m_renderable_created.invoke(m_renderables.size() - 1);
@@ -3178,6 +3879,7 @@ public:
 private:
 	IAllocator& m_allocator;
 	Array<ModelLoadedCallback*> m_model_loaded_callbacks;
+	Array<ModelLoadPriority> m_model_load_priorities;
 
 	Array<Renderable> m_renderables;
 
@@ -3189,6 +3891,7 @@ private:
 	Array<GlobalLight> m_global_lights;
 
 	Array<Camera> m_cameras;
+	int m_camera_slots_change_count;
 
 	Array<Terrain*> m_terrains;
 	Universe& m_universe;
@@ -3197,7 +3900,15 @@ private:
 	Array<DebugLine> m_debug_lines;
 	Array<DebugPoint> m_debug_points;
 	CullingSystem* m_culling_system;
+	CullingSystem* m_static_batch_culling_system;
+	ModelGenerator m_model_generator;
+	Array<Renderable> m_static_batches;
+	Array<StaticBatchLOD> m_static_batch_lods;
+	Array<StaticBatchCell> m_static_batch_cells;
+	Array<int> m_renderable_batch_cell;
 	Array<ParticleEmitter*> m_particle_emitters;
+	Array<float> m_particle_time_steps;
+	Array<Frustum> m_particle_frusta;
 	Array<Array<RenderableMesh>> m_temporary_infos;
 	MTJD::Group m_sync_point;
 	Array<MTJD::Job*> m_jobs;
@@ -23,6 +23,7 @@ class Pose;
 class Renderer;
 class Shader;
 class Terrain;
+class TerrainTiles;
 class Timer;
 class Universe;
 
@@ -46,6 +47,8 @@ struct Renderable
 	Matrix matrix;
 	Entity entity;
 	int64 layer_mask;
+	// only static renderables are merged into static batches
+	bool is_static;
 };
 
 
@@ -170,6 +173,8 @@ public:
 
 	virtual Entity getCameraEntity(ComponentIndex camera) const = 0;
 	virtual ComponentIndex getCameraInSlot(const char* slot) = 0;
+	// changes whenever getCameraInSlot could return a different result
+	virtual int getCameraSlotsChangeCount() const = 0;
 	virtual float getCameraFOV(ComponentIndex camera) = 0;
 	virtual void setCameraFOV(ComponentIndex camera, float fov) = 0;
 	virtual void setCameraFarPlane(ComponentIndex camera, float far) = 0;
@@ -239,6 +244,8 @@ public:
 	virtual void setRenderableLayer(ComponentIndex cmp,
 									const int32& layer) = 0;
 	virtual void setRenderablePath(ComponentIndex cmp, const Path& path) = 0;
+	virtual bool isRenderableStatic(ComponentIndex cmp) = 0;
+	virtual void setRenderableStatic(ComponentIndex cmp, bool is_static) = 0;
 	virtual void getRenderableInfos(const Frustum& frustum,
 		Array<RenderableMesh>& meshes,
 		int64 layer_mask) = 0;
@@ -250,6 +257,14 @@ public:
 	virtual ComponentIndex getNextRenderable(ComponentIndex cmp) = 0;
 	virtual Model* getRenderableModel(ComponentIndex cmp) = 0;
 
+	// merges renderables marked as static sharing a material in each cell into a single model
+	virtual void buildStaticBatches(float cell_size) = 0;
+	virtual void clearStaticBatches() = 0;
+	virtual Renderable* getStaticBatches() = 0;
+	virtual void getStaticBatchInfos(const Frustum& frustum,
+		Array<RenderableMesh>& meshes,
+		int64 layer_mask) = 0;
+
 	virtual void getGrassInfos(const Frustum& frustum,
 							   Array<GrassInfo>& infos,
 							   int64 layer_mask,
@@ -261,9 +276,14 @@ public:
 		LIFOAllocator& allocator) = 0;
 	virtual float getTerrainHeightAt(ComponentIndex cmp, float x, float z) = 0;
 	virtual Vec3 getTerrainNormalAt(ComponentIndex cmp, float x, float z) = 0;
+	virtual void getTerrainHeightsAt(ComponentIndex cmp, const Vec2* xz, float* out, int count) = 0;
+	virtual void getTerrainNormalsAt(ComponentIndex cmp, const Vec2* xz, Vec3* out, int count) = 0;
 	virtual void setTerrainMaterialPath(ComponentIndex cmp, const Path& path) = 0;
 	virtual Path getTerrainMaterialPath(ComponentIndex cmp) = 0;
 	virtual Material* getTerrainMaterial(ComponentIndex cmp) = 0;
+	virtual void setTerrainTilesPath(ComponentIndex cmp, const Path& path) = 0;
+	virtual Path getTerrainTilesPath(ComponentIndex cmp) = 0;
+	virtual TerrainTiles* getTerrainTiles(ComponentIndex cmp) = 0;
 	virtual void setTerrainXZScale(ComponentIndex cmp, float scale) = 0;
 	virtual float getTerrainXZScale(ComponentIndex cmp) = 0;
 	virtual void setTerrainYScale(ComponentIndex cmp, float scale) = 0;
@@ -1,6 +1,7 @@
 #include "renderer.h"
 
 #include "core/array.h"
+#include "core/command_line_parser.h"
 #include "core/crc32.h"
 #include "core/fs/file_system.h"
 #include "core/fs/os_file.h"
@@ -11,6 +12,7 @@
 #include "core/profiler.h"
 #include "core/resource_manager.h"
 #include "core/resource_manager_base.h"
+#include "core/system.h"
 #include "core/vec.h"
 #include "debug/debug.h"
 #include "editor/world_editor.h"
@@ -76,6 +78,20 @@ static const uint32 GLOBAL_LIGHT_HASH = crc32("global_light");
 static const uint32 POINT_LIGHT_HASH = crc32("point_light");
 static const uint32 RENDERABLE_HASH = crc32("renderable");
 static const uint32 CAMERA_HASH = crc32("camera");
+static const char* SHADER_PREWARM_LIST_PATH = "shaders/compiled/prewarm.lsp";
+
+
+static bool hasCommandLineFlag(const char* flag)
+{
+	char cmd_line[2048];
+	getCommandLine(cmd_line, lengthOf(cmd_line));
+	CommandLineParser parser(cmd_line);
+	while (parser.next())
+	{
+		if (parser.currentEquals(flag)) return true;
+	}
+	return false;
+}
 
 
 struct BGFXAllocator : public bx::AllocatorI
@@ -215,9 +231,58 @@ struct RendererImpl : public Renderer
 		}
 
 
-		uint32 cacheReadSize(uint64) override { return 0; }
-		bool cacheRead(uint64, void*, uint32) override { return false; }
-		void cacheWrite(uint64, const void*, uint32) override {}
+		// bgfx asks for program binaries by hash of the shader combination, they are kept in files
+		static void getCachePath(uint64 id, char* path, int max_size)
+		{
+			char id_str[30];
+			toCString(id, id_str, sizeof(id_str));
+			copyString(path, max_size, "shaders/compiled/program_");
+			catString(path, max_size, id_str);
+			catString(path, max_size, ".bin");
+		}
+
+
+		uint32 cacheReadSize(uint64 id) override
+		{
+			char path[MAX_PATH_LENGTH];
+			getCachePath(id, path, sizeof(path));
+			FS::OsFile file;
+			if (!file.open(path, FS::Mode::OPEN_AND_READ, m_renderer.m_allocator)) return 0;
+
+			uint32 size = (uint32)file.size();
+			file.close();
+			return size;
+		}
+
+
+		bool cacheRead(uint64 id, void* data, uint32 size) override
+		{
+			char path[MAX_PATH_LENGTH];
+			getCachePath(id, path, sizeof(path));
+			FS::OsFile file;
+			if (!file.open(path, FS::Mode::OPEN_AND_READ, m_renderer.m_allocator)) return false;
+
+			bool success = file.size() == size && file.read(data, size);
+			file.close();
+			return success;
+		}
+
+
+		void cacheWrite(uint64 id, const void* data, uint32 size) override
+		{
+			char path[MAX_PATH_LENGTH];
+			getCachePath(id, path, sizeof(path));
+			FS::OsFile file;
+			if (!file.open(path, FS::Mode::CREATE | FS::Mode::WRITE, m_renderer.m_allocator))
+			{
+				g_log_warning.log("renderer") << "Could not write shader cache " << path;
+				return;
+			}
+
+			file.write(data, size);
+			file.close();
+		}
+
 		void captureEnd() override { ASSERT(false); }
 		void captureFrame(const void*, uint32) override { ASSERT(false); }
 
@@ -228,7 +293,7 @@ struct RendererImpl : public Renderer
 	RendererImpl(Engine& engine)
 		: m_engine(engine)
 		, m_allocator(engine.getAllocator())
-		, m_texture_manager(m_allocator)
+		, m_texture_manager(engine.getMTJDManager(), m_allocator)
 		, m_model_manager(m_allocator, *this)
 		, m_material_manager(*this, m_allocator)
 		, m_shader_manager(*this, m_allocator)
@@ -256,6 +321,9 @@ struct RendererImpl : public Renderer
 		m_material_manager.create(ResourceManager::MATERIAL, manager);
 		m_shader_manager.create(ResourceManager::SHADER, manager);
 		m_shader_binary_manager.create(ResourceManager::SHADER_BINARY, manager);
+		m_shader_manager.loadPrewarmList(SHADER_PREWARM_LIST_PATH);
+		// games without editor picking do not need CPU copies of all models
+		m_model_manager.setKeepCPUGeometry(!hasCommandLineFlag("-lazy_model_geometry"));
 
 		m_current_pass_hash = crc32("MAIN");
 		m_view_counter = 0;
@@ -274,6 +342,7 @@ struct RendererImpl : public Renderer
 
 	~RendererImpl()
 	{
+		m_shader_manager.savePrewarmList(SHADER_PREWARM_LIST_PATH);
 		m_texture_manager.destroy();
 		m_model_manager.destroy();
 		m_material_manager.destroy();
@@ -382,6 +451,7 @@ struct RendererImpl : public Renderer
 	void frame() override
 	{
 		PROFILE_FUNCTION();
+		m_texture_manager.update();
 		bgfx::frame();
 		m_view_counter = 0;
 	}
@@ -56,8 +56,37 @@ ShaderInstance& Shader::getInstance(uint32 mask)
 		}
 	}
 
-	g_log_error.log("Shader") << "Unknown shader combination requested: " << mask;
-	return *m_instances[0];
+	if (mask >= (1U << m_combintions.m_define_count))
+	{
+		g_log_error.log("Shader") << "Unknown shader combination requested: " << mask;
+		mask = 0;
+		for (auto* instance : m_instances)
+		{
+			if (instance->m_combination == 0) return *instance;
+		}
+	}
+
+	// binaries are loaded later, when a pass of the instance is actually used
+	ShaderInstance* instance = LUMIX_NEW(m_allocator, ShaderInstance)(*this);
+	instance->m_combination = mask;
+	m_instances.push(instance);
+	return *instance;
+}
+
+
+void Shader::prewarm(uint32 mask, int local_pass_idx)
+{
+	if (mask >= (1U << m_combintions.m_define_count)) return;
+	if (local_pass_idx < 0 || local_pass_idx >= m_combintions.m_pass_count) return;
+
+	requestBinaries(getInstance(mask), local_pass_idx);
+}
+
+
+int Shader::getLocalPassIdx(int global_pass_idx) const
+{
+	if (global_pass_idx < 0 || global_pass_idx >= lengthOf(m_global_to_local_pass)) return -1;
+	return m_global_to_local_pass[global_pass_idx];
 }
 
 
@@ -146,62 +175,50 @@ Renderer& Shader::getRenderer()
 }
 
 
-bool Shader::generateInstances()
+void Shader::mapPasses()
 {
-	for (int i = 0; i < m_instances.size(); ++i)
+	for (int i = 0; i < lengthOf(m_global_to_local_pass); ++i)
 	{
-		LUMIX_DELETE(m_allocator, m_instances[i]);
+		m_global_to_local_pass[i] = -1;
 	}
-	m_instances.clear();
+	for (int i = 0; i < m_combintions.m_pass_count; ++i)
+	{
+		int global_idx = getRenderer().getPassIdx(m_combintions.m_passes[i]);
+		if (global_idx < lengthOf(m_global_to_local_pass)) m_global_to_local_pass[global_idx] = i;
+	}
+}
 
-	int count = 1 << m_combintions.m_define_count;
 
-	auto* binary_manager = m_resource_manager.get(ResourceManager::SHADER_BINARY);
+ShaderBinary* Shader::loadBinary(int local_pass_idx, uint32 mask, bool is_vertex)
+{
 	char basename[MAX_PATH_LENGTH];
 	PathUtils::getBasename(basename, sizeof(basename), getPath().c_str());
 
-	for (int mask = 0; mask < count; ++mask)
-	{
-		ShaderInstance* instance = LUMIX_NEW(m_allocator, ShaderInstance)(*this);
-		m_instances.push(instance);
+	const char* pass = m_combintions.m_passes[local_pass_idx];
+	int combinations = is_vertex ? m_combintions.m_vs_combinations[local_pass_idx]
+								 : m_combintions.m_fs_combinations[local_pass_idx];
+	char path[MAX_PATH_LENGTH];
+	copyString(path, "shaders/compiled/");
+	catString(path, basename);
+	catString(path, "_");
+	catString(path, pass);
+	char mask_str[10];
+	toCString(mask & combinations, mask_str, sizeof(mask_str));
+	catString(path, mask_str);
+	catString(path, is_vertex ? "_vs.shb" : "_fs.shb");
 
-		instance->m_combination = mask;
+	auto* binary_manager = m_resource_manager.get(ResourceManager::SHADER_BINARY);
+	return static_cast<ShaderBinary*>(binary_manager->load(Path(path)));
+}
 
-		for (int pass_idx = 0; pass_idx < m_combintions.m_pass_count; ++pass_idx)
-		{
-			const char* pass = m_combintions.m_passes[pass_idx];
-			char path[MAX_PATH_LENGTH];
-			copyString(path, "shaders/compiled/");
-			catString(path, basename);
-			catString(path, "_");
-			catString(path, pass);
-			char mask_str[10];
-			int actual_mask = mask & m_combintions.m_vs_combinations[pass_idx];
-			toCString(actual_mask, mask_str, sizeof(mask_str));
-			catString(path, mask_str);
-			catString(path, "_vs.shb");
-
-			Path vs_path(path);
-			auto* vs_binary = static_cast<ShaderBinary*>(binary_manager->load(vs_path));
-			addDependency(*vs_binary);
-			instance->m_binaries[pass_idx * 2] = vs_binary;
-
-			copyString(path, "shaders/compiled/");
-			catString(path, basename);
-			catString(path, "_");
-			catString(path, pass);
-			actual_mask = mask & m_combintions.m_fs_combinations[pass_idx];
-			toCString(actual_mask, mask_str, sizeof(mask_str));
-			catString(path, mask_str);
-			catString(path, "_fs.shb");
-
-			Path fs_path(path);
-			auto* fs_binary = static_cast<ShaderBinary*>(binary_manager->load(fs_path));
-			addDependency(*fs_binary);
-			instance->m_binaries[pass_idx * 2 + 1] = fs_binary;
-		}
-	}
-	return true;
+
+void Shader::requestBinaries(ShaderInstance& instance, int local_pass_idx)
+{
+	if (instance.m_binaries[local_pass_idx * 2]) return;
+
+	instance.m_binaries[local_pass_idx * 2] = loadBinary(local_pass_idx, instance.m_combination, true);
+	instance.m_binaries[local_pass_idx * 2 + 1] =
+		loadBinary(local_pass_idx, instance.m_combination, false);
 }
 
 
@@ -230,11 +247,15 @@ bool Shader::load(FS::IFile& file)
 
 	parseTextureSlots(L);
 	m_combintions.parse(getRenderer(), L);
-	if (!generateInstances())
+	mapPasses();
+	for (int i = 0; i < m_instances.size(); ++i)
 	{
-		g_log_error.log("renderer") << "Could not load instances of shader " << getPath().c_str();
-		return false;
+		LUMIX_DELETE(m_allocator, m_instances[i]);
 	}
+	m_instances.clear();
+
+	auto* manager = static_cast<ShaderManager*>(m_resource_manager.get(ResourceManager::SHADER));
+	manager->prewarm(*this);
 
 	m_size = file.size();
 	lua_close(L);
@@ -242,28 +263,6 @@ bool Shader::load(FS::IFile& file)
 }
 
 
-void Shader::onBeforeReady()
-{
-	for (auto* instance : m_instances)
-	{
-		auto** binaries = instance->m_binaries;
-		for (int i = 0; i < Lumix::lengthOf(instance->m_binaries); i += 2)
-		{
-			if (!binaries[i] || !binaries[i + 1]) continue;
-
-			auto vs_handle = binaries[i]->getHandle();
-			auto fs_handle = binaries[i + 1]->getHandle();
-			auto program = bgfx::createProgram(vs_handle, fs_handle);
-			
-			int pass_idx = i / 2;
-			int global_idx = getRenderer().getPassIdx(m_combintions.m_passes[pass_idx]);
-
-			instance->m_program_handles[global_idx] = program;
-		}
-	}
-}
-
-
 void Shader::unload(void)
 {
 	for (int i = 0; i < m_texture_slot_count; ++i)
@@ -298,13 +297,38 @@ ShaderInstance::~ShaderInstance()
 	{
 		if (!binary) continue;
 
-		m_shader.removeDependency(*binary);
 		auto* manager = binary->getResourceManager().get(ResourceManager::SHADER_BINARY);
 		manager->unload(*binary);
 	}
 }
 
 
+bgfx::ProgramHandle ShaderInstance::getProgramHandle(int pass_idx)
+{
+	if (pass_idx < 0 || pass_idx >= lengthOf(m_program_handles)) return BGFX_INVALID_HANDLE;
+	if (bgfx::isValid(m_program_handles[pass_idx])) return m_program_handles[pass_idx];
+
+	int local_idx = m_shader.getLocalPassIdx(pass_idx);
+	if (local_idx < 0) return BGFX_INVALID_HANDLE;
+
+	ShaderBinary* vs = m_binaries[local_idx * 2];
+	ShaderBinary* fs = m_binaries[local_idx * 2 + 1];
+	if (!vs)
+	{
+		m_shader.requestBinaries(*this, local_idx);
+		vs = m_binaries[local_idx * 2];
+		fs = m_binaries[local_idx * 2 + 1];
+	}
+	if (!vs->isReady() || !fs->isReady()) return BGFX_INVALID_HANDLE;
+
+	PROFILE_FUNCTION();
+	m_program_handles[pass_idx] = bgfx::createProgram(vs->getHandle(), fs->getHandle());
+	auto* manager = m_shader.getResourceManager().get(ResourceManager::SHADER);
+	static_cast<ShaderManager*>(manager)->onProgramCreated(m_shader, m_combination, local_idx);
+	return m_program_handles[pass_idx];
+}
+
+
 static int indexOf(Renderer& renderer, ShaderCombinations& combination, const char* define)
 {
 	int define_idx = renderer.getShaderDefineIdx(define);
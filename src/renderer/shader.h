@@ -23,7 +23,7 @@ class Shader;
 class ShaderBinary;
 
 
-class ShaderInstance
+class LUMIX_RENDERER_API ShaderInstance
 {
 public:
 	ShaderInstance(Shader& shader)
@@ -38,6 +38,9 @@ public:
 	}
 	~ShaderInstance();
 
+	// binaries of the pass are requested on the first call, returns invalid handle until they are loaded
+	bgfx::ProgramHandle getProgramHandle(int pass_idx);
+
 	bgfx::ProgramHandle m_program_handles[16];
 	ShaderBinary* m_binaries[32];
 	uint32 m_combination;
@@ -120,6 +123,8 @@ public:
 
 	uint32 getDefineMask(int define_idx) const;
 	ShaderInstance& getInstance(uint32 mask);
+	int getLocalPassIdx(int global_pass_idx) const;
+	void prewarm(uint32 mask, int local_pass_idx);
 	const TextureSlot& getTextureSlot(int index) const
 	{
 		return m_texture_slots[index];
@@ -133,9 +138,10 @@ public:
 
 private:
 	void parseTextureSlots(lua_State* state);
-	bool generateInstances();
+	void mapPasses();
+	void requestBinaries(ShaderInstance& instance, int local_pass_idx);
+	ShaderBinary* loadBinary(int local_pass_idx, uint32 mask, bool is_vertex);
 
-	void onBeforeReady() override;
 	void unload(void) override;
 	bool load(FS::IFile& file) override;
 
@@ -145,6 +151,7 @@ private:
 	int m_texture_slot_count;
 	Array<ShaderInstance*> m_instances;
 	ShaderCombinations m_combintions;
+	int m_global_to_local_pass[16];
 };
 
 } // ~namespace Lumix
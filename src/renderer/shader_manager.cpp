@@ -1,17 +1,25 @@
 #include "lumix.h"
 #include "renderer/shader_manager.h"
 
+#include "core/fs/os_file.h"
+#include "core/log.h"
 #include "core/resource.h"
+#include "renderer/renderer.h"
 #include "renderer/shader.h"
 
 namespace Lumix
 {
 
 
+static const uint32 PREWARM_LIST_MAGIC = 0x5f4c5350; // == '_LSP'
+static const uint32 PREWARM_LIST_VERSION = 0;
+
+
 ShaderManager::ShaderManager(Renderer& renderer, IAllocator& allocator)
 	: ResourceManagerBase(allocator)
 	, m_allocator(allocator)
 	, m_renderer(renderer)
+	, m_prewarm_list(allocator)
 {
 	m_buffer = nullptr;
 	m_buffer_size = -1;
@@ -53,6 +61,78 @@ uint8* ShaderManager::getBuffer(int32 size)
 }
 
 
+bool ShaderManager::loadPrewarmList(const char* path)
+{
+	FS::OsFile file;
+	if (!file.open(path, FS::Mode::OPEN_AND_READ, m_allocator)) return false;
+
+	uint32 magic = 0;
+	uint32 version = 0;
+	int32 count = 0;
+	file.read(&magic, sizeof(magic));
+	file.read(&version, sizeof(version));
+	file.read(&count, sizeof(count));
+	if (magic != PREWARM_LIST_MAGIC || version != PREWARM_LIST_VERSION || count < 0)
+	{
+		g_log_warning.log("renderer") << "Invalid shader prewarm list " << path;
+		file.close();
+		return false;
+	}
+
+	m_prewarm_list.resize(count);
+	bool success = count == 0 || file.read(&m_prewarm_list[0], sizeof(m_prewarm_list[0]) * count);
+	if (!success) m_prewarm_list.clear();
+	file.close();
+	return success;
+}
+
+
+bool ShaderManager::savePrewarmList(const char* path)
+{
+	FS::OsFile file;
+	if (!file.open(path, FS::Mode::CREATE | FS::Mode::WRITE, m_allocator))
+	{
+		g_log_warning.log("renderer") << "Could not save shader prewarm list " << path;
+		return false;
+	}
+
+	int32 count = m_prewarm_list.size();
+	file.write(&PREWARM_LIST_MAGIC, sizeof(PREWARM_LIST_MAGIC));
+	file.write(&PREWARM_LIST_VERSION, sizeof(PREWARM_LIST_VERSION));
+	file.write(&count, sizeof(count));
+	if (count > 0) file.write(&m_prewarm_list[0], sizeof(m_prewarm_list[0]) * count);
+	file.close();
+	return true;
+}
+
+
+void ShaderManager::prewarm(Shader& shader)
+{
+	uint32 hash = shader.getPath().getHash();
+	for (const auto& entry : m_prewarm_list)
+	{
+		if (entry.shader_hash != hash) continue;
+
+		shader.prewarm(entry.mask, entry.pass);
+	}
+}
+
+
+void ShaderManager::onProgramCreated(Shader& shader, uint32 mask, int local_pass_idx)
+{
+	uint32 hash = shader.getPath().getHash();
+	for (const auto& entry : m_prewarm_list)
+	{
+		if (entry.shader_hash == hash && entry.mask == mask && entry.pass == local_pass_idx) return;
+	}
+
+	auto& entry = m_prewarm_list.pushEmpty();
+	entry.shader_hash = hash;
+	entry.mask = mask;
+	entry.pass = local_pass_idx;
+}
+
+
 ShaderBinaryManager::ShaderBinaryManager(Renderer& renderer, IAllocator& allocator)
 	: ResourceManagerBase(allocator)
 	, m_allocator(allocator)
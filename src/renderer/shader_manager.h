@@ -1,11 +1,13 @@
 #pragma once
 
+#include "core/array.h"
 #include "core/resource_manager_base.h"
 
 namespace Lumix
 {
 
 	class Renderer;
+	class Shader;
 
 	class LUMIX_RENDERER_API ShaderBinaryManager : public ResourceManagerBase
 	{
@@ -33,14 +35,30 @@ namespace Lumix
 		Renderer& getRenderer() { return m_renderer; }
 		uint8* getBuffer(int32 size);
 
+		// combinations used in a previous run, their binaries are requested as soon as the shader
+		// is loaded
+		bool loadPrewarmList(const char* path);
+		bool savePrewarmList(const char* path);
+		void prewarm(Shader& shader);
+		void onProgramCreated(Shader& shader, uint32 mask, int local_pass_idx);
+
 	protected:
 		Resource* createResource(const Path& path) override;
 		void destroyResource(Resource& resource) override;
 
+	private:
+		struct PrewarmEntry
+		{
+			uint32 shader_hash;
+			uint32 mask;
+			int32 pass;
+		};
+
 	private:
 		IAllocator& m_allocator;
 		uint8* m_buffer;
 		int32 m_buffer_size;
 		Renderer& m_renderer;
+		Array<PrewarmEntry> m_prewarm_list;
 	};
 }
\ No newline at end of file
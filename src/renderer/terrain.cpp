@@ -15,10 +15,12 @@
 #include "renderer/model.h"
 #include "renderer/render_scene.h"
 #include "renderer/shader.h"
+#include "renderer/terrain_tiles.h"
 #include "renderer/texture.h"
 #include "universe/universe.h"
 #include <cfloat>
 #include <cmath>
+#include <emmintrin.h>
 
 
 namespace Lumix
@@ -29,6 +31,7 @@ static const int GRASS_QUAD_SIZE = 10;
 static const float GRASS_QUAD_RADIUS = GRASS_QUAD_SIZE * 0.7072f;
 static const int GRID_SIZE = 16;
 static const int COPY_COUNT = 50;
+static const float TILES_STREAMING_RADIUS = 2.5f; // in tiles
 static const uint32 TERRAIN_HASH = crc32("terrain");
 static const uint32 MORPH_CONST_HASH = crc32("morph_const");
 static const uint32 QUAD_SIZE_HASH = crc32("quad_size");
@@ -46,6 +49,192 @@ struct Sample
 	float u, v;
 };
 
+template <typename T, int STRIDE>
+struct HeightmapSampler
+{
+	HeightmapSampler(const uint8* data, int width, int height)
+		: m_data((const T*)data)
+		, m_width(width)
+		, m_height(height)
+	{
+	}
+
+
+	LUMIX_FORCE_INLINE float get(int x, int z) const
+	{
+		int idx = Math::clamp(x, 0, m_width) + Math::clamp(z, 0, m_height) * m_width;
+		return (float)m_data[idx * STRIDE];
+	}
+
+
+	const T* m_data;
+	int m_width;
+	int m_height;
+};
+
+
+struct TilesSampler
+{
+	TilesSampler(const TerrainTiles& tiles, int width, int height)
+		: m_tiles(tiles)
+		, m_width(width)
+		, m_height(height)
+	{
+	}
+
+
+	LUMIX_FORCE_INLINE float get(int x, int z) const
+	{
+		return (float)m_tiles.getHeight(Math::clamp(x, 0, m_width), Math::clamp(z, 0, m_height));
+	}
+
+
+	const TerrainTiles& m_tiles;
+	int m_width;
+	int m_height;
+};
+
+
+// fetches corners of the cells containing 4 samples and the samples' position inside the cells
+template <typename Sampler>
+static LUMIX_FORCE_INLINE void gatherCells(const Sampler& sampler,
+	const Vec2* xz,
+	__m128 inv_xz_scale,
+	__m128& fx,
+	__m128& fz,
+	__m128& h00,
+	__m128& h10,
+	__m128& h01,
+	__m128& h11)
+{
+	__m128 x = _mm_mul_ps(_mm_setr_ps(xz[0].x, xz[1].x, xz[2].x, xz[3].x), inv_xz_scale);
+	__m128 z = _mm_mul_ps(_mm_setr_ps(xz[0].y, xz[1].y, xz[2].y, xz[3].y), inv_xz_scale);
+	__m128i ix = _mm_cvttps_epi32(x);
+	__m128i iz = _mm_cvttps_epi32(z);
+	fx = _mm_sub_ps(x, _mm_cvtepi32_ps(ix));
+	fz = _mm_sub_ps(z, _mm_cvtepi32_ps(iz));
+
+	int32 cell_x[4];
+	int32 cell_z[4];
+	_mm_storeu_si128((__m128i*)cell_x, ix);
+	_mm_storeu_si128((__m128i*)cell_z, iz);
+	float c00[4], c10[4], c01[4], c11[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		c00[i] = sampler.get(cell_x[i], cell_z[i]);
+		c10[i] = sampler.get(cell_x[i] + 1, cell_z[i]);
+		c01[i] = sampler.get(cell_x[i], cell_z[i] + 1);
+		c11[i] = sampler.get(cell_x[i] + 1, cell_z[i] + 1);
+	}
+	h00 = _mm_loadu_ps(c00);
+	h10 = _mm_loadu_ps(c10);
+	h01 = _mm_loadu_ps(c01);
+	h11 = _mm_loadu_ps(c11);
+}
+
+
+static LUMIX_FORCE_INLINE __m128 selectSIMD(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+
+// processes 4 samples at a time, the last incomplete group is padded by repeating the last sample
+template <typename Sampler>
+static void getHeightsSIMD(const Sampler& sampler,
+	float xz_scale,
+	float height_scale,
+	const Vec2* LUMIX_RESTRICT xz,
+	float* LUMIX_RESTRICT out,
+	int count)
+{
+	__m128 inv_xz_scale = _mm_set1_ps(1 / xz_scale);
+	__m128 y_scale = _mm_set1_ps(height_scale);
+	Vec2 tail_xz[4];
+	float tail_out[4];
+	for (int i = 0; i < count; i += 4)
+	{
+		int remaining = count - i;
+		const Vec2* src = xz + i;
+		if (remaining < 4)
+		{
+			for (int j = 0; j < 4; ++j) tail_xz[j] = xz[i + Math::minValue(j, remaining - 1)];
+			src = tail_xz;
+		}
+
+		__m128 fx, fz, h00, h10, h01, h11;
+		gatherCells(sampler, src, inv_xz_scale, fx, fz, h00, h10, h01, h11);
+
+		// same triangulation as Terrain::getHeight(float, float)
+		__m128 upper_mask = _mm_cmpgt_ps(fx, fz);
+		__m128 upper = _mm_add_ps(h00,
+			_mm_add_ps(_mm_mul_ps(_mm_sub_ps(h10, h00), fx), _mm_mul_ps(_mm_sub_ps(h11, h10), fz)));
+		__m128 lower = _mm_add_ps(h00,
+			_mm_add_ps(_mm_mul_ps(_mm_sub_ps(h01, h00), fz), _mm_mul_ps(_mm_sub_ps(h11, h01), fx)));
+		__m128 h = _mm_mul_ps(selectSIMD(upper_mask, upper, lower), y_scale);
+
+		if (remaining < 4)
+		{
+			_mm_storeu_ps(tail_out, h);
+			for (int j = 0; j < remaining; ++j) out[i + j] = tail_out[j];
+		}
+		else
+		{
+			_mm_storeu_ps(out + i, h);
+		}
+	}
+}
+
+
+template <typename Sampler>
+static void getNormalsSIMD(const Sampler& sampler,
+	float xz_scale,
+	float height_scale,
+	const Vec2* LUMIX_RESTRICT xz,
+	Vec3* LUMIX_RESTRICT out,
+	int count)
+{
+	__m128 inv_xz_scale = _mm_set1_ps(1 / xz_scale);
+	__m128 y_scale = _mm_set1_ps(height_scale);
+	__m128 ny = _mm_set1_ps(xz_scale);
+	Vec2 tail_xz[4];
+	for (int i = 0; i < count; i += 4)
+	{
+		int remaining = count - i;
+		const Vec2* src = xz + i;
+		if (remaining < 4)
+		{
+			for (int j = 0; j < 4; ++j) tail_xz[j] = xz[i + Math::minValue(j, remaining - 1)];
+			src = tail_xz;
+		}
+
+		__m128 fx, fz, h00, h10, h01, h11;
+		gatherCells(sampler, src, inv_xz_scale, fx, fz, h00, h10, h01, h11);
+		h00 = _mm_mul_ps(h00, y_scale);
+		h10 = _mm_mul_ps(h10, y_scale);
+		h01 = _mm_mul_ps(h01, y_scale);
+		h11 = _mm_mul_ps(h11, y_scale);
+
+		// cross products from Terrain::getNormal divided by the xz scale
+		__m128 upper_mask = _mm_cmpgt_ps(fx, fz);
+		__m128 nx = selectSIMD(upper_mask, _mm_sub_ps(h00, h10), _mm_sub_ps(h01, h11));
+		__m128 nz = selectSIMD(upper_mask, _mm_sub_ps(h10, h11), _mm_sub_ps(h00, h01));
+		__m128 len = _mm_sqrt_ps(
+			_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz)));
+
+		float x[4], y[4], z[4];
+		_mm_storeu_ps(x, _mm_div_ps(nx, len));
+		_mm_storeu_ps(y, _mm_div_ps(ny, len));
+		_mm_storeu_ps(z, _mm_div_ps(nz, len));
+		int group_size = Math::minValue(remaining, 4);
+		for (int j = 0; j < group_size; ++j)
+		{
+			out[i + j].set(x[j], y[j], z[j]);
+		}
+	}
+}
+
+
 struct TerrainQuad
 {
 	enum ChildType
@@ -182,6 +371,9 @@ Terrain::Terrain(Renderer& renderer, Entity entity, RenderScene& scene, IAllocat
 	, m_detail_texture(nullptr)
 	, m_heightmap(nullptr)
 	, m_splatmap(nullptr)
+	, m_tiles(nullptr)
+	, m_tiles_heightmap(BGFX_INVALID_HANDLE)
+	, m_tiles_splatmap(BGFX_INVALID_HANDLE)
 	, m_width(0)
 	, m_height(0)
 	, m_layer_mask(1)
@@ -193,6 +385,9 @@ Terrain::Terrain(Renderer& renderer, Entity entity, RenderScene& scene, IAllocat
 	, m_last_camera_position(m_allocator)
 	, m_grass_types(m_allocator)
 	, m_free_grass_quads(m_allocator)
+	, m_grass_positions(m_allocator)
+	, m_grass_densities(m_allocator)
+	, m_grass_heights(m_allocator)
 	, m_renderer(renderer)
 	, m_vertices_handle(BGFX_INVALID_HANDLE)
 	, m_indices_handle(BGFX_INVALID_HANDLE)
@@ -216,6 +411,7 @@ Terrain::~Terrain()
 	bgfx::destroyVertexBuffer(m_vertices_handle);
 
 	setMaterial(nullptr);
+	destroyTiles();
 	LUMIX_DELETE(m_allocator, m_mesh);
 	LUMIX_DELETE(m_allocator, m_root);
 	for(int i = 0; i < m_grass_types.size(); ++i)
@@ -367,45 +563,55 @@ void Terrain::generateGrassTypeQuad(GrassPatch& patch,
 	if (!patch.m_type->m_grass_model || !patch.m_type->m_grass_model->isReady())
 		return;
 
-	Texture* splat_map = m_splatmap;
 	float step = GRASS_QUAD_SIZE / (float)patch.m_type->m_density;
 
+	m_grass_positions.clear();
+	m_grass_densities.clear();
 	for (float dx = 0; dx < GRASS_QUAD_SIZE; dx += step)
 	{
 		for (float dz = 0; dz < GRASS_QUAD_SIZE; dz += step)
 		{
-			uint32 pixel_value = splat_map->getPixelNearest(
-				int(splat_map->getWidth() * (quad_x + dx) /
-					(m_width * m_scale.x)),
-				int(splat_map->getHeight() * (quad_z + dz) /
-					(m_height * m_scale.x)));
+			uint32 pixel_value = getSplatmapPixel(quad_x + dx, quad_z + dz);
 
 			int ground_index = pixel_value & 0xff;
 			int weight = (pixel_value >> 8) & 0xff;
 			uint8 count = ground_index == patch.m_type->m_ground ? weight : 0;
-			float density = count / 255.0f;
+			float density = count / 255.0f * getGrassDensity(quad_x + dx, quad_z + dz);
 
 			if (density < 0.25f) continue;
 
-			Matrix& grass_mtx = patch.m_matrices.pushEmpty();
-			grass_mtx = Matrix::IDENTITY;
 			float x = quad_x + dx + step * Math::randFloat(-0.5f, 0.5f);
 			float z = quad_z + dz + step * Math::randFloat(-0.5f, 0.5f);
-			grass_mtx.setTranslation(Vec3(x, getHeight(x, z), z));
-			Quat q(Vec3(0, 1, 0), Math::randFloat(0, Math::PI * 2));
-			Matrix rotMatrix;
-			q.toMatrix(rotMatrix);
-			grass_mtx = terrain_matrix * grass_mtx * rotMatrix;
-			grass_mtx.multiply3x3(density + Math::randFloat(-0.1f, 0.1f));
+			m_grass_positions.emplace(x, z);
+			m_grass_densities.push(density);
 		}
 	}
+
+	if (m_grass_positions.empty()) return;
+
+	m_grass_heights.resize(m_grass_positions.size());
+	getHeights(&m_grass_positions[0], &m_grass_heights[0], m_grass_positions.size());
+
+	patch.m_matrices.reserve(patch.m_matrices.size() + m_grass_positions.size());
+	for (int i = 0; i < m_grass_positions.size(); ++i)
+	{
+		const Vec2& pos = m_grass_positions[i];
+		Matrix& grass_mtx = patch.m_matrices.pushEmpty();
+		grass_mtx = Matrix::IDENTITY;
+		grass_mtx.setTranslation(Vec3(pos.x, m_grass_heights[i], pos.y));
+		Quat q(Vec3(0, 1, 0), Math::randFloat(0, Math::PI * 2));
+		Matrix rotMatrix;
+		q.toMatrix(rotMatrix);
+		grass_mtx = terrain_matrix * grass_mtx * rotMatrix;
+		grass_mtx.multiply3x3(m_grass_densities[i] + Math::randFloat(-0.1f, 0.1f));
+	}
 }
 
 
 void Terrain::updateGrass(ComponentIndex camera)
 {
 	PROFILE_FUNCTION();
-	if (!m_splatmap)
+	if (!m_splatmap && !useTiles())
 		return;
 
 	Array<GrassQuad*>& quads = getQuads(camera);
@@ -514,6 +720,95 @@ void Terrain::GrassType::grassLoaded(Resource::State, Resource::State)
 }
 
 
+void Terrain::onTileLoaded(int x, int z)
+{
+	const TerrainTiles::Tile* tile = m_tiles->getTile(x, z);
+	if (tile && bgfx::isValid(m_tiles_heightmap))
+	{
+		int tile_size = m_tiles->getTileSize();
+		int samples = tile_size * tile_size;
+		// the same format as raw heightmaps, see Texture::loadRaw
+		const bgfx::Memory* heights = bgfx::alloc(samples * sizeof(float));
+		float* LUMIX_RESTRICT dst = (float*)heights->data;
+		for (int i = 0; i < samples; ++i)
+		{
+			dst[i] = tile->m_heights[i] / 65535.0f;
+		}
+		const bgfx::Memory* splat = bgfx::copy(tile->m_splatmap, samples * sizeof(uint32));
+		uint16 from_x = uint16(x * tile_size);
+		uint16 from_z = uint16(z * tile_size);
+		uint16 size = uint16(tile_size);
+		bgfx::updateTexture2D(m_tiles_heightmap, 0, from_x, from_z, size, size, heights);
+		bgfx::updateTexture2D(m_tiles_splatmap, 0, from_x, from_z, size, size, splat);
+	}
+
+	// grass is generated from the splatmap and heights of the tile
+	if (!m_grass_types.empty()) forceGrassUpdate();
+}
+
+
+void Terrain::onTilesIndexLoaded()
+{
+	createTilesTextures();
+	if (m_material && m_material->isReady()) createRoot();
+	forceGrassUpdate();
+}
+
+
+// tiles are uploaded to the textures as they are streamed in, the textures are never read back,
+// so only the resident tiles are kept in memory
+void Terrain::createTilesTextures()
+{
+	destroyTilesTextures();
+	int width = m_tiles->getWidth();
+	int height = m_tiles->getHeight();
+	int max_size = bgfx::getCaps()->maxTextureSize;
+	if (width > max_size || height > max_size)
+	{
+		g_log_error.log("renderer") << "Terrain tiles " << m_tiles->getPath().c_str() << " are "
+									<< width << "x" << height << ", the GPU supports only "
+									<< max_size << "x" << max_size;
+		return;
+	}
+
+	uint32 flags = BGFX_TEXTURE_U_CLAMP | BGFX_TEXTURE_V_CLAMP;
+	m_tiles_heightmap = bgfx::createTexture2D(
+		(uint16_t)width, (uint16_t)height, 1, bgfx::TextureFormat::R32F, flags);
+	// ground indices can not be interpolated
+	flags |= BGFX_TEXTURE_MIN_POINT | BGFX_TEXTURE_MAG_POINT;
+	m_tiles_splatmap = bgfx::createTexture2D(
+		(uint16_t)width, (uint16_t)height, 1, bgfx::TextureFormat::RGBA8, flags);
+}
+
+
+void Terrain::destroyTilesTextures()
+{
+	if (bgfx::isValid(m_tiles_heightmap)) bgfx::destroyTexture(m_tiles_heightmap);
+	if (bgfx::isValid(m_tiles_splatmap)) bgfx::destroyTexture(m_tiles_splatmap);
+	m_tiles_heightmap = BGFX_INVALID_HANDLE;
+	m_tiles_splatmap = BGFX_INVALID_HANDLE;
+}
+
+
+// the tiles fire tileUnloaded for every resident tile when deleted
+void Terrain::destroyTiles()
+{
+	destroyTilesTextures();
+	if (!m_tiles) return;
+	m_tiles->indexLoaded().unbind<Terrain, &Terrain::onTilesIndexLoaded>(this);
+	m_tiles->tileLoaded().unbind<Terrain, &Terrain::onTileLoaded>(this);
+	LUMIX_DELETE(m_allocator, m_tiles);
+	m_tiles = nullptr;
+}
+
+
+int Terrain::getSplatmapWidth() const
+{
+	if (bgfx::isValid(m_tiles_splatmap)) return m_width;
+	return m_splatmap ? m_splatmap->getWidth() : 0;
+}
+
+
 void Terrain::getGrassInfos(const Frustum& frustum, Array<GrassInfo>& infos, ComponentIndex camera)
 {
 	updateGrass(camera);
@@ -567,7 +862,43 @@ void Terrain::setMaterial(Material* material)
 	}
 }
 
-void Terrain::deserialize(InputBlob& serializer, Universe& universe, RenderScene& scene, int index)
+Path Terrain::getTilesPath() const
+{
+	return m_tiles ? m_tiles->getPath() : Path("");
+}
+
+
+void Terrain::setTilesPath(const Path& path)
+{
+	if (!path.isValid())
+	{
+		destroyTiles();
+	}
+	else
+	{
+		if (!m_tiles)
+		{
+			m_tiles = LUMIX_NEW(m_allocator, TerrainTiles)(
+				m_scene.getEngine().getFileSystem(), m_allocator);
+			m_tiles->indexLoaded().bind<Terrain, &Terrain::onTilesIndexLoaded>(this);
+			m_tiles->tileLoaded().bind<Terrain, &Terrain::onTileLoaded>(this);
+		}
+		destroyTilesTextures();
+		m_tiles->load(path);
+	}
+	forceGrassUpdate();
+	if (m_material && m_material->isReady())
+	{
+		onMaterialLoaded(Resource::State::READY, Resource::State::READY);
+	}
+}
+
+
+void Terrain::deserialize(InputBlob& serializer,
+	Universe& universe,
+	RenderScene& scene,
+	int index,
+	bool has_tiles)
 {
 	serializer.read(m_entity);
 	serializer.read(m_layer_mask);
@@ -596,6 +927,11 @@ void Terrain::deserialize(InputBlob& serializer, Universe& universe, RenderScene
 		serializer.read(m_grass_types[i]->m_density);
 		setGrassTypePath(i, Path(path));
 	}
+	if (has_tiles)
+	{
+		serializer.readString(path, MAX_PATH_LENGTH);
+		setTilesPath(Path(path));
+	}
 	universe.addComponent(m_entity, TERRAIN_HASH, &scene, index);
 }
 
@@ -616,6 +952,7 @@ void Terrain::serialize(OutputBlob& serializer)
 		serializer.write(type.m_ground);
 		serializer.write(type.m_density);
 	}
+	serializer.writeString(m_tiles ? m_tiles->getPath().c_str() : "");
 }
 
 
@@ -630,6 +967,11 @@ void Terrain::getInfos(Array<const TerrainInfo*>& infos, const Vec3& camera_pos,
 	Vec3 local_camera_pos = inv_matrix.multiplyPosition(camera_pos);
 	local_camera_pos.x /= m_scale.x;
 	local_camera_pos.z /= m_scale.z;
+	if (m_tiles)
+	{
+		m_tiles->update(Vec2(local_camera_pos.x, local_camera_pos.z),
+			TILES_STREAMING_RADIUS * m_tiles->getTileSize());
+	}
 	m_root->getInfos(infos, local_camera_pos, this, matrix, allocator);
 }
 
@@ -684,9 +1026,113 @@ float Terrain::getHeight(float x, float z)
 }
 	
 
+void Terrain::getHeights(const Vec2* xz, float* out, int count)
+{
+	PROFILE_FUNCTION();
+	if (useTiles())
+	{
+		TilesSampler sampler(*m_tiles, m_width, m_height);
+		getHeightsSIMD(sampler, m_scale.x, m_scale.y / 65535.0f, xz, out, count);
+		return;
+	}
+	if (!m_heightmap || !m_heightmap->getData())
+	{
+		for (int i = 0; i < count; ++i) out[i] = 0;
+		return;
+	}
+
+	const uint8* data = m_heightmap->getData();
+	if (m_heightmap->getBytesPerPixel() == 2)
+	{
+		HeightmapSampler<uint16, 1> sampler(data, m_width, m_height);
+		getHeightsSIMD(sampler, m_scale.x, m_scale.y / 65535.0f, xz, out, count);
+	}
+	else if (m_heightmap->getBytesPerPixel() == 4)
+	{
+		HeightmapSampler<uint8, 4> sampler(data, m_width, m_height);
+		getHeightsSIMD(sampler, m_scale.x, m_scale.y / 255.0f, xz, out, count);
+	}
+	else
+	{
+		ASSERT(false);
+		for (int i = 0; i < count; ++i) out[i] = 0;
+	}
+}
+
+
+void Terrain::getNormals(const Vec2* xz, Vec3* out, int count)
+{
+	PROFILE_FUNCTION();
+	if (useTiles())
+	{
+		TilesSampler sampler(*m_tiles, m_width, m_height);
+		getNormalsSIMD(sampler, m_scale.x, m_scale.y / 65535.0f, xz, out, count);
+		return;
+	}
+	if (!m_heightmap || !m_heightmap->getData())
+	{
+		for (int i = 0; i < count; ++i) out[i].set(0, 1, 0);
+		return;
+	}
+
+	const uint8* data = m_heightmap->getData();
+	if (m_heightmap->getBytesPerPixel() == 2)
+	{
+		HeightmapSampler<uint16, 1> sampler(data, m_width, m_height);
+		getNormalsSIMD(sampler, m_scale.x, m_scale.y / 65535.0f, xz, out, count);
+	}
+	else if (m_heightmap->getBytesPerPixel() == 4)
+	{
+		HeightmapSampler<uint8, 4> sampler(data, m_width, m_height);
+		getNormalsSIMD(sampler, m_scale.x, m_scale.y / 255.0f, xz, out, count);
+	}
+	else
+	{
+		ASSERT(false);
+		for (int i = 0; i < count; ++i) out[i].set(0, 1, 0);
+	}
+}
+
+
+bool Terrain::useTiles() const
+{
+	return m_tiles && m_tiles->isReady();
+}
+
+
+uint32 Terrain::getSplatmapPixel(float x, float z)
+{
+	if (useTiles())
+	{
+		int tiles_x = int(m_tiles->getWidth() * x / (m_width * m_scale.x));
+		int tiles_z = int(m_tiles->getHeight() * z / (m_height * m_scale.x));
+		return m_tiles->getSplat(tiles_x, tiles_z);
+	}
+	if (!m_splatmap || !m_splatmap->getData()) return 0;
+	return m_splatmap->getPixelNearest(int(m_splatmap->getWidth() * x / (m_width * m_scale.x)),
+		int(m_splatmap->getHeight() * z / (m_height * m_scale.x)));
+}
+
+
+float Terrain::getGrassDensity(float x, float z)
+{
+	if (!useTiles()) return 1;
+	int tiles_x = int(x / m_scale.x);
+	int tiles_z = int(z / m_scale.x);
+	return m_tiles->getGrassDensity(tiles_x, tiles_z) / 255.0f;
+}
+
+
 float Terrain::getHeight(int x, int z)
 {
-	if (!m_heightmap) return 0;
+	if (useTiles())
+	{
+		int tiles_x = Math::clamp(x, 0, m_width);
+		int tiles_z = Math::clamp(z, 0, m_height);
+		return m_scale.y / 65535.0f * m_tiles->getHeight(tiles_x, tiles_z);
+	}
+	// with tiles, the data is not kept, see onMaterialLoaded
+	if (!m_heightmap || !m_heightmap->getData()) return 0;
 
 	int texture_x = x;
 	int texture_y = z;
@@ -708,6 +1154,17 @@ float Terrain::getHeight(int x, int z)
 }
 
 
+bool Terrain::isHeightResident(int x, int z) const
+{
+	if (useTiles())
+	{
+		int tile_size = m_tiles->getTileSize();
+		return m_tiles->getTile(x / tile_size, z / tile_size) != nullptr;
+	}
+	return !m_tiles && m_heightmap && m_heightmap->getData();
+}
+
+
 bool getRayTriangleIntersection(const Vec3& local_origin, const Vec3& local_dir, const Vec3& p0, const Vec3& p1, const Vec3& p2, float& out)
 {
 	Vec3 normal = crossProduct(p1 - p0, p2 - p0);
@@ -777,6 +1234,12 @@ RayCastModelHit Terrain::castRay(const Vec3& origin, const Vec3& dir)
 
 			while (hx >= 0 && hz >= 0 && hx + 1 < m_width && hz + 1 < m_height)
 			{
+				// the cell can span up to four tiles, an unloaded one would look flat
+				if (!isHeightResident(hx, hz) || !isHeightResident(hx + 1, hz) ||
+					!isHeightResident(hx, hz + 1) || !isHeightResident(hx + 1, hz + 1))
+				{
+					return hit;
+				}
 				float t;
 				float x = hx * m_scale.x;
 				float z = hz * m_scale.x;
@@ -894,6 +1357,27 @@ TerrainQuad* Terrain::generateQuadTree(float size)
 	return root;
 }
 
+void Terrain::createRoot()
+{
+	LUMIX_DELETE(m_allocator, m_root);
+	m_root = nullptr;
+	if (m_tiles)
+	{
+		// the size comes from the tiles, it is not known until their index is loaded
+		if (!m_tiles->isReady()) return;
+		m_width = m_tiles->getWidth();
+		m_height = m_tiles->getHeight();
+	}
+	else
+	{
+		if (!m_heightmap || !m_splatmap) return;
+		m_width = m_heightmap->getWidth();
+		m_height = m_heightmap->getHeight();
+	}
+	m_root = generateQuadTree((float)m_width);
+}
+
+
 void Terrain::onMaterialLoaded(Resource::State, Resource::State new_state)
 {
 	PROFILE_FUNCTION();
@@ -903,13 +1387,15 @@ void Terrain::onMaterialLoaded(Resource::State, Resource::State new_state)
 
 		m_heightmap = m_material->getTextureByUniform("u_texHeightmap");
 		bool is_data_ready = true;
-		if (m_heightmap && m_heightmap->getData() == nullptr)
+		// with tiles, heights and splatmap are streamed, the material should not have them at all,
+		// see createTilesTextures
+		if (!m_tiles && m_heightmap && m_heightmap->getData() == nullptr)
 		{
 			m_heightmap->addDataReference();
 			is_data_ready = false;
 		}
 		m_splatmap = m_material->getTextureByUniform("u_texSplatmap");
-		if (m_splatmap && m_splatmap->getData() == nullptr)
+		if (!m_tiles && m_splatmap && m_splatmap->getData() == nullptr)
 		{
 			m_splatmap->addDataReference();
 			is_data_ready = false;
@@ -922,16 +1408,7 @@ void Terrain::onMaterialLoaded(Resource::State, Resource::State new_state)
 			is_data_ready = false;
 		}
 
-		if (is_data_ready)
-		{
-			LUMIX_DELETE(m_allocator, m_root);
-			if (m_heightmap && m_splatmap)
-			{
-				m_width = m_heightmap->getWidth();
-				m_height = m_heightmap->getHeight();
-				m_root = generateQuadTree((float)m_width);
-			}
-		}
+		if (is_data_ready) createRoot();
 	}
 	else
 	{
@@ -21,6 +21,7 @@ class OutputBlob;
 class Renderer;
 class RenderScene;
 struct TerrainQuad;
+class TerrainTiles;
 class Texture;
 
 
@@ -73,11 +74,17 @@ class Terrain
 		Material* getMaterial() const { return m_material; }
 		Texture* getDetailTexture() const { return m_detail_texture; }
 		Texture* getSplatmap() const { return m_splatmap; }
+		int getSplatmapWidth() const;
+		// with tiles, these replace the heightmap and the splatmap of the material
+		bgfx::TextureHandle getTilesHeightmap() const { return m_tiles_heightmap; }
+		bgfx::TextureHandle getTilesSplatmap() const { return m_tiles_splatmap; }
 		int64 getLayerMask() const { return m_layer_mask; }
 		Entity getEntity() const { return m_entity; }
 		float getRootSize() const;
 		Vec3 getNormal(float x, float z);
 		float getHeight(float x, float z);
+		void getHeights(const Vec2* xz, float* out, int count);
+		void getNormals(const Vec2* xz, Vec3* out, int count);
 		float getXZScale() const { return m_scale.x; }
 		float getYScale() const { return m_scale.y; }
 		Mesh* getMesh() { return m_mesh; }
@@ -88,6 +95,8 @@ class Terrain
 		int getGrassTypeDensity(int index);
 		int getGrassTypeCount() const { return m_grass_types.size(); }
 		int getGrassDistance() const { return m_grass_distance; }
+		Path getTilesPath() const;
+		TerrainTiles* getTiles() const { return m_tiles; }
 
 		void setXZScale(float scale) { m_scale.x = scale; m_scale.z = scale; }
 		void setYScale(float scale) { m_scale.y = scale; }
@@ -96,13 +105,18 @@ class Terrain
 		void setGrassTypeDensity(int index, int density);
 		void setGrassDistance(int value) { m_grass_distance = value; forceGrassUpdate(); }
 		void setMaterial(Material* material);
+		void setTilesPath(const Path& path);
 
 		void getInfos(Array<const TerrainInfo*>& infos, const Vec3& camera_pos, LIFOAllocator& allocator);
 		void getGrassInfos(const Frustum& frustum, Array<GrassInfo>& infos, ComponentIndex camera);
 
 		RayCastModelHit castRay(const Vec3& origin, const Vec3& dir);
 		void serialize(OutputBlob& serializer);
-		void deserialize(InputBlob& serializer, Universe& universe, RenderScene& scene, int index);
+		void deserialize(InputBlob& serializer,
+			Universe& universe,
+			RenderScene& scene,
+			int index,
+			bool has_tiles);
 
 		void addGrassType(int index);
 		void removeGrassType(int index);
@@ -112,6 +126,12 @@ class Terrain
 		Array<Terrain::GrassQuad*>& getQuads(ComponentIndex camera);
 		TerrainQuad* generateQuadTree(float size);
 		float getHeight(int x, int z);
+		// heights of tiles which are not loaded yet are not known
+		bool isHeightResident(int x, int z) const;
+		uint32 getSplatmapPixel(float x, float z);
+		// only tiles have grass density, it scales the density given by the splatmap
+		float getGrassDensity(float x, float z);
+		bool useTiles() const;
 		void updateGrass(ComponentIndex camera);
 		void generateGrassTypeQuad(GrassPatch& patch,
 								   const Matrix& terrain_matrix,
@@ -119,6 +139,12 @@ class Terrain
 								   float quad_z);
 		void generateGeometry();
 		void onMaterialLoaded(Resource::State, Resource::State new_state);
+		void onTileLoaded(int x, int z);
+		void onTilesIndexLoaded();
+		void createRoot();
+		void createTilesTextures();
+		void destroyTilesTextures();
+		void destroyTiles();
 
 	private:
 		IAllocator& m_allocator;
@@ -136,11 +162,17 @@ class Terrain
 		Texture* m_heightmap;
 		Texture* m_splatmap;
 		Texture* m_detail_texture;
+		TerrainTiles* m_tiles;
+		bgfx::TextureHandle m_tiles_heightmap;
+		bgfx::TextureHandle m_tiles_splatmap;
 		RenderScene& m_scene;
 		Array<GrassType*> m_grass_types;
 		Array<GrassQuad*> m_free_grass_quads;
 		AssociativeArray<ComponentIndex, Array<GrassQuad*> > m_grass_quads;
 		AssociativeArray<ComponentIndex, Vec3> m_last_camera_position;
+		Array<Vec2> m_grass_positions;
+		Array<float> m_grass_densities;
+		Array<float> m_grass_heights;
 		bool m_force_grass_update;
 		Renderer& m_renderer;
 };
@@ -0,0 +1,495 @@
+#include "renderer/terrain_tiles.h"
+#include "core/fs/file_system.h"
+#include "core/fs/ifile.h"
+#include "core/log.h"
+#include "core/math_utils.h"
+#include "core/path_utils.h"
+#include "core/profiler.h"
+#include "core/string.h"
+#include "renderer/texture.h"
+
+
+namespace Lumix
+{
+
+
+static const int INDEX_REQUEST = -1;
+static const int MAX_PENDING_REQUESTS = 4;
+static const size_t DEFAULT_MEMORY_BUDGET = 64 * 1024 * 1024;
+
+
+struct TerrainTiles::LoadRequest
+{
+	LoadRequest(TerrainTiles& owner, int tile_index)
+		: m_owner(&owner)
+		, m_allocator(owner.m_allocator)
+		, m_tile_index(tile_index)
+	{
+	}
+
+
+	void fileLoaded(FS::IFile& file, bool success)
+	{
+		if (m_owner) m_owner->onFileLoaded(*this, file, success);
+		IAllocator& allocator = m_allocator;
+		LUMIX_DELETE(allocator, this);
+	}
+
+
+	TerrainTiles* m_owner;
+	IAllocator& m_allocator;
+	int m_tile_index;
+};
+
+
+TerrainTiles::TerrainTiles(FS::FileSystem& file_system, IAllocator& allocator)
+	: m_allocator(allocator)
+	, m_file_system(file_system)
+	, m_tiles(allocator)
+	, m_requests(allocator)
+	, m_tile_size(0)
+	, m_tiles_x(0)
+	, m_tiles_z(0)
+	, m_memory_usage(0)
+	, m_memory_budget(DEFAULT_MEMORY_BUDGET)
+	, m_frame(0)
+	, m_index_loaded(allocator)
+	, m_tile_loaded(allocator)
+	, m_tile_unloaded(allocator)
+{
+}
+
+
+TerrainTiles::~TerrainTiles()
+{
+	clear();
+}
+
+
+void TerrainTiles::clear()
+{
+	// requests can not be cancelled, they are orphaned and delete themselves once finished
+	for (auto* request : m_requests)
+	{
+		request->m_owner = nullptr;
+	}
+	m_requests.clear();
+
+	for (int i = 0; i < m_tiles.size(); ++i)
+	{
+		unloadTile(i);
+	}
+	m_tiles.clear();
+	m_tile_size = 0;
+	m_tiles_x = 0;
+	m_tiles_z = 0;
+	m_path = Path();
+}
+
+
+void TerrainTiles::load(const Path& path)
+{
+	clear();
+	m_path = path;
+	if (path.isValid()) requestFile(INDEX_REQUEST);
+}
+
+
+size_t TerrainTiles::getTileMemorySize() const
+{
+	size_t samples = m_tile_size * m_tile_size;
+	return samples * (sizeof(uint16) + sizeof(uint32) + sizeof(uint8));
+}
+
+
+void TerrainTiles::setMemoryBudget(size_t bytes)
+{
+	m_memory_budget = bytes;
+	evict();
+}
+
+
+void TerrainTiles::getTilePath(const Path& path, int x, int z, char* out, int max_size)
+{
+	PathUtils::FileInfo info(path.c_str());
+	char tmp[20];
+	copyString(out, max_size, info.m_dir);
+	catString(out, max_size, info.m_basename);
+	catString(out, max_size, "/");
+	toCString(x, tmp, lengthOf(tmp));
+	catString(out, max_size, tmp);
+	catString(out, max_size, "_");
+	toCString(z, tmp, lengthOf(tmp));
+	catString(out, max_size, tmp);
+	catString(out, max_size, ".ltile");
+}
+
+
+static uint16 getHeightmapSample(const Texture& heightmap, int x, int z)
+{
+	x = Math::clamp(x, 0, heightmap.getWidth() - 1);
+	z = Math::clamp(z, 0, heightmap.getHeight() - 1);
+	int idx = x + z * heightmap.getWidth();
+	if (heightmap.getBytesPerPixel() == 2) return ((const uint16*)heightmap.getData())[idx];
+	return uint16(heightmap.getData()[idx * heightmap.getBytesPerPixel()] * 257);
+}
+
+
+bool TerrainTiles::save(FS::FileSystem& file_system,
+	const Path& path,
+	int tile_size,
+	const Texture& heightmap,
+	const Texture& splatmap,
+	const uint8* grass_density,
+	int grass_width,
+	int grass_height,
+	IAllocator& allocator)
+{
+	if (!heightmap.getData() || !splatmap.getData() || splatmap.getBytesPerPixel() != 4)
+	{
+		g_log_error.log("renderer") << "Can not create terrain tiles " << path.c_str()
+									<< ", heightmap and splatmap data are not available";
+		return false;
+	}
+
+	int width = heightmap.getWidth();
+	int height = heightmap.getHeight();
+	FileHeader header;
+	header.m_magic = FILE_MAGIC;
+	header.m_version = (uint32)FileVersion::LATEST;
+	header.m_tile_size = tile_size;
+	header.m_tiles_x = (width + tile_size - 1) / tile_size;
+	header.m_tiles_z = (height + tile_size - 1) / tile_size;
+
+	FS::IFile* file = file_system.open(
+		file_system.getDefaultDevice(), path, FS::Mode::OPEN_OR_CREATE | FS::Mode::WRITE);
+	if (!file)
+	{
+		g_log_error.log("renderer") << "Could not save " << path.c_str();
+		return false;
+	}
+	file->write(&header, sizeof(header));
+	file_system.close(*file);
+
+	int samples = tile_size * tile_size;
+	Array<uint8> data(allocator);
+	data.resize(samples * (sizeof(uint16) + sizeof(uint32) + sizeof(uint8)));
+	uint16* heights = (uint16*)&data[0];
+	uint32* splat = (uint32*)&data[samples * sizeof(uint16)];
+	uint8* grass = &data[samples * (sizeof(uint16) + sizeof(uint32))];
+	const uint32* splat_data = (const uint32*)splatmap.getData();
+	for (int tile_z = 0; tile_z < header.m_tiles_z; ++tile_z)
+	{
+		for (int tile_x = 0; tile_x < header.m_tiles_x; ++tile_x)
+		{
+			for (int j = 0; j < tile_size; ++j)
+			{
+				for (int i = 0; i < tile_size; ++i)
+				{
+					int x = tile_x * tile_size + i;
+					int z = tile_z * tile_size + j;
+					int idx = i + j * tile_size;
+					heights[idx] = getHeightmapSample(heightmap, x, z);
+					int splat_x =
+						Math::clamp(x * splatmap.getWidth() / width, 0, splatmap.getWidth() - 1);
+					int splat_z =
+						Math::clamp(z * splatmap.getHeight() / height, 0, splatmap.getHeight() - 1);
+					splat[idx] = splat_data[splat_x + splat_z * splatmap.getWidth()];
+					grass[idx] = 0xff;
+					if (grass_density)
+					{
+						int grass_x = Math::clamp(x * grass_width / width, 0, grass_width - 1);
+						int grass_z = Math::clamp(z * grass_height / height, 0, grass_height - 1);
+						grass[idx] = grass_density[grass_x + grass_z * grass_width];
+					}
+				}
+			}
+
+			char tile_path[MAX_PATH_LENGTH];
+			getTilePath(path, tile_x, tile_z, tile_path, lengthOf(tile_path));
+			file = file_system.open(file_system.getDefaultDevice(),
+				Path(tile_path),
+				FS::Mode::OPEN_OR_CREATE | FS::Mode::WRITE);
+			if (!file)
+			{
+				g_log_error.log("renderer") << "Could not save " << tile_path;
+				return false;
+			}
+			TileHeader tile_header;
+			tile_header.m_magic = TILE_MAGIC;
+			tile_header.m_version = (uint32)FileVersion::LATEST;
+			tile_header.m_x = tile_x;
+			tile_header.m_z = tile_z;
+			file->write(&tile_header, sizeof(tile_header));
+			file->write(&data[0], data.size());
+			file_system.close(*file);
+		}
+	}
+	return true;
+}
+
+
+void TerrainTiles::requestFile(int tile_index)
+{
+	LoadRequest* request = LUMIX_NEW(m_allocator, LoadRequest)(*this, tile_index);
+	FS::ReadCallback cb;
+	cb.bind<LoadRequest, &LoadRequest::fileLoaded>(request);
+
+	Path path = m_path;
+	if (tile_index != INDEX_REQUEST)
+	{
+		char tmp[MAX_PATH_LENGTH];
+		getTilePath(m_path, tile_index % m_tiles_x, tile_index / m_tiles_x, tmp, lengthOf(tmp));
+		path = Path(tmp);
+		m_tiles[tile_index].m_state = Tile::State::LOADING;
+	}
+
+	if (m_file_system.openAsync(
+			m_file_system.getDefaultDevice(), path, FS::Mode::OPEN_AND_READ, cb) ==
+		FS::INVALID_ASYNC_HANDLE)
+	{
+		g_log_error.log("renderer") << "Could not open " << path.c_str();
+		if (tile_index != INDEX_REQUEST) m_tiles[tile_index].m_state = Tile::State::FAILURE;
+		LUMIX_DELETE(m_allocator, request);
+		return;
+	}
+	m_requests.push(request);
+}
+
+
+void TerrainTiles::onFileLoaded(LoadRequest& request, FS::IFile& file, bool success)
+{
+	for (int i = 0; i < m_requests.size(); ++i)
+	{
+		if (m_requests[i] == &request)
+		{
+			m_requests.eraseFast(i);
+			break;
+		}
+	}
+
+	if (request.m_tile_index == INDEX_REQUEST)
+	{
+		if (!success || !loadIndex(file))
+		{
+			g_log_error.log("renderer") << "Could not load terrain tiles " << m_path.c_str();
+			return;
+		}
+		m_index_loaded.invoke();
+		return;
+	}
+
+	Tile& tile = m_tiles[request.m_tile_index];
+	if (!success || !loadTile(request.m_tile_index, file))
+	{
+		g_log_error.log("renderer") << "Could not load terrain tile "
+									<< request.m_tile_index % m_tiles_x << ", "
+									<< request.m_tile_index / m_tiles_x << " of "
+									<< m_path.c_str();
+		tile.m_state = Tile::State::FAILURE;
+		return;
+	}
+
+	tile.m_state = Tile::State::READY;
+	m_memory_usage += getTileMemorySize();
+	m_tile_loaded.invoke(request.m_tile_index % m_tiles_x, request.m_tile_index / m_tiles_x);
+	evict();
+}
+
+
+bool TerrainTiles::loadIndex(FS::IFile& file)
+{
+	FileHeader header;
+	if (!file.read(&header, sizeof(header))) return false;
+	if (header.m_magic != FILE_MAGIC) return false;
+	if (header.m_version > (uint32)FileVersion::LATEST) return false;
+	if (header.m_tile_size <= 0 || header.m_tiles_x <= 0 || header.m_tiles_z <= 0) return false;
+
+	m_tile_size = header.m_tile_size;
+	m_tiles_x = header.m_tiles_x;
+	m_tiles_z = header.m_tiles_z;
+	m_tiles.resize(m_tiles_x * m_tiles_z);
+	for (auto& tile : m_tiles)
+	{
+		tile.m_heights = nullptr;
+		tile.m_splatmap = nullptr;
+		tile.m_grass = nullptr;
+		tile.m_last_used_frame = 0;
+		tile.m_state = Tile::State::EMPTY;
+	}
+	return true;
+}
+
+
+bool TerrainTiles::loadTile(int index, FS::IFile& file)
+{
+	PROFILE_FUNCTION();
+	TileHeader header;
+	if (!file.read(&header, sizeof(header))) return false;
+	if (header.m_magic != TILE_MAGIC) return false;
+	if (header.m_version > (uint32)FileVersion::LATEST) return false;
+	if (header.m_x + header.m_z * m_tiles_x != index) return false;
+
+	int samples = m_tile_size * m_tile_size;
+	size_t data_size = getTileMemorySize();
+	// the grass density of the oldest tiles is a copy of the splatmap weight and it is skipped,
+	// tiles saved after them and before GRASS_DENSITY have none
+	bool has_grass = header.m_version > (uint32)FileVersion::GRASS_DENSITY;
+	bool has_old_grass = header.m_version <= (uint32)FileVersion::REMOVED_GRASS;
+	size_t read_size = has_grass ? data_size : data_size - samples;
+	size_t file_size = has_grass || has_old_grass ? data_size : read_size;
+	if (file.size() != sizeof(header) + file_size) return false;
+
+	uint8* data = (uint8*)m_allocator.allocate(data_size);
+	if (!file.read(data, read_size))
+	{
+		m_allocator.deallocate(data);
+		return false;
+	}
+
+	Tile& tile = m_tiles[index];
+	tile.m_heights = (uint16*)data;
+	tile.m_splatmap = (uint32*)(data + samples * sizeof(uint16));
+	tile.m_grass = data + samples * (sizeof(uint16) + sizeof(uint32));
+	if (!has_grass) setMemory(tile.m_grass, 0xff, samples);
+	return true;
+}
+
+
+void TerrainTiles::unloadTile(int index)
+{
+	Tile& tile = m_tiles[index];
+	if (tile.m_state == Tile::State::READY)
+	{
+		m_tile_unloaded.invoke(index % m_tiles_x, index / m_tiles_x);
+		m_allocator.deallocate(tile.m_heights);
+		m_memory_usage -= getTileMemorySize();
+	}
+	tile.m_heights = nullptr;
+	tile.m_splatmap = nullptr;
+	tile.m_grass = nullptr;
+	tile.m_state = Tile::State::EMPTY;
+}
+
+
+void TerrainTiles::evict()
+{
+	while (m_memory_usage > m_memory_budget)
+	{
+		int lru = -1;
+		for (int i = 0; i < m_tiles.size(); ++i)
+		{
+			const Tile& tile = m_tiles[i];
+			if (tile.m_state != Tile::State::READY) continue;
+			if (tile.m_last_used_frame == m_frame) continue;
+			if (lru < 0 || tile.m_last_used_frame < m_tiles[lru].m_last_used_frame) lru = i;
+		}
+		// everything resident is in use this frame, the budget is too small
+		if (lru < 0) return;
+		unloadTile(lru);
+	}
+}
+
+
+float TerrainTiles::getSquaredDistance(int x, int z, const Vec2& pos) const
+{
+	float min_x = float(x * m_tile_size);
+	float min_z = float(z * m_tile_size);
+	float dx = Math::maxValue(0.0f, Math::maxValue(min_x - pos.x, pos.x - min_x - m_tile_size));
+	float dz = Math::maxValue(0.0f, Math::maxValue(min_z - pos.y, pos.y - min_z - m_tile_size));
+	return dx * dx + dz * dz;
+}
+
+
+void TerrainTiles::nextFrame()
+{
+	evict();
+	++m_frame;
+}
+
+
+void TerrainTiles::update(const Vec2& center, float radius)
+{
+	PROFILE_FUNCTION();
+	if (!isReady()) return;
+
+	int from_x = Math::clamp(int((center.x - radius) / m_tile_size), 0, m_tiles_x - 1);
+	int to_x = Math::clamp(int((center.x + radius) / m_tile_size), 0, m_tiles_x - 1);
+	int from_z = Math::clamp(int((center.y - radius) / m_tile_size), 0, m_tiles_z - 1);
+	int to_z = Math::clamp(int((center.y + radius) / m_tile_size), 0, m_tiles_z - 1);
+	float squared_radius = radius * radius;
+
+	for (int z = from_z; z <= to_z; ++z)
+	{
+		for (int x = from_x; x <= to_x; ++x)
+		{
+			if (getSquaredDistance(x, z, center) > squared_radius) continue;
+			m_tiles[x + z * m_tiles_x].m_last_used_frame = m_frame;
+		}
+	}
+
+	// nearest tiles first, the rest is requested in the following frames
+	int can_request = MAX_PENDING_REQUESTS - m_requests.size();
+	while (can_request > 0)
+	{
+		int best = -1;
+		float best_squared_dist = 0;
+		for (int z = from_z; z <= to_z; ++z)
+		{
+			for (int x = from_x; x <= to_x; ++x)
+			{
+				const Tile& tile = m_tiles[x + z * m_tiles_x];
+				if (tile.m_state != Tile::State::EMPTY) continue;
+				if (tile.m_last_used_frame != m_frame) continue;
+
+				float squared_dist = getSquaredDistance(x, z, center);
+				if (best < 0 || squared_dist < best_squared_dist)
+				{
+					best = x + z * m_tiles_x;
+					best_squared_dist = squared_dist;
+				}
+			}
+		}
+		if (best < 0) break;
+		requestFile(best);
+		--can_request;
+	}
+}
+
+
+const TerrainTiles::Tile* TerrainTiles::getTile(int x, int z) const
+{
+	if (x < 0 || z < 0 || x >= m_tiles_x || z >= m_tiles_z) return nullptr;
+	const Tile& tile = m_tiles[x + z * m_tiles_x];
+	return tile.m_state == Tile::State::READY ? &tile : nullptr;
+}
+
+
+uint16 TerrainTiles::getHeight(int x, int z) const
+{
+	if (x < 0 || z < 0) return 0;
+	const Tile* tile = getTile(x / m_tile_size, z / m_tile_size);
+	if (!tile) return 0;
+	return tile->m_heights[x % m_tile_size + (z % m_tile_size) * m_tile_size];
+}
+
+
+uint32 TerrainTiles::getSplat(int x, int z) const
+{
+	if (x < 0 || z < 0) return 0;
+	const Tile* tile = getTile(x / m_tile_size, z / m_tile_size);
+	if (!tile) return 0;
+	return tile->m_splatmap[x % m_tile_size + (z % m_tile_size) * m_tile_size];
+}
+
+
+uint8 TerrainTiles::getGrassDensity(int x, int z) const
+{
+	if (x < 0 || z < 0) return 0;
+	const Tile* tile = getTile(x / m_tile_size, z / m_tile_size);
+	if (!tile) return 0;
+	return tile->m_grass[x % m_tile_size + (z % m_tile_size) * m_tile_size];
+}
+
+
+} // namespace Lumix
@@ -0,0 +1,158 @@
+#pragma once
+
+
+#include "core/array.h"
+#include "core/delegate_list.h"
+#include "core/path.h"
+#include "core/vec.h"
+
+
+namespace Lumix
+{
+
+
+class IAllocator;
+class Texture;
+
+
+namespace FS
+{
+class FileSystem;
+class IFile;
+}
+
+
+class LUMIX_RENDERER_API TerrainTiles
+{
+public:
+#pragma pack(1)
+	struct FileHeader
+	{
+		uint32 m_magic;
+		uint32 m_version;
+		int32 m_tile_size;
+		int32 m_tiles_x;
+		int32 m_tiles_z;
+	};
+
+	struct TileHeader
+	{
+		uint32 m_magic;
+		uint32 m_version;
+		int32 m_x;
+		int32 m_z;
+	};
+#pragma pack()
+
+	enum class FileVersion : uint32
+	{
+		FIRST,
+		// grass density was a copy of the splatmap weight
+		REMOVED_GRASS,
+		// grass density is a mask independent of the splatmap
+		GRASS_DENSITY,
+
+		LATEST // keep this last
+	};
+
+	struct Tile
+	{
+		enum class State : uint8
+		{
+			EMPTY,
+			LOADING,
+			READY,
+			FAILURE
+		};
+
+		uint16* m_heights;
+		uint32* m_splatmap;
+		uint8* m_grass;
+		uint32 m_last_used_frame;
+		State m_state;
+	};
+
+	typedef DelegateList<void(int, int)> TileCallback;
+	typedef DelegateList<void()> IndexCallback;
+
+public:
+	static const uint32 FILE_MAGIC = 0x5f4c5454; // == '_LTT'
+	static const uint32 TILE_MAGIC = 0x5f4c5449; // == '_LTI'
+
+	TerrainTiles(FS::FileSystem& file_system, IAllocator& allocator);
+	~TerrainTiles();
+
+	// grass_density is a single channel image, without it grass grows wherever the splatmap
+	// allows
+	static bool save(FS::FileSystem& file_system,
+		const Path& path,
+		int tile_size,
+		const Texture& heightmap,
+		const Texture& splatmap,
+		const uint8* grass_density,
+		int grass_width,
+		int grass_height,
+		IAllocator& allocator);
+
+	void load(const Path& path);
+	void clear();
+	bool isReady() const { return m_tile_size > 0; }
+	const Path& getPath() const { return m_path; }
+	int getTileSize() const { return m_tile_size; }
+	int getTilesX() const { return m_tiles_x; }
+	int getTilesZ() const { return m_tiles_z; }
+	int getWidth() const { return m_tile_size * m_tiles_x; }
+	int getHeight() const { return m_tile_size * m_tiles_z; }
+	size_t getTileMemorySize() const;
+	size_t getMemoryUsage() const { return m_memory_usage; }
+	size_t getMemoryBudget() const { return m_memory_budget; }
+	void setMemoryBudget(size_t bytes);
+	// call once per frame after all update() calls, tiles not used since the last nextFrame()
+	// are evicted first when over budget
+	void nextFrame();
+	// marks tiles in radius as used in this frame and requests the missing ones,
+	// can be called for more points in one frame
+	void update(const Vec2& center, float radius);
+	const Tile* getTile(int x, int z) const;
+	uint16 getHeight(int x, int z) const;
+	uint32 getSplat(int x, int z) const;
+	uint8 getGrassDensity(int x, int z) const;
+	// the size is known once the index is loaded
+	IndexCallback& indexLoaded() { return m_index_loaded; }
+	TileCallback& tileLoaded() { return m_tile_loaded; }
+	TileCallback& tileUnloaded() { return m_tile_unloaded; }
+
+private:
+	struct LoadRequest;
+
+	TerrainTiles(const TerrainTiles&);
+	void operator=(const TerrainTiles&);
+
+	void onFileLoaded(LoadRequest& request, FS::IFile& file, bool success);
+	bool loadIndex(FS::IFile& file);
+	bool loadTile(int index, FS::IFile& file);
+	void requestFile(int tile_index);
+	void unloadTile(int index);
+	void evict();
+	float getSquaredDistance(int x, int z, const Vec2& pos) const;
+	static void getTilePath(const Path& path, int x, int z, char* out, int max_size);
+
+private:
+	IAllocator& m_allocator;
+	FS::FileSystem& m_file_system;
+	Path m_path;
+	Array<Tile> m_tiles;
+	Array<LoadRequest*> m_requests;
+	int m_tile_size;
+	int m_tiles_x;
+	int m_tiles_z;
+	size_t m_memory_usage;
+	size_t m_memory_budget;
+	uint32 m_frame;
+	IndexCallback m_index_loaded;
+	TileCallback m_tile_loaded;
+	TileCallback m_tile_unloaded;
+};
+
+
+} // namespace Lumix
@@ -15,7 +15,50 @@ namespace Lumix
 {
 
 
+static const int INITIAL_STREAMED_SIZE = 64;
+static const uint32 DDS_MAGIC = 0x20534444; // == 'DDS '
+static const uint32 DDS_FOURCC_DXT1 = 0x31545844; // == 'DXT1'
+static const uint32 DDS_FOURCC_DXT3 = 0x33545844; // == 'DXT3'
+static const uint32 DDS_FOURCC_DXT5 = 0x35545844; // == 'DXT5'
+static const uint32 DDS_PIXEL_FORMAT_FOURCC = 0x4;
+static const uint32 DDS_CAPS2_CUBEMAP = 0x200;
+static const uint32 DDS_CAPS2_VOLUME = 0x200000;
+
+
 #pragma pack(1)
+struct DDSPixelFormat
+{
+	uint32 size;
+	uint32 flags;
+	uint32 four_cc;
+	uint32 rgb_bit_count;
+	uint32 r_mask;
+	uint32 g_mask;
+	uint32 b_mask;
+	uint32 a_mask;
+};
+
+
+struct DDSHeader
+{
+	uint32 magic;
+	uint32 size;
+	uint32 flags;
+	uint32 height;
+	uint32 width;
+	uint32 pitch_or_linear_size;
+	uint32 depth;
+	uint32 mip_map_count;
+	uint32 reserved1[11];
+	DDSPixelFormat pixel_format;
+	uint32 caps;
+	uint32 caps2;
+	uint32 caps3;
+	uint32 caps4;
+	uint32 reserved2;
+};
+
+
 struct TGAHeader
 {
 	char idLength;
@@ -34,6 +77,58 @@ struct TGAHeader
 #pragma pack()
 
 
+struct Texture::MipRequest
+{
+	MipRequest(Texture& owner, int top_mip)
+		: m_owner(&owner)
+		, m_allocator(owner.m_allocator)
+		, m_top_mip(top_mip)
+	{
+	}
+
+
+	void fileLoaded(FS::IFile& file, bool success)
+	{
+		if (m_owner) m_owner->onMipsLoaded(*this, file, success);
+		IAllocator& allocator = m_allocator;
+		LUMIX_DELETE(allocator, this);
+	}
+
+
+	Texture* m_owner;
+	IAllocator& m_allocator;
+	int m_top_mip;
+};
+
+
+static bool getDDSBlockFormat(const DDSHeader& header,
+	bgfx::TextureFormat::Enum* format,
+	int* block_size)
+{
+	if (header.magic != DDS_MAGIC) return false;
+	if ((header.pixel_format.flags & DDS_PIXEL_FORMAT_FOURCC) == 0) return false;
+	if ((header.caps2 & (DDS_CAPS2_CUBEMAP | DDS_CAPS2_VOLUME)) != 0) return false;
+	if (header.mip_map_count < 2) return false;
+
+	switch (header.pixel_format.four_cc)
+	{
+		case DDS_FOURCC_DXT1:
+			*format = bgfx::TextureFormat::BC1;
+			*block_size = 8;
+			return true;
+		case DDS_FOURCC_DXT3:
+			*format = bgfx::TextureFormat::BC2;
+			*block_size = 16;
+			return true;
+		case DDS_FOURCC_DXT5:
+			*format = bgfx::TextureFormat::BC3;
+			*block_size = 16;
+			return true;
+		default: return false;
+	}
+}
+
+
 Texture::Texture(const Path& path,
 				 ResourceManager& resource_manager,
 				 IAllocator& allocator)
@@ -47,6 +142,14 @@ Texture::Texture(const Path& path,
 	m_atlas_size = -1;
 	m_flags = 0;
 	m_texture_handle = BGFX_INVALID_HANDLE;
+	m_decode_task = nullptr;
+	m_mip_request = nullptr;
+	m_mip_count = 0;
+	m_top_mip = 0;
+	m_requested_size = 0;
+	m_block_size = 0;
+	m_format = bgfx::TextureFormat::Unknown;
+	m_resident_size = 0;
 }
 
 
@@ -354,6 +457,98 @@ void Texture::onDataUpdated(int x, int y, int w, int h)
 }
 
 
+static void releaseMemory(void* ptr, void* user_data)
+{
+	static_cast<IAllocator*>(user_data)->deallocate(ptr);
+}
+
+
+struct DetachedFileBuffer
+{
+	void* data;
+	IAllocator* data_allocator;
+	IAllocator* allocator;
+};
+
+
+static void releaseFileBuffer(void*, void* user_data)
+{
+	auto* buffer = static_cast<DetachedFileBuffer*>(user_data);
+	buffer->data_allocator->deallocate(buffer->data);
+	LUMIX_DELETE(*buffer->allocator, buffer);
+}
+
+
+static void decodeRaw(const uint8* src, int width, int height, float* dst)
+{
+	const uint16* src_mem = (const uint16*)src;
+	for (int i = 0; i < width * height; ++i)
+	{
+		dst[i] = src_mem[i] / 65535.0f;
+	}
+}
+
+
+// Targa is BGR, swap to RGB and add alpha
+static void decodeTGA(const uint8* src, int width, int height, int color_mode, uint8* dst)
+{
+	for (int y = 0; y < height; ++y)
+	{
+		const uint8* read = src + y * width * color_mode;
+		uint8* write = dst + y * width * 4;
+		for (int x = 0; x < width; ++x)
+		{
+			write[0] = read[2];
+			write[1] = read[1];
+			write[2] = read[0];
+			write[3] = color_mode == 4 ? read[3] : 255;
+			read += color_mode;
+			write += 4;
+		}
+	}
+}
+
+
+void Texture::decode(TextureDecodeTask& task)
+{
+	switch (task.format)
+	{
+		case TextureDecodeTask::Format::RAW:
+			decodeRaw(task.src, task.width, task.height, (float*)task.dst);
+			break;
+		case TextureDecodeTask::Format::TGA:
+			decodeTGA(task.src, task.width, task.height, task.src_bytes_per_pixel, task.dst);
+			break;
+		default: ASSERT(false); break;
+	}
+}
+
+
+void Texture::onDecoded(TextureDecodeTask& task)
+{
+	PROFILE_FUNCTION();
+	ASSERT(m_decode_task == &task);
+	m_decode_task = nullptr;
+
+	auto* manager = static_cast<TextureManager*>(m_resource_manager.get(ResourceManager::TEXTURE));
+	IAllocator& allocator = manager->getAllocator();
+	const bgfx::Memory* mem = bgfx::makeRef(task.dst, task.dst_size, releaseMemory, &allocator);
+	task.dst = nullptr;
+
+	auto format = task.format == TextureDecodeTask::Format::RAW ? bgfx::TextureFormat::R32F
+																: bgfx::TextureFormat::RGBA8;
+	m_texture_handle =
+		bgfx::createTexture2D((uint16_t)m_width, (uint16_t)m_height, 1, format, m_flags, mem);
+	if (!bgfx::isValid(m_texture_handle))
+	{
+		g_log_error.log("renderer") << "Could not create texture " << getPath().c_str();
+	}
+
+	--m_empty_dep_count;
+	checkState();
+}
+
+
 bool Texture::loadRaw(FS::IFile& file)
 {
 	PROFILE_FUNCTION();
@@ -361,34 +556,27 @@ bool Texture::loadRaw(FS::IFile& file)
 	m_BPP = 2;
 	m_width = (int)sqrt(size / m_BPP);
 	m_height = m_width;
+	m_depth = 1;
 
 	if (m_data_reference)
 	{
 		m_data.resize((int)size);
 		file.read(&m_data[0], size);
-	}
-
-	const uint16* src_mem = (const uint16*)file.getBuffer();
-	const bgfx::Memory* mem = bgfx::alloc(m_width * m_height * sizeof(float));
-	float* dst_mem = (float*)mem->data;
 
-	for (int i = 0; i < m_width * m_height; ++i)
-	{
-		dst_mem[i] = src_mem[i] / 65535.0f;
+		const bgfx::Memory* mem = bgfx::alloc(m_width * m_height * sizeof(float));
+		decodeRaw((const uint8*)file.getBuffer(), m_width, m_height, (float*)mem->data);
+		m_texture_handle = bgfx::createTexture2D(
+			(uint16_t)m_width, (uint16_t)m_height, 1, bgfx::TextureFormat::R32F, m_flags, mem);
+		return bgfx::isValid(m_texture_handle);
 	}
 
-	m_texture_handle = bgfx::createTexture2D(
-		(uint16_t)m_width, (uint16_t)m_height, 1, bgfx::TextureFormat::R32F, m_flags, nullptr);
-	bgfx::updateTexture2D(
-		m_texture_handle,
-		0,
-		0,
-		0,
-		(uint16_t)m_width,
-		(uint16_t)m_height,
-		mem);
-	m_depth = 1;
-	return bgfx::isValid(m_texture_handle);
+	auto* manager = static_cast<TextureManager*>(m_resource_manager.get(ResourceManager::TEXTURE));
+	int dst_size = m_width * m_height * sizeof(float);
+	m_decode_task = manager->decodeAsync(*this, file, 0, TextureDecodeTask::Format::RAW, dst_size);
+	m_decode_task->width = m_width;
+	m_decode_task->height = m_height;
+	++m_empty_dep_count;
+	return true;
 }
 
 
@@ -412,56 +600,39 @@ bool Texture::loadTGA(FS::IFile& file)
 		return false;
 	}
 
+	if (file.size() < sizeof(header) + header.width * header.height * color_mode)
+	{
+		g_log_error.log("renderer") << "Truncated texture " << getPath().c_str();
+		return false;
+	}
+
 	m_width = header.width;
 	m_height = header.height;
-	TextureManager* manager = static_cast<TextureManager*>(
-		getResourceManager().get(ResourceManager::TEXTURE));
+	m_BPP = 4;
+	m_depth = 1;
+	size_t src_offset = sizeof(header);
 	if (m_data_reference)
 	{
 		m_data.resize(image_size);
+		const uint8* src = (const uint8*)file.getBuffer() + src_offset;
+		decodeTGA(src, m_width, m_height, color_mode, &m_data[0]);
+		m_texture_handle = bgfx::createTexture2D(header.width,
+			header.height,
+			1,
+			bgfx::TextureFormat::RGBA8,
+			m_flags,
+			bgfx::copy(&m_data[0], image_size));
+		return bgfx::isValid(m_texture_handle);
 	}
-	uint8* image_dest = m_data_reference
-							  ? &m_data[0]
-							  : (uint8*)manager->getBuffer(image_size);
-
-	// Targa is BGR, swap to RGB, add alpha and flip Y axis
-	for (long y = 0; y < header.height; y++)
-	{
-		long read_index = y * header.width * color_mode;
-		long write_index = ((header.imageDescriptor & 32) != 0)
-							   ? read_index
-							   : y * header.width * 4;
-		for (long x = 0; x < header.width; x++)
-		{
-			file.read(&image_dest[write_index + 2], sizeof(uint8));
-			file.read(&image_dest[write_index + 1], sizeof(uint8));
-			file.read(&image_dest[write_index + 0], sizeof(uint8));
-			if (color_mode == 4)
-				file.read(&image_dest[write_index + 3], sizeof(uint8));
-			else
-				image_dest[write_index + 3] = 255;
-			write_index += 4;
-		}
-	}
-	m_BPP = 4;
 
-	m_texture_handle = bgfx::createTexture2D(
-		header.width,
-		header.height,
-		1,
-		bgfx::TextureFormat::RGBA8,
-		m_flags,
-		0);
-	bgfx::updateTexture2D(
-		m_texture_handle,
-		0,
-		0,
-		0,
-		header.width,
-		header.height,
-		bgfx::copy(image_dest, header.width * header.height * 4));
-	m_depth = 1;
-	return bgfx::isValid(m_texture_handle);
+	auto* manager = static_cast<TextureManager*>(m_resource_manager.get(ResourceManager::TEXTURE));
+	m_decode_task =
+		manager->decodeAsync(*this, file, src_offset, TextureDecodeTask::Format::TGA, image_size);
+	m_decode_task->width = m_width;
+	m_decode_task->height = m_height;
+	m_decode_task->src_bytes_per_pixel = color_mode;
+	++m_empty_dep_count;
+	return true;
 }
 
 
@@ -485,14 +656,154 @@ void Texture::removeDataReference()
 }
 
 
+int Texture::getTopMipForSize(int size) const
+{
+	int dim = Math::maxValue(m_width, m_height);
+	for (int mip = m_mip_count - 1; mip > 0; --mip)
+	{
+		if ((dim >> mip) >= size) return mip;
+	}
+	return 0;
+}
+
+
+size_t Texture::getMipChainSize(int top_mip) const
+{
+	size_t size = 0;
+	for (int mip = top_mip; mip < m_mip_count; ++mip)
+	{
+		int w = Math::maxValue(1, m_width >> mip);
+		int h = Math::maxValue(1, m_height >> mip);
+		size += ((w + 3) / 4) * ((h + 3) / 4) * m_block_size;
+	}
+	return size;
+}
+
+
+bool Texture::createStreamedTexture(FS::IFile& file, int top_mip)
+{
+	PROFILE_FUNCTION();
+	top_mip = Math::clamp(top_mip, 0, m_mip_count - 1);
+	size_t size = getMipChainSize(top_mip);
+	size_t offset = sizeof(DDSHeader) + getMipChainSize(0) - size;
+	const uint8* file_data = (const uint8*)file.getBuffer();
+	if (!file_data || offset + size > file.size())
+	{
+		g_log_error.log("renderer") << "Truncated texture " << getPath().c_str();
+		return false;
+	}
+
+	// the mips are uploaded straight from the file's buffer, which bgfx releases afterwards
+	const bgfx::Memory* mem;
+	IAllocator* data_allocator = nullptr;
+	void* data = file.detachBuffer(&data_allocator);
+	if (data)
+	{
+		auto* detached = LUMIX_NEW(m_allocator, DetachedFileBuffer);
+		detached->data = data;
+		detached->data_allocator = data_allocator;
+		detached->allocator = &m_allocator;
+		mem = bgfx::makeRef((const uint8*)data + offset, (uint32)size, releaseFileBuffer, detached);
+	}
+	else
+	{
+		mem = bgfx::copy(file_data + offset, (uint32)size);
+	}
+
+	auto handle = bgfx::createTexture2D((uint16_t)Math::maxValue(1, m_width >> top_mip),
+		(uint16_t)Math::maxValue(1, m_height >> top_mip),
+		(uint8_t)(m_mip_count - top_mip),
+		m_format,
+		m_flags,
+		mem);
+	if (!bgfx::isValid(handle)) return false;
+
+	if (bgfx::isValid(m_texture_handle)) bgfx::destroyTexture(m_texture_handle);
+	m_texture_handle = handle;
+	m_top_mip = top_mip;
+	m_resident_size = size;
+	return true;
+}
+
+
+bool Texture::loadStreamedDDS(FS::IFile& file)
+{
+	const DDSHeader& header = *(const DDSHeader*)file.getBuffer();
+	getDDSBlockFormat(header, &m_format, &m_block_size);
+	m_width = header.width;
+	m_height = header.height;
+	m_depth = 1;
+	m_BPP = -1;
+	m_mip_count = header.mip_map_count;
+
+	// only the low mips are uploaded now, the rest is streamed in once the texture is drawn
+	if (!createStreamedTexture(file, getTopMipForSize(INITIAL_STREAMED_SIZE)))
+	{
+		m_mip_count = 0;
+		return false;
+	}
+
+	auto* manager = static_cast<TextureManager*>(m_resource_manager.get(ResourceManager::TEXTURE));
+	manager->addStreamedTexture(*this);
+	return true;
+}
+
+
+void Texture::streamMips(int top_mip)
+{
+	if (m_mip_request || !isReady() || top_mip == m_top_mip) return;
+
+	FS::FileSystem& fs = m_resource_manager.getFileSystem();
+	m_mip_request = LUMIX_NEW(m_allocator, MipRequest)(*this, top_mip);
+	FS::ReadCallback cb;
+	cb.bind<MipRequest, &MipRequest::fileLoaded>(m_mip_request);
+	// the I/O thread reads the file, so the render thread does not wait for it while uploading
+	int mode = FS::Mode::OPEN_AND_READ | FS::Mode::PREFETCH;
+	if (fs.openAsync(fs.getDefaultDevice(), getPath(), mode, cb) == FS::INVALID_ASYNC_HANDLE)
+	{
+		LUMIX_DELETE(m_allocator, m_mip_request);
+		m_mip_request = nullptr;
+	}
+}
+
+
+void Texture::onMipsLoaded(MipRequest& request, FS::IFile& file, bool success)
+{
+	ASSERT(m_mip_request == &request);
+	m_mip_request = nullptr;
+	if (!success || !file.getBuffer())
+	{
+		g_log_warning.log("renderer") << "Could not stream mips of " << getPath().c_str();
+		return;
+	}
+
+	createStreamedTexture(file, request.m_top_mip);
+}
+
+
+int Texture::getStreamingTopMip() const
+{
+	return m_mip_request ? m_mip_request->m_top_mip : m_top_mip;
+}
+
+
 bool Texture::loadDDS(FS::IFile& file)
 {
+	bgfx::TextureFormat::Enum format;
+	int block_size;
+	if (file.getBuffer() && file.size() >= sizeof(DDSHeader) &&
+		getDDSBlockFormat(*(const DDSHeader*)file.getBuffer(), &format, &block_size))
+	{
+		return loadStreamedDDS(file);
+	}
+
+	uint32 size = (uint32)file.size();
+	IAllocator* allocator = nullptr;
+	void* buffer = file.detachBuffer(&allocator);
+	const bgfx::Memory* mem = buffer ? bgfx::makeRef(buffer, size, releaseMemory, allocator)
+									 : bgfx::copy(file.getBuffer(), size);
 	bgfx::TextureInfo info;
-	m_texture_handle =
-		bgfx::createTexture(bgfx::copy(file.getBuffer(), (uint32)file.size()),
-							m_flags,
-							0,
-							&info);
+	m_texture_handle = bgfx::createTexture(mem, m_flags, 0, &info);
 	m_BPP = -1;
 	m_width = info.width;
 	m_height = info.height;
@@ -507,6 +818,7 @@ bool Texture::load(FS::IFile& file)
 
 	const char* path = getPath().c_str();
 	size_t len = getPath().length();
+	size_t file_size = file.size();
 	bool loaded = false;
 	if (len > 3 && compareString(path + len - 4, ".dds") == 0)
 	{
@@ -526,13 +838,33 @@ bool Texture::load(FS::IFile& file)
 		return false;
 	}
 
-	m_size = file.size();
+	m_size = file_size;
 	return true;
 }
 
 
 void Texture::unload(void)
 {
+	if (m_mip_request)
+	{
+		// the request can not be cancelled, it deletes itself once finished
+		m_mip_request->m_owner = nullptr;
+		m_mip_request = nullptr;
+	}
+	if (m_mip_count > 0)
+	{
+		auto* manager = static_cast<TextureManager*>(m_resource_manager.get(ResourceManager::TEXTURE));
+		manager->removeStreamedTexture(*this);
+		m_mip_count = 0;
+		m_top_mip = 0;
+		m_resident_size = 0;
+	}
+	if (m_decode_task)
+	{
+		auto* manager = static_cast<TextureManager*>(m_resource_manager.get(ResourceManager::TEXTURE));
+		manager->cancelDecoding(*m_decode_task);
+		m_decode_task = nullptr;
+	}
 	if (bgfx::isValid(m_texture_handle))
 	{
 		bgfx::destroyTexture(m_texture_handle);
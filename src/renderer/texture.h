@@ -12,6 +12,8 @@ namespace FS
 	class FileSystem;
 }
 
+struct TextureDecodeTask;
+
 
 class LUMIX_RENDERER_API Texture : public Resource
 {
@@ -44,8 +46,32 @@ class LUMIX_RENDERER_API Texture : public Resource
 		int getAtlasSize() const { return m_atlas_size; }
 		void setAtlasSize(int size) { m_atlas_size = size; }
 
+		static void decode(TextureDecodeTask& task);
+		void onDecoded(TextureDecodeTask& task);
+
+		// mip streaming, only 2D DXT textures with mips are streamed
+		bool isStreamed() const { return m_mip_count > 0; }
+		void requestSize(int size) { if (size > m_requested_size) m_requested_size = size; }
+		int getRequestedSize() const { return m_requested_size; }
+		void clearRequestedSize() { m_requested_size = 0; }
+		int getMipCount() const { return m_mip_count; }
+		int getTopMip() const { return m_top_mip; }
+		int getTopMipForSize(int size) const;
+		size_t getMipChainSize(int top_mip) const;
+		size_t getResidentSize() const { return m_resident_size; }
+		bool isStreamingMips() const { return m_mip_request != nullptr; }
+		// top mip of the texture once the current request finishes
+		int getStreamingTopMip() const;
+		// the new mips replace the current ones once they are read
+		void streamMips(int top_mip);
+
 	private:
+		struct MipRequest;
+
 		bool load3D(FS::IFile& file);
+		bool loadStreamedDDS(FS::IFile& file);
+		bool createStreamedTexture(FS::IFile& file, int top_mip);
+		void onMipsLoaded(MipRequest& request, FS::IFile& file, bool success);
 		bool loadDDS(FS::IFile& file);
 		bool loadTGA(FS::IFile& file);
 		bool loadRaw(FS::IFile& file);
@@ -65,6 +91,14 @@ class LUMIX_RENDERER_API Texture : public Resource
 		uint32 m_flags;
 		Array<uint8> m_data;
 		bgfx::TextureHandle m_texture_handle;
+		TextureDecodeTask* m_decode_task;
+		MipRequest* m_mip_request;
+		int m_mip_count;
+		int m_top_mip;
+		int m_requested_size;
+		int m_block_size;
+		bgfx::TextureFormat::Enum m_format;
+		size_t m_resident_size;
 };
 
 
@@ -1,14 +1,31 @@
 #include "lumix.h"
 #include "renderer/texture_manager.h"
 
+#include "core/fs/ifile.h"
+#include "core/math_utils.h"
+#include "core/mt/atomic.h"
+#include "core/mt/thread.h"
+#include "core/mtjd/generic_job.h"
+#include "core/mtjd/manager.h"
+#include "core/profiler.h"
 #include "core/resource.h"
 #include "renderer/texture.h"
 
 namespace Lumix
 {
-	TextureManager::TextureManager(IAllocator& allocator)
+	static const size_t DEFAULT_MEMORY_BUDGET = 256 * 1024 * 1024;
+	static const int MAX_MIP_REQUESTS = 4;
+	static const uint32 UNUSED_FRAMES_TO_SHRINK = 60;
+
+
+	TextureManager::TextureManager(MTJD::Manager& mtjd_manager, IAllocator& allocator)
 		: ResourceManagerBase(allocator)
 		, m_allocator(allocator)
+		, m_mtjd_manager(mtjd_manager)
+		, m_decode_tasks(allocator)
+		, m_streamed_textures(allocator)
+		, m_memory_budget(DEFAULT_MEMORY_BUDGET)
+		, m_frame(0)
 	{
 		m_buffer = nullptr;
 		m_buffer_size = -1;
@@ -17,6 +34,11 @@ namespace Lumix
 
 	TextureManager::~TextureManager()
 	{
+		for (auto* task : m_decode_tasks)
+		{
+			while (!task->is_done) MT::yield();
+			destroyTask(task);
+		}
 		m_allocator.deallocate(m_buffer);
 	}
 
@@ -46,4 +68,224 @@ namespace Lumix
 		}
 		return m_buffer;
 	}
-}
\ No newline at end of file
+
+
+	TextureDecodeTask* TextureManager::decodeAsync(Texture& texture,
+		FS::IFile& file,
+		size_t src_offset,
+		TextureDecodeTask::Format format,
+		int dst_size)
+	{
+		auto* task = LUMIX_NEW(m_allocator, TextureDecodeTask);
+		task->texture = &texture;
+		task->format = format;
+		task->is_done = 0;
+		task->dst_size = dst_size;
+		task->dst = (uint8*)m_allocator.allocate(dst_size);
+
+		// take the file's buffer if possible, the file is closed right after the load callback
+		task->src_allocator = nullptr;
+		task->src_buffer = file.detachBuffer(&task->src_allocator);
+		if (!task->src_buffer)
+		{
+			size_t size = file.size();
+			task->src_allocator = &m_allocator;
+			task->src_buffer = m_allocator.allocate(size);
+			file.seek(FS::SeekMode::BEGIN, 0);
+			file.read(task->src_buffer, size);
+		}
+		task->src = (const uint8*)task->src_buffer + src_offset;
+		m_decode_tasks.push(task);
+
+		auto* job = MTJD::makeJob(m_mtjd_manager,
+			[task]() {
+				PROFILE_BLOCK("decode texture");
+				Texture::decode(*task);
+				MT::atomicIncrement(&task->is_done);
+			},
+			m_allocator);
+		m_mtjd_manager.schedule(job);
+		return task;
+	}
+
+
+	void TextureManager::cancelDecoding(TextureDecodeTask& task)
+	{
+		task.texture = nullptr;
+	}
+
+
+	void TextureManager::update()
+	{
+		PROFILE_FUNCTION();
+		for (int i = m_decode_tasks.size() - 1; i >= 0; --i)
+		{
+			TextureDecodeTask* task = m_decode_tasks[i];
+			if (!task->is_done) continue;
+
+			if (task->texture) task->texture->onDecoded(*task);
+			destroyTask(task);
+			m_decode_tasks.eraseFast(i);
+		}
+
+		updateStreaming();
+	}
+
+
+	void TextureManager::addStreamedTexture(Texture& texture)
+	{
+		StreamedTexture& streamed = m_streamed_textures.pushEmpty();
+		streamed.texture = &texture;
+		streamed.last_used_frame = m_frame;
+		streamed.has_size_request = false;
+	}
+
+
+	void TextureManager::removeStreamedTexture(Texture& texture)
+	{
+		for (int i = 0, c = m_streamed_textures.size(); i < c; ++i)
+		{
+			if (m_streamed_textures[i].texture == &texture)
+			{
+				m_streamed_textures.eraseFast(i);
+				return;
+			}
+		}
+	}
+
+
+	size_t TextureManager::getStreamedMemory() const
+	{
+		size_t size = 0;
+		for (const StreamedTexture& streamed : m_streamed_textures)
+		{
+			size += streamed.texture->getResidentSize();
+		}
+		return size;
+	}
+
+
+	size_t TextureManager::evict(size_t needed, const Texture* except, int& requests)
+	{
+		size_t freed = 0;
+		while (freed < needed && requests < MAX_MIP_REQUESTS)
+		{
+			// the least recently used texture drops as many mips as needed in one request
+			StreamedTexture* lru = nullptr;
+			for (StreamedTexture& streamed : m_streamed_textures)
+			{
+				Texture* texture = streamed.texture;
+				if (texture == except || texture->isStreamingMips()) continue;
+				if (texture->getTopMip() >= texture->getMipCount() - 1) continue;
+				if (streamed.last_used_frame == m_frame) continue;
+				if (!lru || streamed.last_used_frame < lru->last_used_frame) lru = &streamed;
+			}
+			if (!lru) break;
+
+			Texture* texture = lru->texture;
+			int top_mip = texture->getTopMip();
+			size_t texture_freed = 0;
+			while (freed + texture_freed < needed && top_mip < texture->getMipCount() - 1)
+			{
+				++top_mip;
+				texture_freed = texture->getResidentSize() - texture->getMipChainSize(top_mip);
+			}
+			texture->streamMips(top_mip);
+			if (!texture->isStreamingMips()) break;
+			freed += texture_freed;
+			++requests;
+		}
+		return freed;
+	}
+
+
+	void TextureManager::updateStreaming()
+	{
+		PROFILE_FUNCTION();
+		++m_frame;
+
+		// memory is charged when the new texture replaces the old one, until then requests
+		// which grow textures are pending and requests which shrink them free nothing yet
+		size_t resident = 0;
+		size_t growing = 0;
+		size_t shrinking = 0;
+		int requests = 0;
+		for (StreamedTexture& streamed : m_streamed_textures)
+		{
+			Texture* texture = streamed.texture;
+			resident += texture->getResidentSize();
+			if (texture->isStreamingMips())
+			{
+				++requests;
+				size_t new_size = texture->getMipChainSize(texture->getStreamingTopMip());
+				if (new_size > texture->getResidentSize())
+				{
+					growing += new_size - texture->getResidentSize();
+				}
+				else
+				{
+					shrinking += texture->getResidentSize() - new_size;
+				}
+			}
+			if (texture->getRequestedSize() > 0) streamed.has_size_request = true;
+			// only meshes request sizes, other users need all the mips
+			if (!streamed.has_size_request)
+			{
+				texture->requestSize(Math::maxValue(texture->getWidth(), texture->getHeight()));
+			}
+			if (texture->getRequestedSize() > 0) streamed.last_used_frame = m_frame;
+		}
+
+		for (StreamedTexture& streamed : m_streamed_textures)
+		{
+			Texture* texture = streamed.texture;
+			int requested_size = texture->getRequestedSize();
+			texture->clearRequestedSize();
+			if (requests >= MAX_MIP_REQUESTS) continue;
+			if (texture->isStreamingMips() || !texture->isReady()) continue;
+
+			int top_mip = texture->getTopMip();
+			if (requested_size > 0)
+			{
+				int wanted_mip = texture->getTopMipForSize(requested_size);
+				if (wanted_mip >= top_mip) continue;
+
+				size_t needed = texture->getMipChainSize(wanted_mip) - texture->getResidentSize();
+				if (resident + growing + needed > m_memory_budget)
+				{
+					// the texture grows in a later frame, once the evicted textures are replaced
+					size_t overflow = resident + growing + needed - m_memory_budget;
+					if (overflow > shrinking)
+					{
+						shrinking += evict(overflow - shrinking, texture, requests);
+					}
+					continue;
+				}
+				growing += needed;
+				texture->streamMips(wanted_mip);
+				if (texture->isStreamingMips()) ++requests;
+			}
+			else if (m_frame - streamed.last_used_frame > UNUSED_FRAMES_TO_SHRINK &&
+					 resident - shrinking > m_memory_budget &&
+					 top_mip < texture->getMipCount() - 1)
+			{
+				size_t freed = texture->getResidentSize() - texture->getMipChainSize(top_mip + 1);
+				texture->streamMips(top_mip + 1);
+				if (!texture->isStreamingMips()) continue;
+				shrinking += freed;
+				++requests;
+			}
+		}
+
+		PROFILE_INT("streamed textures", m_streamed_textures.size());
+		PROFILE_INT("streamed texture memory", (int)(resident / 1024));
+	}
+
+
+	void TextureManager::destroyTask(TextureDecodeTask* task)
+	{
+		task->src_allocator->deallocate(task->src_buffer);
+		m_allocator.deallocate(task->dst);
+		LUMIX_DELETE(m_allocator, task);
+	}
+}
@@ -1,24 +1,97 @@
 #pragma once
 
+#include "core/array.h"
 #include "core/resource_manager_base.h"
 
 namespace Lumix
 {
+	namespace FS
+	{
+		class IFile;
+	}
+
+	namespace MTJD
+	{
+		class Manager;
+	}
+
+	class Texture;
+
+
+	struct TextureDecodeTask
+	{
+		enum class Format : uint8
+		{
+			TGA,
+			RAW
+		};
+
+		Texture* texture; // nullptr if the texture was unloaded while decoding
+		const uint8* src;
+		void* src_buffer;
+		IAllocator* src_allocator;
+		uint8* dst;
+		int dst_size;
+		int width;
+		int height;
+		int src_bytes_per_pixel;
+		Format format;
+		volatile int32 is_done;
+	};
+
+
 	class LUMIX_RENDERER_API TextureManager : public ResourceManagerBase
 	{
 	public:
-		TextureManager(IAllocator& allocator);
+		TextureManager(MTJD::Manager& mtjd_manager, IAllocator& allocator);
 		~TextureManager();
 
 		uint8* getBuffer(int32 size);
+		IAllocator& getAllocator() { return m_allocator; }
+
+		// decodes on a worker thread, the texture is finished in update()
+		TextureDecodeTask* decodeAsync(Texture& texture,
+			FS::IFile& file,
+			size_t src_offset,
+			TextureDecodeTask::Format format,
+			int dst_size);
+		void cancelDecoding(TextureDecodeTask& task);
+		void update();
+
+		// mips of streamed textures are kept resident by their size on screen within the budget,
+		// textures without size requests, e.g. used by terrains or UI, are kept fully resident
+		void addStreamedTexture(Texture& texture);
+		void removeStreamedTexture(Texture& texture);
+		size_t getMemoryBudget() const { return m_memory_budget; }
+		void setMemoryBudget(size_t bytes) { m_memory_budget = bytes; }
+		size_t getStreamedMemory() const;
 
 	protected:
 		Resource* createResource(const Path& path) override;
 		void destroyResource(Resource& resource) override;
 
+	private:
+		struct StreamedTexture
+		{
+			Texture* texture;
+			uint32 last_used_frame;
+			bool has_size_request;
+		};
+
+		void destroyTask(TextureDecodeTask* task);
+		void updateStreaming();
+		// starts requests which drop mips of textures unused in this frame, returns the size
+		// they free once they are finished
+		size_t evict(size_t needed, const Texture* except, int& requests);
+
 	private:
 		IAllocator& m_allocator;
+		MTJD::Manager& m_mtjd_manager;
 		uint8* m_buffer;
 		int32 m_buffer_size;
+		Array<TextureDecodeTask*> m_decode_tasks;
+		Array<StreamedTexture> m_streamed_textures;
+		size_t m_memory_budget;
+		uint32 m_frame;
 	};
-}
\ No newline at end of file
+}
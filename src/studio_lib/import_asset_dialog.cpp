@@ -2,12 +2,15 @@
 #include "assimp/postprocess.h"
 #include "assimp/ProgressHandler.hpp"
 #include "assimp/scene.h"
+#include "core/blob.h"
 #include "core/crc32.h"
 #include "core/FS/ifile.h"
 #include "core/FS/file_system.h"
 #include "core/FS/os_file.h"
 #include "core/log.h"
 #include "core/MT/task.h"
+#include "core/MTJD/generic_job.h"
+#include "core/MTJD/group.h"
 #include "core/path_utils.h"
 #include "core/system.h"
 #include "crnlib.h"
@@ -18,6 +21,7 @@
 #include "imgui/imgui.h"
 #include "platform_interface.h"
 #include "physics/physics_geometry_manager.h"
+#include "renderer/mesh_optimizer.h"
 #include "renderer/model.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb/stb_image.h"
@@ -27,22 +31,13 @@
 typedef StringBuilder<Lumix::MAX_PATH_LENGTH> PathBuilder;
 
 
-enum class VertexAttributeDef : Lumix::uint32
-{
-	POSITION,
-	FLOAT1,
-	FLOAT2,
-	FLOAT3,
-	FLOAT4,
-	INT1,
-	INT2,
-	INT3,
-	INT4,
-	SHORT2,
-	SHORT4,
-	BYTE4,
-	NONE
-};
+typedef Lumix::Model::VertexAttributeDef VertexAttributeDef;
+
+
+// generated LOD n is used up to LOD_DISTANCE_RADII * 2^n bounding radii from the camera
+static const float LOD_DISTANCE_RADII = 10.0f;
+// smaller meshes are drawn instanced as a whole, without culling their clusters
+static const int MIN_CLUSTERED_TRIANGLES = 4 * Lumix::MeshOptimizer::CLUSTER_TRIANGLES;
 
 
 struct DDSConvertCallbackData
@@ -370,6 +365,9 @@ struct ConvertTask : public Lumix::MT::Task
 		: Task(dialog.m_editor.getAllocator())
 		, m_dialog(dialog)
 		, m_filtered_meshes(dialog.m_editor.getAllocator())
+		, m_mesh_indices(dialog.m_editor.getAllocator())
+		, m_mesh_clusters(dialog.m_editor.getAllocator())
+		, m_generated_lod_count(0)
 		, m_scale(scale)
 	{
 	}
@@ -711,39 +709,83 @@ struct ConvertTask : public Lumix::MT::Task
 	}
 
 
-	void writeGeometry(Lumix::FS::IFile& file) const
+	static Lumix::uint16 floatToHalf(float value)
+	{
+		union
+		{
+			float f;
+			Lumix::uint32 ui32;
+		} un;
+		un.f = value;
+
+		Lumix::uint32 sign = (un.ui32 >> 16) & 0x8000;
+		Lumix::int32 exponent = Lumix::int32((un.ui32 >> 23) & 0xff) - 127 + 15;
+		Lumix::uint32 mantissa = un.ui32 & 0x7fffff;
+		if (exponent <= 0) return Lumix::uint16(sign);
+		if (exponent >= 31) return Lumix::uint16(sign | 0x7c00);
+
+		Lumix::uint32 half = sign | (exponent << 10) | (mantissa >> 13);
+		if (mantissa & 0x1000) ++half;
+		return Lumix::uint16(half);
+	}
+
+
+	void writeIndices(Lumix::FS::IFile& file) const
 	{
-		const aiScene* scene = m_dialog.m_importer.GetScene();
 		Lumix::int32 indices_count = 0;
-		int vertices_count = 0;
-		Lumix::int32 vertices_size = 0;
+		Lumix::int32 index_size = sizeof(Lumix::uint16);
 		for (auto* mesh : m_filtered_meshes)
 		{
-			indices_count += mesh->mNumFaces * 3;
-			vertices_count += mesh->mNumVertices;
-			vertices_size += mesh->mNumVertices * getVertexSize(mesh);
+			// indices are relative to the mesh
+			if (mesh->mNumVertices > 0xffff + 1) index_size = sizeof(Lumix::uint32);
+		}
+		for (auto& indices : m_mesh_indices)
+		{
+			indices_count += indices.size();
 		}
 
-		file.write((const char*)&indices_count, sizeof(indices_count));
-		Lumix::int32 polygon_idx = 0;
-		for (auto* mesh : m_filtered_meshes)
+		Lumix::OutputBlob blob(m_dialog.m_editor.getAllocator());
+		blob.reserve(indices_count * index_size);
+		for (auto& indices : m_mesh_indices)
 		{
-			for (unsigned int j = 0; j < mesh->mNumFaces; ++j)
+			for (Lumix::uint32 index : indices)
 			{
-				polygon_idx = mesh->mFaces[j].mIndices[0];
-				file.write((const char*)&polygon_idx, sizeof(polygon_idx));
-				polygon_idx = mesh->mFaces[j].mIndices[1];
-				file.write((const char*)&polygon_idx, sizeof(polygon_idx));
-				polygon_idx = mesh->mFaces[j].mIndices[2];
-				file.write((const char*)&polygon_idx, sizeof(polygon_idx));
+				if (index_size == sizeof(Lumix::uint16))
+				{
+					blob.write(Lumix::uint16(index));
+				}
+				else
+				{
+					blob.write(index);
+				}
 			}
 		}
 
-		file.write((const char*)&vertices_size, sizeof(vertices_size));
+		file.write((const char*)&index_size, sizeof(index_size));
+		file.write((const char*)&indices_count, sizeof(indices_count));
+		file.write(blob.getData(), blob.getSize());
+	}
+
+
+	void writeGeometry(Lumix::FS::IFile& file) const
+	{
+		const aiScene* scene = m_dialog.m_importer.GetScene();
+		int vertices_count = 0;
+		Lumix::int32 vertices_size = 0;
+		for (auto* mesh : m_filtered_meshes)
+		{
+			vertices_count += mesh->mNumVertices;
+			vertices_size += mesh->mNumVertices * getVertexSize(mesh);
+		}
+
+		writeIndices(file);
 
 		Lumix::Array<SkinInfo> skin_infos(m_dialog.m_editor.getAllocator());
 		fillSkinInfo(scene, skin_infos, vertices_count);
 
+		Lumix::OutputBlob blob(m_dialog.m_editor.getAllocator());
+		blob.reserve(vertices_size);
+
 		int skin_index = 0;
 		aiMatrix3x3 normal_matrix(scene->mRootNode->mTransformation);
 
@@ -754,9 +796,8 @@ struct ConvertTask : public Lumix::MT::Task
 			{
 				if (is_skinned)
 				{
-					file.write((const char*)skin_infos[skin_index].weights,
-						sizeof(skin_infos[skin_index].weights));
-					file.write((const char*)skin_infos[skin_index].bone_indices,
+					blob.write(skin_infos[skin_index].weights, sizeof(skin_infos[skin_index].weights));
+					blob.write(skin_infos[skin_index].bone_indices,
 						sizeof(skin_infos[skin_index].bone_indices));
 				}
 				++skin_index;
@@ -765,7 +806,7 @@ struct ConvertTask : public Lumix::MT::Task
 
 				Lumix::Vec3 position(v.x, v.y, v.z);
 				position *= m_scale;
-				file.write((const char*)&position, sizeof(position));
+				blob.write(position);
 
 				if (mesh->mColors[0])
 				{
@@ -775,25 +816,37 @@ struct ConvertTask : public Lumix::MT::Task
 					color[1] = Lumix::uint8(assimp_color.g * 255);
 					color[2] = Lumix::uint8(assimp_color.b * 255);
 					color[3] = Lumix::uint8(assimp_color.a * 255);
-					file.write(color, sizeof(color));
+					blob.write(color, sizeof(color));
 				}
 
 				auto normal = normal_matrix * mesh->mNormals[j];
 				Lumix::uint32 int_normal = packF4u(normal);
-				file.write((const char*)&int_normal, sizeof(int_normal));
+				blob.write(int_normal);
 
 				if (mesh->mTangents)
 				{
 					auto tangent = mesh->mTangents[j];
 					Lumix::uint32 int_tangent = packF4u(tangent);
-					file.write((const char*)&int_tangent, sizeof(int_tangent));
+					blob.write(int_tangent);
 				}
 
 				auto uv = mesh->mTextureCoords[0][j];
 				uv.y = -uv.y;
-				file.write((const char*)&uv, sizeof(uv.x) + sizeof(uv.y));
+				if (m_dialog.m_quantize_uvs)
+				{
+					blob.write(floatToHalf(uv.x));
+					blob.write(floatToHalf(uv.y));
+				}
+				else
+				{
+					blob.write(&uv, int(sizeof(uv.x) + sizeof(uv.y)));
+				}
 			}
 		}
+
+		// vertices are the last thing in the file, the engine hands them to the GPU as they are
+		file.write((const char*)&vertices_size, sizeof(vertices_size));
+		file.write(blob.getData(), blob.getSize());
 	}
 
 
@@ -807,15 +860,17 @@ struct ConvertTask : public Lumix::MT::Task
 	}
 
 
-	static int getVertexSize(const aiMesh* mesh)
+	int getVertexSize(const aiMesh* mesh) const
 	{
 		static const int POSITION_SIZE = sizeof(float) * 3;
 		static const int NORMAL_SIZE = sizeof(Lumix::uint8) * 4;
 		static const int TANGENT_SIZE = sizeof(Lumix::uint8) * 4;
 		static const int UV_SIZE = sizeof(float) * 2;
+		static const int HALF_UV_SIZE = sizeof(Lumix::uint16) * 2;
 		static const int COLOR_SIZE = sizeof(Lumix::uint8) * 4;
 		static const int BONE_INDICES_WEIGHTS_SIZE = sizeof(float) * 4 + sizeof(Lumix::uint16) * 4;
-		int size = POSITION_SIZE + NORMAL_SIZE + UV_SIZE;
+		int size = POSITION_SIZE + NORMAL_SIZE;
+		size += m_dialog.m_quantize_uvs ? HALF_UV_SIZE : UV_SIZE;
 		if (mesh->mTangents) size += TANGENT_SIZE;
 		if (mesh->mColors[0]) size += COLOR_SIZE;
 		if (isSkinned(mesh)) size += BONE_INDICES_WEIGHTS_SIZE;
@@ -868,57 +923,88 @@ struct ConvertTask : public Lumix::MT::Task
 	}
 
 
-	void writeMeshes(Lumix::FS::IFile& file) const
+	void writeMesh(Lumix::FS::IFile& file,
+		const aiMesh* mesh,
+		const char* mesh_name,
+		Lumix::int32 attribute_array_offset,
+		Lumix::int32 indices_offset,
+		Lumix::int32 mesh_tri_count) const
 	{
 		const aiScene* scene = m_dialog.m_importer.GetScene();
-		Lumix::int32 mesh_count = 0;
-		for (int i = 0; i < m_dialog.m_mesh_mask.size(); ++i)
-		{
-			if (m_dialog.m_mesh_mask[i]) ++mesh_count;
-		}
+		aiString material_name;
+		scene->mMaterials[mesh->mMaterialIndex]->Get(AI_MATKEY_NAME, material_name);
+		Lumix::int32 length = Lumix::stringLength(material_name.C_Str());
+		file.write((const char*)&length, sizeof(length));
+		file.write((const char*)material_name.C_Str(), length);
 
-		file.write((const char*)&mesh_count, sizeof(mesh_count));
-		Lumix::int32 attribute_array_offset = 0;
-		Lumix::int32 indices_offset = 0;
-		for (auto* mesh : m_filtered_meshes)
-		{
-			int vertex_size = getVertexSize(mesh);
-			aiString material_name;
-			scene->mMaterials[mesh->mMaterialIndex]->Get(AI_MATKEY_NAME, material_name);
-			Lumix::int32 length = Lumix::stringLength(material_name.C_Str());
-			file.write((const char*)&length, sizeof(length));
-			file.write((const char*)material_name.C_Str(), length);
+		file.write((const char*)&attribute_array_offset, sizeof(attribute_array_offset));
+		Lumix::int32 attribute_array_size = mesh->mNumVertices * getVertexSize(mesh);
+		file.write((const char*)&attribute_array_size, sizeof(attribute_array_size));
 
-			file.write((const char*)&attribute_array_offset, sizeof(attribute_array_offset));
-			Lumix::int32 attribute_array_size = mesh->mNumVertices * vertex_size;
-			attribute_array_offset += attribute_array_size;
-			file.write((const char*)&attribute_array_size, sizeof(attribute_array_size));
+		file.write((const char*)&indices_offset, sizeof(indices_offset));
+		file.write((const char*)&mesh_tri_count, sizeof(mesh_tri_count));
 
-			file.write((const char*)&indices_offset, sizeof(indices_offset));
-			Lumix::int32 mesh_tri_count = mesh->mNumFaces;
-			indices_offset += mesh->mNumFaces * 3;
-			file.write((const char*)&mesh_tri_count, sizeof(mesh_tri_count));
+		length = Lumix::stringLength(mesh_name);
+		file.write((const char*)&length, sizeof(length));
+		file.write(mesh_name, length);
 
-			aiString mesh_name = getMeshName(mesh);
-			length = Lumix::stringLength(mesh_name.C_Str());
+		Lumix::int32 attribute_count = getAttributeCount(mesh);
+		file.write((const char*)&attribute_count, sizeof(attribute_count));
 
-			file.write((const char*)&length, sizeof(length));
-			file.write((const char*)mesh_name.C_Str(), length);
+		if (isSkinned(mesh))
+		{
+			writeAttribute("in_weights", VertexAttributeDef::FLOAT4, file);
+			writeAttribute("in_indices", VertexAttributeDef::SHORT4, file);
+		}
 
-			Lumix::int32 attribute_count = getAttributeCount(mesh);
-			file.write((const char*)&attribute_count, sizeof(attribute_count));
+		writeAttribute("in_position", VertexAttributeDef::POSITION, file);
+		if (mesh->mColors[0]) writeAttribute("in_colors", VertexAttributeDef::BYTE4, file);
+		writeAttribute("in_normal", VertexAttributeDef::BYTE4, file);
+		if (mesh->mTangents) writeAttribute("in_tangents", VertexAttributeDef::BYTE4, file);
+		writeAttribute("in_tex_coords",
+			m_dialog.m_quantize_uvs ? VertexAttributeDef::HALF2 : VertexAttributeDef::FLOAT2,
+			file);
+	}
 
-			if (isSkinned(mesh))
-			{
-				writeAttribute("in_weights", VertexAttributeDef::FLOAT4, file);
-				writeAttribute("in_indices", VertexAttributeDef::SHORT4, file);
-			}
 
-			writeAttribute("in_position", VertexAttributeDef::POSITION, file);
-			if (mesh->mColors[0]) writeAttribute("in_colors", VertexAttributeDef::BYTE4, file);
-			writeAttribute("in_normal", VertexAttributeDef::BYTE4, file);
-			if (mesh->mTangents) writeAttribute("in_tangents", VertexAttributeDef::BYTE4, file);
-			writeAttribute("in_tex_coords", VertexAttributeDef::FLOAT2, file);
+	void writeMeshes(Lumix::FS::IFile& file) const
+	{
+		Lumix::int32 mesh_count = m_mesh_indices.size();
+		file.write((const char*)&mesh_count, sizeof(mesh_count));
+
+		Lumix::Array<Lumix::int32> attribute_array_offsets(m_dialog.m_editor.getAllocator());
+		Lumix::int32 attribute_array_offset = 0;
+		Lumix::int32 indices_offset = 0;
+		for (auto* mesh : m_filtered_meshes)
+		{
+			int mesh_idx = attribute_array_offsets.size();
+			attribute_array_offsets.push(attribute_array_offset);
+			Lumix::int32 mesh_tri_count = m_mesh_indices[mesh_idx].size() / 3;
+			writeMesh(file,
+				mesh,
+				getMeshName(mesh).C_Str(),
+				attribute_array_offset,
+				indices_offset,
+				mesh_tri_count);
+			attribute_array_offset += mesh->mNumVertices * getVertexSize(mesh);
+			indices_offset += m_mesh_indices[mesh_idx].size();
+		}
+
+		// generated LODs reference the vertices of their source meshes
+		for (int i = m_filtered_meshes.size(); i < m_mesh_indices.size(); ++i)
+		{
+			int mesh_idx = i % m_filtered_meshes.size();
+			const aiMesh* mesh = m_filtered_meshes[mesh_idx];
+			int lod = i / m_filtered_meshes.size();
+			StringBuilder<Lumix::MAX_PATH_LENGTH> name(getMeshName(mesh).C_Str(), "_LOD", lod);
+			Lumix::int32 mesh_tri_count = m_mesh_indices[i].size() / 3;
+			writeMesh(file,
+				mesh,
+				name,
+				attribute_array_offsets[mesh_idx],
+				indices_offset,
+				mesh_tri_count);
+			indices_offset += m_mesh_indices[i].size();
 		}
 	}
 
@@ -970,8 +1056,47 @@ struct ConvertTask : public Lumix::MT::Task
 	}
 
 
+	float getBoundingRadius() const
+	{
+		const aiScene* scene = m_dialog.m_importer.GetScene();
+		float radius_squared = 0;
+		for (auto* mesh : m_filtered_meshes)
+		{
+			for (unsigned int j = 0; j < mesh->mNumVertices; ++j)
+			{
+				auto v = scene->mRootNode->mTransformation * mesh->mVertices[j];
+				radius_squared = Lumix::Math::maxValue(radius_squared, v.SquareLength());
+			}
+		}
+		return sqrtf(radius_squared) * m_scale;
+	}
+
+
+	void writeGeneratedLods(Lumix::FS::IFile& file) const
+	{
+		Lumix::int32 lod_count = m_generated_lod_count + 1;
+		file.write((const char*)&lod_count, sizeof(lod_count));
+		float distance = getBoundingRadius() * LOD_DISTANCE_RADII;
+		for (int i = 0; i < lod_count; ++i)
+		{
+			Lumix::int32 to_mesh = (i + 1) * m_filtered_meshes.size() - 1;
+			file.write((const char*)&to_mesh, sizeof(to_mesh));
+			// the engine compares LOD distances with squared distances
+			float squared_distance = i == lod_count - 1 ? FLT_MAX : distance * distance;
+			file.write((const char*)&squared_distance, sizeof(squared_distance));
+			distance *= 2;
+		}
+	}
+
+
 	void writeLods(Lumix::FS::IFile& file) const
 	{
+		if (m_generated_lod_count > 0)
+		{
+			writeGeneratedLods(file);
+			return;
+		}
+
 		Lumix::int32 lods[] = {-1, -1, -1, -1, -1, -1, -1, -1};
 		Lumix::int32 lod_count = -1;
 		float factors[8];
@@ -1216,6 +1341,176 @@ struct ConvertTask : public Lumix::MT::Task
 	}
 
 
+	// ratio == 1 keeps all the triangles of the source mesh, transform and scale are applied
+	// to the vertices by writeGeometry, clusters must be built in the same space
+	static void processMesh(Lumix::Array<Lumix::uint32>& out_indices,
+		Lumix::Array<Lumix::MeshOptimizer::Cluster>& clusters,
+		const aiMesh* mesh,
+		const aiMatrix4x4& transform,
+		float scale,
+		float ratio,
+		bool optimize,
+		bool build_clusters,
+		Lumix::IAllocator& allocator)
+	{
+		Lumix::Array<Lumix::uint32> indices(allocator);
+		indices.reserve(mesh->mNumFaces * 3);
+		for (unsigned int i = 0; i < mesh->mNumFaces; ++i)
+		{
+			for (int j = 0; j < 3; ++j) indices.push(mesh->mFaces[i].mIndices[j]);
+		}
+		if (indices.empty()) return;
+
+		auto* positions = (const Lumix::Vec3*)mesh->mVertices;
+		auto* normals = (const Lumix::Vec3*)mesh->mNormals;
+		if (ratio < 1)
+		{
+			int target_index_count = int(mesh->mNumFaces * ratio) * 3;
+			Lumix::MeshOptimizer::simplify(out_indices,
+				&indices[0],
+				indices.size(),
+				positions,
+				mesh->mNumVertices,
+				target_index_count,
+				allocator);
+		}
+		// a LOD without triangles would make the whole mesh disappear
+		if (out_indices.empty()) out_indices.swap(indices);
+
+		if (optimize)
+		{
+			Lumix::MeshOptimizer::optimizeVertexCache(
+				indices, &out_indices[0], out_indices.size(), mesh->mNumVertices, allocator);
+			out_indices.swap(indices);
+			Lumix::MeshOptimizer::optimizeOverdraw(&out_indices[0],
+				out_indices.size(),
+				positions,
+				normals,
+				mesh->mNumVertices,
+				allocator);
+		}
+
+		// skinned vertices move, bounds computed from the bind pose would be wrong
+		if (build_clusters && !isSkinned(mesh) && out_indices.size() >= MIN_CLUSTERED_TRIANGLES * 3)
+		{
+			Lumix::Array<Lumix::Vec3> transformed_positions(allocator);
+			Lumix::Array<Lumix::Vec3> transformed_normals(allocator);
+			transformed_positions.resize(mesh->mNumVertices);
+			if (normals) transformed_normals.resize(mesh->mNumVertices);
+			aiMatrix3x3 normal_matrix(transform);
+			for (unsigned int i = 0; i < mesh->mNumVertices; ++i)
+			{
+				auto v = transform * mesh->mVertices[i];
+				transformed_positions[i].set(v.x * scale, v.y * scale, v.z * scale);
+				if (!normals) continue;
+				auto n = normal_matrix * mesh->mNormals[i];
+				transformed_normals[i].set(n.x, n.y, n.z);
+			}
+			Lumix::MeshOptimizer::buildClusters(clusters,
+				&out_indices[0],
+				out_indices.size(),
+				&transformed_positions[0],
+				normals ? &transformed_normals[0] : nullptr,
+				Lumix::MeshOptimizer::CLUSTER_TRIANGLES);
+		}
+	}
+
+
+	bool hasSourceLods()
+	{
+		for (int i = 0; i < m_filtered_meshes.size(); ++i)
+		{
+			if (getMeshLOD(&m_filtered_meshes[i]) >= 0) return true;
+		}
+		return false;
+	}
+
+
+	void processMeshes()
+	{
+		m_mesh_indices.clear();
+		m_mesh_clusters.clear();
+		m_generated_lod_count = 0;
+		if (m_dialog.m_generate_lods && !hasSourceLods())
+		{
+			m_generated_lod_count =
+				Lumix::Math::clamp(m_dialog.m_lod_count, 0, ImportAssetDialog::MAX_GENERATED_LODS);
+		}
+
+		m_dialog.setImportMessage("Processing meshes...");
+		auto& allocator = m_dialog.m_editor.getAllocator();
+		auto& mtjd_manager = m_dialog.m_editor.getEngine().getMTJDManager();
+		int mesh_count = m_filtered_meshes.size();
+		int total_count = (m_generated_lod_count + 1) * mesh_count;
+		m_mesh_indices.reserve(total_count);
+		m_mesh_clusters.reserve(total_count);
+		for (int i = 0; i < total_count; ++i)
+		{
+			m_mesh_indices.emplace(allocator);
+			m_mesh_clusters.emplace(allocator);
+		}
+
+		Lumix::MTJD::Group sync_point(true, allocator);
+		Lumix::Array<Lumix::MTJD::Job*> jobs(allocator);
+		bool optimize = m_dialog.m_optimize_vertex_cache;
+		bool build_clusters = m_dialog.m_build_clusters;
+		const aiMatrix4x4& transform = m_dialog.m_importer.GetScene()->mRootNode->mTransformation;
+		float scale = m_scale;
+		for (int i = 0; i < total_count; ++i)
+		{
+			const aiMesh* mesh = m_filtered_meshes[i % mesh_count];
+			int lod = i / mesh_count;
+			float ratio = lod == 0 ? 1 : m_dialog.m_lod_ratios[lod - 1];
+			Lumix::Array<Lumix::uint32>* indices = &m_mesh_indices[i];
+			Lumix::Array<Lumix::MeshOptimizer::Cluster>* clusters = &m_mesh_clusters[i];
+			Lumix::MTJD::Job* job = Lumix::MTJD::makeJob(mtjd_manager,
+				[indices,
+					clusters,
+					mesh,
+					&transform,
+					scale,
+					ratio,
+					optimize,
+					build_clusters,
+					&allocator]()
+				{
+					processMesh(*indices,
+						*clusters,
+						mesh,
+						transform,
+						scale,
+						ratio,
+						optimize,
+						build_clusters,
+						allocator);
+				},
+				allocator);
+			job->addDependency(&sync_point);
+			jobs.push(job);
+		}
+		for (auto* job : jobs)
+		{
+			mtjd_manager.schedule(job);
+		}
+		if (!jobs.empty()) sync_point.sync();
+	}
+
+
+	void writeClusters(Lumix::FS::IFile& file) const
+	{
+		for (auto& clusters : m_mesh_clusters)
+		{
+			Lumix::int32 count = clusters.size();
+			file.write((const char*)&count, sizeof(count));
+		}
+		for (auto& clusters : m_mesh_clusters)
+		{
+			if (clusters.empty()) continue;
+			file.write((const char*)&clusters[0], clusters.size() * sizeof(clusters[0]));
+		}
+	}
+
+
 	bool saveLumixModel()
 	{
 		ASSERT(m_dialog.m_output_dir[0] != '\0');
@@ -1244,18 +1539,23 @@ struct ConvertTask : public Lumix::MT::Task
 		}
 
 		filterMeshes();
+		processMeshes();
 
 		writeModelHeader(*file);
 		writeMeshes(*file);
-		writeGeometry(*file);
 		writeSkeleton(*file);
 		writeLods(*file);
+		writeClusters(*file);
+		writeGeometry(*file);
 
 		fs.close(*file);
 		return true;
 	}
 
 	Lumix::Array<aiMesh*> m_filtered_meshes;
+	Lumix::Array<Lumix::Array<Lumix::uint32>> m_mesh_indices;
+	Lumix::Array<Lumix::Array<Lumix::MeshOptimizer::Cluster>> m_mesh_clusters;
+	int m_generated_lod_count;
 	ImportAssetDialog& m_dialog;
 	float m_scale;
 
@@ -1274,6 +1574,11 @@ ImportAssetDialog::ImportAssetDialog(Lumix::WorldEditor& editor, Metadata& metad
 	, m_is_importing_texture(false)
 	, m_mutex(false)
 	, m_make_convex(false)
+	, m_quantize_uvs(false)
+	, m_generate_lods(true)
+	, m_optimize_vertex_cache(true)
+	, m_build_clusters(true)
+	, m_lod_count(3)
 	, m_saved_textures(editor.getAllocator())
 	, m_saved_embedded_textures(editor.getAllocator())
 	, m_path_mapping(editor.getAllocator())
@@ -1290,6 +1595,12 @@ ImportAssetDialog::ImportAssetDialog(Lumix::WorldEditor& editor, Metadata& metad
 	m_source[0] = '\0';
 	m_output_dir[0] = '\0';
 	m_texture_output_dir[0] = '\0';
+	float ratio = 0.5f;
+	for (int i = 0; i < Lumix::lengthOf(m_lod_ratios); ++i)
+	{
+		m_lod_ratios[i] = ratio;
+		ratio *= 0.5f;
+	}
 }
 
 
@@ -1594,6 +1905,20 @@ void ImportAssetDialog::onGUI()
 			{
 				ImGui::SameLine();
 				ImGui::DragFloat("Scale", &m_mesh_scale, 0.01f, 0.001f, 0);
+				ImGui::Checkbox("Half precision UVs", &m_quantize_uvs);
+				ImGui::Checkbox("Optimize vertex cache and overdraw", &m_optimize_vertex_cache);
+				ImGui::Checkbox("Build clusters", &m_build_clusters);
+				ImGui::Checkbox("Generate LODs", &m_generate_lods);
+				if (m_generate_lods)
+				{
+					ImGui::SameLine();
+					ImGui::SliderInt("LOD count", &m_lod_count, 1, MAX_GENERATED_LODS);
+					for (int i = 0; i < m_lod_count; ++i)
+					{
+						ImGui::SliderFloat(
+							StringBuilder<30>("LOD ", i + 1, " triangles"), &m_lod_ratios[i], 0.01f, 1);
+					}
+				}
 			}
 
 			if (scene->HasMaterials())
@@ -40,6 +40,8 @@ class LUMIX_STUDIO_LIB_API ImportAssetDialog
 		void onGUI();
 
 	public:
+		static const int MAX_GENERATED_LODS = 4;
+
 		bool m_is_opened;
 
 	private:
@@ -76,6 +78,12 @@ class LUMIX_STUDIO_LIB_API ImportAssetDialog
 		bool m_is_converting;
 		bool m_is_importing;
 		bool m_make_convex;
+		bool m_quantize_uvs;
+		bool m_generate_lods;
+		bool m_optimize_vertex_cache;
+		bool m_build_clusters;
+		int m_lod_count;
+		float m_lod_ratios[MAX_GENERATED_LODS];
 		bool m_is_importing_texture;
 		float m_raw_texture_scale;
 		float m_mesh_scale;
@@ -755,7 +755,16 @@ void ProfilerUIImpl::onGUIResources()
 		ImGui::NextColumn();
 
 		ImGui::Columns(1);
-		
+
+		auto& stats = material_manager->getStats();
+		ImGui::Text("Cached: %.3fKB, budget: %.3fKB",
+			material_manager->getCachedMemoryUsage() / 1024.0f,
+			material_manager->getMemoryBudget() / 1024.0f);
+		ImGui::Text("Hits: %u, misses: %u, evictions: %u (%.3fKB)",
+			stats.hits,
+			stats.misses,
+			stats.evictions,
+			stats.evicted_bytes / 1024.0f);
 	}
 
 	static int saved_displayed = 0;
@@ -315,6 +315,11 @@ void registerRendererProperties(Lumix::WorldEditor& editor)
 		"Mesh (*.msh)",
 		ResourceManager::MODEL,
 		allocator));
+	PropertyRegister::add("renderable",
+		LUMIX_NEW(allocator, BoolPropertyDescriptor<RenderScene>)("Static",
+		&RenderScene::isRenderableStatic,
+		&RenderScene::setRenderableStatic,
+		allocator));
 
 	PropertyRegister::add("global_light",
 		LUMIX_NEW(allocator, DecimalPropertyDescriptor<RenderScene>)("Ambient intensity",
@@ -449,6 +454,13 @@ void registerRendererProperties(Lumix::WorldEditor& editor)
 		0.0f,
 		allocator));
 
+	PropertyRegister::add("terrain",
+		LUMIX_NEW(allocator, FilePropertyDescriptor<RenderScene>)("Tiles",
+		&RenderScene::getTerrainTilesPath,
+		&RenderScene::setTerrainTilesPath,
+		"Terrain tiles (*.ltiles)",
+		allocator));
+
 	PropertyRegister::add("terrain",
 		LUMIX_NEW(allocator, IntPropertyDescriptor<RenderScene>)("Grass distance",
 		&RenderScene::getGrassDistance,
@@ -6,6 +6,7 @@
 #include "core/crc32.h"
 #include "core/default_allocator.h"
 #include "core/fs/file_system.h"
+#include "core/fs/ifile.h"
 #include "core/fs/os_file.h"
 #include "core/input_system.h"
 #include "core/log.h"
@@ -50,6 +51,7 @@
 
 
 static void imGuiCallback(ImDrawData* draw_data);
+static const char* PREFETCH_MANIFEST_PATH = "prefetch.manifest";
 
 
 class StudioAppImpl* g_app;
@@ -632,7 +634,10 @@ public:
 				ImGui::EndMenu();
 			}
 			StringBuilder<100> stats("");
-			if (m_engine->getFileSystem().hasWork()) stats << "Loading... | ";
+			if (m_engine->getFileSystem().hasWork() || m_engine->getResourceManager().hasWork())
+			{
+				stats << "Loading... | ";
+			}
 			stats << "FPS: ";
 			stats << m_engine->getFPS();
 			auto stats_size = ImGui::CalcTextSize(stats);
@@ -793,6 +798,39 @@ public:
 		{
 			Lumix::g_log_warning.log("studio") << "Could not save metadata";
 		}
+		savePrefetchManifest();
+	}
+
+
+	void loadPrefetchManifest()
+	{
+		auto& fs = m_engine->getFileSystem();
+		auto* file = fs.open(
+			fs.getDiskDevice(), Lumix::Path(PREFETCH_MANIFEST_PATH), Lumix::FS::Mode::OPEN_AND_READ);
+		if (!file) return;
+
+		if (!m_engine->getResourceManager().getPrefetchManifest().load(*file))
+		{
+			Lumix::g_log_warning.log("studio") << "Could not load " << PREFETCH_MANIFEST_PATH;
+		}
+		fs.close(*file);
+	}
+
+
+	void savePrefetchManifest()
+	{
+		auto& fs = m_engine->getFileSystem();
+		auto* file = fs.open(fs.getDiskDevice(),
+			Lumix::Path(PREFETCH_MANIFEST_PATH),
+			Lumix::FS::Mode::CREATE | Lumix::FS::Mode::WRITE);
+		if (!file)
+		{
+			Lumix::g_log_warning.log("studio") << "Could not save " << PREFETCH_MANIFEST_PATH;
+			return;
+		}
+
+		m_engine->getResourceManager().getPrefetchManifest().save(*file);
+		fs.close(*file);
 	}
 
 
@@ -1317,6 +1355,7 @@ public:
 		Lumix::Engine::PlatformData platform_data;
 		platform_data.window_handle = PlatformInterface::getWindowHandle();
 		m_engine->setPlatformData(platform_data);
+		loadPrefetchManifest();
 		char current_dir[Lumix::MAX_PATH_LENGTH];
 		PlatformInterface::getCurrentDirectory(current_dir, Lumix::lengthOf(current_dir));
 		m_editor = Lumix::WorldEditor::create(current_dir, *m_engine, m_allocator);
@@ -1475,7 +1514,7 @@ public:
 				elem_offset,
 				pcmd->ElemCount,
 				material->getRenderStates(),
-				material->getShaderInstance().m_program_handles[pass_idx]);
+				material->getShaderInstance().getProgramHandle(pass_idx));
 
 			elem_offset += pcmd->ElemCount;
 		}
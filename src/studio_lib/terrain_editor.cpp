@@ -3,6 +3,7 @@
 #include "core/crc32.h"
 #include "core/frustum.h"
 #include "core/json_serializer.h"
+#include "core/path_utils.h"
 #include "core/profiler.h"
 #include "core/resource_manager.h"
 #include "core/resource_manager_base.h"
@@ -16,6 +17,7 @@
 #include "renderer/material.h"
 #include "renderer/model.h"
 #include "renderer/render_scene.h"
+#include "renderer/terrain_tiles.h"
 #include "renderer/texture.h"
 #include "stb/stb_image.h"
 #include "universe/universe.h"
@@ -161,6 +163,8 @@ struct PaintEntitiesCommand : public Lumix::IEditorCommand
 		scene->getTerrainSize(m_component.index, &w, &h);
 		float scale = 1.0f - Lumix::Math::maxValue(0.01f, m_brush_strength);
 		Lumix::Model* model = scene->getRenderableModel(renderable.index);
+		Lumix::Array<Lumix::Vec3> positions(m_world_editor.getAllocator());
+		Lumix::Array<Lumix::Vec2> terrain_positions(m_world_editor.getAllocator());
 		for (int i = 0; i <= m_brush_size * m_brush_size / 1000.0f; ++i)
 		{
 			float angle = Lumix::Math::randFloat(0, Lumix::Math::PI * 2);
@@ -170,21 +174,41 @@ struct PaintEntitiesCommand : public Lumix::IEditorCommand
 			if (terrain_pos.x >= 0 && terrain_pos.z >= 0 && terrain_pos.x <= w &&
 				terrain_pos.z <= h)
 			{
-				pos.y = scene->getTerrainHeightAt(m_component.index, terrain_pos.x, terrain_pos.z);
-				pos.y += terrain_matrix.getTranslation().y;
-				if (!isOBBCollision(*scene, meshes, pos, model, scale))
+				positions.push(pos);
+				terrain_positions.emplace(terrain_pos.x, terrain_pos.z);
+			}
+		}
+		if (positions.empty()) return false;
+
+		Lumix::Array<float> heights(m_world_editor.getAllocator());
+		heights.resize(positions.size());
+		scene->getTerrainHeightsAt(
+			m_component.index, &terrain_positions[0], &heights[0], terrain_positions.size());
+
+		Lumix::Array<Lumix::Vec3> normals(m_world_editor.getAllocator());
+		if (m_align_with_normal)
+		{
+			normals.resize(positions.size());
+			scene->getTerrainNormalsAt(
+				m_component.index, &terrain_positions[0], &normals[0], terrain_positions.size());
+		}
+
+		for (int i = 0; i < positions.size(); ++i)
+		{
+			Lumix::Vec3 pos = positions[i];
+			pos.y = heights[i] + terrain_matrix.getTranslation().y;
+			if (!isOBBCollision(*scene, meshes, pos, model, scale))
+			{
+				auto entity = template_system.createInstanceNoCommand(m_template_name_hash, pos);
+				if (m_align_with_normal)
 				{
-					auto entity = template_system.createInstanceNoCommand(m_template_name_hash, pos);
-					if (m_align_with_normal)
-					{
-						alignWithNormal(entity, pos);
-					}
-					else if (m_rotate_x || m_rotate_z)
-					{
-						rotateRandom(entity);
-					}
-					m_entities.push(entity);
+					alignWithNormal(entity, normals[i]);
+				}
+				else if (m_rotate_x || m_rotate_z)
+				{
+					rotateRandom(entity);
 				}
+				m_entities.push(entity);
 			}
 		}
 
@@ -217,10 +241,8 @@ struct PaintEntitiesCommand : public Lumix::IEditorCommand
 	}
 
 
-	void alignWithNormal(Lumix::Entity entity, const Lumix::Vec3& pos) const
+	void alignWithNormal(Lumix::Entity entity, const Lumix::Vec3& normal) const
 	{
-		Lumix::RenderScene* scene = static_cast<Lumix::RenderScene*>(m_component.scene);
-		Lumix::Vec3 normal = scene->getTerrainNormalAt(m_component.index, pos.x, pos.z);
 		Lumix::Matrix mtx = m_world_editor.getUniverse()->getMatrix(entity);
 		Lumix::Vec3 dir = Lumix::crossProduct(normal, mtx.getXVector()).normalized();
 		mtx.setXVector(Lumix::crossProduct(normal, dir));
@@ -1520,6 +1542,54 @@ Lumix::Material* TerrainEditor::getMaterial()
 }
 
 
+void TerrainEditor::exportTiles()
+{
+	static const int TILE_SIZE = 256;
+
+	auto* heightmap = getMaterial()->getTextureByUniform(HEIGHTMAP_UNIFORM);
+	auto* splatmap = getMaterial()->getTextureByUniform(SPLATMAP_UNIFORM);
+	if (!heightmap || !splatmap) return;
+
+	char filename[Lumix::MAX_PATH_LENGTH];
+	if (!PlatformInterface::getSaveFilename(
+			filename, Lumix::lengthOf(filename), "Terrain tiles\0*.ltiles\0", "ltiles"))
+	{
+		return;
+	}
+
+	Lumix::PathUtils::FileInfo info(filename);
+	char tiles_dir[Lumix::MAX_PATH_LENGTH];
+	Lumix::copyString(tiles_dir, info.m_dir);
+	Lumix::catString(tiles_dir, info.m_basename);
+	PlatformInterface::makePath(tiles_dir);
+
+	// the grass density image is optional, cancelling the dialog exports without it
+	char grass_filename[Lumix::MAX_PATH_LENGTH];
+	stbi_uc* grass_density = nullptr;
+	int grass_width = 0;
+	int grass_height = 0;
+	if (PlatformInterface::getOpenFilename(
+			grass_filename, Lumix::lengthOf(grass_filename), "Grass density\0*.*\0"))
+	{
+		int grass_comp;
+		grass_density = stbi_load(grass_filename, &grass_width, &grass_height, &grass_comp, 1);
+	}
+
+	char relative_path[Lumix::MAX_PATH_LENGTH];
+	m_world_editor.getRelativePath(relative_path, Lumix::lengthOf(relative_path), filename);
+	Lumix::TerrainTiles::save(m_world_editor.getEngine().getFileSystem(),
+		Lumix::Path(relative_path),
+		TILE_SIZE,
+		*heightmap,
+		*splatmap,
+		grass_density,
+		grass_width,
+		grass_height,
+		m_world_editor.getAllocator());
+	if (grass_density) stbi_image_free(grass_density);
+}
+
+
 void TerrainEditor::onGUI()
 {
 	if (m_decrease_brush_size->isRequested()) m_decrease_brush_size->func.invoke();
@@ -1564,6 +1634,8 @@ void TerrainEditor::onGUI()
 		case HEIGHT:
 			if (ImGui::Button("Save heightmap"))
 				getMaterial()->getTextureByUniform(HEIGHTMAP_UNIFORM)->save();
+			ImGui::SameLine();
+			if (ImGui::Button("Export tiles")) exportTiles();
 			break;
 		case LAYER:
 			if (ImGui::Button("Save layermap"))
@@ -47,6 +47,7 @@ private:
 		const Lumix::ComponentUID& cmp,
 		const Lumix::Vec3& center);
 	Lumix::Material* getMaterial();
+	void exportTiles();
 	void paint(const Lumix::RayCastModelHit& hit, TerrainEditor::Type type, bool new_stroke);
 
 	static void getProjections(const Lumix::Vec3& axis,
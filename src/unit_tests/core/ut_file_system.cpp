@@ -4,7 +4,10 @@
 #include "core/fs/disk_file_device.h"
 #include "core/fs/file_events_device.h"
 #include "core/fs/ifile.h"
+#include "core/fs/memory_file_device.h"
+#include "core/mt/thread.h"
 #include "core/path.h"
+#include "core/string.h"
 
 namespace
 {
@@ -130,6 +133,172 @@ void UT_file_events_device(const char* params)
 };
 
 
+static const int ASYNC_FILE_COUNT = 64;
+int async_loaded = 0;
+int async_failed = 0;
+
+
+void fs_async_cb(Lumix::FS::IFile& file, bool success)
+{
+	if (success && file.size() >= 4)
+	{
+		++async_loaded;
+	}
+	else
+	{
+		++async_failed;
+	}
+}
+
+
+void UT_file_system_async(const char* params)
+{
+	Lumix::DefaultAllocator allocator;
+	Lumix::PathManager path_manager(allocator);
+	Lumix::FS::FileSystem* file_system = Lumix::FS::FileSystem::create(allocator, 4);
+	auto* disk_file_device = LUMIX_NEW(allocator, Lumix::FS::DiskFileDevice)(allocator);
+	file_system->mount(disk_file_device);
+
+	Lumix::FS::DeviceList device_list;
+	file_system->fillDeviceList("disk", device_list);
+	Lumix::FS::ReadCallback cb;
+	cb.bind<fs_async_cb>();
+	for (int i = 0; i < ASYNC_FILE_COUNT; ++i)
+	{
+		const char* path = i % 8 == 7 ? "unit_tests/file_system/missing.xml"
+									  : "unit_tests/file_system/selenitic.xml";
+		Lumix::FS::AsyncHandle handle = file_system->openAsync(
+			device_list, Lumix::Path(path), Lumix::FS::Mode::OPEN_AND_READ, cb);
+		LUMIX_EXPECT(handle != Lumix::FS::INVALID_ASYNC_HANDLE);
+	}
+
+	LUMIX_EXPECT(file_system->hasWork());
+	while (file_system->hasWork())
+	{
+		file_system->updateAsyncTransactions();
+		Lumix::MT::sleep(1);
+	}
+
+	LUMIX_EXPECT(async_loaded == ASYNC_FILE_COUNT - ASYNC_FILE_COUNT / 8);
+	LUMIX_EXPECT(async_failed == ASYNC_FILE_COUNT / 8);
+
+	Lumix::FS::FileSystem::destroy(file_system);
+	LUMIX_DELETE(allocator, disk_file_device);
+}
+
+
+void UT_file_system_mapped(const char* params)
+{
+	Lumix::DefaultAllocator allocator;
+	Lumix::PathManager path_manager(allocator);
+	Lumix::FS::FileSystem* file_system = Lumix::FS::FileSystem::create(allocator);
+	auto* disk_file_device = LUMIX_NEW(allocator, Lumix::FS::DiskFileDevice)(allocator);
+	auto* memory_file_device = LUMIX_NEW(allocator, Lumix::FS::MemoryFileDevice)(allocator);
+	file_system->mount(disk_file_device);
+	file_system->mount(memory_file_device);
+
+	Lumix::FS::DeviceList device_list;
+	file_system->fillDeviceList("memory:disk", device_list);
+	Lumix::FS::IFile* file = file_system->open(device_list,
+		Lumix::Path("unit_tests/file_system/selenitic.xml"),
+		Lumix::FS::Mode::OPEN_AND_READ);
+	LUMIX_EXPECT(file != nullptr);
+
+	size_t size = file->size();
+	LUMIX_EXPECT(size >= size_t(4));
+	const void* mapped = file->getBuffer();
+	LUMIX_EXPECT(mapped != nullptr);
+
+	uint32 buff;
+	LUMIX_EXPECT(file->read(&buff, sizeof(buff)));
+	LUMIX_EXPECT(Lumix::compareMemory(&buff, mapped, sizeof(buff)) == 0);
+
+	// the detached view outlives the file
+	Lumix::IAllocator* buffer_allocator = nullptr;
+	void* buffer = file->detachBuffer(&buffer_allocator);
+	LUMIX_EXPECT(buffer == mapped);
+	LUMIX_EXPECT(buffer_allocator != nullptr);
+	file_system->close(*file);
+	LUMIX_EXPECT(Lumix::compareMemory(&buff, buffer, sizeof(buff)) == 0);
+	buffer_allocator->deallocate(buffer);
+
+	Lumix::FS::FileSystem::destroy(file_system);
+	LUMIX_DELETE(allocator, memory_file_device);
+	LUMIX_DELETE(allocator, disk_file_device);
+}
+
+
+int priority_order[3];
+int priority_count = 0;
+bool is_cancelled_called = false;
+
+
+template <int ID> void fs_priority_cb(Lumix::FS::IFile&, bool success)
+{
+	if (success && priority_count < Lumix::lengthOf(priority_order))
+	{
+		priority_order[priority_count] = ID;
+	}
+	++priority_count;
+}
+
+
+void fs_cancelled_cb(Lumix::FS::IFile&, bool)
+{
+	is_cancelled_called = true;
+}
+
+
+void UT_file_system_priority(const char* params)
+{
+	Lumix::DefaultAllocator allocator;
+	Lumix::PathManager path_manager(allocator);
+	// one I/O thread, so requests finish in the order they are served
+	Lumix::FS::FileSystem* file_system = Lumix::FS::FileSystem::create(allocator, 1);
+	auto* disk_file_device = LUMIX_NEW(allocator, Lumix::FS::DiskFileDevice)(allocator);
+	file_system->mount(disk_file_device);
+
+	Lumix::FS::DeviceList device_list;
+	file_system->fillDeviceList("disk", device_list);
+	Lumix::Path path("unit_tests/file_system/selenitic.xml");
+	Lumix::FS::ReadCallback cb;
+
+	cb.bind<fs_priority_cb<0>>();
+	file_system->openAsync(device_list, path, Lumix::FS::Mode::OPEN_AND_READ, cb, 0);
+	cb.bind<fs_priority_cb<1>>();
+	Lumix::FS::AsyncHandle handle =
+		file_system->openAsync(device_list, path, Lumix::FS::Mode::OPEN_AND_READ, cb, 1);
+	cb.bind<fs_priority_cb<2>>();
+	file_system->openAsync(device_list, path, Lumix::FS::Mode::OPEN_AND_READ, cb, 2);
+	cb.bind<fs_cancelled_cb>();
+	Lumix::FS::AsyncHandle cancelled =
+		file_system->openAsync(device_list, path, Lumix::FS::Mode::OPEN_AND_READ, cb, 3);
+
+	LUMIX_EXPECT(handle != Lumix::FS::INVALID_ASYNC_HANDLE);
+	LUMIX_EXPECT(cancelled != Lumix::FS::INVALID_ASYNC_HANDLE);
+	file_system->setPriority(handle, 10);
+	file_system->cancel(cancelled);
+
+	while (file_system->hasWork())
+	{
+		file_system->updateAsyncTransactions();
+		Lumix::MT::sleep(1);
+	}
+
+	LUMIX_EXPECT(priority_count == 3);
+	LUMIX_EXPECT(priority_order[0] == 1);
+	LUMIX_EXPECT(priority_order[1] == 2);
+	LUMIX_EXPECT(priority_order[2] == 0);
+	LUMIX_EXPECT(!is_cancelled_called);
+
+	Lumix::FS::FileSystem::destroy(file_system);
+	LUMIX_DELETE(allocator, disk_file_device);
+}
+
+
 } // anonymous namespace
 
-REGISTER_TEST("unit_tests/core/file_system/file_events_device", UT_file_events_device, "")
\ No newline at end of file
+REGISTER_TEST("unit_tests/core/file_system/file_events_device", UT_file_events_device, "")
+REGISTER_TEST("unit_tests/core/file_system/async", UT_file_system_async, "")
+REGISTER_TEST("unit_tests/core/file_system/mapped", UT_file_system_mapped, "")
+REGISTER_TEST("unit_tests/core/file_system/priority", UT_file_system_priority, "")
\ No newline at end of file
@@ -0,0 +1,27 @@
+#include "unit_tests/suite/lumix_unit_tests.h"
+#include "core/lz4.h"
+#include "core/string.h"
+
+
+void UT_lz4(const char* params)
+{
+	const char text[] = "LumixEngine LumixEngine LumixEngine LumixEngine LumixEngine LumixEngine";
+	const int size = sizeof(text);
+	char packed[256];
+	char unpacked[256];
+
+	int packed_size = Lumix::LZ4::compress(text, size, packed, sizeof(packed));
+	LUMIX_EXPECT(packed_size > 0);
+	LUMIX_EXPECT(packed_size < size);
+	LUMIX_EXPECT(Lumix::LZ4::decompress(packed, packed_size, unpacked, sizeof(unpacked)) == size);
+	LUMIX_EXPECT(Lumix::compareMemory(text, unpacked, size) == 0);
+
+	LUMIX_EXPECT(Lumix::LZ4::compress(text, size, packed, 4) == 0);
+	LUMIX_EXPECT(Lumix::LZ4::decompress(packed, packed_size, unpacked, 8) == -1);
+
+	packed_size = Lumix::LZ4::compress("abc", 3, packed, sizeof(packed));
+	LUMIX_EXPECT(Lumix::LZ4::decompress(packed, packed_size, unpacked, sizeof(unpacked)) == 3);
+	LUMIX_EXPECT(Lumix::compareMemory("abc", unpacked, 3) == 0);
+}
+
+REGISTER_TEST("unit_tests/core/lz4", UT_lz4, "")
@@ -0,0 +1,156 @@
+#include "unit_tests/suite/lumix_unit_tests.h"
+
+#include "core/fs/ifile.h"
+#include "core/fs/os_file.h"
+#include "core/fs/pack_file_device.h"
+#include "core/path.h"
+#include "core/string.h"
+#include "core/system.h"
+
+namespace
+{
+
+
+const char* const ARCHIVE_PATH = "unit_tests/file_system.pack";
+const char* const STORED_PATH = "unit_tests/file_system/pack_stored.dds";
+const char* const COMPRESSED_PATH = "unit_tests/file_system/pack_compressed.txt";
+// both span several blocks
+const int FILE_SIZE = 3 * Lumix::FS::PackFileDevice::DEFAULT_BLOCK_SIZE + 1000;
+
+
+// compressible unless noisy
+void fillData(Lumix::uint8* data, bool noisy)
+{
+	Lumix::uint32 seed = 0x12345678;
+	for (int i = 0; i < FILE_SIZE; ++i)
+	{
+		seed = seed * 1103515245 + 12345;
+		data[i] = noisy ? Lumix::uint8(seed >> 16) : Lumix::uint8(i / 100);
+	}
+}
+
+
+void writeFile(const char* path, const Lumix::uint8* data, Lumix::IAllocator& allocator)
+{
+	Lumix::FS::OsFile file;
+	if (!file.open(path, Lumix::FS::Mode::CREATE | Lumix::FS::Mode::WRITE, allocator)) return;
+	file.write(data, FILE_SIZE);
+	file.close();
+}
+
+
+void checkFile(Lumix::FS::PackFileDevice& device,
+	const char* path,
+	const Lumix::uint8* expected,
+	Lumix::uint8* buffer)
+{
+	Lumix::FS::IFile* file = device.createFile(nullptr);
+	LUMIX_EXPECT(file->open(Lumix::Path(path), Lumix::FS::Mode::OPEN_AND_READ));
+	LUMIX_EXPECT(file->size() == FILE_SIZE);
+	LUMIX_EXPECT(file->read(buffer, FILE_SIZE));
+	LUMIX_EXPECT(Lumix::compareMemory(buffer, expected, FILE_SIZE) == 0);
+	LUMIX_EXPECT(!file->read(buffer, 1));
+
+	// a read across the boundary of the first two blocks
+	const int block_end = Lumix::FS::PackFileDevice::DEFAULT_BLOCK_SIZE;
+	LUMIX_EXPECT(file->seek(Lumix::FS::SeekMode::BEGIN, block_end - 8) == block_end - 8);
+	LUMIX_EXPECT(file->read(buffer, 16));
+	LUMIX_EXPECT(Lumix::compareMemory(buffer, expected + block_end - 8, 16) == 0);
+	LUMIX_EXPECT(file->pos() == block_end + 8);
+
+	// and back to the first block
+	LUMIX_EXPECT(file->seek(Lumix::FS::SeekMode::BEGIN, 10) == 10);
+	LUMIX_EXPECT(file->read(buffer, 10));
+	LUMIX_EXPECT(Lumix::compareMemory(buffer, expected + 10, 10) == 0);
+
+	LUMIX_EXPECT(file->seek(Lumix::FS::SeekMode::END, 4) == FILE_SIZE - 4);
+	LUMIX_EXPECT(file->read(buffer, 4));
+	LUMIX_EXPECT(Lumix::compareMemory(buffer, expected + FILE_SIZE - 4, 4) == 0);
+
+	file->close();
+	device.destroyFile(file);
+}
+
+
+// the header and the index are intact, but the data of the last entries are missing
+bool truncateArchive(const char* path, Lumix::IAllocator& allocator)
+{
+	Lumix::FS::OsFile file;
+	if (!file.open(path, Lumix::FS::Mode::OPEN_AND_READ, allocator)) return false;
+	size_t size = file.size() - 1000;
+	auto* data = (Lumix::uint8*)allocator.allocate(size);
+	bool success = file.read(data, size);
+	file.close();
+
+	if (success)
+	{
+		success = file.open(path, Lumix::FS::Mode::CREATE | Lumix::FS::Mode::WRITE, allocator);
+	}
+	if (success)
+	{
+		success = file.write(data, size);
+		file.close();
+	}
+	allocator.deallocate(data);
+	return success;
+}
+
+
+void UT_pack_file_device(const char* params)
+{
+	Lumix::DefaultAllocator allocator;
+	Lumix::PathManager path_manager(allocator);
+
+	auto* stored = (Lumix::uint8*)allocator.allocate(FILE_SIZE);
+	auto* compressed = (Lumix::uint8*)allocator.allocate(FILE_SIZE);
+	auto* buffer = (Lumix::uint8*)allocator.allocate(FILE_SIZE);
+	fillData(stored, true);
+	fillData(compressed, false);
+	writeFile(STORED_PATH, stored, allocator);
+	writeFile(COMPRESSED_PATH, compressed, allocator);
+
+	const char* input_dir = "unit_tests/file_system";
+	LUMIX_EXPECT(Lumix::FS::PackFileDevice::pack(input_dir, ARCHIVE_PATH, allocator));
+
+	Lumix::FS::PackFileDevice device(allocator);
+	LUMIX_EXPECT(device.mount(ARCHIVE_PATH));
+	if (device.isMounted())
+	{
+		// paths in the archive are relative to the packed directory
+		const auto* stored_entry = device.find(Lumix::Path("pack_stored.dds").getHash());
+		const auto* compressed_entry = device.find(Lumix::Path("pack_compressed.txt").getHash());
+		LUMIX_EXPECT(stored_entry != nullptr);
+		LUMIX_EXPECT(compressed_entry != nullptr);
+		if (stored_entry && compressed_entry)
+		{
+			LUMIX_EXPECT((stored_entry->flags & Lumix::FS::PackFileDevice::COMPRESSED) == 0);
+			LUMIX_EXPECT((compressed_entry->flags & Lumix::FS::PackFileDevice::COMPRESSED) != 0);
+			LUMIX_EXPECT(compressed_entry->packed_size < compressed_entry->size);
+		}
+
+		checkFile(device, "pack_stored.dds", stored, buffer);
+		checkFile(device, "pack_compressed.txt", compressed, buffer);
+
+		// files which are not in the archive are opened by the child device, there is none
+		Lumix::FS::IFile* file = device.createFile(nullptr);
+		LUMIX_EXPECT(!file->open(Lumix::Path("missing.txt"), Lumix::FS::Mode::OPEN_AND_READ));
+		device.destroyFile(file);
+		device.unmount();
+	}
+
+	LUMIX_EXPECT(truncateArchive(ARCHIVE_PATH, allocator));
+	LUMIX_EXPECT(!device.mount(ARCHIVE_PATH));
+	LUMIX_EXPECT(!device.isMounted());
+
+	Lumix::deleteFile(ARCHIVE_PATH);
+	Lumix::deleteFile(STORED_PATH);
+	Lumix::deleteFile(COMPRESSED_PATH);
+	allocator.deallocate(stored);
+	allocator.deallocate(compressed);
+	allocator.deallocate(buffer);
+}
+
+
+} // anonymous namespace
+
+REGISTER_TEST("unit_tests/core/pack_file_device", UT_pack_file_device, "")
@@ -0,0 +1,57 @@
+#include "unit_tests/suite/lumix_unit_tests.h"
+
+#include "core/fs/ifile.h"
+#include "core/fs/memory_file_device.h"
+#include "core/path.h"
+#include "core/prefetch_manifest.h"
+
+namespace
+{
+
+
+void UT_prefetch_manifest(const char* params)
+{
+	Lumix::DefaultAllocator allocator;
+	Lumix::PathManager path_manager(allocator);
+	Lumix::PrefetchManifest manifest(allocator);
+
+	Lumix::Path model("models/tree.msh");
+	Lumix::Path material("models/bark.mat");
+	Lumix::Path texture("models/bark.dds");
+	LUMIX_EXPECT(manifest.getDependencies(model) == nullptr);
+
+	manifest.addDependency(model, 1, material);
+	manifest.addDependency(model, 1, material);
+	manifest.addDependency(material, 2, texture);
+	LUMIX_EXPECT(manifest.getDependencies(model) != nullptr);
+	LUMIX_EXPECT(manifest.getDependencies(model)->size() == 1);
+
+	Lumix::FS::MemoryFileDevice memory_device(allocator);
+	Lumix::FS::IFile* file = memory_device.createFile(nullptr);
+	LUMIX_EXPECT(file->open(Lumix::Path("prefetch.manifest"), Lumix::FS::Mode::CREATE | Lumix::FS::Mode::WRITE));
+	manifest.save(*file);
+	file->seek(Lumix::FS::SeekMode::BEGIN, 0);
+
+	Lumix::PrefetchManifest loaded(allocator);
+	LUMIX_EXPECT(loaded.load(*file));
+	file->close();
+	memory_device.destroyFile(file);
+
+	auto* dependencies = loaded.getDependencies(material);
+	LUMIX_EXPECT(dependencies != nullptr);
+	if (dependencies)
+	{
+		LUMIX_EXPECT(dependencies->size() == 1);
+		LUMIX_EXPECT((*dependencies)[0].type == 2);
+		LUMIX_EXPECT((*dependencies)[0].path == texture);
+	}
+
+	loaded.removeDependencies(material);
+	LUMIX_EXPECT(loaded.getDependencies(material) == nullptr);
+	LUMIX_EXPECT(loaded.getDependencies(model) != nullptr);
+}
+
+
+} // anonymous namespace
+
+REGISTER_TEST("unit_tests/core/prefetch_manifest", UT_prefetch_manifest, "")
@@ -0,0 +1,187 @@
+#include "unit_tests/suite/lumix_unit_tests.h"
+
+#include "core/fs/disk_file_device.h"
+#include "core/fs/file_system.h"
+#include "core/fs/ifile.h"
+#include "core/fs/os_file.h"
+#include "core/mt/thread.h"
+#include "core/mtjd/manager.h"
+#include "core/path.h"
+#include "core/resource.h"
+#include "core/resource_manager.h"
+#include "core/resource_manager_base.h"
+#include "core/system.h"
+
+namespace
+{
+
+
+const Lumix::uint32 STUB_TYPE = 0x12345678;
+const int RESOURCE_SIZE = 100;
+const char* const PATHS[] = {"unit_tests/file_system/cache_a.res",
+	"unit_tests/file_system/cache_b.res",
+	"unit_tests/file_system/cache_c.res"};
+
+
+class StubResource : public Lumix::Resource
+{
+public:
+	StubResource(const Lumix::Path& path,
+		Lumix::ResourceManager& resource_manager,
+		Lumix::IAllocator& allocator)
+		: Resource(path, resource_manager, allocator)
+	{
+	}
+
+	void unload() override {}
+
+	bool load(Lumix::FS::IFile& file) override
+	{
+		m_size = file.size();
+		return true;
+	}
+};
+
+
+class StubManager : public Lumix::ResourceManagerBase
+{
+public:
+	explicit StubManager(Lumix::IAllocator& allocator)
+		: ResourceManagerBase(allocator)
+		, m_allocator(allocator)
+	{
+	}
+
+protected:
+	Lumix::Resource* createResource(const Lumix::Path& path) override
+	{
+		return LUMIX_NEW(m_allocator, StubResource)(path, getOwner(), m_allocator);
+	}
+
+	void destroyResource(Lumix::Resource& resource) override
+	{
+		LUMIX_DELETE(m_allocator, static_cast<StubResource*>(&resource));
+	}
+
+private:
+	Lumix::IAllocator& m_allocator;
+};
+
+
+void createFiles(Lumix::IAllocator& allocator)
+{
+	char data[RESOURCE_SIZE] = {};
+	for (auto* path : PATHS)
+	{
+		Lumix::FS::OsFile file;
+		if (!file.open(path, Lumix::FS::Mode::CREATE | Lumix::FS::Mode::WRITE, allocator)) continue;
+		file.write(data, sizeof(data));
+		file.close();
+	}
+}
+
+
+void waitForLoads(Lumix::FS::FileSystem& file_system)
+{
+	while (file_system.hasWork())
+	{
+		file_system.updateAsyncTransactions();
+		Lumix::MT::sleep(1);
+	}
+}
+
+
+void UT_resource_cache(const char* params)
+{
+	Lumix::DefaultAllocator allocator;
+	Lumix::PathManager path_manager(allocator);
+	createFiles(allocator);
+
+	Lumix::FS::FileSystem* file_system = Lumix::FS::FileSystem::create(allocator);
+	Lumix::FS::DiskFileDevice disk_file_device(allocator);
+	file_system->mount(&disk_file_device);
+	file_system->setDefaultDevice("disk");
+	Lumix::MTJD::Manager* mtjd_manager = Lumix::MTJD::Manager::create(allocator);
+
+	Lumix::ResourceManager resource_manager(allocator);
+	resource_manager.create(*file_system, *mtjd_manager);
+	StubManager manager(allocator);
+	manager.create(STUB_TYPE, resource_manager);
+	manager.setGracePeriod(1000);
+
+	Lumix::Resource* a = manager.load(Lumix::Path(PATHS[0]));
+	Lumix::Resource* b = manager.load(Lumix::Path(PATHS[1]));
+	Lumix::Resource* c = manager.load(Lumix::Path(PATHS[2]));
+	// a resource which is still loading is neither a hit nor a miss
+	LUMIX_EXPECT(manager.load(Lumix::Path(PATHS[2])) == c);
+	manager.unload(*c);
+	LUMIX_EXPECT(manager.getStats().misses == 3);
+	waitForLoads(*file_system);
+	LUMIX_EXPECT(a->isReady());
+	LUMIX_EXPECT(b->isReady());
+	LUMIX_EXPECT(c->isReady());
+	LUMIX_EXPECT(manager.getMemoryUsage() == 3 * RESOURCE_SIZE);
+	LUMIX_EXPECT(manager.getStats().misses == 3);
+	LUMIX_EXPECT(manager.getStats().hits == 0);
+
+	// unreferenced resources stay loaded during the grace period
+	manager.unload(*a);
+	manager.unload(*b);
+	manager.unload(*c);
+	resource_manager.update();
+	LUMIX_EXPECT(a->isReady());
+	LUMIX_EXPECT(b->isReady());
+	LUMIX_EXPECT(c->isReady());
+	LUMIX_EXPECT(manager.getCachedMemoryUsage() == 3 * RESOURCE_SIZE);
+	LUMIX_EXPECT(manager.getStats().evictions == 0);
+
+	// a hit makes b the most recently used
+	LUMIX_EXPECT(manager.load(Lumix::Path(PATHS[1])) == b);
+	LUMIX_EXPECT(manager.getStats().hits == 1);
+	LUMIX_EXPECT(manager.getStats().misses == 3);
+	LUMIX_EXPECT(!file_system->hasWork());
+	manager.unload(*b);
+
+	// the least recently used are evicted first, only until the budget is met
+	manager.setMemoryBudget(RESOURCE_SIZE + RESOURCE_SIZE / 2);
+	resource_manager.update();
+	LUMIX_EXPECT(a->isEmpty());
+	LUMIX_EXPECT(c->isEmpty());
+	LUMIX_EXPECT(b->isReady());
+	LUMIX_EXPECT(manager.getMemoryUsage() == RESOURCE_SIZE);
+	LUMIX_EXPECT(manager.getStats().evictions == 2);
+	LUMIX_EXPECT(manager.getStats().evicted_bytes == 2 * RESOURCE_SIZE);
+
+	// an evicted resource is read again
+	LUMIX_EXPECT(manager.load(Lumix::Path(PATHS[0])) == a);
+	LUMIX_EXPECT(manager.getStats().misses == 4);
+	waitForLoads(*file_system);
+	LUMIX_EXPECT(a->isReady());
+	manager.unload(*a);
+	manager.setMemoryBudget(0);
+
+	// cached resources are unloaded when their grace period ends
+	manager.setGracePeriod(0.001f);
+	Lumix::MT::sleep(10);
+	resource_manager.update();
+	LUMIX_EXPECT(a->isEmpty());
+	LUMIX_EXPECT(b->isEmpty());
+	LUMIX_EXPECT(manager.getCachedMemoryUsage() == 0);
+	LUMIX_EXPECT(manager.getStats().evictions == 4);
+	LUMIX_EXPECT(manager.getStats().evicted_bytes == 4 * RESOURCE_SIZE);
+
+	resource_manager.setCacheEnabled(false);
+	manager.destroy();
+	resource_manager.destroy();
+	Lumix::MTJD::Manager::destroy(*mtjd_manager);
+	Lumix::FS::FileSystem::destroy(file_system);
+	for (auto* path : PATHS)
+	{
+		Lumix::deleteFile(path);
+	}
+}
+
+
+} // anonymous namespace
+
+REGISTER_TEST("unit_tests/core/resource_cache", UT_resource_cache, "")
@@ -0,0 +1,130 @@
+#include "unit_tests/suite/lumix_unit_tests.h"
+
+#include "core/fs/disk_file_device.h"
+#include "core/fs/file_system.h"
+#include "core/fs/ifile.h"
+#include "core/fs/os_file.h"
+#include "core/fs/tcp_file_device.h"
+#include "core/fs/tcp_file_server.h"
+#include "core/mt/thread.h"
+#include "core/path.h"
+#include "core/string.h"
+#include "core/system.h"
+
+namespace
+{
+
+
+bool isSameFile(Lumix::FS::FileSystem& file_system, const Lumix::Path& path)
+{
+	Lumix::FS::DeviceList tcp_device;
+	Lumix::FS::DeviceList disk_device;
+	file_system.fillDeviceList("tcp", tcp_device);
+	file_system.fillDeviceList("disk", disk_device);
+
+	Lumix::FS::IFile* remote = file_system.open(tcp_device, path, Lumix::FS::Mode::OPEN_AND_READ);
+	Lumix::FS::IFile* local = file_system.open(disk_device, path, Lumix::FS::Mode::OPEN_AND_READ);
+	bool is_same = remote && local && remote->size() == local->size() && remote->getBuffer() &&
+				   local->getBuffer() &&
+				   Lumix::compareMemory(remote->getBuffer(), local->getBuffer(), local->size()) == 0;
+	if (remote) file_system.close(*remote);
+	if (local) file_system.close(*local);
+	return is_same;
+}
+
+
+// a valid header with a damaged payload, a cache which is not verified would be used as is
+void damageCache(const char* cache_path, Lumix::IAllocator& allocator)
+{
+	Lumix::FS::OsFile file;
+	if (!file.open(cache_path, Lumix::FS::Mode::OPEN_OR_CREATE | Lumix::FS::Mode::WRITE, allocator))
+	{
+		return;
+	}
+	file.seek(Lumix::FS::SeekMode::END, 0);
+	bool has_payload = file.pos() > 3 * sizeof(Lumix::uint32);
+	file.seek(Lumix::FS::SeekMode::BEGIN, 3 * sizeof(Lumix::uint32));
+	if (has_payload) file.write("#", 1);
+	file.close();
+}
+
+
+void UT_tcp_file_device(const char* params)
+{
+	Lumix::DefaultAllocator allocator;
+	Lumix::PathManager path_manager(allocator);
+	Lumix::FS::TCPFileServer server;
+	server.start("./", allocator);
+
+	Lumix::FS::TCPFileDevice tcp_file_device;
+	for (int i = 0; i < 100; ++i)
+	{
+		tcp_file_device.connect("127.0.0.1", 10001, allocator);
+		if (tcp_file_device.getStream()) break;
+		tcp_file_device.disconnect();
+		Lumix::MT::sleep(10);
+	}
+	LUMIX_EXPECT(tcp_file_device.getStream() != nullptr);
+	if (!tcp_file_device.getStream())
+	{
+		server.stop();
+		return;
+	}
+
+	Lumix::FS::FileSystem* file_system = Lumix::FS::FileSystem::create(allocator);
+	Lumix::FS::DiskFileDevice disk_file_device(allocator);
+	file_system->mount(&disk_file_device);
+	file_system->mount(&tcp_file_device);
+
+	Lumix::Path path("unit_tests/file_system/selenitic.xml");
+	LUMIX_EXPECT(isSameFile(*file_system, path));
+	tcp_file_device.enableCompression(true);
+	LUMIX_EXPECT(isSameFile(*file_system, path));
+
+	// the first fetch fills the cache, the second one is answered with NOT_MODIFIED
+	tcp_file_device.setCacheDir("unit_tests/file_system");
+	char cache_path[Lumix::MAX_PATH_LENGTH];
+	char hash[20];
+	Lumix::toCString(path.getHash(), hash, Lumix::lengthOf(hash));
+	Lumix::copyString(cache_path, "unit_tests/file_system/");
+	Lumix::catString(cache_path, hash);
+	Lumix::catString(cache_path, ".cache");
+	LUMIX_EXPECT(isSameFile(*file_system, path));
+	Lumix::FS::OsFile cache_file;
+	LUMIX_EXPECT(cache_file.open(cache_path, Lumix::FS::Mode::OPEN_AND_READ, allocator));
+	cache_file.close();
+	LUMIX_EXPECT(isSameFile(*file_system, path));
+	damageCache(cache_path, allocator);
+	LUMIX_EXPECT(isSameFile(*file_system, path));
+	Lumix::deleteFile(cache_path);
+	tcp_file_device.setCacheDir("");
+
+	Lumix::FS::DeviceList tcp_device;
+	file_system->fillDeviceList("tcp", tcp_device);
+	LUMIX_EXPECT(!file_system->open(
+		tcp_device, Lumix::Path("unit_tests/file_system/missing.xml"), Lumix::FS::Mode::OPEN_AND_READ));
+
+	// the server handles several clients at once
+	Lumix::FS::TCPFileDevice second_device;
+	second_device.connect("127.0.0.1", 10001, allocator);
+	LUMIX_EXPECT(second_device.getStream() != nullptr);
+	if (second_device.getStream())
+	{
+		Lumix::FS::IFile* file = second_device.createFile(nullptr);
+		LUMIX_EXPECT(file->open(path, Lumix::FS::Mode::OPEN_AND_READ));
+		LUMIX_EXPECT(isSameFile(*file_system, path));
+		LUMIX_EXPECT(file->size() > 0);
+		file->close();
+		second_device.destroyFile(file);
+	}
+	second_device.disconnect();
+
+	Lumix::FS::FileSystem::destroy(file_system);
+	tcp_file_device.disconnect();
+	server.stop();
+}
+
+
+} // anonymous namespace
+
+REGISTER_TEST("unit_tests/core/tcp_file_device", UT_tcp_file_device, "")
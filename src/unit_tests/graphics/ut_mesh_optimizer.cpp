@@ -0,0 +1,218 @@
+#include "unit_tests/suite/lumix_unit_tests.h"
+
+#include "core/array.h"
+#include "core/default_allocator.h"
+#include "core/log.h"
+#include "core/math_utils.h"
+#include "core/vec.h"
+#include "renderer/mesh_optimizer.h"
+#include <cmath>
+
+
+namespace
+{
+	static const int GRID_SIZE = 65;
+	static const int SPHERE_RINGS = 100;
+	static const int SPHERE_SEGMENTS = 200;
+
+
+	void createGrid(Lumix::Array<Lumix::Vec3>& positions, Lumix::Array<Lumix::uint32>& indices)
+	{
+		for (int z = 0; z < GRID_SIZE; ++z)
+		{
+			for (int x = 0; x < GRID_SIZE; ++x)
+			{
+				positions.push(Lumix::Vec3((float)x, 0, (float)z));
+			}
+		}
+		for (int z = 0; z < GRID_SIZE - 1; ++z)
+		{
+			for (int x = 0; x < GRID_SIZE - 1; ++x)
+			{
+				Lumix::uint32 i = z * GRID_SIZE + x;
+				indices.push(i);
+				indices.push(i + GRID_SIZE);
+				indices.push(i + 1);
+				indices.push(i + 1);
+				indices.push(i + GRID_SIZE);
+				indices.push(i + GRID_SIZE + 1);
+			}
+		}
+	}
+
+
+	void UT_mesh_simplify(const char* params)
+	{
+		Lumix::DefaultAllocator allocator;
+		Lumix::Array<Lumix::Vec3> positions(allocator);
+		Lumix::Array<Lumix::uint32> indices(allocator);
+		createGrid(positions, indices);
+
+		Lumix::Array<Lumix::uint32> lod(allocator);
+		int target_index_count = indices.size() / 4;
+		Lumix::MeshOptimizer::simplify(lod,
+			&indices[0],
+			indices.size(),
+			&positions[0],
+			positions.size(),
+			target_index_count,
+			allocator);
+
+		LUMIX_EXPECT(lod.size() > 0);
+		LUMIX_EXPECT(lod.size() % 3 == 0);
+		LUMIX_EXPECT(lod.size() < indices.size() / 2);
+
+		// a flat grid loses no area and no triangle flips when its border is kept
+		float area = 0;
+		for (int i = 0; i < lod.size(); i += 3)
+		{
+			LUMIX_EXPECT(lod[i] < (Lumix::uint32)positions.size());
+			Lumix::Vec3 normal = Lumix::crossProduct(positions[lod[i + 1]] - positions[lod[i]],
+				positions[lod[i + 2]] - positions[lod[i]]);
+			LUMIX_EXPECT(normal.y > 0);
+			area += normal.y * 0.5f;
+		}
+		float expected_area = float((GRID_SIZE - 1) * (GRID_SIZE - 1));
+		LUMIX_EXPECT_CLOSE_EQ(area, expected_area, 0.01f);
+	}
+
+
+	void shuffleTriangles(Lumix::Array<Lumix::uint32>& indices)
+	{
+		Lumix::uint32 seed = 12345;
+		for (int i = indices.size() / 3 - 1; i > 0; --i)
+		{
+			seed = seed * 1103515245 + 12345;
+			int j = (seed >> 8) % (i + 1);
+			for (int k = 0; k < 3; ++k)
+			{
+				Lumix::uint32 tmp = indices[i * 3 + k];
+				indices[i * 3 + k] = indices[j * 3 + k];
+				indices[j * 3 + k] = tmp;
+			}
+		}
+	}
+
+
+	void createSphere(Lumix::Array<Lumix::Vec3>& positions, Lumix::Array<Lumix::uint32>& indices)
+	{
+		for (int r = 0; r <= SPHERE_RINGS; ++r)
+		{
+			for (int s = 0; s <= SPHERE_SEGMENTS; ++s)
+			{
+				float theta = Lumix::Math::PI * r / SPHERE_RINGS;
+				float phi = 2 * Lumix::Math::PI * s / SPHERE_SEGMENTS;
+				positions.push(
+					Lumix::Vec3(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi)));
+			}
+		}
+		for (int r = 0; r < SPHERE_RINGS; ++r)
+		{
+			for (int s = 0; s < SPHERE_SEGMENTS; ++s)
+			{
+				Lumix::uint32 i = r * (SPHERE_SEGMENTS + 1) + s;
+				indices.push(i);
+				indices.push(i + 1);
+				indices.push(i + SPHERE_SEGMENTS + 1);
+				indices.push(i + 1);
+				indices.push(i + SPHERE_SEGMENTS + 2);
+				indices.push(i + SPHERE_SEGMENTS + 1);
+			}
+		}
+	}
+
+
+	void UT_mesh_vertex_cache(const char* params)
+	{
+		Lumix::DefaultAllocator allocator;
+		Lumix::Array<Lumix::Vec3> positions(allocator);
+		Lumix::Array<Lumix::uint32> indices(allocator);
+		createGrid(positions, indices);
+		shuffleTriangles(indices);
+
+		float shuffled_acmr = Lumix::MeshOptimizer::getACMR(&indices[0],
+			indices.size(),
+			positions.size(),
+			Lumix::MeshOptimizer::CACHE_SIZE,
+			allocator);
+
+		Lumix::Array<Lumix::uint32> optimized(allocator);
+		Lumix::MeshOptimizer::optimizeVertexCache(
+			optimized, &indices[0], indices.size(), positions.size(), allocator);
+		LUMIX_EXPECT(optimized.size() == indices.size());
+		float optimized_acmr = Lumix::MeshOptimizer::getACMR(&optimized[0],
+			optimized.size(),
+			positions.size(),
+			Lumix::MeshOptimizer::CACHE_SIZE,
+			allocator);
+
+		Lumix::MeshOptimizer::optimizeOverdraw(
+			&optimized[0], optimized.size(), &positions[0], nullptr, positions.size(), allocator);
+		float overdraw_acmr = Lumix::MeshOptimizer::getACMR(&optimized[0],
+			optimized.size(),
+			positions.size(),
+			Lumix::MeshOptimizer::CACHE_SIZE,
+			allocator);
+
+		Lumix::g_log_info.log("unit") << "ACMR shuffled: " << shuffled_acmr
+									  << ", vertex cache: " << optimized_acmr
+									  << ", overdraw: " << overdraw_acmr;
+		LUMIX_EXPECT(optimized_acmr < 1.0f);
+		LUMIX_EXPECT(optimized_acmr < shuffled_acmr);
+		LUMIX_EXPECT(overdraw_acmr <= optimized_acmr + 0.05f);
+	}
+
+
+	void UT_mesh_clusters(const char* params)
+	{
+		Lumix::DefaultAllocator allocator;
+		Lumix::Array<Lumix::Vec3> positions(allocator);
+		Lumix::Array<Lumix::uint32> indices(allocator);
+		createSphere(positions, indices);
+
+		Lumix::Array<Lumix::uint32> optimized(allocator);
+		Lumix::MeshOptimizer::optimizeVertexCache(
+			optimized, &indices[0], indices.size(), positions.size(), allocator);
+
+		// positions of a unit sphere are its outward normals
+		Lumix::Array<Lumix::MeshOptimizer::Cluster> clusters(allocator);
+		Lumix::MeshOptimizer::buildClusters(clusters,
+			&optimized[0],
+			optimized.size(),
+			&positions[0],
+			&positions[0],
+			Lumix::MeshOptimizer::CLUSTER_TRIANGLES);
+
+		int index_count = 0;
+		for (auto& cluster : clusters)
+		{
+			LUMIX_EXPECT(cluster.indices_offset == index_count);
+			index_count += cluster.index_count;
+		}
+		LUMIX_EXPECT(index_count == optimized.size());
+
+		Lumix::Vec3 camera_pos(0, 0, -5);
+		int culled = 0;
+		for (auto& cluster : clusters)
+		{
+			if (!Lumix::MeshOptimizer::isClusterBackfacing(cluster, camera_pos)) continue;
+
+			++culled;
+			int cluster_end = cluster.indices_offset + cluster.index_count;
+			for (int i = cluster.indices_offset; i < cluster_end; ++i)
+			{
+				const Lumix::Vec3& pos = positions[optimized[i]];
+				LUMIX_EXPECT(Lumix::dotProduct(pos, pos - camera_pos) >= 0);
+			}
+		}
+
+		Lumix::g_log_info.log("unit") << "clusters: " << clusters.size()
+									  << ", backfacing: " << culled;
+		LUMIX_EXPECT(culled > 0);
+		LUMIX_EXPECT(culled < clusters.size());
+	}
+}
+
+REGISTER_TEST("unit_tests/graphics/mesh_simplify", UT_mesh_simplify, "");
+REGISTER_TEST("unit_tests/graphics/mesh_vertex_cache", UT_mesh_vertex_cache, "");
+REGISTER_TEST("unit_tests/graphics/mesh_clusters", UT_mesh_clusters, "");
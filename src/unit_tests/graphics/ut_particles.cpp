@@ -0,0 +1,67 @@
+#include "unit_tests/suite/lumix_unit_tests.h"
+
+#include "core/default_allocator.h"
+#include "core/log.h"
+#include "core/quat.h"
+#include "core/timer.h"
+#include "core/vec.h"
+#include "renderer/particle_system.h"
+#include "universe/universe.h"
+
+
+namespace
+{
+	static const int PARTICLE_COUNT = 100000;
+	static const int BATCH_SIZE = 256;
+
+
+	void UT_particles_render_data(const char* params)
+	{
+		Lumix::DefaultAllocator allocator;
+		Lumix::Universe universe(allocator);
+		Lumix::Entity entity = universe.createEntity(Lumix::Vec3(0, 0, 0), Lumix::Quat(0, 0, 0, 1));
+
+		Lumix::ParticleEmitter emitter(entity, universe, allocator);
+		emitter.m_spawn_count.from = emitter.m_spawn_count.to = PARTICLE_COUNT;
+		emitter.m_initial_life.from = emitter.m_initial_life.to = 10;
+		auto* shape = LUMIX_NEW(allocator, Lumix::ParticleEmitter::SpawnShapeModule)(emitter);
+		shape->m_radius = 10;
+		emitter.addModule(shape);
+
+		emitter.spawnParticles(0.01f);
+		LUMIX_EXPECT(emitter.getParticlesCount() == PARTICLE_COUNT);
+
+		{
+			Lumix::ScopedTimer timer("Particles simulate", allocator);
+			emitter.simulate(0.01f);
+			Lumix::g_log_info.log("unit") << "simulate: " << timer.getTimeSinceStart() * 1000 << "ms";
+		}
+		LUMIX_EXPECT(emitter.getParticlesCount() == PARTICLE_COUNT);
+
+		Lumix::Sphere sphere = emitter.getBoundingSphere();
+		LUMIX_EXPECT(sphere.m_position.length() < 1.0f);
+		LUMIX_EXPECT(sphere.m_radius >= 10.0f);
+
+		Lumix::Array<Lumix::ParticleEmitter::RenderInstance> instances(allocator);
+		Lumix::Array<Lumix::ParticleEmitter::RenderInstance*> batches(allocator);
+		instances.resize(PARTICLE_COUNT);
+		for (int i = 0; i < PARTICLE_COUNT; i += BATCH_SIZE)
+		{
+			batches.push(&instances[i]);
+		}
+
+		{
+			Lumix::ScopedTimer timer("Particles sort and fill", allocator);
+			emitter.fillInstances(Lumix::Vec3(0, 0, -50), Lumix::Vec3(0, 0, 1), &batches[0], BATCH_SIZE);
+			Lumix::g_log_info.log("unit") << "sort and fill: " << timer.getTimeSinceStart() * 1000
+										  << "ms";
+		}
+
+		for (int i = 1; i < PARTICLE_COUNT; ++i)
+		{
+			LUMIX_EXPECT(instances[i - 1].pos.z >= instances[i].pos.z);
+		}
+	}
+}
+
+REGISTER_TEST("unit_tests/graphics/particles_render_data", UT_particles_render_data, "");